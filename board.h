@@ -0,0 +1,33 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - BOARD DEFINITIONS
+ * ============================================================================
+ * Pin map of the CH32V003 board. Only firmware-side modules (HAL, serial
+ * drivers) include this; the control core sees pins through hal.h.
+ * ============================================================================
+ */
+
+#ifndef __BOARD_H
+#define __BOARD_H
+
+#include "ch32v00x.h"
+#include "stabilizer.h"
+
+// PIN DEFINITIONS - CORRECTED TO MATCH YOUR HARDWARE
+#define PIN_LOWCUT_EN    GPIO_Pin_1  // PC1 - Low cut enable/disable
+#define PIN_M_START      GPIO_Pin_3  // PC3 - M-START button
+#define PIN_BUTTON       GPIO_Pin_4  // PC4 - Setting button
+#define PIN_MAIN_LED     GPIO_Pin_7  // PC7 - Main LED
+#define PIN_R1           GPIO_Pin_0  // PC0 - Relay R1
+#define PIN_FAULT_LED    GPIO_Pin_1  // PD1 - Fault LED
+#define PIN_SETTING_LED  GPIO_Pin_4  // PD4 - Setting LED
+#define PIN_R4           GPIO_Pin_5  // PD5 - Relay R4
+#define PIN_R3           GPIO_Pin_6  // PD6 - Relay R3
+#define PIN_R2           GPIO_Pin_7  // PD7 - Relay R2
+#define PIN_R5           GPIO_Pin_1  // PA1 - Relay R5
+#define PIN_ADC_SENSE    GPIO_Pin_2  // PA2 - ADC Input
+#define PIN_UART_TX      GPIO_Pin_0  // PD0 - USART1 TX (partial remap 1)
+#define PIN_UART_RX      GPIO_Pin_1  // PD1 - USART1 RX (replaces Fault LED)
+#define PIN_RS485_DE     GPIO_Pin_2  // PC2 - RS-485 driver enable
+
+#endif /* __BOARD_H */
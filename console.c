@@ -0,0 +1,192 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - PARAMETER CONSOLE
+ * ============================================================================
+ * Runs from the main loop after the control state machines. Each call does
+ * at most one received frame or one "list" line, and output only starts when
+ * the previous DMA transfer has finished, so the cost per pass is bounded.
+ * ============================================================================
+ */
+
+#include "stabilizer.h"
+#include "serial.h"
+#include "params.h"
+#include "console.h"
+
+static char consoleLine[CONSOLE_LINE_SIZE];
+static uint8_t consoleLineLen=0;
+static char consoleOut[CONSOLE_OUT_SIZE];
+static uint8_t consoleOutLen=0;
+static int8_t consoleListIndex=-1;      // >= 0 while "list" is streaming
+
+static void Out_Str(const char* s) {
+    while(*s && consoleOutLen < CONSOLE_OUT_SIZE) consoleOut[consoleOutLen++] = *s++;
+}
+
+static void Out_Uint(uint32_t v) {
+    char buf[10];
+    int n = 0;
+    do { buf[n++] = '0' + (v % 10); v /= 10; } while(v);
+    while(n) Out_Str((char[]){buf[--n], 0});
+}
+
+static void Out_Value(int id, uint16_t v) {
+    switch(paramInfo[id].type) {
+        case PARAM_TYPE_DECIVOLT:
+            Out_Uint(v / 10); Out_Str("."); Out_Uint(v % 10); Out_Str(" V");
+            break;
+        case PARAM_TYPE_VOLT: Out_Uint(v); Out_Str(" V"); break;
+        case PARAM_TYPE_MS:   Out_Uint(v); Out_Str(" ms"); break;
+        case PARAM_TYPE_SEC:  Out_Uint(v); Out_Str(" s"); break;
+    }
+}
+
+static void Out_Param(int id, bool bounds) {
+    Out_Str(paramInfo[id].name);
+    Out_Str(" = ");
+    Out_Value(id, Params_Get(id));
+    if(bounds) {
+        Out_Str(" [");
+        Out_Value(id, paramInfo[id].min);
+        Out_Str(" .. ");
+        Out_Value(id, paramInfo[id].max);
+        Out_Str("]");
+    }
+    Out_Str("\r\n");
+}
+
+// Parses "123" or "123.4" into raw units; decivolt values scale by 10
+static bool Parse_Value(const char* s, ParamType_t type, uint16_t* out) {
+    uint32_t v = 0, frac = 0;
+    bool dot = false, digits = false;
+    
+    for(; *s; s++) {
+        if(*s >= '0' && *s <= '9') {
+            if(dot) {
+                if(frac) return false;          // One decimal place
+                frac = 1;
+                v = v * 10 + (*s - '0');
+            } else {
+                v = v * 10 + (*s - '0');
+            }
+            digits = true;
+            if(v > 655350) return false;
+        } else if(*s == '.' && !dot && type == PARAM_TYPE_DECIVOLT) {
+            dot = true;
+        } else {
+            return false;
+        }
+    }
+    if(!digits) return false;
+    if(type == PARAM_TYPE_DECIVOLT && !frac) v *= 10;
+    if(v > 0xFFFF) return false;
+    *out = (uint16_t)v;
+    return true;
+}
+
+// Splits the line in place; returns the number of words (max 3)
+static int Split(char* line, char* words[3]) {
+    int n = 0;
+    while(*line && n < 3) {
+        while(*line == ' ') *line++ = 0;
+        if(!*line) break;
+        words[n++] = line;
+        while(*line && *line != ' ') line++;
+    }
+    return n;
+}
+
+static bool Equals(const char* a, const char* b) {
+    while(*a && *a == *b) { a++; b++; }
+    return *a == *b;
+}
+
+static void Out_Cal_Point(uint16_t decivolts, uint16_t adc) {
+    Out_Uint(decivolts / 10); Out_Str("."); Out_Uint(decivolts % 10);
+    Out_Str(" V @ "); Out_Uint(adc); Out_Str("\r\n");
+}
+
+// cal: list the points; cal <volts>: capture the present count there
+static void Console_Calibration(int n, char* arg) {
+    uint16_t dv;
+    
+    if(n == 1) {
+        Out_Cal_Point(CALIBRATION_DECIVOLTS, adcCapturedA);
+        for(int i = 0; i < calPointCount; i++) Out_Cal_Point(calPoints[i].decivolts, calPoints[i].adc);
+    } else if(Equals(arg, "clear")) {
+        Calibration_Clear_Points();
+        Out_Str("OK cleared\r\n");
+    } else if(!Parse_Value(arg, PARAM_TYPE_DECIVOLT, &dv)) {
+        Out_Str("ERR value\r\n");
+    } else if(!Calibration_Set_Point(dv, currentADC)) {
+        Out_Str("ERR point\r\n");
+    } else {
+        Out_Str("OK "); Out_Cal_Point(dv, currentADC);
+    }
+}
+
+static void Console_Execute(char* line) {
+    char* w[3];
+    int n = Split(line, w);
+    int id;
+    uint16_t value;
+    
+    if(n == 0) return;
+    
+    if(Equals(w[0], "list") && n == 1) {
+        consoleListIndex = 0;
+    } else if(Equals(w[0], "get") && n == 2) {
+        if((id = Params_Find(w[1])) < 0) Out_Str("ERR name\r\n");
+        else Out_Param(id, false);
+    } else if(Equals(w[0], "set") && n == 3) {
+        if((id = Params_Find(w[1])) < 0) { Out_Str("ERR name\r\n"); return; }
+        if(!Parse_Value(w[2], paramInfo[id].type, &value)) { Out_Str("ERR value\r\n"); return; }
+        switch(Params_Set(id, value)) {
+            case PARAM_OK:        Out_Str("OK "); Out_Param(id, false); break;
+            case PARAM_ERR_RANGE: Out_Str("ERR range "); Out_Param(id, true); break;
+            case PARAM_ERR_ORDER: Out_Str("ERR order\r\n"); break;
+            default:              Out_Str("ERR name\r\n"); break;
+        }
+    } else if(Equals(w[0], "save") && n == 1) {
+        Out_Str(Params_Save() ? "OK saved\r\n" : "ERR flash\r\n");
+    } else if(Equals(w[0], "cal") && n <= 2) {
+        Console_Calibration(n, w[1]);
+    } else if(Equals(w[0], "defaults") && n == 1) {
+        Params_Defaults();
+        Params_Compile();
+        Out_Str("OK defaults\r\n");
+    } else {
+        Out_Str("list | get <name> | set <name> <value> | save | defaults | cal [<volts> | clear]\r\n");
+    }
+}
+
+void Console_Init(void) {
+    Serial_Init(CONSOLE_BAUDRATE, USART_Parity_No, true);
+}
+
+void Console_Poll(void) {
+    const uint8_t* rx;
+    uint16_t len;
+    
+    if(Serial_TxBusy()) return;
+    consoleOutLen = 0;
+    
+    if(consoleListIndex >= 0) {
+        Out_Param(consoleListIndex, true);
+        if(++consoleListIndex >= PARAM_COUNT) consoleListIndex = -1;
+    } else if((len = Serial_RxFrame(&rx)) > 0) {
+        for(uint16_t i = 0; i < len; i++) {
+            char c = (char)rx[i];
+            if(c == '\r' || c == '\n') {
+                consoleLine[consoleLineLen] = 0;
+                consoleLineLen = 0;
+                Console_Execute(consoleLine);
+            } else if(consoleLineLen < CONSOLE_LINE_SIZE-1) {
+                consoleLine[consoleLineLen++] = c;
+            }
+        }
+        Serial_RxRelease();
+    }
+    
+    if(consoleOutLen > 0) Serial_Write((const uint8_t*)consoleOut, consoleOutLen);
+}
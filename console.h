@@ -0,0 +1,27 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - PARAMETER CONSOLE
+ * ============================================================================
+ * Line-based text console on USART1 (115200 8N1, TX PD0 / RX PD1):
+ *   list                  all parameters with bounds
+ *   get <name>            one parameter
+ *   set <name> <value>    validate, apply and recompile the control table
+ *   save                  write the parameter page to Flash
+ *   defaults              restore built-in defaults (not saved)
+ *   cal                   calibration points (244 V setting point first)
+ *   cal <volts>           capture the present count as a point (stored)
+ *   cal clear             keep only the 244 V setting point
+ * Voltages are entered in volts ("256" or "256.5"), times in ms or s.
+ * ============================================================================
+ */
+
+#ifndef __CONSOLE_H
+#define __CONSOLE_H
+
+#define CONSOLE_LINE_SIZE   48
+#define CONSOLE_OUT_SIZE    128
+
+void Console_Init(void);
+void Console_Poll(void);
+
+#endif /* __CONSOLE_H */
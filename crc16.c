@@ -0,0 +1,22 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CRC-16/MODBUS
+ * ============================================================================
+ */
+
+#include "crc16.h"
+
+static const uint16_t crc16Nibble[16] = {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+// Two table steps per byte: fixed cost, no data-dependent branches
+uint16_t CRC16_Update(uint16_t crc, const uint8_t* data, uint16_t len) {
+    while(len--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ crc16Nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc16Nibble[crc & 0x0F];
+    }
+    return crc;
+}
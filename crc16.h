@@ -0,0 +1,23 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CRC-16/MODBUS
+ * ============================================================================
+ * Polynomial 0xA001 (reflected 0x8005), init 0xFFFF. Shared by the telemetry
+ * frames and the host tools. Nibble table keeps flash cost at 32 bytes.
+ * ============================================================================
+ */
+
+#ifndef __CRC16_H
+#define __CRC16_H
+
+#include <stdint.h>
+
+#define CRC16_INIT  0xFFFF
+
+uint16_t CRC16_Update(uint16_t crc, const uint8_t* data, uint16_t len);
+
+static inline uint16_t CRC16_Calculate(const uint8_t* data, uint16_t len) {
+    return CRC16_Update(CRC16_INIT, data, len);
+}
+
+#endif /* __CRC16_H */
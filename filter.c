@@ -0,0 +1,121 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - FIXED-POINT FILTER CHAIN
+ * ============================================================================
+ * Stage values are unsigned Q.FILTER_FRAC counts: a 10-bit ADC count keeps
+ * the biquad products below 2^30, so everything stays in int32_t.
+ * ============================================================================
+ */
+
+#include "filter.h"
+#include "fixmath.h"
+
+#define FILTER_ROUND            (1 << (FILTER_FRAC-1))
+
+static int32_t Filter_Clamp(int32_t v) {
+    if(v < 0) return 0;
+    if(v > 0xFFFF) return 0xFFFF;
+    return v;
+}
+
+static void Stage_Seed(const FilterStage_t* st, FilterState_t* s, int32_t x) {
+    switch(st->kind) {
+        case FILTER_MEDIAN:
+            for(int i = 0; i < FILTER_MEDIAN_MAX; i++) s->median.window[i] = (uint16_t)x;
+            s->median.pos = 0;
+            break;
+        case FILTER_EMA10:
+            s->z[0] = (x + FILTER_ROUND) >> FILTER_FRAC;    // Whole counts
+            break;
+        default:
+            for(int i = 0; i < 4; i++) s->z[i] = x;
+            break;
+    }
+}
+
+// Median of the last arg values: insertion sort of a copy, at most 7
+static int32_t Stage_Median(const FilterStage_t* st, FilterState_t* s, int32_t x) {
+    uint8_t n = st->arg > FILTER_MEDIAN_MAX ? FILTER_MEDIAN_MAX : st->arg;
+    uint16_t sorted[FILTER_MEDIAN_MAX];
+    
+    if(n < 2) return x;
+    s->median.window[s->median.pos] = (uint16_t)x;
+    if(++s->median.pos >= n) s->median.pos = 0;
+    for(int i = 0; i < n; i++) {
+        uint16_t v = s->median.window[i];
+        int j = i;
+        while(j > 0 && sorted[j-1] > v) {
+            sorted[j] = sorted[j-1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[n >> 1];
+}
+
+// Direct form I, Q2.14 coefficients; the products are shift-add loops over
+// the 16-bit stage values
+static int32_t Stage_Biquad(const FilterStage_t* st, FilterState_t* s, int32_t x) {
+    const int32_t* c = st->coef;
+    int32_t acc = 1 << (FILTER_BIQUAD_SHIFT-1);
+    int32_t y;
+    
+    acc += Fix_Mul_Short(c[0], (uint16_t)x);
+    acc += Fix_Mul_Short(c[1], (uint16_t)s->z[0]);
+    acc += Fix_Mul_Short(c[2], (uint16_t)s->z[1]);
+    acc -= Fix_Mul_Short(c[3], (uint16_t)s->z[2]);
+    acc -= Fix_Mul_Short(c[4], (uint16_t)s->z[3]);
+    y = Filter_Clamp(acc >> FILTER_BIQUAD_SHIFT);
+    s->z[1] = s->z[0];
+    s->z[0] = x;
+    s->z[3] = s->z[2];
+    s->z[2] = y;
+    return y;
+}
+
+static int32_t Stage_Run(const FilterStage_t* st, FilterState_t* s, int32_t x) {
+    int32_t step;
+    
+    switch(st->kind) {
+        case FILTER_MEDIAN:
+            return Stage_Median(st, s, x);
+        case FILTER_EMA:
+            if(x >= s->z[0]) s->z[0] += (x - s->z[0]) >> st->arg;
+            else s->z[0] -= (s->z[0] - x) >> st->arg;
+            return s->z[0];
+        case FILTER_EMA10:
+            // Whole counts, the original regulation filter: truncates
+            x = (x + FILTER_ROUND) >> FILTER_FRAC;
+            s->z[0] = (int32_t)Fix_Div10((uint32_t)(Fix_Mul_Short(x, st->arg) +
+                                                    Fix_Mul_Short(s->z[0], 10 - st->arg)));
+            return s->z[0] << FILTER_FRAC;
+        case FILTER_BIQUAD:
+            return Stage_Biquad(st, s, x);
+        case FILTER_SLEW:
+            step = (int32_t)st->arg << FILTER_FRAC;
+            if(x > s->z[0] + step) s->z[0] += step;
+            else if(x < s->z[0] - step) s->z[0] -= step;
+            else s->z[0] = x;
+            return s->z[0];
+        default:
+            return x;
+    }
+}
+
+void Filter_Reset(FilterChain_t* chain) {
+    chain->seeded = false;
+}
+
+// One sample through every stage; the first one after a reset seeds them
+// all and comes out unchanged
+uint16_t Filter_Run(FilterChain_t* chain, uint16_t sample) {
+    int32_t v = (int32_t)sample << FILTER_FRAC;
+    
+    if(!chain->seeded) {
+        for(int i = 0; i < chain->count; i++) Stage_Seed(&chain->stages[i], &chain->state[i], v);
+        chain->seeded = true;
+        return sample;
+    }
+    for(int i = 0; i < chain->count; i++) v = Stage_Run(&chain->stages[i], &chain->state[i], v);
+    return (uint16_t)Filter_Clamp((v + FILTER_ROUND) >> FILTER_FRAC);
+}
@@ -0,0 +1,72 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - FIXED-POINT FILTER CHAIN
+ * ============================================================================
+ * A measurement path is a const table of stages run in order on one averaged
+ * ADC count per control pass: median of the last N, EMA with a shift alpha,
+ * EMA in tenths, biquad low-pass, slew limiter. Values travel between stages
+ * with FILTER_FRAC fraction bits and the chain rounds its result back to
+ * counts. No division and no multiply call on rv32ec (fixmath.h).
+ *
+ * tools/filter_bench measures a chain's step response and noise rejection on
+ * the host and designs biquad coefficients; rv32bench times each stage kind.
+ * ============================================================================
+ */
+
+#ifndef __FILTER_H
+#define __FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FILTER_FRAC             4           // Fraction bits between stages
+#define FILTER_MEDIAN_MAX       7           // Longest median window
+#define FILTER_BIQUAD_SHIFT     14          // Biquad coefficients in Q2.14, a0 = 1
+
+typedef enum { FILTER_MEDIAN, FILTER_EMA, FILTER_EMA10, FILTER_BIQUAD, FILTER_SLEW } FilterKind_t;
+
+typedef struct {
+    uint8_t kind;                           // FilterKind_t
+    uint8_t arg;                            // MEDIAN window (odd), EMA shift, EMA10 weight in tenths,
+                                            // SLEW counts per pass
+    int32_t coef[5];                        // BIQUAD b0, b1, b2, a1, a2
+} FilterStage_t;
+
+typedef union {
+    int32_t z[4];                           // EMA/EMA10/SLEW: z[0]; BIQUAD: x1, x2, y1, y2
+    struct {
+        uint16_t window[FILTER_MEDIAN_MAX];
+        uint8_t pos, reserved;
+    } median;
+} FilterState_t;
+
+typedef struct {
+    const FilterStage_t* stages;
+    FilterState_t* state;                   // One per stage
+    uint8_t count;
+    bool seeded;                            // Cleared by Filter_Reset, first sample seeds every stage
+} FilterChain_t;
+
+// STAGES - the table entries
+#define FILTER_STAGE_MEDIAN(n)          {FILTER_MEDIAN, (n), {0}}
+#define FILTER_STAGE_EMA(shift)         {FILTER_EMA,    (shift), {0}}
+#define FILTER_STAGE_EMA10(tenths)      {FILTER_EMA10,  (tenths), {0}}
+#define FILTER_STAGE_SLEW(counts)       {FILTER_SLEW,   (counts), {0}}
+#define FILTER_STAGE_BIQUAD(b0, b1, b2, a1, a2) {FILTER_BIQUAD, 0, {(b0), (b1), (b2), (a1), (a2)}}
+
+// Butterworth low-passes at the 100 Hz pass rate (filter_bench -d), b1
+// trimmed so the DC gain is exactly one
+#define FILTER_STAGE_LP_2HZ     FILTER_STAGE_BIQUAD(59, 119, 59, -29863, 13716)
+#define FILTER_STAGE_LP_5HZ     FILTER_STAGE_BIQUAD(329, 658, 329, -25576, 10508)
+
+// A chain with its state, from a list of stages
+#define FILTER_CHAIN(name, ...) \
+    static const FilterStage_t name##Stages[] = { __VA_ARGS__ }; \
+    static FilterState_t name##State[sizeof(name##Stages) / sizeof(name##Stages[0])]; \
+    static FilterChain_t name = { name##Stages, name##State, \
+                                  sizeof(name##Stages) / sizeof(name##Stages[0]), false }
+
+void Filter_Reset(FilterChain_t* chain);
+uint16_t Filter_Run(FilterChain_t* chain, uint16_t sample);
+
+#endif /* __FILTER_H */
@@ -0,0 +1,52 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - DIVISION-FREE INTEGER ARITHMETIC
+ * ============================================================================
+ * RV32EC has no M extension: every '*' and '/' on a variable, and '/' by a
+ * constant that is not a power of two, becomes a call to __mulsi3 or
+ * __udivsi3, a loop of up to 32 shift/add steps. The control pass uses these
+ * inline kernels instead. They are exact and give the same results as the
+ * C operators, so the host builds run the same arithmetic. tools/rv32bench
+ * times each one against its libgcc twin and checks the results.
+ * ============================================================================
+ */
+
+#ifndef __FIXMATH_H
+#define __FIXMATH_H
+
+#include <stdint.h>
+
+// Multiply by 10 as two shifts and an add
+#define FIX_MUL10(x)        (((x) << 3) + ((x) << 1))
+
+// floor(log2(n)) of a constant, for power-of-two windows (n up to 256)
+#define FIX_LOG2(n)         ((n) >= 256 ? 8 : (n) >= 128 ? 7 : (n) >= 64 ? 6 : (n) >= 32 ? 5 : (n) >= 16 ? 4 : \
+                             (n) >= 8 ? 3 : (n) >= 4 ? 2 : (n) >= 2 ? 1 : 0)
+#define FIX_IS_POW2(n)      ((n) > 0 && ((n) & ((n) - 1)) == 0)
+
+// n / 10 for any n: multiply by the reciprocal 0.8 = 0.11001100...b as a
+// shift-add series, divide by 8, then one correction step for the bits the
+// series dropped
+static inline uint32_t Fix_Div10(uint32_t n) {
+    uint32_t q = (n >> 1) + (n >> 2);
+    q += q >> 4;
+    q += q >> 8;
+    q += q >> 16;
+    q >>= 3;
+    return q + (n - FIX_MUL10(q) > 9);
+}
+
+// a * b for a 16-bit b: one shift-add per bit of b, ending at its top set
+// bit, so a 10-bit ADC count costs at most 10 steps and no call
+static inline int32_t Fix_Mul_Short(int32_t a, uint16_t b) {
+    uint32_t r = 0, x = (uint32_t)a;
+    
+    while(b) {
+        if(b & 1) r += x;
+        x <<= 1;
+        b >>= 1;
+    }
+    return (int32_t)r;
+}
+
+#endif /* __FIXMATH_H */
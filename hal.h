@@ -0,0 +1,62 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - HARDWARE ABSTRACTION LAYER
+ * ============================================================================
+ * The only hardware the control core (stabilizer.c, params.c) may touch.
+ * hal_ch32v00x.c implements it on the MCU with the WCH drivers; host builds
+ * link tools/hal_mock.c instead. Plain <stdint.h> types only.
+ * ============================================================================
+ */
+
+#ifndef __HAL_H
+#define __HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    HAL_OUT_R1, HAL_OUT_R2, HAL_OUT_R3, HAL_OUT_R4, HAL_OUT_R5,
+    HAL_OUT_MAIN_LED, HAL_OUT_FAULT_LED, HAL_OUT_SETTING_LED,
+    HAL_OUT_COUNT
+} HalOutput_t;
+
+typedef enum {
+    HAL_IN_LOWCUT_EN, HAL_IN_M_START, HAL_IN_BUTTON,
+    HAL_IN_COUNT
+} HalInput_t;
+
+typedef enum {
+    HAL_CLOCK_IDLE,     // Waiting for the next pass: slowest clock, no ADC
+    HAL_CLOCK_NORMAL,   // Reset/boot clock
+    HAL_CLOCK_BURST,    // Measurement and control: fastest clock
+    HAL_CLOCK_COUNT
+} HalClock_t;
+
+void HAL_Init(void);
+
+// CLOCK: takes effect on the next 1 ms tick, so the tick, HAL_GetMicros()
+// and ADC conversion times stay the same across profiles. Request it
+// before a delay, never around an ADC read
+void HAL_Clock_Set(HalClock_t clock);
+
+// ADC: one conversion of the sense input (PA2), 10-bit count
+uint16_t HAL_ADC_Read(void);
+
+// GPIO: outputs are active high; inputs report true when pulled low
+void HAL_Output_Write(HalOutput_t out, bool on);
+void HAL_Relays_Write(uint8_t relays);  // R1-R4 at once, bit 0 = R1 (RELAY_R1..R4)
+bool HAL_Input_Active(HalInput_t in);
+
+// TIME: 1 ms tick (wraps after 49 days) and blocking delays
+uint32_t HAL_GetTick(void);
+uint32_t HAL_GetMicros(void);       // us since reset, wraps after 71 minutes
+void HAL_Delay_Ms(uint32_t ms);
+void HAL_Delay_Us(uint32_t us);
+void HAL_Sleep_Until(uint32_t start, uint32_t ms);  // Core asleep (wfi) until ms ticks after start
+
+// FLASH: 64-byte pages (FLASH_PAGE_SIZE); addresses are MCU addresses
+const void* HAL_Flash_Read(uint32_t addr);
+void HAL_Flash_Erase(uint32_t addr);
+bool HAL_Flash_Write(uint32_t addr, const void* data, uint16_t len);
+
+#endif /* __HAL_H */
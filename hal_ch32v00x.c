@@ -0,0 +1,355 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - HAL FOR CH32V003
+ * ============================================================================
+ * hal.h on the WCH peripheral drivers: 24 MHz HSI at boot, switched
+ * between clock profiles (8/24/48 MHz) on the TIM2 1 ms tick, ADC1
+ * channel 0 (PA2), GPIO per board.h, 64-byte fast Flash pages.
+ * CRITICAL FIX: Flash latency is configured first for VDD > 3.6V.
+ * The per-sample paths (ADC read, GPIO, tick ISR) go straight to the
+ * registers; the drivers are only used for one-time setup.
+ * ============================================================================
+ */
+
+#include "board.h"
+#include "hal.h"
+#include "trace.h"
+
+static volatile uint32_t systemTick=0;
+
+// Clock profiles: HCLK source and AHB divider, Flash wait states, an ADC
+// divider that keeps ADCCLK at 3 MHz wherever the ADC is sampled, and the
+// TIM2 prescaler that keeps the timer at 1 MHz
+typedef struct {
+    uint32_t cfgr0;                         // RCC_SW | RCC_HPRE | RCC_ADCPRE
+    uint32_t hz;
+    uint16_t psc;
+    uint8_t latency;
+} HalClockProfile_t;
+
+#define HAL_CLOCK(sw, hpre, adcpre, mhz, latency) \
+    {(sw) | (hpre) | (adcpre), (mhz) * 1000000u, (mhz) - 1, (latency)}
+static const HalClockProfile_t halClocks[HAL_CLOCK_COUNT] = {
+    HAL_CLOCK(RCC_SW_HSI, RCC_HPRE_DIV3, RCC_PCLK2_Div4,   8, FLASH_ACTLR_LATENCY_0),  // ADC unused
+    HAL_CLOCK(RCC_SW_HSI, RCC_HPRE_DIV1, RCC_PCLK2_Div8,  24, FLASH_ACTLR_LATENCY_1),
+    HAL_CLOCK(RCC_SW_PLL, RCC_HPRE_DIV1, RCC_PCLK2_Div16, 48, FLASH_ACTLR_LATENCY_1)
+};
+
+// Running profile, the one whose prescaler TIM2 loads at the next update,
+// and the last one requested
+static volatile uint8_t halClock=HAL_CLOCK_NORMAL, halClockNext=HAL_CLOCK_NORMAL;
+static volatile uint8_t halClockRequest=HAL_CLOCK_NORMAL;
+
+// hal.h outputs -> port/pin
+static GPIO_TypeDef* const halOutPort[HAL_OUT_COUNT] = {
+    GPIOC, GPIOD, GPIOD, GPIOD, GPIOA, GPIOC, GPIOD, GPIOD
+};
+static const uint16_t halOutPin[HAL_OUT_COUNT] = {
+    PIN_R1, PIN_R2, PIN_R3, PIN_R4, PIN_R5, PIN_MAIN_LED, PIN_FAULT_LED, PIN_SETTING_LED
+};
+static const uint16_t halInPin[HAL_IN_COUNT] = {   // All on GPIOC
+    PIN_LOWCUT_EN, PIN_M_START, PIN_BUTTON
+};
+
+// R1-R4 mask -> {GPIOC, GPIOD} BSHR words: set bits for closed contacts,
+// reset bits (upper half) for open ones. R1 is on GPIOC, R2-R4 on GPIOD
+#define RELAY_BSHR(m, bit, pin) (((m) & (bit)) ? (uint32_t)(pin) : (uint32_t)(pin) << 16)
+#define RELAY_WORDS(m) {RELAY_BSHR(m, RELAY_R1, PIN_R1), \
+    RELAY_BSHR(m, RELAY_R2, PIN_R2) | RELAY_BSHR(m, RELAY_R3, PIN_R3) | RELAY_BSHR(m, RELAY_R4, PIN_R4)}
+static const uint32_t relayBshr[16][2] = {
+    RELAY_WORDS(0),  RELAY_WORDS(1),  RELAY_WORDS(2),  RELAY_WORDS(3),
+    RELAY_WORDS(4),  RELAY_WORDS(5),  RELAY_WORDS(6),  RELAY_WORDS(7),
+    RELAY_WORDS(8),  RELAY_WORDS(9),  RELAY_WORDS(10), RELAY_WORDS(11),
+    RELAY_WORDS(12), RELAY_WORDS(13), RELAY_WORDS(14), RELAY_WORDS(15)
+};
+
+void Setup_Flash_For_5V(void);
+void GPIO_Init_Custom(void);
+void ADC_Init_Custom(void);
+void TIM_Init_Custom(void);
+void NVIC_Init_Custom(void);
+
+// CRITICAL: Setup Flash Latency for 5V Operation
+void Setup_Flash_For_5V(void) {
+    // At VDD > 3.6V with 24MHz clock, Flash needs 1 wait state
+    // Without this, code execution fails above 3.7V!
+    
+    FLASH->ACTLR &= ~(FLASH_ACTLR_LATENCY);     // Clear latency bits
+    FLASH->ACTLR |= FLASH_ACTLR_LATENCY_1;     // Set 1 wait state
+    
+    // Read back: the controller has taken it once the register shows it
+    while((FLASH->ACTLR & FLASH_ACTLR_LATENCY) != FLASH_ACTLR_LATENCY_1);
+}
+
+// No settling delays: the relay outputs are driven first, the tick starts
+// next (boot time counts from there), and the sense input settles while
+// StateMachine0_Boot() is already sampling it
+void HAL_Init(void) {
+    // *** CRITICAL: Setup Flash latency FIRST for 5V operation ***
+    Setup_Flash_For_5V();
+    GPIO_Init_Custom();                         // Relays off: step 0, R5 open
+    
+    NVIC_PriorityGroupConfig(NVIC_PriorityGroup_1);
+    SystemCoreClockUpdate();
+    TIM_Init_Custom();
+    NVIC_Init_Custom();
+    ADC_Init_Custom();
+    FLASH_Unlock();
+}
+
+void GPIO_Init_Custom(void) {
+    GPIO_InitTypeDef g={0};
+    
+    // Enable all port clocks + AFIO for pin remapping
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA|RCC_APB2Periph_GPIOC|
+                           RCC_APB2Periph_GPIOD|RCC_APB2Periph_AFIO, ENABLE);
+    
+    // OPTIONAL: Disable SDI to use PD1 as normal GPIO (Fault LED)
+    // WARNING: After this, reprogramming requires power cycle!
+    // Comment out if you want to keep programming capability
+    GPIO_PinRemapConfig(GPIO_Remap_SDI_Disable, ENABLE);
+    
+    // Configure relay outputs on GPIOC (R1 on PC0)
+    g.GPIO_Pin = PIN_R1;
+    g.GPIO_Mode = GPIO_Mode_Out_PP;
+    g.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_Init(GPIOC, &g);
+    
+    // Configure relay outputs on GPIOD (R2, R3, R4)
+    g.GPIO_Pin = PIN_R2 | PIN_R3 | PIN_R4;
+    GPIO_Init(GPIOD, &g);
+    
+    // Configure relay output on GPIOA (R5 on PA1)
+    g.GPIO_Pin = PIN_R5;
+    GPIO_Init(GPIOA, &g);
+    
+    // Configure LED outputs on GPIOC
+    g.GPIO_Pin = PIN_MAIN_LED;
+    GPIO_Init(GPIOC, &g);
+    
+    // Configure LED outputs on GPIOD
+    g.GPIO_Pin = PIN_FAULT_LED | PIN_SETTING_LED;
+    GPIO_Init(GPIOD, &g);
+    
+    // Configure input buttons on GPIOC
+    g.GPIO_Pin = PIN_LOWCUT_EN | PIN_M_START | PIN_BUTTON;
+    g.GPIO_Mode = GPIO_Mode_IPU;
+    GPIO_Init(GPIOC, &g);
+    
+    // Configure ADC input on GPIOA (PA2)
+    g.GPIO_Pin = PIN_ADC_SENSE;
+    g.GPIO_Mode = GPIO_Mode_AIN;
+    GPIO_Init(GPIOA, &g);
+    
+    // Reset all outputs to LOW
+    GPIO_ResetBits(GPIOC, PIN_R1 | PIN_MAIN_LED);
+    GPIO_ResetBits(GPIOD, PIN_R2 | PIN_R3 | PIN_R4 | PIN_FAULT_LED | PIN_SETTING_LED);
+    GPIO_ResetBits(GPIOA, PIN_R5);
+}
+
+void ADC_Init_Custom(void) {
+    ADC_InitTypeDef a={0};
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+    RCC_ADCCLKConfig(RCC_PCLK2_Div8);
+    ADC_DeInit(ADC1);
+    a.ADC_Mode = ADC_Mode_Independent;
+    a.ADC_ScanConvMode = DISABLE;
+    a.ADC_ContinuousConvMode = DISABLE;
+    a.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
+    a.ADC_DataAlign = ADC_DataAlign_Right;
+    a.ADC_NbrOfChannel = 1;
+    ADC_Init(ADC1, &a);
+    // Single regular channel: configured once, never touched per sample
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_0, 1, ADC_SampleTime_241Cycles);
+    ADC_Cmd(ADC1, ENABLE);
+    
+    ADC_ResetCalibration(ADC1);
+    while(ADC_GetResetCalibrationStatus(ADC1));
+    ADC_StartCalibration(ADC1);
+    while(ADC_GetCalibrationStatus(ADC1));
+}
+
+void TIM_Init_Custom(void) {
+    TIM_TimeBaseInitTypeDef t={0};
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+    t.TIM_Period = 999;
+    t.TIM_Prescaler = (SystemCoreClock/1000000)-1;
+    t.TIM_ClockDivision = TIM_CKD_DIV1;
+    t.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM2, &t);
+    TIM_ITConfig(TIM2, TIM_IT_Update, ENABLE);
+    TIM_Cmd(TIM2, ENABLE);
+}
+
+void NVIC_Init_Custom(void) {
+    NVIC_InitTypeDef n={0};
+    n.NVIC_IRQChannel = TIM2_IRQn;
+    n.NVIC_IRQChannelPreemptionPriority = 1;
+    n.NVIC_IRQChannelSubPriority = 1;
+    n.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&n);
+}
+
+// CLOCK - HCLK changes only right after a TIM2 update that loaded the
+// matching prescaler, so every tick is 1000 timer counts at 1 MHz. The
+// prescaler is preloaded by HAL_Clock_Set() when the update is far off,
+// else by the ISR one tick later
+static void Clock_Apply(uint8_t clock) {
+    const HalClockProfile_t* p = &halClocks[clock];
+    
+    if((p->cfgr0 & RCC_SW) == RCC_SW_PLL && !(RCC->CTLR & RCC_PLLRDY)) {
+        RCC->CTLR |= RCC_PLLON;                 // Normally locked by HAL_Clock_Set()
+        while(!(RCC->CTLR & RCC_PLLRDY));
+    }
+    // Wait states go up before the clock does, and down after it
+    if(p->latency > (FLASH->ACTLR & FLASH_ACTLR_LATENCY))
+        FLASH->ACTLR = (FLASH->ACTLR & ~FLASH_ACTLR_LATENCY) | p->latency;
+    RCC->CFGR0 = (RCC->CFGR0 & ~(RCC_SW | RCC_HPRE | RCC_ADCPRE)) | p->cfgr0;
+    while((RCC->CFGR0 & RCC_SWS) != ((p->cfgr0 & RCC_SW) << 2));
+    FLASH->ACTLR = (FLASH->ACTLR & ~FLASH_ACTLR_LATENCY) | p->latency;
+    
+    if((p->cfgr0 & RCC_SW) != RCC_SW_PLL && (halClocks[halClockRequest].cfgr0 & RCC_SW) != RCC_SW_PLL)
+        RCC->CTLR &= ~RCC_PLLON;
+    SystemCoreClock = p->hz;
+    halClock = clock;
+}
+
+void HAL_Clock_Set(HalClock_t clock) {
+    if(clock >= HAL_CLOCK_COUNT) return;
+    if((halClocks[clock].cfgr0 & RCC_SW) == RCC_SW_PLL) {
+        RCC->CTLR |= RCC_PLLON;                 // Lock now, not inside the ISR
+        while(!(RCC->CTLR & RCC_PLLRDY));
+    }
+    NVIC_DisableIRQ(TIM2_IRQn);
+    halClockRequest = clock;
+    if(TIM2->CNT < 900 && !(TIM2->INTFR & TIM_IT_Update)) {
+        halClockNext = clock;                   // >= 100 us before the update
+        TIM2->PSC = halClocks[clock].psc;
+    }
+    NVIC_EnableIRQ(TIM2_IRQn);
+}
+
+void TIM2_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void TIM2_IRQHandler(void) {
+    if(TIM2->INTFR & TIM_IT_Update) {
+        // First: the new prescaler has been counting since the update
+        if(halClock != halClockNext) Clock_Apply(halClockNext);
+        systemTick++;
+        TIM2->INTFR = (uint16_t)~TIM_IT_Update;     // rc_w0: other flags kept
+        if(halClockNext != halClockRequest) {
+            halClockNext = halClockRequest;
+            TIM2->PSC = halClocks[halClockNext].psc;
+        }
+    }
+}
+
+// ADC - PA2 (Channel 0), sequence set up in ADC_Init_Custom
+uint16_t HAL_ADC_Read(void) {
+    ADC1->CTLR2 |= ADC_EXTTRIG | ADC_SWSTART;
+    while(!(ADC1->STATR & ADC_EOC));
+    uint16_t v = (uint16_t)ADC1->RDATAR;        // Read clears EOC
+#if TRACE_ENABLE
+    Trace_Record_Sample(v);
+#endif
+    return v;
+}
+
+// GPIO
+void HAL_Output_Write(HalOutput_t out, bool on) {
+    if(out >= HAL_OUT_COUNT) return;
+    if(on) halOutPort[out]->BSHR = halOutPin[out];
+    else halOutPort[out]->BCR = halOutPin[out];
+}
+
+void HAL_Relays_Write(uint8_t relays) {
+    const uint32_t* w = relayBshr[relays & 0x0F];
+    GPIOC->BSHR = w[0];
+    GPIOD->BSHR = w[1];
+}
+
+bool HAL_Input_Active(HalInput_t in) {
+    if(in >= HAL_IN_COUNT) return false;
+    return !(GPIOC->INDR & halInPin[in]);
+}
+
+// TIME
+uint32_t HAL_GetTick(void) {
+    return systemTick;
+}
+
+// TIM2 counts microseconds within the tick
+uint32_t HAL_GetMicros(void) {
+    uint32_t ms, cnt;
+    
+    do {
+        ms = systemTick;
+        cnt = TIM2->CNT;
+    } while(ms != systemTick);
+    // Wrapped, ISR not run yet
+    if((TIM2->INTFR & TIM_IT_Update) && cnt < 500) ms++;
+    return ms*1000 + cnt;
+}
+
+void HAL_Delay_Ms(uint32_t ms) {
+    uint32_t start = systemTick;
+    while((systemTick - start) < ms);
+}
+
+// Sleep mode between ticks: the core clock stops, TIM2 counts on. Interrupts
+// are masked from the test to the sleep, so it does not rely on wfi waking
+// with mstatus.MIE clear: WFITOWFE turns the wfi into a wfe and SEVONPEND
+// makes any pending interrupt a wake-up event. Per PFIC_SCTLR in the
+// CH32V003 reference manual, an event that came before the wfe ends it at
+// once, so a tick between the test and the sleep is not slept through; it
+// is serviced as soon as interrupts are unmasked
+#define PFIC_SCTLR_WFITOWFE     (1u << 3)
+#define PFIC_SCTLR_SEVONPEND    (1u << 4)
+
+void HAL_Sleep_Until(uint32_t start, uint32_t ms) {
+    NVIC->SCTLR |= PFIC_SCTLR_WFITOWFE | PFIC_SCTLR_SEVONPEND;
+    for(;;) {
+        __disable_irq();
+        if((systemTick - start) >= ms) break;
+        __asm volatile ("wfi");         // Not __WFI(): it clears WFITOWFE
+        __enable_irq();
+    }
+    __enable_irq();
+}
+
+// Timed on TIM2, so it holds at every clock profile
+void HAL_Delay_Us(uint32_t us) {
+    uint32_t start = HAL_GetMicros();
+    while((HAL_GetMicros() - start) < us);
+}
+
+// FLASH - 64-byte fast page operations: the standard FLASH_ErasePage()
+// erases 1 KB, which would take the parameter page (and any code below it)
+// with it
+const void* HAL_Flash_Read(uint32_t addr) {
+    return (const void*)addr;
+}
+
+void HAL_Flash_Erase(uint32_t addr) {
+    FLASH_Unlock_Fast();
+    FLASH_ErasePage_Fast(addr);
+    FLASH_Lock_Fast();
+}
+
+bool HAL_Flash_Write(uint32_t addr, const void* data, uint16_t len) {
+    const uint32_t* src = (const uint32_t*)data;
+    
+    if(len > FLASH_PAGE_SIZE || (addr & (FLASH_PAGE_SIZE-1))) return false;
+    
+    FLASH_Unlock_Fast();
+    FLASH_ErasePage_Fast(addr);
+    FLASH_BufReset();
+    for(uint16_t i = 0; i < FLASH_PAGE_SIZE/4; i++)
+        FLASH_BufLoad(addr + 4*i, (4*i < len) ? src[i] : 0xFFFFFFFF);
+    FLASH_ProgramPage_Fast(addr);
+    FLASH_Lock_Fast();
+    
+    // Read back: the page is only trusted if it holds what was written
+    for(uint16_t i = 0; i < len/4; i++)
+        if(((volatile uint32_t*)addr)[i] != src[i]) return false;
+    return true;
+}
@@ -0,0 +1,120 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MODBUS RTU PROTOCOL ENGINE
+ * ============================================================================
+ * Every loop is bounded by the register count limits, so one request costs
+ * at most MODBUS_ADU_MAX bytes of CRC plus MODBUS_MAX_*_REGS table calls.
+ * ============================================================================
+ */
+
+#include "modbus.h"
+#include "crc16.h"
+
+static uint16_t Modbus_Get16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void Modbus_Put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+// Appends CRC (low byte first) and returns the full ADU length
+static uint16_t Modbus_Finish(uint8_t* resp, uint16_t len) {
+    uint16_t crc = CRC16_Calculate(resp, len);
+    resp[len] = (uint8_t)crc;
+    resp[len+1] = (uint8_t)(crc >> 8);
+    return len + 2;
+}
+
+static uint16_t Modbus_Exception(uint8_t* resp, uint8_t code) {
+    resp[1] |= 0x80;
+    resp[2] = code;
+    return Modbus_Finish(resp, 3);
+}
+
+static uint16_t Modbus_Read(const ModbusRegister_t* table, uint16_t count,
+                            const uint8_t* req, uint16_t len, uint8_t* resp) {
+    if(len != 8) return Modbus_Exception(resp, MODBUS_EX_ILLEGAL_VALUE);
+    
+    uint16_t start = Modbus_Get16(&req[2]);
+    uint16_t qty = Modbus_Get16(&req[4]);
+    if(qty == 0 || qty > MODBUS_MAX_READ_REGS)
+        return Modbus_Exception(resp, MODBUS_EX_ILLEGAL_VALUE);
+    if(start >= count || qty > count - start)
+        return Modbus_Exception(resp, MODBUS_EX_ILLEGAL_ADDRESS);
+    
+    resp[2] = (uint8_t)(qty * 2);
+    for(uint16_t i = 0; i < qty; i++)
+        Modbus_Put16(&resp[3 + 2*i], table[start + i].read());
+    return Modbus_Finish(resp, 3 + 2*qty);
+}
+
+// Every register of the request between writeBegin and writeEnd, which
+// applies them together or drops them after the first refusal
+static uint8_t Modbus_WriteRegs(const ModbusMap_t* map, uint16_t start,
+                                uint16_t qty, const uint8_t* values) {
+    bool ok = true;
+    
+    if(start >= map->holdingCount || qty > map->holdingCount - start)
+        return MODBUS_EX_ILLEGAL_ADDRESS;
+    
+    if(map->writeBegin) map->writeBegin();
+    for(uint16_t i = 0; i < qty && ok; i++) {
+        const ModbusRegister_t* r = &map->holding[start + i];
+        ok = r->write != 0 && r->write(Modbus_Get16(&values[2*i]));
+    }
+    if(map->writeEnd) ok = map->writeEnd(ok);
+    return ok ? 0 : MODBUS_EX_ILLEGAL_VALUE;
+}
+
+uint16_t Modbus_Process(const ModbusMap_t* map, uint8_t slaveId,
+                        const uint8_t* req, uint16_t len, uint8_t* resp) {
+    uint8_t ex;
+    
+    // Shortest valid request: id + fc + 4 data + CRC
+    if(len < 8 || len > MODBUS_ADU_MAX) return 0;
+    if(CRC16_Calculate(req, len) != 0) return 0;    // CRC over ADU incl. CRC = 0
+    if(req[0] != slaveId && req[0] != MODBUS_BROADCAST) return 0;
+    
+    resp[0] = slaveId;
+    resp[1] = req[1];
+    
+    switch(req[1]) {
+        case MODBUS_FC_READ_HOLDING:
+            len = Modbus_Read(map->holding, map->holdingCount, req, len, resp);
+            break;
+        
+        case MODBUS_FC_READ_INPUT:
+            len = Modbus_Read(map->input, map->inputCount, req, len, resp);
+            break;
+        
+        case MODBUS_FC_WRITE_SINGLE:
+            if(len != 8) { len = Modbus_Exception(resp, MODBUS_EX_ILLEGAL_VALUE); break; }
+            ex = Modbus_WriteRegs(map, Modbus_Get16(&req[2]), 1, &req[4]);
+            if(ex) { len = Modbus_Exception(resp, ex); break; }
+            for(int i = 2; i < 6; i++) resp[i] = req[i];    // Echo address + value
+            len = Modbus_Finish(resp, 6);
+            break;
+        
+        case MODBUS_FC_WRITE_MULTIPLE: {
+            uint16_t qty = Modbus_Get16(&req[4]);
+            if(qty == 0 || qty > MODBUS_MAX_WRITE_REGS || req[6] != qty*2 || len != 9 + qty*2) {
+                len = Modbus_Exception(resp, MODBUS_EX_ILLEGAL_VALUE);
+                break;
+            }
+            ex = Modbus_WriteRegs(map, Modbus_Get16(&req[2]), qty, &req[7]);
+            if(ex) { len = Modbus_Exception(resp, ex); break; }
+            for(int i = 2; i < 6; i++) resp[i] = req[i];    // Echo address + quantity
+            len = Modbus_Finish(resp, 6);
+            break;
+        }
+        
+        default:
+            len = Modbus_Exception(resp, MODBUS_EX_ILLEGAL_FUNCTION);
+            break;
+    }
+    
+    // Broadcast writes are executed but never answered
+    return (req[0] == MODBUS_BROADCAST) ? 0 : len;
+}
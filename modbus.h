@@ -0,0 +1,54 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MODBUS RTU PROTOCOL ENGINE
+ * ============================================================================
+ * Pure request -> response transform over a table-driven register map.
+ * No hardware access, so the same code runs on the host (tools/modbus_pty.c).
+ * With the write hooks a multi-register write is applied all or none.
+ *
+ * Supported functions:
+ *   0x03 Read Holding Registers    0x06 Write Single Register
+ *   0x04 Read Input Registers      0x10 Write Multiple Registers
+ * ============================================================================
+ */
+
+#ifndef __MODBUS_H
+#define __MODBUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MODBUS_ADU_MAX              64      // Request and response buffer size
+#define MODBUS_MAX_READ_REGS        16      // 5 + 2*16 = 37 byte response
+#define MODBUS_MAX_WRITE_REGS       ((MODBUS_ADU_MAX - 9) / 2)
+#define MODBUS_BROADCAST            0
+
+#define MODBUS_FC_READ_HOLDING      0x03
+#define MODBUS_FC_READ_INPUT        0x04
+#define MODBUS_FC_WRITE_SINGLE      0x06
+#define MODBUS_FC_WRITE_MULTIPLE    0x10
+
+#define MODBUS_EX_ILLEGAL_FUNCTION  0x01
+#define MODBUS_EX_ILLEGAL_ADDRESS   0x02
+#define MODBUS_EX_ILLEGAL_VALUE     0x03
+
+// One register: read returns the live value, write returns false to reject
+typedef struct {
+    uint16_t (*read)(void);
+    bool (*write)(uint16_t value);
+} ModbusRegister_t;
+
+typedef struct {
+    const ModbusRegister_t* input;
+    uint16_t inputCount;
+    const ModbusRegister_t* holding;
+    uint16_t holdingCount;
+    void (*writeBegin)(void);           // Optional: before the first register of a write
+    bool (*writeEnd)(bool apply);       // Optional: applies the writes (true) or drops
+                                        // them; false rejects the request
+} ModbusMap_t;
+
+uint16_t Modbus_Process(const ModbusMap_t* map, uint8_t slaveId,
+                        const uint8_t* req, uint16_t len, uint8_t* resp);
+
+#endif /* __MODBUS_H */
@@ -0,0 +1,148 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MODBUS RTU SLAVE
+ * ============================================================================
+ * Frames are delimited by the USART IDLE-line interrupt and collected by
+ * DMA; Modbus_Poll() runs from the main loop after the control state
+ * machines, so a request never delays protection. Holding register writes
+ * go through the parameter store and take effect on the next control pass.
+ * A write request is staged and compiled once: all of it applies or none.
+ * ============================================================================
+ */
+
+#include "stabilizer.h"
+#include "hal.h"
+#include "serial.h"
+#include "telemetry.h"
+#include "modbus_slave.h"
+#include "params.h"
+
+static uint8_t modbusResp[MODBUS_ADU_MAX];
+static bool modbusSave;                     // Command register written in this request
+static bool modbusCalWrite;                 // Calibration register written ...
+static uint16_t modbusCalValue;             // ... with this value
+
+// INPUT REGISTERS
+static uint16_t IR_OPV(void)        { return currentOPV; }
+static uint16_t IR_IPV(void)        { return currentIPV; }
+static uint16_t IR_ADC(void)        { return currentADC; }
+static uint16_t IR_Step(void)       { return currentStep; }
+static uint16_t IR_R5State(void)    { return (uint16_t)r5State; }
+static uint16_t IR_State(void)      { return (uint16_t)currentState; }
+static uint16_t IR_RelayOps(void)   { return relayOperations; }
+static uint16_t IR_HicutTrips(void) { return hicutTrips; }
+static uint16_t IR_LocutTrips(void) { return locutTrips; }
+static uint16_t IR_UptimeHi(void)   { return (uint16_t)((HAL_GetTick() / 1000) >> 16); }
+static uint16_t IR_UptimeLo(void)   { return (uint16_t)(HAL_GetTick() / 1000); }
+static uint16_t IR_CalADC(void)     { return adcCapturedA; }
+static uint16_t IR_BootMs(void)     { return (uint16_t)(bootDecisionUs / 1000); }
+static uint16_t IR_ADCFast(void)    { return currentADCFast; }
+
+static uint16_t IR_Flags(void) {
+    uint16_t flags = 0;
+    if(r5Status) flags |= TELEMETRY_FLAG_R5_CLOSED;
+    if(HAL_Input_Active(HAL_IN_LOWCUT_EN)) flags |= TELEMETRY_FLAG_LOWCUT_EN;
+    if(stepChangePending) flags |= TELEMETRY_FLAG_STEP_PENDING;
+    if(adcCapturedA > 0) flags |= TELEMETRY_FLAG_CALIBRATED;
+    return flags;
+}
+
+// HOLDING REGISTERS - views onto the parameter store. Writes are staged
+// and Params_Commit() keeps LOCUT < LOCUT resume < HICUT resume < HICUT
+static uint16_t HR_HicutThreshold(void) { return Params_Get(PARAM_HICUT); }
+static uint16_t HR_HicutResume(void)    { return Params_Get(PARAM_HICUT_RESUME); }
+static uint16_t HR_LocutThreshold(void) { return Params_Get(PARAM_LOCUT); }
+static uint16_t HR_LocutResume(void)    { return Params_Get(PARAM_LOCUT_RESUME); }
+static uint16_t HR_Delay(void)          { return Params_Get(PARAM_DELAY_S); }
+static uint16_t HR_Command(void)        { return 0; }
+static uint16_t HR_CalPoint(void)       { return adcCapturedA ? 1 + calPointCount : 0; }
+
+static bool HR_Set_HicutThreshold(uint16_t v) { return Params_Set(PARAM_HICUT, v) == PARAM_OK; }
+static bool HR_Set_HicutResume(uint16_t v)    { return Params_Set(PARAM_HICUT_RESUME, v) == PARAM_OK; }
+static bool HR_Set_LocutThreshold(uint16_t v) { return Params_Set(PARAM_LOCUT, v) == PARAM_OK; }
+static bool HR_Set_LocutResume(uint16_t v)    { return Params_Set(PARAM_LOCUT_RESUME, v) == PARAM_OK; }
+static bool HR_Set_Delay(uint16_t v)          { return Params_Set(PARAM_DELAY_S, v) == PARAM_OK; }
+
+// Saves once the request's parameters are applied
+static bool HR_Set_Command(uint16_t v) {
+    if(v != MODBUS_CMD_SAVE_SETTINGS) return false;
+    modbusSave = true;
+    return true;
+}
+
+// Output voltage (0.1 V) the unit sits at: captures the present count there; 0 clears
+static bool HR_Set_CalPoint(uint16_t v) {
+    modbusCalWrite = true;
+    modbusCalValue = v;
+    return true;
+}
+
+static void Modbus_Write_Begin(void) {
+    modbusSave = false;
+    modbusCalWrite = false;
+    Params_Stage();
+}
+
+// The staged parameters first, then a calibration point (a refused one
+// rolls them back), then the save
+static bool Modbus_Write_End(bool apply) {
+    if(!apply) {
+        Params_Rollback();
+        return false;
+    }
+    if(!Params_Commit()) return false;
+    if(modbusCalWrite) {
+        if(modbusCalValue == 0) Calibration_Clear_Points();
+        else if(!Calibration_Set_Point(modbusCalValue, currentADC)) {
+            Params_Rollback();
+            return false;
+        }
+    }
+    if(modbusSave) {
+        Save_Settings();
+        return Params_Save();
+    }
+    return true;
+}
+
+static const ModbusRegister_t modbusInputRegs[] = {
+    {IR_OPV, 0}, {IR_IPV, 0}, {IR_ADC, 0}, {IR_Step, 0}, {IR_R5State, 0},
+    {IR_State, 0}, {IR_Flags, 0}, {IR_RelayOps, 0}, {IR_HicutTrips, 0},
+    {IR_LocutTrips, 0}, {IR_UptimeHi, 0}, {IR_UptimeLo, 0}, {IR_CalADC, 0},
+    {IR_BootMs, 0}, {IR_ADCFast, 0}
+};
+
+static const ModbusRegister_t modbusHoldingRegs[] = {
+    {HR_HicutThreshold, HR_Set_HicutThreshold},
+    {HR_HicutResume,    HR_Set_HicutResume},
+    {HR_LocutThreshold, HR_Set_LocutThreshold},
+    {HR_LocutResume,    HR_Set_LocutResume},
+    {HR_Delay,          HR_Set_Delay},
+    {HR_Command,        HR_Set_Command},
+    {HR_CalPoint,       HR_Set_CalPoint}
+};
+
+static const ModbusMap_t modbusMap = {
+    modbusInputRegs, sizeof(modbusInputRegs)/sizeof(modbusInputRegs[0]),
+    modbusHoldingRegs, sizeof(modbusHoldingRegs)/sizeof(modbusHoldingRegs[0]),
+    Modbus_Write_Begin, Modbus_Write_End
+};
+
+void Modbus_Init(void) {
+    Serial_Init(MODBUS_BAUDRATE, USART_Parity_Even, true);
+}
+
+void Modbus_Poll(void) {
+    const uint8_t* req;
+    uint16_t len;
+    
+    // Previous response still on the wire: leave any new frame for next pass
+    if(Serial_TxBusy()) return;
+    
+    len = Serial_RxFrame(&req);
+    if(len == 0) return;
+    
+    len = Modbus_Process(&modbusMap, MODBUS_SLAVE_ID, req, len, modbusResp);
+    Serial_RxRelease();
+    if(len > 0) Serial_Write(modbusResp, len);
+}
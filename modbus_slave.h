@@ -0,0 +1,39 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MODBUS RTU SLAVE
+ * ============================================================================
+ * Register map and USART1 glue for the protocol engine in modbus.c.
+ * Voltages are in 0.1 V units.
+ *
+ * Input registers (0x04)           Holding registers (0x03/0x06/0x10)
+ *   0 OPV                            0 HICUT threshold
+ *   1 IPV                            1 HICUT resume
+ *   2 Regulation path ADC count      2 LOCUT threshold
+ *   3 Current step (0-7)             3 LOCUT resume
+ *   4 R5 state (R5State_t)           4 Reconnect delay (s)
+ *   5 System state                   5 Command (write 1 = save to Flash)
+ *   6 Flags (TELEMETRY_FLAG_*)       6 Calibration point: write OPV to
+ *                                      capture currentADC there, 0 clears;
+ *                                      reads the number of points
+ *   7 Tap changes since reset
+ *   8 HICUT trips
+ *   9 LOCUT trips
+ *  10 Uptime (s), high word
+ *  11 Uptime (s), low word
+ *  12 Calibration ADC count
+ *  13 First relay decision (ms)
+ *  14 Protection path ADC count
+ * ============================================================================
+ */
+
+#ifndef __MODBUS_SLAVE_H
+#define __MODBUS_SLAVE_H
+
+#include "modbus.h"
+
+#define MODBUS_CMD_SAVE_SETTINGS    1
+
+void Modbus_Init(void);
+void Modbus_Poll(void);
+
+#endif /* __MODBUS_SLAVE_H */
@@ -0,0 +1,266 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RUNTIME PARAMETER STORE
+ * ============================================================================
+ * Flash record (one 64-byte fast-erase page):
+ *   magic (PARAMS_MAGIC | PARAM_COUNT), values[PARAM_COUNT], CRC-16
+ * A record written by firmware with a different parameter list fails the
+ * magic check and the defaults are used.
+ * ============================================================================
+ */
+
+#include "params.h"
+#include "hal.h"
+#include "crc16.h"
+#include "telemetry.h"
+
+#define PARAMS_MAGIC        0x50410000
+#define PARAMS_STEP_FIRST   PARAM_STEP1_UP
+
+typedef struct {
+    uint32_t magic;
+    uint16_t values[PARAM_COUNT];
+    uint16_t crc;
+} ParamRecord_t;
+
+typedef char ParamRecordSizeCheck_t[(sizeof(ParamRecord_t) <= FLASH_PAGE_SIZE) ? 1 : -1];
+
+// Step thresholds default to relaySteps[]; their def field is unused
+const ParamInfo_t paramInfo[PARAM_COUNT] = {
+    {"hicut",           PARAM_TYPE_DECIVOLT, 2000,  3000, 2560},
+    {"hicut_resume",    PARAM_TYPE_DECIVOLT, 1800,  3000, 2490},
+    {"locut",           PARAM_TYPE_DECIVOLT, 1000,  2400, 1810},
+    {"locut_resume",    PARAM_TYPE_DECIVOLT, 1000,  2600, 1890},
+    {"hicut_detect_ms", PARAM_TYPE_MS,         20, 10000, HICUT_DETECT_TIME_MS},
+    {"hicut_resume_ms", PARAM_TYPE_MS,         20, 10000, HICUT_RESUME_TIME_MS},
+    {"locut_detect_ms", PARAM_TYPE_MS,         20, 10000, LOCUT_DETECT_TIME_MS},
+    {"locut_resume_ms", PARAM_TYPE_MS,         20, 10000, LOCUT_RESUME_TIME_MS},
+    {"debounce_ms",     PARAM_TYPE_MS,          0,  2000, DEBOUNCE_TIME_MS},
+    {"delay_s",         PARAM_TYPE_SEC, MIN_DELAY_TIME_SEC, MAX_DELAY_TIME_SEC, DEFAULT_DELAY_TIME_SEC},
+    {"step1_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step1_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"step2_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step2_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"step3_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step3_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"step4_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step4_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"step5_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step5_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"step6_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step6_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"step7_up",   PARAM_TYPE_VOLT, 50, 450, 0}, {"step7_down", PARAM_TYPE_VOLT, 50, 450, 0},
+    {"telemetry_ms",    PARAM_TYPE_MS, TELEMETRY_MIN_PERIOD_MS, 60000, TELEMETRY_PERIOD_MS}
+};
+
+static uint16_t paramValues[PARAM_COUNT];
+static uint16_t paramStaged[PARAM_COUNT];  // Values at Params_Stage()
+static bool paramStaging;
+static ControlTable_t controlTables[2];
+const ControlTable_t* volatile controlTable = &controlTables[0];
+
+static uint16_t Params_Default(int id) {
+    if(id >= PARAMS_STEP_FIRST && id <= PARAM_STEP7_DOWN) {
+        int step = (id - PARAMS_STEP_FIRST) / 2 + 1;
+        return ((id - PARAMS_STEP_FIRST) & 1) ? relaySteps[step].threshold_down
+                                              : relaySteps[step].threshold_up;
+    }
+    return paramInfo[id].def;
+}
+
+// SENSE CALIBRATION - adcCapturedA at CALIBRATION_DECIVOLTS and the extra
+// calPoints[], sorted by count. A lone point is paired with the origin
+static int Params_Cal_Points(CalPoint_t p[CAL_POINTS_MAX], bool extra) {
+    int n = 0;
+    
+    p[n++] = (CalPoint_t){adcCapturedA, CALIBRATION_DECIVOLTS};
+    for(int i = 0; extra && i < calPointCount && n < CAL_POINTS_MAX; i++) p[n++] = calPoints[i];
+    if(n == 1) p[n++] = (CalPoint_t){0, 0};
+    
+    for(int i = 1; i < n; i++) {
+        CalPoint_t x = p[i];
+        int j = i;
+        for(; j > 0 && p[j-1].adc > x.adc; j--) p[j] = p[j-1];
+        p[j] = x;
+    }
+    return n;
+}
+
+// Rising by at least CAL_MIN_SPAN counts and some voltage from point to point
+bool Params_Calibration_Valid(void) {
+    CalPoint_t p[CAL_POINTS_MAX];
+    int n = Params_Cal_Points(p, true);
+    
+    for(int i = 1; i < n; i++)
+        if(p[i].adc < p[i-1].adc + CAL_MIN_SPAN || p[i].decivolts <= p[i-1].decivolts) return false;
+    return true;
+}
+
+// One segment per pair of adjacent points, through the lower one. The
+// steepest segment sets the fraction bits: slope * 1023 stays below 2^29,
+// so the hot path needs no 64-bit product
+static void Params_Compile_Cal(ControlTable_t* t) {
+    CalPoint_t p[CAL_POINTS_MAX];
+    int n = Params_Cal_Points(p, Params_Calibration_Valid());
+    int shift = CAL_SHIFT_MAX;
+    
+    if(adcCapturedA == 0) {
+        t->calSegments = 1;
+        t->cal[0] = (CalSegment_t){0, 0};
+        t->calShift = 0;
+        return;
+    }
+    for(int i = 1; i < n; i++)
+        while(((uint32_t)(p[i].decivolts - p[i-1].decivolts) << shift) / (p[i].adc - p[i-1].adc) >= (1u << 19))
+            shift--;
+    
+    for(int i = 1; i < n; i++) {
+        int32_t den = p[i].adc - p[i-1].adc;
+        int32_t slope = (((int32_t)(p[i].decivolts - p[i-1].decivolts) << shift) + den/2) / den;
+        t->calStart[i-1] = p[i-1].adc;
+        t->cal[i-1] = (CalSegment_t){slope, ((int32_t)p[i-1].decivolts << shift) - slope * p[i-1].adc};
+    }
+    t->calSegments = (uint8_t)(n - 1);
+    t->calShift = (uint8_t)shift;
+}
+
+// OPV (0.1 V) -> ADC count on the calibration curve: floor for '>'
+// comparisons, ceil for '<'. Interpolated exactly between the points
+static uint16_t Params_Adc(uint16_t dV, bool up) {
+    CalPoint_t p[CAL_POINTS_MAX];
+    int n = Params_Cal_Points(p, Params_Calibration_Valid()), i = 1;
+    
+    if(adcCapturedA == 0) return 0;
+    while(i < n-1 && dV > p[i].decivolts) i++;
+    
+    int32_t num = ((int32_t)dV - p[i-1].decivolts) * (p[i].adc - p[i-1].adc);
+    int32_t den = p[i].decivolts - p[i-1].decivolts;
+    int32_t x = num / den;                  // Truncated towards zero
+    if(num % den) x += up ? (num > 0) : -(num < 0);
+    x += p[i-1].adc;
+    return (uint16_t)(x < 0 ? 0 : x > 0xFFFF ? 0xFFFF : x);
+}
+
+static uint16_t Params_Adc_Floor(uint16_t dV) { return Params_Adc(dV, false); }
+static uint16_t Params_Adc_Ceil(uint16_t dV)  { return Params_Adc(dV, true); }
+
+// Validates the registry as a whole and publishes a new table; false leaves
+// the active table untouched
+bool Params_Compile(void) {
+    const uint16_t* v = paramValues;
+    ControlTable_t* t = (controlTable == &controlTables[0]) ? &controlTables[1] : &controlTables[0];
+    
+    if(!(v[PARAM_LOCUT] < v[PARAM_LOCUT_RESUME] && v[PARAM_LOCUT_RESUME] < v[PARAM_HICUT_RESUME] &&
+         v[PARAM_HICUT_RESUME] < v[PARAM_HICUT]))
+        return false;
+    
+    t->stepUp[0] = 0;
+    t->stepDown[0] = 0;
+    for(int s = 1; s < 8; s++) {
+        t->stepUp[s] = v[PARAMS_STEP_FIRST + 2*(s-1)] * 10;
+        t->stepDown[s] = v[PARAMS_STEP_FIRST + 2*(s-1) + 1] * 10;
+        if(t->stepDown[s] >= t->stepUp[s]) return false;
+        if(s > 1 && (t->stepUp[s] <= t->stepUp[s-1] || t->stepDown[s] <= t->stepDown[s-1]))
+            return false;
+    }
+    
+    t->prot[R5_CH_HICUT] = (ProtLimits_t){
+        Params_Adc_Floor(v[PARAM_HICUT]), Params_Adc_Ceil(v[PARAM_HICUT_RESUME]),
+        v[PARAM_HICUT_DETECT_MS], v[PARAM_HICUT_RESUME_MS]
+    };
+    t->prot[R5_CH_LOCUT] = (ProtLimits_t){
+        Params_Adc_Ceil(v[PARAM_LOCUT]), Params_Adc_Floor(v[PARAM_LOCUT_RESUME]),
+        v[PARAM_LOCUT_DETECT_MS], v[PARAM_LOCUT_RESUME_MS]
+    };
+    t->debounceMs = v[PARAM_DEBOUNCE_MS];
+    Params_Compile_Cal(t);
+    
+    controlTable = t;
+    delayTimeMs = (uint32_t)v[PARAM_DELAY_S] * 1000;
+#if TELEMETRY_ENABLE
+    Telemetry_SetPeriod(v[PARAM_TELEMETRY_MS]);
+#endif
+    return true;
+}
+
+void Params_Defaults(void) {
+    for(int i = 0; i < PARAM_COUNT; i++) paramValues[i] = Params_Default(i);
+}
+
+// Call after Load_Settings(): the calibration feeds the compiled ADC thresholds
+void Params_Init(void) {
+    const ParamRecord_t* r = (const ParamRecord_t*)HAL_Flash_Read(FLASH_PARAMS_ADDR);
+    bool valid = (r->magic == (PARAMS_MAGIC | PARAM_COUNT)) &&
+                 (CRC16_Calculate((const uint8_t*)r->values, sizeof(r->values)) == r->crc);
+    
+    if(valid) {
+        for(int i = 0; i < PARAM_COUNT; i++) {
+            uint16_t x = r->values[i];
+            paramValues[i] = (x < paramInfo[i].min || x > paramInfo[i].max) ? Params_Default(i) : x;
+        }
+    } else {
+        // First boot with a parameter store: keep the delay from Settings_t
+        Params_Defaults();
+        paramValues[PARAM_DELAY_S] = (uint16_t)(delayTimeMs / 1000);
+    }
+    
+    if(!Params_Compile()) {
+        Params_Defaults();
+        Params_Compile();
+    }
+}
+
+bool Params_Save(void) {
+    ParamRecord_t r;
+    
+    r.magic = PARAMS_MAGIC | PARAM_COUNT;
+    for(int i = 0; i < PARAM_COUNT; i++) r.values[i] = paramValues[i];
+    r.crc = CRC16_Calculate((const uint8_t*)r.values, sizeof(r.values));
+    return HAL_Flash_Write(FLASH_PARAMS_ADDR, &r, sizeof(r));
+}
+
+int Params_Find(const char* name) {
+    for(int i = 0; i < PARAM_COUNT; i++) {
+        const char* a = paramInfo[i].name;
+        const char* b = name;
+        while(*a && *a == *b) { a++; b++; }
+        if(*a == 0 && *b == 0) return i;
+    }
+    return -1;
+}
+
+uint16_t Params_Get(ParamId_t id) {
+    return (id < PARAM_COUNT) ? paramValues[id] : 0;
+}
+
+ParamStatus_t Params_Set(ParamId_t id, uint16_t value) {
+    if(id >= PARAM_COUNT) return PARAM_ERR_ID;
+    if(value < paramInfo[id].min || value > paramInfo[id].max) return PARAM_ERR_RANGE;
+    
+    uint16_t old = paramValues[id];
+    paramValues[id] = value;
+    if(paramStaging) return PARAM_OK;
+    if(!Params_Compile()) {
+        paramValues[id] = old;
+        return PARAM_ERR_ORDER;
+    }
+    return PARAM_OK;
+}
+
+// STAGED CHANGES - ordering and the compiled table are checked once, on
+// the whole set; until then the hot path keeps the active table
+void Params_Stage(void) {
+    for(int i = 0; i < PARAM_COUNT; i++) paramStaged[i] = paramValues[i];
+    paramStaging = true;
+}
+
+// Compiles the staged set; false restores the values from Params_Stage()
+bool Params_Commit(void) {
+    paramStaging = false;
+    if(Params_Compile()) return true;
+    for(int i = 0; i < PARAM_COUNT; i++) paramValues[i] = paramStaged[i];
+    return false;
+}
+
+// Back to the values from Params_Stage(), also after a Params_Commit()
+void Params_Rollback(void) {
+    bool committed = !paramStaging;
+    
+    paramStaging = false;
+    for(int i = 0; i < PARAM_COUNT; i++) paramValues[i] = paramStaged[i];
+    if(committed) Params_Compile();
+}
@@ -0,0 +1,88 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RUNTIME PARAMETER STORE
+ * ============================================================================
+ * Typed registry of tunable parameters with bounds and defaults, persisted
+ * in the 64-byte Flash page at FLASH_PARAMS_ADDR. The control state machines
+ * never read the registry: every accepted change recompiles ControlTable_t
+ * (integer thresholds, ADC counts for protection) into a spare buffer and
+ * then swaps the controlTable pointer in one store. Between Params_Stage()
+ * and Params_Commit() changes are only range-checked, so a set of values is
+ * validated and compiled once and applied all or none.
+ * ============================================================================
+ */
+
+#ifndef __PARAMS_H
+#define __PARAMS_H
+
+#include "stabilizer.h"
+
+typedef enum {
+    PARAM_HICUT, PARAM_HICUT_RESUME, PARAM_LOCUT, PARAM_LOCUT_RESUME,
+    PARAM_HICUT_DETECT_MS, PARAM_HICUT_RESUME_MS,
+    PARAM_LOCUT_DETECT_MS, PARAM_LOCUT_RESUME_MS,
+    PARAM_DEBOUNCE_MS, PARAM_DELAY_S,
+    PARAM_STEP1_UP, PARAM_STEP1_DOWN, PARAM_STEP2_UP, PARAM_STEP2_DOWN,
+    PARAM_STEP3_UP, PARAM_STEP3_DOWN, PARAM_STEP4_UP, PARAM_STEP4_DOWN,
+    PARAM_STEP5_UP, PARAM_STEP5_DOWN, PARAM_STEP6_UP, PARAM_STEP6_DOWN,
+    PARAM_STEP7_UP, PARAM_STEP7_DOWN,
+    PARAM_TELEMETRY_MS,
+    PARAM_COUNT
+} ParamId_t;
+
+typedef enum { PARAM_TYPE_DECIVOLT, PARAM_TYPE_VOLT, PARAM_TYPE_MS, PARAM_TYPE_SEC } ParamType_t;
+
+typedef enum { PARAM_OK, PARAM_ERR_ID, PARAM_ERR_RANGE, PARAM_ERR_ORDER } ParamStatus_t;
+
+typedef struct {
+    const char* name;
+    uint8_t type;               // ParamType_t
+    uint16_t min, max, def;     // Raw units: 0.1 V, V, ms or s
+} ParamInfo_t;
+
+// Limits of one R5 protection channel
+typedef struct {
+    uint16_t tripAdc, resumeAdc;
+    uint16_t detectMs, resumeMs;
+} ProtLimits_t;
+
+// Sense calibration segment: OPV = (slope * adc + offset) * calScale volts.
+// Between two calibration points (below the first and above the last the
+// end segments extrapolate); one point is a ratio through zero
+#define CAL_SEGMENTS_MAX        (CAL_POINTS_MAX-1)
+#define CAL_SHIFT_MAX           16          // Fraction bits of slope, fewer if it is steep
+#define CAL_MIN_SPAN            8           // Counts between adjacent calibration points
+
+typedef struct {
+    int32_t slope, offset;              // 0.1 V << calShift per count, 0.1 V << calShift
+} CalSegment_t;
+
+// Derived table read by the hot path. Protection compares ADC counts:
+// HICUT trips when adc > tripAdc and resumes when adc < resumeAdc, LOCUT
+// the other way round - exactly the OPV comparisons it replaces.
+typedef struct {
+    ProtLimits_t prot[R5_CH_COUNT];     // By R5Channel_t
+    uint16_t debounceMs;
+    uint16_t stepUp[8], stepDown[8];    // 0.1 V, compared against IPV
+    uint16_t calStart[CAL_SEGMENTS_MAX];    // Segment s starts at this count (s > 0)
+    CalSegment_t cal[CAL_SEGMENTS_MAX];
+    uint8_t calSegments;
+    uint8_t calShift;                   // Fraction bits of cal[]
+} ControlTable_t;
+
+extern const ParamInfo_t paramInfo[PARAM_COUNT];
+extern const ControlTable_t* volatile controlTable;
+
+void Params_Init(void);
+void Params_Defaults(void);
+bool Params_Compile(void);
+bool Params_Calibration_Valid(void);
+bool Params_Save(void);
+int Params_Find(const char* name);
+uint16_t Params_Get(ParamId_t id);
+ParamStatus_t Params_Set(ParamId_t id, uint16_t value);
+void Params_Stage(void);
+bool Params_Commit(void);
+void Params_Rollback(void);
+
+#endif /* __PARAMS_H */
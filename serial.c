@@ -0,0 +1,174 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - USART1 DMA DRIVER
+ * ============================================================================
+ * TX: DMA1 channel 4, RX: DMA1 channel 5 (fixed USART1 request lines)
+ * RX is half-duplex by frame: after the line goes idle the DMA channel is
+ * stopped and the frame is held until Serial_RxRelease() re-arms it.
+ * ============================================================================
+ */
+
+#include "serial.h"
+
+static uint8_t serialRxBuf[SERIAL_RX_BUFFER_SIZE];
+static volatile uint16_t serialRxLength=0;
+static volatile bool serialRxReady=false;
+static bool serialRxEnabled=false;
+static uint32_t serialBaud=0, serialClock=0;    // BRR was derived for these
+
+static void Serial_DMA_Config(DMA_Channel_TypeDef* ch, uint32_t dir, uint32_t mem, uint16_t len) {
+    DMA_InitTypeDef d={0};
+    
+    DMA_DeInit(ch);
+    d.DMA_PeripheralBaseAddr = (uint32_t)&USART1->DATAR;
+    d.DMA_MemoryBaseAddr = mem;
+    d.DMA_DIR = dir;
+    d.DMA_BufferSize = len;
+    d.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    d.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    d.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    d.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    d.DMA_Mode = DMA_Mode_Normal;
+    d.DMA_Priority = DMA_Priority_Low;
+    d.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(ch, &d);
+}
+
+static void Serial_RxArm(void) {
+    DMA1_Channel5->CFGR &= ~DMA_CFGR1_EN;
+    DMA_ClearFlag(DMA1_FLAG_GL5);
+    DMA1_Channel5->MADDR = (uint32_t)serialRxBuf;
+    DMA1_Channel5->CNTR = SERIAL_RX_BUFFER_SIZE;
+    DMA1_Channel5->CFGR |= DMA_CFGR1_EN;
+}
+
+void Serial_Init(uint32_t baudrate, uint16_t parity, bool rx) {
+    GPIO_InitTypeDef g={0};
+    USART_InitTypeDef u={0};
+    NVIC_InitTypeDef n={0};
+    
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC|RCC_APB2Periph_GPIOD|
+                           RCC_APB2Periph_AFIO|RCC_APB2Periph_USART1, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+    
+    // Default USART1 pins (PD5/PD6) are relays R4/R3 - use PD0/PD1
+    GPIO_PinRemapConfig(GPIO_PartialRemap1_USART1, ENABLE);
+    g.GPIO_Pin = PIN_UART_TX;
+    g.GPIO_Mode = GPIO_Mode_AF_PP;
+    g.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_Init(GPIOD, &g);
+    
+    if(rx) {
+        // PD1 stops being the Fault LED; floating input ignores LED_Set()
+        g.GPIO_Pin = PIN_UART_RX;
+        g.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+        GPIO_Init(GPIOD, &g);
+    }
+
+#if SERIAL_RS485
+    g.GPIO_Pin = PIN_RS485_DE;
+    g.GPIO_Mode = GPIO_Mode_Out_PP;
+    GPIO_Init(GPIOC, &g);
+    GPIO_ResetBits(GPIOC, PIN_RS485_DE);
+#endif
+    
+    // Parity occupies the 9th bit: 8 data bits + parity needs 9-bit words
+    u.USART_BaudRate = baudrate;
+    u.USART_WordLength = (parity == USART_Parity_No) ? USART_WordLength_8b : USART_WordLength_9b;
+    u.USART_StopBits = USART_StopBits_1;
+    u.USART_Parity = parity;
+    u.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+    u.USART_Mode = rx ? (USART_Mode_Tx | USART_Mode_Rx) : USART_Mode_Tx;
+    USART_Init(USART1, &u);
+    serialBaud = baudrate;
+    serialClock = SystemCoreClock;
+    
+    Serial_DMA_Config(DMA1_Channel4, DMA_DIR_PeripheralDST, 0, 0);
+    USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
+    
+    serialRxEnabled = rx;
+    if(rx) {
+        Serial_DMA_Config(DMA1_Channel5, DMA_DIR_PeripheralSRC, (uint32_t)serialRxBuf, SERIAL_RX_BUFFER_SIZE);
+        USART_DMACmd(USART1, USART_DMAReq_Rx, ENABLE);
+        USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);
+        Serial_RxArm();
+    }
+    
+    if(rx || SERIAL_RS485) {
+        n.NVIC_IRQChannel = USART1_IRQn;
+        n.NVIC_IRQChannelPreemptionPriority = 1;
+        n.NVIC_IRQChannelSubPriority = 2;
+        n.NVIC_IRQChannelCmd = ENABLE;
+        NVIC_Init(&n);
+    }
+    
+    USART_Cmd(USART1, ENABLE);
+}
+
+// BRR divides HCLK: re-derive it after a clock profile change. Only while
+// the line is idle - a byte in flight would be garbled
+void Serial_Reclock(void) {
+    if(!serialBaud || serialClock == SystemCoreClock) return;
+    serialClock = SystemCoreClock;
+    USART1->BRR = (uint16_t)((serialClock + serialBaud/2) / serialBaud);   // 12.4 fixed point, 16x oversampling
+}
+
+bool Serial_TxBusy(void) {
+#if SERIAL_RS485
+    // Driver stays enabled until the last stop bit has left the shifter
+    if(GPIO_ReadOutputDataBit(GPIOC, PIN_RS485_DE)) return true;
+#else
+    // DMA done still leaves up to two bytes in DATAR and the shifter
+    if(!(USART1->STATR & USART_FLAG_TC)) return true;
+#endif
+    return (DMA1_Channel4->CFGR & DMA_CFGR1_EN) && DMA1_Channel4->CNTR != 0;
+}
+
+// Hands the buffer to DMA; it must stay untouched until Serial_TxBusy() clears
+bool Serial_Write(const uint8_t* buf, uint16_t len) {
+    if(Serial_TxBusy() || len == 0) return false;
+    
+    USART_ClearFlag(USART1, USART_FLAG_TC);
+#if SERIAL_RS485
+    GPIOC->BSHR = PIN_RS485_DE;
+    USART_ITConfig(USART1, USART_IT_TC, ENABLE);
+#endif
+    DMA1_Channel4->CFGR &= ~DMA_CFGR1_EN;
+    DMA_ClearFlag(DMA1_FLAG_GL4);
+    DMA1_Channel4->MADDR = (uint32_t)buf;
+    DMA1_Channel4->CNTR = len;
+    DMA1_Channel4->CFGR |= DMA_CFGR1_EN;
+    return true;
+}
+
+// Returns the length of a completed RX frame (0 = none); buffer valid until release
+uint16_t Serial_RxFrame(const uint8_t** buf) {
+    if(!serialRxReady) return 0;
+    *buf = serialRxBuf;
+    return serialRxLength;
+}
+
+void Serial_RxRelease(void) {
+    serialRxReady = false;
+    if(serialRxEnabled) Serial_RxArm();
+}
+
+void USART1_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void USART1_IRQHandler(void) {
+    if(USART_GetITStatus(USART1, USART_IT_IDLE) != RESET) {
+        // IDLE clears on STATR read followed by DATAR read
+        (void)USART1->STATR;
+        (void)USART1->DATAR;
+        DMA1_Channel5->CFGR &= ~DMA_CFGR1_EN;
+        serialRxLength = SERIAL_RX_BUFFER_SIZE - DMA1_Channel5->CNTR;
+        if(serialRxLength > 0) serialRxReady = true;
+        else Serial_RxArm();
+    }
+#if SERIAL_RS485
+    if(USART_GetITStatus(USART1, USART_IT_TC) != RESET) {
+        USART_ITConfig(USART1, USART_IT_TC, DISABLE);
+        USART_ClearITPendingBit(USART1, USART_IT_TC);
+        GPIOC->BCR = PIN_RS485_DE;
+    }
+#endif
+}
@@ -0,0 +1,24 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - USART1 DMA DRIVER
+ * ============================================================================
+ * USART1 with partial remap 1 (TX on PD0, RX on PD1). Both directions are
+ * handed to DMA, so the CPU never touches individual bytes:
+ *   TX: DMA1 channel 4, one-shot per buffer
+ *   RX: DMA1 channel 5 into a frame buffer, closed by the IDLE-line interrupt
+ * ============================================================================
+ */
+
+#ifndef __SERIAL_H
+#define __SERIAL_H
+
+#include "board.h"
+
+void Serial_Init(uint32_t baudrate, uint16_t parity, bool rx);
+void Serial_Reclock(void);
+bool Serial_TxBusy(void);
+bool Serial_Write(const uint8_t* buf, uint16_t len);
+uint16_t Serial_RxFrame(const uint8_t** buf);
+void Serial_RxRelease(void);
+
+#endif /* __SERIAL_H */
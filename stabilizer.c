@@ -0,0 +1,748 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CONTROL CORE
+ * ============================================================================
+ * Measurement, tap control (R1-R4), R5 protection, settings and setting mode.
+ * Hardware is reached only through hal.h: the firmware links
+ * hal_ch32v00x.c, host tools link tools/hal_mock.c.
+ * ============================================================================
+ */
+
+#include "stabilizer.h"
+#include "hal.h"
+#include "params.h"
+#include "fixmath.h"
+#include "filter.h"
+
+// ADC averaging: the samples kept after discarding the extremes are summed
+// and shifted, so their count must be a power of two
+#define ADC_AVERAGE_WINDOW      (ADC_SAMPLES_COUNT - 2*ADC_DISCARD_SAMPLES)
+#define ADC_AVERAGE_SHIFT       FIX_LOG2(ADC_AVERAGE_WINDOW)
+_Static_assert(FIX_IS_POW2(ADC_AVERAGE_WINDOW), "ADC averaging window must be a power of two");
+
+// Two filter chains on the same averaged count, one sample per pass
+_Static_assert(ADC_FAST_SHIFT >= 0 && ADC_FAST_SHIFT <= 6, "ADC_FAST_SHIFT out of range");
+_Static_assert(ADC_SLOW_WEIGHT >= 1 && ADC_SLOW_WEIGHT <= 10, "ADC_SLOW_WEIGHT is in tenths");
+
+// The default detect times; Pass_Rate_Calm() checks the runtime ones
+_Static_assert(PASS_SLOW_MS % LOOP_PERIOD_MS == 0, "PASS_SLOW_MS must be a multiple of LOOP_PERIOD_MS");
+_Static_assert(ADAPTIVE_LATENCY_MS < HICUT_DETECT_TIME_MS && ADAPTIVE_LATENCY_MS < LOCUT_DETECT_TIME_MS,
+               "slow passes must stay well inside the detect times");
+
+// settings_guard.ld fails the link at the lower of the two pages
+_Static_assert(FLASH_SETTINGS_ADDR == 0x08001F80 && FLASH_PARAMS_ADDR > FLASH_SETTINGS_ADDR,
+               "settings_guard.ld checks against 0x08001F80");
+
+// RELAY STEP TABLE - packed from RELAY_STEP_TABLE in stabilizer.h
+#define RELAY_RATIO_Q(ratio)    ((uint16_t)((ratio) * (1 << RELAY_RATIO_SHIFT) + 0.5f))
+#define RELAY_STEP_ENTRY(s, r1, r2, r3, r4, up, down, ratio) \
+    {(r1)*RELAY_R1 | (r2)*RELAY_R2 | (r3)*RELAY_R3 | (r4)*RELAY_R4, 0, up, down, RELAY_RATIO_Q(ratio)},
+
+const RelayStep_t relaySteps[8] = {
+    RELAY_STEP_TABLE(RELAY_STEP_ENTRY)
+};
+
+// The ordering rules Params_Compile() enforces on runtime thresholds, plus
+// rising tap ratios, checked on the shipped table at compile time
+#define RELAY_STEP_CONSTANTS(s, r1, r2, r3, r4, up, down, ratio) \
+    RELAY_UP_##s = (up), RELAY_DOWN_##s = (down), RELAY_Q_##s = RELAY_RATIO_Q(ratio),
+#define RELAY_STEP_ONE(s, r1, r2, r3, r4, up, down, ratio) + 1
+enum { RELAY_STEP_TABLE(RELAY_STEP_CONSTANTS) RELAY_STEP_ROWS = 0 RELAY_STEP_TABLE(RELAY_STEP_ONE) };
+
+#define RELAY_STEP_CHECK(s, prev) \
+    _Static_assert(RELAY_DOWN_##s < RELAY_UP_##s, "step " #s ": down threshold not below up"); \
+    _Static_assert(RELAY_UP_##s > RELAY_UP_##prev && RELAY_DOWN_##s > RELAY_DOWN_##prev, \
+                   "step " #s ": thresholds not above step " #prev); \
+    _Static_assert(RELAY_Q_##s > RELAY_Q_##prev, "step " #s ": tap ratio not above step " #prev);
+
+_Static_assert(RELAY_UP_0 == 0 && RELAY_DOWN_0 == 0, "step 0 has no thresholds");
+_Static_assert(RELAY_STEP_ROWS == 8, "RELAY_STEP_TABLE needs 8 steps");
+_Static_assert(sizeof(RelayStep_t) == 8, "RelayStep_t is indexed by shift");
+RELAY_STEP_CHECK(1, 0)
+RELAY_STEP_CHECK(2, 1)
+RELAY_STEP_CHECK(3, 2)
+RELAY_STEP_CHECK(4, 3)
+RELAY_STEP_CHECK(5, 4)
+RELAY_STEP_CHECK(6, 5)
+RELAY_STEP_CHECK(7, 6)
+
+// GLOBAL VARIABLES
+volatile SystemState_t currentState=STATE_NORMAL;
+volatile SettingState_t settingState=SETTING_IDLE;
+volatile R5State_t r5State=R5_NORMAL;
+volatile uint16_t adcCapturedA=0, currentADC=0, currentADCFast=0;
+volatile uint16_t currentOPV=0, currentIPV=0;
+volatile uint8_t currentStep=0, pendingStep=0;
+volatile bool r5Status=false, stepChangePending=false;
+volatile uint16_t relayOperations=0, hicutTrips=0, locutTrips=0;
+volatile uint32_t relayChangeTimer=0, r5Timer=0;
+volatile uint32_t delayTimeMs=DEFAULT_DELAY_TIME_SEC*1000;
+volatile uint32_t bootDecisionUs=0;
+volatile uint16_t passPeriodMs=LOOP_PERIOD_MS;
+CalPoint_t calPoints[CAL_POINTS_MAX-1];
+uint8_t calPointCount=0;
+volatile uint32_t delayCountStart=0, settingBlinkTimer=0;
+volatile bool settingLedState=false;
+volatile uint32_t buttonPressStart=0, mstartPressStart=0;
+volatile bool buttonWasPressed=false, mstartWasPressed=false;
+volatile uint32_t ledBlinkTimer=0;
+volatile bool ledBlinkState=false;
+FILTER_CHAIN(adcProtection, ADC_PROTECTION_CHAIN);
+FILTER_CHAIN(adcRegulation, ADC_REGULATION_CHAIN);
+static uint16_t adcLastSample=0;            // Last averaged count, before the filter
+static uint32_t adcLastMs=0;                // ... and when it was taken
+static uint16_t settingCaptures[ADC_CAPTURE_COUNT];
+static uint8_t settingCaptureCount=0, settingBlinks=0;
+static uint32_t bootStartMs=0;
+static uint16_t bootLastAdc=0;
+static uint8_t bootStablePasses=0;
+static bool bootButtonHeld=false;
+static uint16_t rateLastSample=0;
+static uint8_t rateCalmPasses=0;
+
+// R5 PROTECTION CHANNELS - one row per cut, limits in controlTable->prot[]
+typedef struct {
+    uint8_t detecting;              // R5State_t of the channel's DETECTING phase
+    uint16_t below;                 // 0: trips above tripAdc, 0xFFFF: below it
+    uint8_t enable;                 // HalInput_t arming it, HAL_IN_COUNT: always
+    volatile uint16_t* trips;
+} R5ChannelInfo_t;
+
+static const R5ChannelInfo_t r5Channels[R5_CH_COUNT] = {
+    {R5_HICUT_DETECTING, 0x0000, HAL_IN_COUNT,     &hicutTrips},
+    {R5_LOCUT_DETECTING, 0xFFFF, HAL_IN_LOWCUT_EN, &locutTrips}
+};
+
+// STARTUP - settings and parameters; the boot itself (setting mode request,
+// initial tap position) runs pass by pass in StateMachine0_Boot()
+void Stabilizer_Init(void) {
+    Filter_Reset(&adcProtection);       // First sample seeds the chains again
+    Filter_Reset(&adcRegulation);
+    Load_Settings();
+    Params_Init();
+    
+    currentState = STATE_BOOT;
+    bootDecisionUs = 0;
+    bootStartMs = HAL_GetTick();
+    bootLastAdc = 0xFFFF;               // First pass only seeds the comparison
+    bootStablePasses = 0;
+    bootButtonHeld = true;              // Until a pass sees it released
+    passPeriodMs = LOOP_PERIOD_MS;
+    rateCalmPasses = 0;
+}
+
+// ONE CONTROL PASS - called every passPeriodMs
+void Stabilizer_Run(void) {
+    // Setting mode measures uncalibrated too: its captures come from here
+    if((adcCapturedA>0 && currentState!=STATE_BOOT) || currentState==STATE_SETTING)
+        StateMachine1_Calculate_Voltages();
+    
+    switch(currentState) {
+        case STATE_BOOT:
+            StateMachine0_Boot();
+            break;
+        case STATE_NORMAL:
+            if(r5State!=R5_DELAY_ACTIVE) HAL_Output_Write(HAL_OUT_MAIN_LED,true);
+            HAL_Output_Write(HAL_OUT_SETTING_LED,false);
+            if(adcCapturedA>0) {
+                StateMachine2_Control_R1_R4();
+                StateMachine2_Control_R5();
+            }
+            LED_Handle_Blinking();
+            break;
+        case STATE_SETTING:
+            if(adcCapturedA>0) {            // Old calibration until the new one is committed
+                StateMachine2_Control_R5();
+                LED_Handle_Blinking();
+            }
+            Handle_Setting_Mode();
+            break;
+        case STATE_FAULT:
+            StateMachine2_Control_R5();     // Watches for the resume condition
+            LED_Handle_Blinking();
+            break;
+    }
+    StateMachine3_Pass_Rate();
+}
+
+// STATE MACHINE 0 - BOOT, one step per pass. The taps stay on step 0, where
+// reset left them, while the sense input (RC filtered) settles
+// and a button held from power-on is timed. The first relay decision is
+// taken as soon as both are resolved, instead of after fixed delays
+void StateMachine0_Boot(void) {
+    uint32_t elapsed = HAL_GetTick() - bootStartMs;
+    
+    // Held for BUTTON_PRESS_TIME_MS from power-on: setting mode
+    if(bootButtonHeld && !HAL_Input_Active(HAL_IN_BUTTON)) bootButtonHeld = false;
+    if(bootButtonHeld && elapsed >= BUTTON_PRESS_TIME_MS) {
+        bootDecisionUs = HAL_GetMicros();
+        currentState = STATE_NORMAL;
+        Enter_Setting_Mode();
+        return;
+    }
+    
+    if(adcCapturedA > 0) {
+        uint16_t adc = ADC_ReadCount_Averaged();
+        uint16_t delta = adc > bootLastAdc ? adc - bootLastAdc : bootLastAdc - adc;
+        
+        bootStablePasses = delta <= BOOT_SETTLE_COUNTS ? bootStablePasses + 1 : 0;
+        bootLastAdc = adc;
+        if(bootStablePasses < BOOT_SETTLE_PASSES && elapsed < BOOT_SETTLE_MAX_MS) return;
+    }
+    if(bootButtonHeld) return;
+    
+    bootDecisionUs = HAL_GetMicros();
+    currentState = STATE_NORMAL;
+    if(adcCapturedA > 0) {
+        StateMachine0_Position_Taps(bootLastAdc);   // Next pass is LOOP_PERIOD_MS away
+        r5State = R5_DELAY_ACTIVE;
+        r5Timer = HAL_GetTick();
+        HAL_Output_Write(HAL_OUT_MAIN_LED, false);
+    } else {
+        HAL_Output_Write(HAL_OUT_SETTING_LED, true);
+    }
+}
+
+// STATE MACHINE 0 - taps from a count read on step 0
+void StateMachine0_Position_Taps(uint16_t adc) {
+    uint16_t initial_ipv = Calculate_IPV(Calculate_OPV(adc), 0);
+    
+    const ControlTable_t* t = controlTable;
+    uint8_t target_step = 0;
+    for(int step = 7; step >= 0; step--) {
+        if(initial_ipv > t->stepUp[step]) {
+            target_step = step;
+            break;
+        }
+    }
+    
+    currentStep = target_step;
+    Apply_Relay_Step(target_step);
+}
+
+// SETTINGS
+typedef char SettingsSizeCheck_t[(sizeof(Settings_t) <= FLASH_PAGE_SIZE) ? 1 : -1];
+
+// Record written before multi-point calibration
+typedef struct {
+    uint16_t adc_captured_a;
+    uint32_t delay_time_ms, magic, checksum;
+} SettingsV1_t;
+
+uint32_t Calculate_Checksum(Settings_t* s) {
+    uint32_t sum = s->adc_captured_a + s->delay_time_ms + s->magic + s->cal_count;
+    for(int i = 0; i < CAL_POINTS_MAX-1; i++)
+        sum += s->cal[i].adc + ((uint32_t)s->cal[i].decivolts << 16);
+    return sum;
+}
+
+void Load_Settings(void) {
+    Settings_t* s = (Settings_t*)HAL_Flash_Read(FLASH_SETTINGS_ADDR);
+    SettingsV1_t* v1 = (SettingsV1_t*)s;
+    
+    calPointCount = 0;
+    if(s->magic == SETTINGS_MAGIC && s->checksum == Calculate_Checksum(s)) {
+        adcCapturedA = s->adc_captured_a;
+        delayTimeMs = s->delay_time_ms;
+        if(s->cal_count < CAL_POINTS_MAX) {
+            calPointCount = (uint8_t)s->cal_count;
+            for(int i = 0; i < calPointCount; i++) calPoints[i] = s->cal[i];
+        }
+    } else if(v1->magic == SETTINGS_MAGIC_V1 &&
+              v1->checksum == v1->adc_captured_a + v1->delay_time_ms + v1->magic) {
+        adcCapturedA = v1->adc_captured_a;
+        delayTimeMs = v1->delay_time_ms;
+    } else {
+        adcCapturedA = 0;
+        delayTimeMs = DEFAULT_DELAY_TIME_SEC*1000;
+    }
+    if(adcCapturedA == 0 || adcCapturedA > 1023) adcCapturedA = 0;
+    if(delayTimeMs < MIN_DELAY_TIME_SEC*1000 || delayTimeMs > MAX_DELAY_TIME_SEC*1000)
+        delayTimeMs = DEFAULT_DELAY_TIME_SEC*1000;
+    if(!Params_Calibration_Valid()) calPointCount = 0;    // The single point still holds
+}
+
+void Save_Settings(void) {
+    Settings_t s;
+    s.adc_captured_a = adcCapturedA;
+    s.cal_count = calPointCount;
+    for(int i = 0; i < CAL_POINTS_MAX-1; i++)
+        s.cal[i] = (i < calPointCount) ? calPoints[i] : (CalPoint_t){0, 0};
+    s.delay_time_ms = delayTimeMs;
+    s.magic = SETTINGS_MAGIC;
+    s.checksum = Calculate_Checksum(&s);
+    HAL_Flash_Write(FLASH_SETTINGS_ADDR, &s, sizeof(s));
+}
+
+void Clear_Settings(void) {
+    adcCapturedA = 0;
+    calPointCount = 0;
+    delayTimeMs = DEFAULT_DELAY_TIME_SEC*1000;
+    HAL_Flash_Erase(FLASH_SETTINGS_ADDR);
+}
+
+// Adds a sense calibration point (or moves the one at the same voltage;
+// CALIBRATION_VOLTAGE moves adcCapturedA) and stores it. Refused while
+// uncalibrated and when the curve would not rise by at least CAL_MIN_SPAN
+// counts from point to point
+bool Calibration_Set_Point(uint16_t decivolts, uint16_t adc) {
+    CalPoint_t saved[CAL_POINTS_MAX-1];
+    uint8_t savedCount = calPointCount;
+    uint16_t savedA = adcCapturedA;
+    int i;
+    
+    if(adcCapturedA == 0 || decivolts < CAL_DECIVOLTS_MIN || decivolts > CAL_DECIVOLTS_MAX) return false;
+    for(i = 0; i < calPointCount; i++) saved[i] = calPoints[i];
+    
+    if(decivolts == CALIBRATION_DECIVOLTS) {
+        adcCapturedA = adc;
+    } else {
+        for(i = 0; i < calPointCount && calPoints[i].decivolts != decivolts; i++);
+        if(i == CAL_POINTS_MAX-1) return false;
+        calPoints[i] = (CalPoint_t){adc, decivolts};
+        if(i == calPointCount) calPointCount++;
+    }
+    
+    if(adcCapturedA == 0 || !Params_Calibration_Valid()) {
+        adcCapturedA = savedA;
+        calPointCount = savedCount;
+        for(i = 0; i < savedCount; i++) calPoints[i] = saved[i];
+        return false;
+    }
+    Save_Settings();
+    Params_Compile();                       // Segments and ADC thresholds
+    return true;
+}
+
+// Back to the single point at CALIBRATION_VOLTAGE
+void Calibration_Clear_Points(void) {
+    calPointCount = 0;
+    Save_Settings();
+    Params_Compile();
+}
+
+// ADC FUNCTIONS WITH 5V COMPENSATION
+uint16_t ADC_ReadCount(void) {
+    return HAL_ADC_Read();
+}
+
+uint16_t ADC_ReadCount_Averaged(void) {
+    uint16_t samples[ADC_SAMPLES_COUNT];
+    uint32_t sum = 0;
+    
+    for(int i = 0; i < ADC_SAMPLES_COUNT; i++) {
+        samples[i] = HAL_ADC_Read();
+        HAL_Delay_Us(ADC_SETTLE_DELAY_US);
+    }
+    
+    for(int i = 0; i < ADC_SAMPLES_COUNT-1; i++)
+        for(int j = 0; j < ADC_SAMPLES_COUNT-i-1; j++)
+            if(samples[j] > samples[j+1]) {
+                uint16_t t = samples[j];
+                samples[j] = samples[j+1];
+                samples[j+1] = t;
+            }
+    
+    for(int i = ADC_DISCARD_SAMPLES; i < ADC_SAMPLES_COUNT-ADC_DISCARD_SAMPLES; i++)
+        sum += samples[i];
+    
+    return (uint16_t)(sum >> ADC_AVERAGE_SHIFT);
+}
+
+// One averaged count per call feeds both measurement paths: returns the
+// regulation path, leaves the protection path in currentADCFast
+uint16_t ADC_ReadCount_Filtered(void) {
+    uint16_t newSample = ADC_ReadCount_Averaged();
+    uint32_t now = HAL_GetTick(), elapsed = now - adcLastMs;
+    
+    // A slow pass stands for PASS_SLOW_MS / LOOP_PERIOD_MS full-rate ones:
+    // the skipped ones see the count from before the wait and the new count
+    // comes once, so it is at most ADAPTIVE_LATENCY_MS late and a one-pass
+    // spike weighs what it does at the full rate. main.c may end the wait
+    // early for telemetry: only the passes that time covers are fed
+    for(uint16_t ms = LOOP_PERIOD_MS; ms < passPeriodMs && ms + LOOP_PERIOD_MS/2 <= elapsed;
+        ms += LOOP_PERIOD_MS) {
+        Filter_Run(&adcProtection, adcLastSample);
+        Filter_Run(&adcRegulation, adcLastSample);
+    }
+    adcLastSample = newSample;
+    adcLastMs = now;
+    currentADCFast = Filter_Run(&adcProtection, newSample);
+    return Filter_Run(&adcRegulation, newSample);
+}
+
+// Piecewise-linear through the calibration points (params.c compiles the
+// segments): a few compares, a short shift-add multiply and a rounding
+// shift to 0.1 V, no division and no float
+uint16_t Calculate_OPV(uint16_t adc) {
+    const ControlTable_t* t = controlTable;
+    uint8_t s = 0;
+    
+    while(s + 1 < t->calSegments && adc >= t->calStart[s+1]) s++;
+    int32_t q = Fix_Mul_Short(t->cal[s].slope, adc) + t->cal[s].offset;
+    if(q <= 0) return 0;
+    q = (q + ((1 << t->calShift) >> 1)) >> t->calShift;
+    return q < 0xFFFF ? (uint16_t)q : 0xFFFF;
+}
+
+// IPV (0.1 V) from OPV through the Q2.14 tap ratio of a step
+uint16_t Calculate_IPV(uint16_t opv, uint8_t step) {
+    uint32_t q = (uint32_t)Fix_Mul_Short(relaySteps[step].ratio, opv) + (1u << (RELAY_RATIO_SHIFT - 1));
+    q >>= RELAY_RATIO_SHIFT;
+    return q < 0xFFFF ? (uint16_t)q : 0xFFFF;
+}
+
+// STATE MACHINE 1 - VOLTAGE CALCULATION
+void StateMachine1_Calculate_Voltages(void) {
+    uint16_t adc = ADC_ReadCount_Filtered();
+    currentADC = adc;
+    currentOPV = Calculate_OPV(adc);
+    currentIPV = Calculate_IPV(currentOPV, currentStep);
+}
+
+// STATE MACHINE 2 - RELAY CONTROL
+void StateMachine2_Control_R1_R4(void) {
+    const ControlTable_t* t = controlTable;
+    uint32_t now = HAL_GetTick();
+    uint8_t newStep = currentStep;
+    uint16_t ipv = currentIPV;
+    
+    if(ipv > t->stepUp[currentStep] && currentStep < 7) {
+        for(int i = currentStep+1; i < 8; i++) {
+            if(ipv > t->stepUp[i]) newStep = i;
+            else break;
+        }
+    } else if(currentStep > 0 && ipv < t->stepDown[currentStep]) {
+        for(int i = currentStep-1; i >= 0; i--) {
+            if(ipv < t->stepDown[i+1]) newStep = i;
+            else break;
+        }
+    }
+    
+    if(newStep != currentStep) {
+        if(!stepChangePending) {
+            pendingStep = newStep;
+            stepChangePending = true;
+            relayChangeTimer = now;
+        } else if(pendingStep == newStep) {
+            if((now - relayChangeTimer) >= t->debounceMs) {
+                currentStep = newStep;
+                Apply_Relay_Step(newStep);
+                relayOperations++;
+                stepChangePending = false;
+            }
+        } else {
+            pendingStep = newStep;
+            relayChangeTimer = now;
+        }
+    } else {
+        stepChangePending = false;
+    }
+}
+
+// adc past limit in a channel's trip direction; inverting both sides turns
+// '>' into '<', so one compare serves either direction
+static bool R5_Past(uint16_t below, uint16_t adc, uint16_t limit) {
+    return (uint16_t)(adc ^ below) > (uint16_t)(limit ^ below);
+}
+
+// Channel and phase of a protection state; false for NORMAL and DELAY
+static bool R5_Lookup(R5State_t s, uint8_t* ch, uint8_t* phase) {
+    for(uint8_t c = 0; c < R5_CH_COUNT; c++) {
+        uint8_t p = (uint8_t)(s - r5Channels[c].detecting);
+        if(p <= R5_PHASE_RESUMING) {
+            *ch = c;
+            *phase = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+void StateMachine2_Control_R5(void) {
+    uint16_t adc = currentADCFast;          // Protection reads the fast path
+    uint32_t now = HAL_GetTick();
+    const ControlTable_t* t = controlTable;
+    uint8_t ch, phase;
+    
+    if(r5State == R5_NORMAL) {
+        // First channel in table order wins; an arming input is only read
+        // once its channel is past the trip point
+        for(ch = 0; ch < R5_CH_COUNT; ch++) {
+            const R5ChannelInfo_t* c = &r5Channels[ch];
+            if(R5_Past(c->below, adc, t->prot[ch].tripAdc) &&
+               (c->enable >= HAL_IN_COUNT || HAL_Input_Active((HalInput_t)c->enable))) {
+                r5State = (R5State_t)c->detecting;
+                r5Timer = now;
+                break;
+            }
+        }
+    } else if(r5State == R5_DELAY_ACTIVE) {
+        // M-START skips the rest of the reconnect delay. Either way R5
+        // waits while the voltage is above the HICUT trip point: closing
+        // would put the overvoltage on the load for a detect time
+        if(((now - r5Timer) >= delayTimeMs || Check_MStart_Pressed()) &&
+           adc <= t->prot[R5_CH_HICUT].tripAdc) {
+            Set_R5_Relay(true);
+            r5State = R5_NORMAL;
+            HAL_Output_Write(HAL_OUT_MAIN_LED, true);
+        }
+    } else if(R5_Lookup(r5State, &ch, &phase)) {
+        const R5ChannelInfo_t* c = &r5Channels[ch];
+        const ProtLimits_t* p = &t->prot[ch];
+        
+        switch(phase) {
+            case R5_PHASE_DETECTING:
+                if(!R5_Past(c->below, adc, p->tripAdc)) {
+                    r5State = R5_NORMAL;
+                } else if((now - r5Timer) >= p->detectMs) {
+                    r5State = (R5State_t)(c->detecting + R5_PHASE_ACTIVE);
+                    Set_R5_Relay(false);
+                    (*c->trips)++;
+                    if(currentState != STATE_SETTING) currentState = STATE_FAULT;
+                }
+                break;
+            
+            case R5_PHASE_ACTIVE:
+                if(R5_Past(~c->below, adc, p->resumeAdc)) {
+                    r5State = (R5State_t)(c->detecting + R5_PHASE_RESUMING);
+                    r5Timer = now;
+                }
+                break;
+            
+            case R5_PHASE_RESUMING:
+                if(!R5_Past(~c->below, adc, p->resumeAdc)) {
+                    r5State = (R5State_t)(c->detecting + R5_PHASE_ACTIVE);
+                } else if((now - r5Timer) >= p->resumeMs) {
+                    HAL_Output_Write(HAL_OUT_FAULT_LED, false);
+                    if(currentState == STATE_SETTING) {
+                        r5State = R5_NORMAL;        // Watching again, R5 held open
+                        break;
+                    }
+                    r5State = R5_DELAY_ACTIVE;
+                    r5Timer = now;
+                    currentState = STATE_NORMAL;
+                }
+                break;
+        }
+    }
+}
+
+// STATE MACHINE 3 - PASS RATE. Slow passes only in a steady NORMAL state:
+// R5 closed and not detecting, no tap change pending, the averaged count
+// within ADAPTIVE_MOVE_COUNTS of the last pass and of the regulation path,
+// both the cut trip points (LOCUT even when disabled) and the current
+// step's tap thresholds beyond the margins, and every runtime detect time
+// longer than ADAPTIVE_LATENCY_MS (a shorter excursion could fall between
+// two slow passes). Any pass that sees otherwise
+// restores LOOP_PERIOD_MS at once, so whatever happens during a slow pass
+// is acted on at most ADAPTIVE_LATENCY_MS later than at the full rate
+static bool Pass_Rate_Calm(void) {
+    const ControlTable_t* t = controlTable;
+    uint16_t adc = adcLastSample;
+    uint16_t move = adc > rateLastSample ? adc - rateLastSample : rateLastSample - adc;
+    uint16_t lag = adc > currentADC ? adc - currentADC : currentADC - adc;
+    uint16_t ipv = currentIPV;
+    
+    rateLastSample = adc;
+    if(currentState != STATE_NORMAL || adcCapturedA == 0 || r5State != R5_NORMAL || stepChangePending)
+        return false;
+    if(move > ADAPTIVE_MOVE_COUNTS || lag > ADAPTIVE_MOVE_COUNTS) return false;
+    for(uint8_t ch = 0; ch < R5_CH_COUNT; ch++) {
+        uint16_t below = r5Channels[ch].below;
+        
+        if(t->prot[ch].detectMs <= ADAPTIVE_LATENCY_MS) return false;
+        uint16_t probe = below ? (adc > ADAPTIVE_MARGIN_COUNTS ? adc - ADAPTIVE_MARGIN_COUNTS : 0)
+                               : adc + ADAPTIVE_MARGIN_COUNTS;
+        if(R5_Past(below, probe, t->prot[ch].tripAdc)) return false;
+    }
+    if(currentStep < 7 && ipv > t->stepUp[currentStep+1] - FIX_MUL10(ADAPTIVE_MARGIN_V)) return false;
+    if(currentStep > 0 && ipv < t->stepDown[currentStep] + FIX_MUL10(ADAPTIVE_MARGIN_V)) return false;
+    return true;
+}
+
+void StateMachine3_Pass_Rate(void) {
+    if(!ADAPTIVE_RATE_ENABLE || !Pass_Rate_Calm()) {
+        rateCalmPasses = 0;
+        passPeriodMs = LOOP_PERIOD_MS;
+    } else if(rateCalmPasses < ADAPTIVE_CALM_PASSES) {
+        rateCalmPasses++;
+    } else {
+        passPeriodMs = PASS_SLOW_MS;
+    }
+}
+
+void Apply_Relay_Step(uint8_t step) {
+    if(step >= 8) return;
+    
+    HAL_Relays_Write(relaySteps[step].relays);
+}
+
+void Set_R5_Relay(bool state) {
+    r5Status = state;
+    HAL_Output_Write(HAL_OUT_R5, state);
+}
+
+// SETTING MODE - one step per pass, like the rest of the loop. Nothing is
+// erased on entry: the stored calibration and delay stay in force (and keep
+// the cut channels watching) until the new ones are committed. R5 is held
+// open throughout
+void Enter_Setting_Mode(void) {
+    Set_R5_Relay(false);
+    r5State = R5_NORMAL;
+    currentState = STATE_SETTING;
+    settingState = SETTING_ENTRY;
+    settingBlinks = 0;
+    settingBlinkTimer = HAL_GetTick();
+    HAL_Output_Write(HAL_OUT_SETTING_LED, true);
+}
+
+// New calibration: median of the captures, stored with the counted delay
+static void Setting_Commit(void) {
+    for(int i = 0; i < ADC_CAPTURE_COUNT-1; i++)
+        for(int j = 0; j < ADC_CAPTURE_COUNT-i-1; j++)
+            if(settingCaptures[j] > settingCaptures[j+1]) {
+                uint16_t t = settingCaptures[j];
+                settingCaptures[j] = settingCaptures[j+1];
+                settingCaptures[j+1] = t;
+            }
+    
+    adcCapturedA = settingCaptures[ADC_CAPTURE_COUNT/2];
+    calPointCount = 0;                      // A new calibration starts from one point
+    Save_Settings();
+    // Recompiles the ADC thresholds against the new calibration
+    Params_Set(PARAM_DELAY_S, (uint16_t)(delayTimeMs / 1000));
+    Params_Save();
+    
+    HAL_Output_Write(HAL_OUT_SETTING_LED, false);
+    HAL_Output_Write(HAL_OUT_FAULT_LED, false);
+    settingState = SETTING_IDLE;
+    currentState = STATE_NORMAL;
+    StateMachine0_Position_Taps(adcLastSample);
+    r5State = R5_DELAY_ACTIVE;
+    r5Timer = HAL_GetTick();
+    HAL_Output_Write(HAL_OUT_MAIN_LED, false);
+}
+
+// Entry: three blinks, then the button is released.
+// Step 1: the operator counts the reconnect delay with the Setting LED
+// blinking once per second, then presses the button (180 s ends it anyway).
+// Step 2: LED solid - apply CALIBRATION_VOLTAGE and press the button again;
+// ADC_CAPTURE_COUNT measurement passes ADC_CAPTURE_PERIOD_MS apart are kept.
+void Handle_Setting_Mode(void) {
+    uint32_t now = HAL_GetTick();
+    
+    switch(settingState) {
+        case SETTING_ENTRY:
+            if(settingBlinks < 6) {
+                if((now - settingBlinkTimer) >= BLINK_ENTRY_MS) {
+                    settingBlinkTimer = now;
+                    settingBlinks++;
+                    HAL_Output_Write(HAL_OUT_SETTING_LED, settingBlinks < 6 && !(settingBlinks & 1));
+                }
+            } else if(!HAL_Input_Active(HAL_IN_BUTTON)) {
+                // The entry press must not count as the first setting press
+                buttonWasPressed = false;
+                settingState = SETTING_WAITING_DELAY;
+                delayCountStart = now;
+                settingBlinkTimer = now;
+                settingLedState = false;
+            }
+            break;
+        
+        case SETTING_WAITING_DELAY: {
+            uint32_t elapsed = now - delayCountStart;
+            
+            if((now - settingBlinkTimer) >= BLINK_SETTING_MS/2) {
+                settingBlinkTimer = now;
+                settingLedState = !settingLedState;
+                HAL_Output_Write(HAL_OUT_SETTING_LED, settingLedState);
+            }
+            
+            if(Check_Button_Pressed() || elapsed >= MAX_DELAY_TIME_SEC*1000) {
+                if(elapsed < MIN_DELAY_TIME_SEC*1000) elapsed = MIN_DELAY_TIME_SEC*1000;
+                if(elapsed > MAX_DELAY_TIME_SEC*1000) elapsed = MAX_DELAY_TIME_SEC*1000;
+                delayTimeMs = (elapsed / 1000) * 1000;
+                settingState = SETTING_WAITING_ADC;
+                HAL_Output_Write(HAL_OUT_SETTING_LED, true);
+            }
+            break;
+        }
+        
+        case SETTING_WAITING_ADC:
+            if(Check_Button_Pressed()) {
+                settingCaptures[0] = adcLastSample;     // Measured this pass
+                settingCaptureCount = 1;
+                settingBlinkTimer = now;
+                settingState = SETTING_CAPTURING;
+            }
+            break;
+        
+        case SETTING_CAPTURING:
+            if((now - settingBlinkTimer) >= ADC_CAPTURE_PERIOD_MS) {
+                settingBlinkTimer = now;
+                settingCaptures[settingCaptureCount++] = adcLastSample;
+                if(settingCaptureCount >= ADC_CAPTURE_COUNT) Setting_Commit();
+            }
+            break;
+        
+        case SETTING_IDLE:
+            currentState = STATE_NORMAL;
+            break;
+    }
+}
+
+// BUTTONS - true once per press, on release after BUTTON_DEBOUNCE_MS
+bool Check_Button_Pressed(void) {
+    bool pressed = HAL_Input_Active(HAL_IN_BUTTON);
+    
+    if(pressed && !buttonWasPressed) {
+        buttonWasPressed = true;
+        buttonPressStart = HAL_GetTick();
+    } else if(!pressed && buttonWasPressed) {
+        buttonWasPressed = false;
+        return (HAL_GetTick() - buttonPressStart) >= BUTTON_DEBOUNCE_MS;
+    }
+    return false;
+}
+
+bool Check_MStart_Pressed(void) {
+    bool pressed = HAL_Input_Active(HAL_IN_M_START);
+    
+    if(pressed && !mstartWasPressed) {
+        mstartWasPressed = true;
+        mstartPressStart = HAL_GetTick();
+    } else if(!pressed && mstartWasPressed) {
+        mstartWasPressed = false;
+        return (HAL_GetTick() - mstartPressStart) >= BUTTON_DEBOUNCE_MS;
+    }
+    return false;
+}
+
+// FAULT LED - solid while R5 is held open, fast blink while a cut is being
+// confirmed, slow blink while the voltage is confirmed back in range
+void LED_Handle_Blinking(void) {
+    uint32_t now = HAL_GetTick();
+    uint32_t period;
+    uint8_t ch, phase;
+    
+    if(!R5_Lookup(r5State, &ch, &phase)) {
+        if(ledBlinkState) {
+            ledBlinkState = false;
+            HAL_Output_Write(HAL_OUT_FAULT_LED, false);
+        }
+        return;
+    }
+    if(phase == R5_PHASE_ACTIVE) {
+        HAL_Output_Write(HAL_OUT_FAULT_LED, true);
+        HAL_Output_Write(HAL_OUT_MAIN_LED, false);
+        return;
+    }
+    period = (phase == R5_PHASE_DETECTING) ? BLINK_FAST_MS : BLINK_SLOW_MS;
+    
+    if((now - ledBlinkTimer) >= period) {
+        ledBlinkTimer = now;
+        ledBlinkState = !ledBlinkState;
+        HAL_Output_Write(HAL_OUT_FAULT_LED, ledBlinkState);
+    }
+}
@@ -0,0 +1,224 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - SHARED DEFINITIONS
+ * ============================================================================
+ * Configuration, data types, global state and entry points of the control
+ * core (stabilizer.c). Hardware-free: the pin map lives in board.h and the
+ * core reaches the MCU only through hal.h, so it also builds on a PC.
+ * ============================================================================
+ */
+
+#ifndef __STABILIZER_H
+#define __STABILIZER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// CONFIGURATION
+#define DEFAULT_DELAY_TIME_SEC  180
+#define MIN_DELAY_TIME_SEC      3
+#define MAX_DELAY_TIME_SEC      180
+#define ADC_SAMPLES_COUNT       16
+#define ADC_DISCARD_SAMPLES     4
+#define ADC_SETTLE_DELAY_US     100
+#define ADC_CAPTURE_COUNT       5
+#define ADC_CAPTURE_PERIOD_MS   50         // Between calibration captures
+#ifndef ADC_FAST_SHIFT
+#define ADC_FAST_SHIFT          1          // Protection path: EMA weight 1/2^n per pass, 0 = unfiltered
+#endif
+#ifndef ADC_SLOW_WEIGHT
+#define ADC_SLOW_WEIGHT         2          // Regulation path: new sample weight in tenths per pass
+#endif
+#ifndef ADC_PROTECTION_CHAIN                // filter.h stages, in order, once per pass
+#define ADC_PROTECTION_CHAIN    FILTER_STAGE_EMA(ADC_FAST_SHIFT)
+#endif
+#ifndef ADC_REGULATION_CHAIN
+#define ADC_REGULATION_CHAIN    FILTER_STAGE_EMA10(ADC_SLOW_WEIGHT)
+#endif
+#define DEBOUNCE_TIME_MS        250        // Tap changes (debounce_ms), from tools/tune_steps
+#define BUTTON_DEBOUNCE_MS      10
+#define BUTTON_PRESS_TIME_MS    1000
+#define BLINK_FAST_MS           100
+#define BLINK_SLOW_MS           500
+#define BLINK_SETTING_MS        1000
+#define BLINK_ENTRY_MS          300        // Setting mode entry: three blinks
+#define LOOP_PERIOD_MS          10
+#define HICUT_DETECT_TIME_MS    500
+#define HICUT_RESUME_TIME_MS    200
+#define LOCUT_DETECT_TIME_MS    500
+#define LOCUT_RESUME_TIME_MS    200
+#define BOOT_SETTLE_COUNTS      4          // Sense input settled: passes differ by at most this
+#define BOOT_SETTLE_PASSES      2          // ... this many times in a row
+#define BOOT_SETTLE_MAX_MS      500        // First decision taken by then regardless
+#define ADAPTIVE_LATENCY_MS     30         // Slow rate: detection at most this much later
+#define PASS_SLOW_MS            (LOOP_PERIOD_MS + ADAPTIVE_LATENCY_MS)
+#define ADAPTIVE_MARGIN_COUNTS  16         // Slow rate: sense count this far inside HICUT/LOCUT
+#define ADAPTIVE_MARGIN_V       5          // ... IPV this far inside the step band
+#define ADAPTIVE_MOVE_COUNTS    6          // ... averaged count steady within this per pass
+#define ADAPTIVE_CALM_PASSES    10         // ... for this many full-rate passes first
+#define HICUT_THRESHOLD         256.0f
+#define HICUT_RESUME            249.0f
+#define LOCUT_THRESHOLD         181.0f
+#define LOCUT_RESUME            189.0f
+#define CALIBRATION_VOLTAGE     244.0f
+#define CALIBRATION_DECIVOLTS   2440
+#define CAL_POINTS_MAX          5          // Sense calibration points, CALIBRATION_VOLTAGE's included
+#define CAL_DECIVOLTS_MIN       500        // Range of the extra points
+#define CAL_DECIVOLTS_MAX       4000
+#define FLASH_SETTINGS_ADDR     0x08001F80
+#define FLASH_PARAMS_ADDR       0x08001FC0
+#define FLASH_PAGE_SIZE         64         // Fast erase/program page
+#define SETTINGS_MAGIC          0xA5C3F0E2
+#define SETTINGS_MAGIC_V1       0xA5C3F0E1 // Single-point record, still read
+
+// SERIAL PORT - USART1 carries exactly one protocol
+#define SERIAL_NONE             0
+#define SERIAL_TELEMETRY        1          // TX only (PD0), binary status frames
+#define SERIAL_MODBUS           2          // Modbus RTU slave, RX on PD1
+#define SERIAL_CONSOLE          3          // Text parameter console, RX on PD1
+#define SERIAL_TRACE            4          // TX only, raw ADC sample trace
+#ifndef SERIAL_PROTOCOL
+#define SERIAL_PROTOCOL         SERIAL_TELEMETRY
+#endif
+#define SERIAL_RX_BUFFER_SIZE   64
+#define TELEMETRY_ENABLE        (SERIAL_PROTOCOL == SERIAL_TELEMETRY)
+#define MODBUS_ENABLE           (SERIAL_PROTOCOL == SERIAL_MODBUS)
+#define CONSOLE_ENABLE          (SERIAL_PROTOCOL == SERIAL_CONSOLE)
+#define TRACE_ENABLE            (SERIAL_PROTOCOL == SERIAL_TRACE)
+#ifndef SERIAL_RS485                        // Drive PIN_RS485_DE around transmissions
+#define SERIAL_RS485            MODBUS_ENABLE   // The transceiver is fitted for Modbus only
+#endif
+
+// CLOCK PROFILES - the control pass at CLOCK_PASS (hal.h HalClock_t), 8 MHz
+// while waiting for the next one. USART1 is clocked from HCLK, so only with
+// a TX-only protocol (RX could arrive at any time)
+#ifndef CLOCK_SCALING
+#define CLOCK_SCALING           1
+#endif
+#define CLOCK_SCALING_ENABLE    (CLOCK_SCALING && !MODBUS_ENABLE && !CONSOLE_ENABLE)
+#define CLOCK_PASS              HAL_CLOCK_BURST    // HAL_CLOCK_NORMAL: see README
+
+// ADAPTIVE PASS RATE - passes every PASS_SLOW_MS while the line is steady
+// and clear of every threshold, LOOP_PERIOD_MS otherwise. Modbus and the
+// console poll their RX buffer once per pass, so only with the TX-only
+// protocols, like clock scaling
+#ifndef ADAPTIVE_RATE
+#define ADAPTIVE_RATE           1
+#endif
+#define ADAPTIVE_RATE_ENABLE    (ADAPTIVE_RATE && !MODBUS_ENABLE && !CONSOLE_ENABLE)
+
+// TELEMETRY (8N1)
+#define TELEMETRY_BAUDRATE      115200
+#define TELEMETRY_PERIOD_MS     100        // Default frame period
+#define TELEMETRY_MIN_PERIOD_MS 20         // One mains cycle at 50 Hz
+
+// MODBUS RTU SLAVE (8E1)
+#define MODBUS_SLAVE_ID         1
+#define MODBUS_BAUDRATE         19200
+
+// PARAMETER CONSOLE (8N1)
+#define CONSOLE_BAUDRATE        115200
+
+// ADC TRACE (8N1) - every conversion, about 3.7 KB/s
+#define TRACE_BAUDRATE          115200
+#define TRACE_CONFIG_PERIOD_MS  1000       // Calibration/parameter snapshot
+
+// RELAY STEP SOURCE TABLE - per step: contacts R1-R4 (1 = closed), step
+// up/down thresholds (V, IPV) and tap ratio (output/input). relaySteps[] is
+// generated from it and checked at compile time in stabilizer.c. Thresholds
+// and DEBOUNCE_TIME_MS from tools/tune_steps: target 226 V, hysteresis 1.5 %
+#define RELAY_STEP_TABLE(X) \
+    X(0, 0,0,0,0,   0,   0, 0.472414f)  /* 137V/290V, all relays OFF */ \
+    X(1, 0,0,0,1, 118, 116, 0.570833f) \
+    X(2, 0,0,1,0, 142, 140, 0.689655f) \
+    X(3, 0,0,1,1, 172, 169, 0.833333f) \
+    X(4, 0,1,1,0, 207, 204, 1.000000f) \
+    X(5, 0,1,1,1, 249, 245, 1.208333f) \
+    X(6, 1,1,1,0, 299, 295, 1.441379f) \
+    X(7, 1,1,1,1, 359, 354, 1.741667f)
+
+#define RELAY_R1                0x01       // RelayStep_t.relays, HAL_Relays_Write()
+#define RELAY_R2                0x02
+#define RELAY_R3                0x04
+#define RELAY_R4                0x08
+#define RELAY_RATIO_SHIFT       14         // Tap ratio in Q2.14
+#define RELAY_STEP_RATIO(s)     ((float)relaySteps[s].ratio * (1.0f / (1 << RELAY_RATIO_SHIFT)))
+
+// DATA STRUCTURES
+typedef struct {
+    uint8_t relays;                         // RELAY_R1..RELAY_R4 closed
+    uint8_t reserved;
+    uint16_t threshold_up, threshold_down;
+    uint16_t ratio;                         // Q2.14, RELAY_STEP_RATIO()
+} RelayStep_t;                              // 8 bytes: indexing is a shift
+
+typedef struct {
+    uint16_t adc, decivolts;                // Sense count at an OPV
+} CalPoint_t;
+
+typedef struct {
+    uint16_t adc_captured_a;                // Count at CALIBRATION_VOLTAGE
+    uint16_t cal_count;                     // Extra points in cal[]
+    CalPoint_t cal[CAL_POINTS_MAX-1];
+    uint32_t delay_time_ms, magic, checksum;
+} Settings_t;
+
+typedef enum { STATE_NORMAL, STATE_SETTING, STATE_FAULT, STATE_BOOT } SystemState_t;
+typedef enum { SETTING_IDLE, SETTING_WAITING_DELAY, SETTING_WAITING_ADC,
+               SETTING_ENTRY, SETTING_CAPTURING } SettingState_t;
+typedef enum { R5_NORMAL, R5_HICUT_DETECTING, R5_HICUT_ACTIVE, R5_HICUT_RESUMING,
+               R5_LOCUT_DETECTING, R5_LOCUT_ACTIVE, R5_LOCUT_RESUMING, R5_DELAY_ACTIVE } R5State_t;
+
+// R5 PROTECTION CHANNELS - each owns three consecutive R5State_t values,
+// DETECTING/ACTIVE/RESUMING; a new channel adds its states after
+// R5_DELAY_ACTIVE (telemetry and Modbus report r5State as is)
+typedef enum { R5_CH_HICUT, R5_CH_LOCUT, R5_CH_COUNT } R5Channel_t;
+typedef enum { R5_PHASE_DETECTING, R5_PHASE_ACTIVE, R5_PHASE_RESUMING } R5Phase_t;
+
+// RELAY STEP TABLE
+extern const RelayStep_t relaySteps[8];
+
+// GLOBAL VARIABLES (defined in stabilizer.c)
+extern volatile SystemState_t currentState;
+extern volatile SettingState_t settingState;
+extern volatile R5State_t r5State;
+extern volatile uint16_t adcCapturedA, currentADC, currentADCFast;
+extern volatile uint16_t currentOPV, currentIPV; // 0.1 V
+extern volatile uint8_t currentStep, pendingStep;
+extern volatile bool r5Status, stepChangePending;
+extern volatile uint16_t relayOperations, hicutTrips, locutTrips;
+extern volatile uint32_t delayTimeMs;
+extern CalPoint_t calPoints[CAL_POINTS_MAX-1];  // Beyond adcCapturedA, any order
+extern uint8_t calPointCount;
+extern volatile uint32_t bootDecisionUs;    // HAL_GetMicros() at the first relay decision
+extern volatile uint16_t passPeriodMs;      // Until the next pass, set by each pass
+
+// CONTROL CORE
+void Stabilizer_Init(void);
+void Stabilizer_Run(void);
+void Load_Settings(void);
+void Save_Settings(void);
+void Clear_Settings(void);
+uint32_t Calculate_Checksum(Settings_t* s);
+bool Calibration_Set_Point(uint16_t decivolts, uint16_t adc);
+void Calibration_Clear_Points(void);
+uint16_t ADC_ReadCount(void);
+uint16_t ADC_ReadCount_Averaged(void);
+uint16_t ADC_ReadCount_Filtered(void);
+uint16_t Calculate_OPV(uint16_t adc);
+uint16_t Calculate_IPV(uint16_t opv, uint8_t step);
+void StateMachine0_Boot(void);
+void StateMachine0_Position_Taps(uint16_t adc);
+void StateMachine1_Calculate_Voltages(void);
+void StateMachine2_Control_R1_R4(void);
+void StateMachine2_Control_R5(void);
+void StateMachine3_Pass_Rate(void);
+void Apply_Relay_Step(uint8_t step);
+void Set_R5_Relay(bool state);
+void Enter_Setting_Mode(void);
+void Handle_Setting_Mode(void);
+bool Check_Button_Pressed(void);
+bool Check_MStart_Pressed(void);
+void LED_Handle_Blinking(void);
+
+#endif /* __STABILIZER_H */
@@ -0,0 +1,90 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - BINARY TELEMETRY
+ * ============================================================================
+ * Two frame buffers: DMA drains one while the main loop fills the other.
+ * Telemetry_Service() runs after the control state machines, does no
+ * waiting and its cost is fixed (one frame fill + one 22-byte CRC).
+ * Telemetry_Due_Ms() bounds the wait in main.c so a slow pass does not hold
+ * a frame past its period.
+ * ============================================================================
+ */
+
+#include "stabilizer.h"
+#include "hal.h"
+#include "serial.h"
+#include "crc16.h"
+#include "telemetry.h"
+
+volatile uint16_t telemetryPeriodMs=TELEMETRY_PERIOD_MS;
+volatile uint16_t telemetryOverruns=0;
+
+static TelemetryFrame_t telemetryFrames[2];
+static uint8_t telemetryFill=0;          // Buffer not owned by DMA
+static bool telemetryQueued=false;       // telemetryFill holds an unsent frame
+static uint16_t telemetrySeq=0;
+static uint32_t telemetryTimer=0;
+
+static void Telemetry_Build(TelemetryFrame_t* f) {
+    uint8_t flags = 0;
+    
+    if(r5Status) flags |= TELEMETRY_FLAG_R5_CLOSED;
+    if(HAL_Input_Active(HAL_IN_LOWCUT_EN)) flags |= TELEMETRY_FLAG_LOWCUT_EN;
+    if(stepChangePending) flags |= TELEMETRY_FLAG_STEP_PENDING;
+    if(adcCapturedA > 0) flags |= TELEMETRY_FLAG_CALIBRATED;
+    
+    f->sync[0] = TELEMETRY_SYNC0;
+    f->sync[1] = TELEMETRY_SYNC1;
+    f->type = TELEMETRY_TYPE_STATUS;
+    f->flags = flags;
+    f->seq = telemetrySeq++;
+    f->adc = currentADC;
+    f->tick = HAL_GetTick();
+    f->opv = currentOPV;
+    f->ipv = currentIPV;
+    f->step = currentStep;
+    f->pending = pendingStep;
+    f->r5State = (uint8_t)r5State;
+    f->state = (uint8_t)currentState;
+    f->relayOps = relayOperations;
+    f->crc = CRC16_Calculate((const uint8_t*)f, TELEMETRY_CRC_OFFSET);
+}
+
+static void Telemetry_Kick(void) {
+    if(Serial_Write((const uint8_t*)&telemetryFrames[telemetryFill], TELEMETRY_FRAME_SIZE)) {
+        telemetryFill ^= 1;
+        telemetryQueued = false;
+    }
+}
+
+void Telemetry_Init(void) {
+    Serial_Init(TELEMETRY_BAUDRATE, USART_Parity_No, false);
+    telemetryTimer = HAL_GetTick();
+}
+
+void Telemetry_SetPeriod(uint16_t periodMs) {
+    telemetryPeriodMs = (periodMs < TELEMETRY_MIN_PERIOD_MS) ? TELEMETRY_MIN_PERIOD_MS : periodMs;
+}
+
+// ms from now until the next frame is due, 0 once it is
+uint32_t Telemetry_Due_Ms(uint32_t now) {
+    uint32_t since = now - telemetryTimer;
+    return since < telemetryPeriodMs ? telemetryPeriodMs - since : 0;
+}
+
+void Telemetry_Service(void) {
+    // A frame that found DMA busy last time goes out first
+    if(telemetryQueued) Telemetry_Kick();
+    
+    uint32_t now = HAL_GetTick();
+    if((now - telemetryTimer) >= telemetryPeriodMs) {
+        telemetryTimer = now;
+        
+        // Still queued: DMA has not drained the previous frame, newest wins
+        if(telemetryQueued) telemetryOverruns++;
+        
+        Telemetry_Build(&telemetryFrames[telemetryFill]);
+        telemetryQueued = true;
+        Telemetry_Kick();
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - BINARY TELEMETRY
+ * ============================================================================
+ * Fixed-layout status frames streamed on USART1 by DMA. The frame layout is
+ * plain <stdint.h> so host tools can include this header directly.
+ *
+ * Wire format (little-endian, 24 bytes, naturally aligned):
+ *   0  sync     0xA5 0x5A
+ *   2  type     TELEMETRY_TYPE_STATUS
+ *   3  flags    TELEMETRY_FLAG_*
+ *   4  seq      frame counter, wraps at 65535
+ *   6  adc      regulation path ADC count
+ *   8  tick     HAL_GetTick() (ms since reset)
+ *  12  opv      output voltage, 0.1 V
+ *  14  ipv      input voltage, 0.1 V
+ *  16  step     currentStep (0-7)
+ *  17  pending  pendingStep (valid with TELEMETRY_FLAG_STEP_PENDING)
+ *  18  r5State  R5State_t
+ *  19  state    SystemState_t
+ *  20  relayOps tap changes since reset, wraps at 65535
+ *  22  crc      CRC-16/MODBUS over bytes 0-21
+ * ============================================================================
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_SYNC0             0xA5
+#define TELEMETRY_SYNC1             0x5A
+#define TELEMETRY_TYPE_STATUS       0x01
+
+#define TELEMETRY_FLAG_R5_CLOSED    0x01
+#define TELEMETRY_FLAG_LOWCUT_EN    0x02
+#define TELEMETRY_FLAG_STEP_PENDING 0x04
+#define TELEMETRY_FLAG_CALIBRATED   0x08
+
+typedef struct {
+    uint8_t  sync[2];
+    uint8_t  type;
+    uint8_t  flags;
+    uint16_t seq;
+    uint16_t adc;
+    uint32_t tick;
+    uint16_t opv;
+    uint16_t ipv;
+    uint8_t  step;
+    uint8_t  pending;
+    uint8_t  r5State;
+    uint8_t  state;
+    uint16_t relayOps;
+    uint16_t crc;
+} TelemetryFrame_t;
+
+#define TELEMETRY_FRAME_SIZE        24
+#define TELEMETRY_CRC_OFFSET        22
+
+typedef char TelemetryFrameSizeCheck_t[(sizeof(TelemetryFrame_t) == TELEMETRY_FRAME_SIZE) ? 1 : -1];
+
+void Telemetry_Init(void);
+void Telemetry_Service(void);
+void Telemetry_SetPeriod(uint16_t periodMs);
+uint32_t Telemetry_Due_Ms(uint32_t now);
+
+extern volatile uint16_t telemetryPeriodMs;
+extern volatile uint16_t telemetryOverruns;
+
+#endif /* __TELEMETRY_H */
@@ -0,0 +1,128 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - BENCHMARK HAL (TARGET, RUNS ON rv32bench)
+ * ============================================================================
+ * hal.h for the cycle-count benchmark: the control core is cross-compiled
+ * unmodified with the product flags and linked against this file instead of
+ * hal_ch32v00x.c. rv32bench calls the kernels directly and drives them
+ * through the bench* variables below, looked up by symbol name.
+ *
+ * The Bench_* arithmetic kernels pair each fixmath.h routine with the plain
+ * C operator, which reaches the libgcc helper on rv32ec; rv32bench times
+ * both and checks that they agree. The Bench_Filter_* kernels run a
+ * one-stage chain of each filter.h stage kind on one count per call.
+ *
+ * Peripheral waits are not part of a kernel's cost: HAL_ADC_Read returns
+ * the next entry of benchAdc at once and the delays return immediately, so
+ * the numbers are CPU cycles only. On the board each ADC_ReadCount_Averaged
+ * also waits about 2.9 ms: 16 x (84 us conversion + ADC_SETTLE_DELAY_US).
+ *
+ * Build (from tools/, same -march/-mabi/-O as the firmware):
+ *   riscv-none-embed-gcc -march=rv32ec -mabi=ilp32e -O2 -I.. -DSERIAL_PROTOCOL=0 \
+ *       -nostartfiles -T bench.ld -o bench.elf bench_target.c \
+ *       ../stabilizer.c ../params.c ../filter.c ../crc16.c
+ * ============================================================================
+ */
+
+#include "stabilizer.h"
+#include "hal.h"
+#include "params.h"
+#include "fixmath.h"
+#include "filter.h"
+
+#define BENCH_ADC_SAMPLES   256         // Power of two
+
+volatile uint16_t benchAdc[BENCH_ADC_SAMPLES];
+volatile uint32_t benchAdcIndex=0;
+volatile uint32_t benchTick=0;
+volatile bool benchInputs[HAL_IN_COUNT];
+volatile bool benchOutputs[HAL_OUT_COUNT];
+
+// Calibration and parameters as after a normal first boot
+void Bench_Setup(void) {
+    adcCapturedA = 700;
+    delayTimeMs = 3000;
+    Params_Init();
+    currentState = STATE_NORMAL;
+    r5State = R5_NORMAL;
+}
+
+// ARITHMETIC KERNELS - the filter and OPV operands: n up to 10 * 1023, the
+// multiply packed as slope << 10 | adc
+uint32_t Bench_Div10_Fix(uint32_t n)    { return Fix_Div10(n); }
+uint32_t Bench_Div10_Libgcc(uint32_t n) { return n / 10; }
+
+int32_t Bench_Mul_Fix(uint32_t x)    { return Fix_Mul_Short((int32_t)x >> 10, x & 1023); }
+int32_t Bench_Mul_Libgcc(uint32_t x) { return ((int32_t)x >> 10) * (int32_t)(x & 1023); }
+
+// FILTER KERNELS - one averaged count per call, as in a control pass
+FILTER_CHAIN(benchMedian, FILTER_STAGE_MEDIAN(5));
+FILTER_CHAIN(benchEma, FILTER_STAGE_EMA(2));
+FILTER_CHAIN(benchEma10, FILTER_STAGE_EMA10(2));
+FILTER_CHAIN(benchBiquad, FILTER_STAGE_LP_5HZ);
+FILTER_CHAIN(benchSlew, FILTER_STAGE_SLEW(2));
+
+uint16_t Bench_Filter_Median(uint16_t x) { return Filter_Run(&benchMedian, x); }
+uint16_t Bench_Filter_Ema(uint16_t x)    { return Filter_Run(&benchEma, x); }
+uint16_t Bench_Filter_Ema10(uint16_t x)  { return Filter_Run(&benchEma10, x); }
+uint16_t Bench_Filter_Biquad(uint16_t x) { return Filter_Run(&benchBiquad, x); }
+uint16_t Bench_Filter_Slew(uint16_t x)   { return Filter_Run(&benchSlew, x); }
+
+void HAL_Init(void) {
+}
+
+void HAL_Clock_Set(HalClock_t clock) {
+    (void)clock;
+}
+
+uint16_t HAL_ADC_Read(void) {
+    return benchAdc[benchAdcIndex++ & (BENCH_ADC_SAMPLES-1)];
+}
+
+void HAL_Output_Write(HalOutput_t out, bool on) {
+    if(out >= HAL_OUT_COUNT) return;
+    benchOutputs[out] = on;
+}
+
+void HAL_Relays_Write(uint8_t relays) {
+    for(int i = 0; i < 4; i++) benchOutputs[HAL_OUT_R1 + i] = (relays >> i) & 1;
+}
+
+bool HAL_Input_Active(HalInput_t in) {
+    if(in >= HAL_IN_COUNT) return false;
+    return benchInputs[in];
+}
+
+uint32_t HAL_GetTick(void) {
+    return benchTick;
+}
+
+uint32_t HAL_GetMicros(void) {
+    return benchTick*1000;
+}
+
+void HAL_Delay_Ms(uint32_t ms) {
+    benchTick += ms;
+}
+
+void HAL_Delay_Us(uint32_t us) {
+    (void)us;
+}
+
+void HAL_Sleep_Until(uint32_t start, uint32_t ms) {
+    if(benchTick - start < ms) benchTick = start + ms;
+}
+
+// Parameter page reads as erased Flash: defaults, as on a first boot
+const void* HAL_Flash_Read(uint32_t addr) {
+    return (const void*)addr;
+}
+
+void HAL_Flash_Erase(uint32_t addr) {
+    (void)addr;
+}
+
+bool HAL_Flash_Write(uint32_t addr, const void* data, uint16_t len) {
+    (void)addr; (void)data; (void)len;
+    return false;
+}
@@ -0,0 +1,1388 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CH32V003 CHIP MODEL (HOST)
+ * ============================================================================
+ * See ch32v003.h. Register offsets and bit positions follow ch32v00x.h and
+ * the SPL sources in the repository root; every peripheral keeps its state
+ * in HCLK cycles and is caught up by Sync_Peripherals().
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "ch32v003.h"
+
+#define FLASH_BASE          0x00000000
+#define FLASH_ALIAS         0x08000000
+#define RAM_BASE            0x20000000
+#define ESIG_BASE           0x1FFFF000  // System Flash, option bytes, ESIG
+
+#define TIM2_BASE           0x40000000
+#define AFIO_BASE           0x40010000
+#define GPIOA_BASE          0x40010800
+#define GPIOC_BASE          0x40011000
+#define GPIOD_BASE          0x40011400
+#define ADC1_BASE           0x40012400
+#define USART1_BASE         0x40013800
+#define DMA1_BASE           0x40020000
+#define RCC_BASE            0x40021000
+#define FLASHC_BASE         0x40022000
+#define PFIC_BASE           0xE000E000
+#define STK_BASE            0xE000F000
+
+#define IRQ_SYSTICK         12
+#define IRQ_SW              14
+#define IRQ_DMA1_CH1        22
+#define IRQ_ADC             29
+#define IRQ_USART1          32
+#define IRQ_TIM2            38
+
+#define MSTATUS_MIE         (1u << 3)
+#define MSTATUS_MPIE        (1u << 7)
+#define INTSYSCR_HWSTKEN    (1u << 0)
+#define INTSYSCR_INESTEN    (1u << 1)
+
+#define FLASH_KEY1          0x45670123
+#define FLASH_KEY2          0xCDEF89AB
+#define FL_PG               (1u << 1)
+#define FL_PER              (1u << 2)
+#define FL_MER              (1u << 4)
+#define FL_STRT             (1u << 6)
+#define FL_LOCK             (1u << 7)
+#define FL_FLOCK            (1u << 15)
+#define FL_PAGE_PG          (1u << 16)
+#define FL_PAGE_ER          (1u << 17)
+#define FL_BUF_LOAD         (1u << 18)
+#define FL_BUF_RST          (1u << 19)
+#define FL_SR_BSY           (1u << 0)
+#define FL_SR_WRPRTERR      (1u << 4)
+#define FL_SR_EOP           (1u << 5)
+#define FLASH_ERASE_US      2000        // Approximate, per page or sector
+#define FLASH_PROGRAM_US    1000
+#define FLASH_FAST_PAGE     64
+#define FLASH_SECTOR        1024
+
+#define ADC_AWD             (1u << 0)
+#define ADC_EOC             (1u << 1)
+#define ADC_STRT            (1u << 4)
+#define ADC_EOCIE           (1u << 5)
+#define ADC_AWDIE           (1u << 6)
+#define ADC_SCAN            (1u << 8)
+#define ADC_AWDSGL          (1u << 9)
+#define ADC_AWDEN           (1u << 23)
+#define ADC_ADON            (1u << 0)
+#define ADC_CONT            (1u << 1)
+#define ADC_CAL             (1u << 2)
+#define ADC_RSTCAL          (1u << 3)
+#define ADC_DMA             (1u << 8)
+#define ADC_ALIGN           (1u << 11)
+#define ADC_SWSTART         (1u << 22)
+#define ADC_CONV_CLOCKS     11
+
+#define US_PE               (1u << 0)
+#define US_FE               (1u << 1)
+#define US_NE               (1u << 2)
+#define US_ORE              (1u << 3)
+#define US_IDLE             (1u << 4)
+#define US_RXNE             (1u << 5)
+#define US_TC               (1u << 6)
+#define US_TXE              (1u << 7)
+#define US_RE               (1u << 2)
+#define US_TE               (1u << 3)
+#define US_IDLEIE           (1u << 4)
+#define US_RXNEIE           (1u << 5)
+#define US_TCIE             (1u << 6)
+#define US_TXEIE            (1u << 7)
+#define US_PEIE             (1u << 8)
+#define US_M                (1u << 12)
+#define US_UE               (1u << 13)
+#define US_DMAR             (1u << 6)
+#define US_DMAT             (1u << 7)
+
+#define DMA_EN              (1u << 0)
+#define DMA_TCIE            (1u << 1)
+#define DMA_HTIE            (1u << 2)
+#define DMA_DIR             (1u << 4)
+#define DMA_CIRC            (1u << 5)
+#define DMA_PINC            (1u << 6)
+#define DMA_MINC            (1u << 7)
+#define DMA_MEM2MEM         (1u << 14)
+#define DMA_CH_ADC          0           // Channel 1
+#define DMA_CH_UART_TX      3           // Channel 4
+#define DMA_CH_UART_RX      4           // Channel 5
+
+#define TIM_CEN             (1u << 0)
+#define TIM_OPM             (1u << 3)
+#define TIM_UIF             (1u << 0)
+
+#define STK_STE             (1u << 0)
+#define STK_STIE            (1u << 1)
+#define STK_STCLK           (1u << 2)
+#define STK_STRE            (1u << 3)
+#define STK_MODE            (1u << 4)
+#define STK_INIT            (1u << 5)
+#define STK_SWIE            (1u << 31)
+
+#define NEVER               UINT64_MAX
+
+static const uint16_t adcSampleClocks[8] = {3, 9, 15, 30, 43, 57, 73, 241};
+static const uint32_t portBase[CHIP_PORTS] = {GPIOA_BASE, GPIOC_BASE, GPIOD_BASE};
+
+static void Sync_Peripherals(Chip_t* c);
+static bool Periph_Read(Chip_t* c, uint32_t addr, int size, uint32_t* value);
+static bool Periph_Write(Chip_t* c, uint32_t addr, int size, uint32_t value);
+
+// TIME
+static uint64_t Ps_At(const Chip_t* c, uint64_t cycle) {
+    return c->basePs + (uint64_t)((double)(cycle - c->baseCycle) * 1e12 / c->hclkHz);
+}
+
+static uint64_t Cycle_At(const Chip_t* c, uint64_t ps) {
+    if(ps <= c->basePs) return c->baseCycle;
+    return c->baseCycle + (uint64_t)ceil((double)(ps - c->basePs) * c->hclkHz / 1e12);
+}
+
+static uint64_t Us_To_Cycles(const Chip_t* c, uint32_t us) {
+    return (uint64_t)us * c->hclkHz / 1000000;
+}
+
+uint64_t Chip_Time_Ps(const Chip_t* c) {
+    return Ps_At(c, c->cpu.cycles);
+}
+
+// RCC - HSI 24 MHz, HSE taken as 24 MHz, PLL x2, then the AHB prescaler
+// Closes the segment at the current HCLK into its residency slot
+static void Rcc_Account(Chip_t* c, uint64_t now) {
+    int i = 0;
+    
+    while(i < c->clockCount && c->clockHz[i] != c->hclkHz) i++;
+    if(i == CHIP_CLOCKS) return;
+    if(i == c->clockCount) c->clockHz[c->clockCount++] = c->hclkHz;
+    c->clockPs[i] += now - c->basePs;
+}
+
+uint64_t Chip_Clock_Ps(const Chip_t* c, int i) {
+    if(i < 0 || i >= c->clockCount) return 0;
+    return c->clockPs[i] + (c->clockHz[i] == c->hclkHz ? Chip_Time_Ps(c) - c->basePs : 0);
+}
+
+static void Rcc_Update_Clock(Chip_t* c) {
+    uint32_t sysclk = 24000000, hpre = (c->rccCfgr0 >> 4) & 15, hclk;
+    
+    if((c->rccCfgr0 & 3) == 2) sysclk = 48000000;
+    hclk = (hpre < 8) ? sysclk / (hpre + 1) : sysclk >> (hpre - 7);
+    if(hclk == c->hclkHz) return;
+    uint64_t now = Chip_Time_Ps(c);
+    Rcc_Account(c, now);
+    c->basePs = now;
+    c->baseCycle = c->cpu.cycles;
+    c->hclkHz = hclk;
+    c->runUntilCycle = Cycle_At(c, c->runUntilPs);
+}
+
+static uint32_t Adc_Divider(const Chip_t* c) {
+    uint32_t pre = c->rccCfgr0 >> 11;
+    
+    if(pre & 4) return ((pre & 8) ? 16 : 12) << (pre & 3);
+    return 2 * (((pre >> 3) & 3) + 1);
+}
+
+// GPIO
+static uint8_t Gpio_Output_Mask(const Chip_t* c, int p) {
+    uint8_t mask = 0;
+    
+    for(int pin = 0; pin < 8; pin++)
+        if((c->gpioCfglr[p] >> (4*pin)) & 3) mask |= 1 << pin;
+    return mask;
+}
+
+static uint32_t Gpio_Input(const Chip_t* c, int p) {
+    uint32_t level = 0;
+    
+    for(int pin = 0; pin < 8; pin++) {
+        uint32_t cfg = (c->gpioCfglr[p] >> (4*pin)) & 15, bit = 1u << pin;
+        bool ext = c->gpioExtDriven[p] & bit, extLevel = c->gpioExtLevel[p] & bit, on;
+        if(cfg & 3) {
+            if(cfg & 8) on = ext ? extLevel : true;                 // Alternate function: idle high
+            else if(cfg & 4) on = (c->gpioOutdr[p] & bit) && (!ext || extLevel);   // Open drain
+            else on = c->gpioOutdr[p] & bit;
+        } else if(ext) on = extLevel;
+        else on = ((cfg >> 2) == 2) && (c->gpioOutdr[p] & bit);   // Pull-up/down
+        if(on) level |= bit;
+    }
+    return level;
+}
+
+static void Gpio_Report(Chip_t* c, int p) {
+    uint8_t mask = Gpio_Output_Mask(c, p), level = (uint8_t)c->gpioOutdr[p] & mask;
+    uint8_t changed = ((level ^ c->gpioLogged[p]) | ~c->gpioLoggedMask[p]) & mask;
+    
+    for(int pin = 0; pin < 8 && changed; pin++) {
+        if(!(changed & (1 << pin))) continue;
+        changed &= ~(1 << pin);
+        if(c->gpioHook) c->gpioHook(c->ctx, p, pin, level & (1 << pin), Chip_Time_Ps(c));
+    }
+    c->gpioLogged[p] = (c->gpioLogged[p] & ~mask) | level;
+    c->gpioLoggedMask[p] |= mask;
+}
+
+static void Gpio_Reset(Chip_t* c, int p) {
+    c->gpioCfglr[p] = 0x44444444;       // Floating inputs
+    c->gpioOutdr[p] = 0;
+    Gpio_Report(c, p);
+}
+
+static bool Gpio_Read(Chip_t* c, int p, uint32_t off, uint32_t* value) {
+    switch(off) {
+        case 0x00: *value = c->gpioCfglr[p]; return true;
+        case 0x08: *value = Gpio_Input(c, p); return true;
+        case 0x0C: *value = c->gpioOutdr[p]; return true;
+        case 0x10: case 0x14: case 0x18: *value = 0; return true;
+    }
+    return false;
+}
+
+static bool Gpio_Write(Chip_t* c, int p, uint32_t off, uint32_t value, uint32_t mask) {
+    value &= mask;
+    switch(off) {
+        case 0x00: c->gpioCfglr[p] = (c->gpioCfglr[p] & ~mask) | value; break;
+        case 0x0C: c->gpioOutdr[p] = ((c->gpioOutdr[p] & ~mask) | value) & 0xFF; break;
+        case 0x10: c->gpioOutdr[p] = (c->gpioOutdr[p] & ~(value >> 16)) | (value & 0xFF); break;
+        case 0x14: c->gpioOutdr[p] &= ~value; break;
+        case 0x18: return true;         // LCKR: locking not modelled
+        default: return false;
+    }
+    Gpio_Report(c, p);
+    return true;
+}
+
+// DMA1 - memory side goes straight to the buffers, peripheral side through
+// the register models without another Sync_Peripherals()
+static bool Bus_Read(Chip_t* c, uint32_t addr, int size, uint32_t* value) {
+    if(addr - RAM_BASE < CHIP_RAM_SIZE || addr < CHIP_FLASH_SIZE || addr - FLASH_ALIAS < CHIP_FLASH_SIZE)
+        return Rv32_Read(&c->cpu, addr, size, value);
+    return Periph_Read(c, addr, size, value);
+}
+
+static bool Bus_Write(Chip_t* c, uint32_t addr, int size, uint32_t value) {
+    if(addr - RAM_BASE < CHIP_RAM_SIZE) return Rv32_Write(&c->cpu, addr, size, value);
+    return Periph_Write(c, addr, size, value);
+}
+
+// One unit on channel n; false when the channel is off or done
+static bool Dma_Transfer(Chip_t* c, int n) {
+    ChipDmaChannel_t* d = &c->dma[n];
+    int psize = 1 << ((d->cfgr >> 8) & 3), msize = 1 << ((d->cfgr >> 10) & 3);
+    uint32_t v = 0;
+    bool ok;
+    
+    if(!(d->cfgr & DMA_EN) || !d->cntr) return false;
+    if(d->cfgr & DMA_DIR) ok = Bus_Read(c, d->mcur, msize, &v) && Bus_Write(c, d->pcur, psize, v);
+    else ok = Bus_Read(c, d->pcur, psize, &v) && Bus_Write(c, d->mcur, msize, v);
+    if(!ok) {
+        c->dmaIntfr |= 9u << (4*n);                     // GIF + TEIF
+        d->cfgr &= ~DMA_EN;
+        return false;
+    }
+    if(d->cfgr & DMA_PINC) d->pcur += psize;
+    if(d->cfgr & DMA_MINC) d->mcur += msize;
+    d->cntr--;
+    if(d->cntr == d->reload / 2) c->dmaIntfr |= 5u << (4*n);   // GIF + HTIF
+    if(!d->cntr) {
+        c->dmaIntfr |= 3u << (4*n);                     // GIF + TCIF
+        if(d->cfgr & DMA_CIRC) {
+            d->cntr = d->reload;
+            d->pcur = d->paddr;
+            d->mcur = d->maddr;
+        }
+    }
+    return true;
+}
+
+// USART1
+static uint64_t Uart_Frame_Cycles(const Chip_t* c) {
+    const ChipUsart_t* u = &c->usart;
+    uint32_t bits = 1 + ((u->ctlr1 & US_M) ? 9 : 8) + (((u->ctlr2 >> 12) & 3) == 2 ? 2 : 1);
+    
+    return (uint64_t)(u->brr ? u->brr : 16) * bits;
+}
+
+static void Uart_Transmit(Chip_t* c, uint16_t data) {
+    ChipUsart_t* u = &c->usart;
+    
+    if(!(u->ctlr1 & US_UE) || !(u->ctlr1 & US_TE)) return;
+    u->statr &= ~US_TC;
+    if(!u->shifting) {
+        u->shift = data;
+        u->shifting = true;
+        u->shiftDone = c->cpu.cycles + Uart_Frame_Cycles(c);
+    } else {
+        u->tdr = data;
+        u->tdrFull = true;
+        u->statr &= ~US_TXE;
+    }
+}
+
+static void Uart_Reset(Chip_t* c) {
+    ChipUsart_t* u = &c->usart;
+    
+    u->statr = US_TXE | US_TC;
+    u->brr = u->ctlr1 = u->ctlr2 = u->ctlr3 = u->gpr = 0;
+    u->tdrFull = u->shifting = u->statrRead = false;
+    u->idleAt = 0;
+}
+
+static void Dma_Service(Chip_t* c) {
+    ChipUsart_t* u = &c->usart;
+    
+    while((u->ctlr3 & US_DMAT) && (u->statr & US_TXE) && Dma_Transfer(c, DMA_CH_UART_TX));
+    if((u->ctlr3 & US_DMAR) && (u->statr & US_RXNE)) Dma_Transfer(c, DMA_CH_UART_RX);
+}
+
+static void Uart_Sync(Chip_t* c, uint64_t now) {
+    ChipUsart_t* u = &c->usart;
+    
+    while(u->shifting && u->shiftDone <= now) {
+        if(c->uartHook) c->uartHook(c->ctx, (uint8_t)u->shift, Ps_At(c, u->shiftDone));
+        if(u->tdrFull) {
+            u->shift = u->tdr;
+            u->tdrFull = false;
+            u->statr |= US_TXE;
+            u->shiftDone += Uart_Frame_Cycles(c);
+            Dma_Service(c);
+        } else {
+            u->shifting = false;
+            u->statr |= US_TC;
+        }
+    }
+    while(u->rxHead != u->rxTail && u->rxNext <= now) {
+        uint8_t byte = u->rxQueue[u->rxHead];
+        u->rxHead = (u->rxHead + 1) % sizeof(u->rxQueue);
+        if((u->ctlr1 & US_UE) && (u->ctlr1 & US_RE)) {
+            if(u->statr & US_RXNE) u->statr |= US_ORE;
+            else {
+                u->rdr = byte;
+                u->statr |= US_RXNE;
+            }
+            Dma_Service(c);
+        }
+        u->rxNext += Uart_Frame_Cycles(c);
+        if(u->rxHead == u->rxTail) u->idleAt = u->rxNext;
+    }
+    if(u->idleAt && u->idleAt <= now) {
+        if((u->ctlr1 & US_UE) && (u->ctlr1 & US_RE)) u->statr |= US_IDLE;
+        u->idleAt = 0;
+    }
+}
+
+static bool Uart_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    ChipUsart_t* u = &c->usart;
+    
+    switch(off) {
+        case 0x00:
+            *value = u->statr;
+            u->statrRead = true;
+            return true;
+        case 0x04:
+            *value = u->rdr;
+            u->statr &= ~US_RXNE;
+            if(u->statrRead) u->statr &= ~(US_IDLE | US_ORE | US_NE | US_FE | US_PE);
+            u->statrRead = false;
+            return true;
+        case 0x08: *value = u->brr; return true;
+        case 0x0C: *value = u->ctlr1; return true;
+        case 0x10: *value = u->ctlr2; return true;
+        case 0x14: *value = u->ctlr3; return true;
+        case 0x18: *value = u->gpr; return true;
+    }
+    return false;
+}
+
+static bool Uart_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    ChipUsart_t* u = &c->usart;
+    
+    switch(off) {
+        case 0x00: u->statr &= ~(~value & mask & (US_TC | US_RXNE)); return true;   // rc_w0
+        case 0x04: Uart_Transmit(c, (uint16_t)(value & 0x1FF)); return true;
+        case 0x08: u->brr = ((u->brr & ~mask) | (value & mask)) & 0xFFFF; return true;
+        case 0x0C: u->ctlr1 = (u->ctlr1 & ~mask) | (value & mask); return true;
+        case 0x10: u->ctlr2 = (u->ctlr2 & ~mask) | (value & mask); return true;
+        case 0x14: u->ctlr3 = (u->ctlr3 & ~mask) | (value & mask); return true;
+        case 0x18: u->gpr = (u->gpr & ~mask) | (value & mask); return true;
+    }
+    return false;
+}
+
+static bool Dma_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    if(off == 0x00) { *value = c->dmaIntfr; return true; }
+    if(off == 0x04) { *value = 0; return true; }
+    if(off < 0x08 || off >= 0x08 + 7*0x14) return false;
+    
+    ChipDmaChannel_t* d = &c->dma[(off - 8) / 0x14];
+    switch((off - 8) % 0x14) {
+        case 0x00: *value = d->cfgr; return true;
+        case 0x04: *value = d->cntr; return true;
+        case 0x08: *value = d->paddr; return true;
+        case 0x0C: *value = d->maddr; return true;
+    }
+    *value = 0;
+    return true;
+}
+
+static bool Dma_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    value &= mask;
+    if(off == 0x04) {                                   // INTFCR: a GIF clears the channel
+        for(int n = 0; n < 7; n++)
+            if(value & (1u << (4*n))) value |= 15u << (4*n);
+        c->dmaIntfr &= ~value;
+        return true;
+    }
+    if(off < 0x08 || off >= 0x08 + 7*0x14) return off == 0x00;
+    
+    int n = (off - 8) / 0x14;
+    ChipDmaChannel_t* d = &c->dma[n];
+    switch((off - 8) % 0x14) {
+        case 0x00: {
+            bool enabling = (value & DMA_EN) && !(d->cfgr & DMA_EN);
+            d->cfgr = (d->cfgr & ~mask) | value;
+            if(enabling) {
+                d->pcur = d->paddr;
+                d->mcur = d->maddr;
+                d->reload = d->cntr;
+                if(d->cfgr & DMA_MEM2MEM) while(Dma_Transfer(c, n));
+            }
+            break;
+        }
+        case 0x04: d->cntr = ((d->cntr & ~mask) | value) & 0xFFFF; break;
+        case 0x08: d->paddr = (d->paddr & ~mask) | value; break;
+        case 0x0C: d->maddr = (d->maddr & ~mask) | value; break;
+    }
+    Dma_Service(c);
+    return true;
+}
+
+// ADC1 - regular group, software start only
+static uint32_t Adc_Sequence_Channel(const Chip_t* c, int index) {
+    if(index < 6) return (c->adcRsqr[2] >> (5*index)) & 31;
+    if(index < 12) return (c->adcRsqr[1] >> (5*(index - 6))) & 31;
+    return (c->adcRsqr[0] >> (5*(index - 12))) & 31;
+}
+
+static void Adc_Schedule(Chip_t* c, uint64_t from) {
+    uint32_t ch = Adc_Sequence_Channel(c, c->adcSeqIndex);
+    uint32_t smp = (ch < 10) ? (c->adcSamptr2 >> (3*ch)) & 7 : (c->adcSamptr1 >> (3*(ch - 10))) & 7;
+    
+    c->adcDone = from + (uint64_t)(adcSampleClocks[smp] + ADC_CONV_CLOCKS) * Adc_Divider(c);
+}
+
+static void Adc_Start(Chip_t* c) {
+    if(!(c->adcCtlr2 & ADC_ADON) || c->adcBusy) return;
+    c->adcBusy = true;
+    c->adcSeqIndex = 0;
+    c->adcStatr |= ADC_STRT;
+    Adc_Schedule(c, c->cpu.cycles);
+}
+
+static void Adc_Complete(Chip_t* c) {
+    uint32_t ch = Adc_Sequence_Channel(c, c->adcSeqIndex);
+    double volts = (ch < CHIP_ADC_CHANNELS) ? c->analogVolts[ch] : 0.0;
+    long counts = lround(volts / c->vdd * 1023.0);
+    int length = ((c->adcRsqr[0] >> 20) & 15) + 1;
+    
+    if(counts < 0) counts = 0;
+    if(counts > 1023) counts = 1023;
+    c->adcRdatar = (c->adcCtlr2 & ADC_ALIGN) ? (uint32_t)counts << 6 : (uint32_t)counts;
+    c->adcStatr |= ADC_EOC;
+    c->adcConversions++;
+    if((c->adcCtlr1 & ADC_AWDEN) && (!(c->adcCtlr1 & ADC_AWDSGL) || ch == (c->adcCtlr1 & 31))
+       && ((uint32_t)counts > c->adcWdhtr || (uint32_t)counts < c->adcWdltr))
+        c->adcStatr |= ADC_AWD;
+    if(c->adcCtlr2 & ADC_DMA) Dma_Transfer(c, DMA_CH_ADC);
+    
+    if((c->adcCtlr1 & ADC_SCAN) && c->adcSeqIndex + 1 < length) c->adcSeqIndex++;
+    else if(c->adcCtlr2 & ADC_CONT) c->adcSeqIndex = 0;
+    else {
+        c->adcBusy = false;
+        return;
+    }
+    Adc_Schedule(c, c->adcDone);
+}
+
+static void Adc_Reset(Chip_t* c) {
+    c->adcStatr = c->adcCtlr1 = c->adcCtlr2 = c->adcSamptr1 = c->adcSamptr2 = 0;
+    memset(c->adcIofr, 0, sizeof(c->adcIofr));
+    memset(c->adcRsqr, 0, sizeof(c->adcRsqr));
+    memset(c->adcIdatar, 0, sizeof(c->adcIdatar));
+    c->adcWdhtr = 0x3FF;
+    c->adcWdltr = c->adcIsqr = c->adcRdatar = c->adcDlyr = 0;
+    c->adcBusy = false;
+}
+
+static uint32_t* Adc_Register(Chip_t* c, uint32_t off) {
+    switch(off) {
+        case 0x00: return &c->adcStatr;
+        case 0x04: return &c->adcCtlr1;
+        case 0x08: return &c->adcCtlr2;
+        case 0x0C: return &c->adcSamptr1;
+        case 0x10: return &c->adcSamptr2;
+        case 0x14: case 0x18: case 0x1C: case 0x20: return &c->adcIofr[(off - 0x14) / 4];
+        case 0x24: return &c->adcWdhtr;
+        case 0x28: return &c->adcWdltr;
+        case 0x2C: case 0x30: case 0x34: return &c->adcRsqr[(off - 0x2C) / 4];
+        case 0x38: return &c->adcIsqr;
+        case 0x3C: case 0x40: case 0x44: case 0x48: return &c->adcIdatar[(off - 0x3C) / 4];
+        case 0x4C: return &c->adcRdatar;
+        case 0x50: return &c->adcDlyr;
+    }
+    return NULL;
+}
+
+static bool Adc_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    uint32_t* reg = Adc_Register(c, off);
+    
+    if(!reg) return false;
+    *value = *reg;
+    if(off == 0x4C) c->adcStatr &= ~ADC_EOC;
+    return true;
+}
+
+static bool Adc_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    uint32_t* reg = Adc_Register(c, off);
+    
+    if(!reg) return false;
+    if(off == 0x00) {                                   // rc_w0
+        c->adcStatr &= value | ~mask;
+        return true;
+    }
+    if(off == 0x4C) return true;
+    *reg = (*reg & ~mask) | (value & mask);
+    if(off == 0x08) {
+        c->adcCtlr2 &= ~(ADC_CAL | ADC_RSTCAL);         // Calibration is instant
+        if(c->adcCtlr2 & ADC_SWSTART) {
+            c->adcCtlr2 &= ~ADC_SWSTART;
+            Adc_Start(c);
+        }
+        if(!(c->adcCtlr2 & ADC_ADON)) c->adcBusy = false;
+    }
+    return true;
+}
+
+// TIM2 - up-counting time base: prescaler, auto-reload, update flag
+static void Tim_Sync(Chip_t* c, uint64_t now) {
+    uint64_t elapsed = now - c->timLast;
+    
+    c->timLast = now;
+    if(!(c->timCtlr1 & TIM_CEN)) return;
+    
+    uint64_t div = (uint64_t)c->timPscActive + 1, total = c->timPscCnt + elapsed, ticks = total / div;
+    c->timPscCnt = (uint32_t)(total % div);
+    if(!ticks) return;
+    
+    uint64_t toUpdate = ((c->timArr - c->timCnt) & 0xFFFF) + 1;
+    if(ticks < toUpdate) {
+        c->timCnt = (uint32_t)((c->timCnt + ticks) & 0xFFFF);
+        return;
+    }
+    c->timIntfr |= TIM_UIF;
+    c->timPscActive = c->timPsc;
+    c->timCnt = (uint32_t)((ticks - toUpdate) % ((uint64_t)c->timArr + 1));
+    if(c->timCtlr1 & TIM_OPM) {
+        c->timCtlr1 &= ~TIM_CEN;
+        c->timCnt = 0;
+    }
+}
+
+static uint64_t Tim_Next_Update(const Chip_t* c) {
+    if(!(c->timCtlr1 & TIM_CEN)) return NEVER;
+    uint64_t toUpdate = ((c->timArr - c->timCnt) & 0xFFFF) + 1;
+    return c->timLast + toUpdate * ((uint64_t)c->timPscActive + 1) - c->timPscCnt;
+}
+
+static void Tim_Reset(Chip_t* c) {
+    c->timCtlr1 = c->timCtlr2 = c->timSmcfgr = c->timDier = c->timIntfr = c->timCcer = 0;
+    c->timChctlr[0] = c->timChctlr[1] = 0;
+    c->timCnt = c->timPsc = c->timPscActive = c->timPscCnt = 0;
+    c->timArr = 0xFFFF;
+    memset(c->timCcr, 0, sizeof(c->timCcr));
+    c->timLast = c->cpu.cycles;
+}
+
+static uint32_t* Tim_Register(Chip_t* c, uint32_t off) {
+    switch(off) {
+        case 0x00: return &c->timCtlr1;
+        case 0x04: return &c->timCtlr2;
+        case 0x08: return &c->timSmcfgr;
+        case 0x0C: return &c->timDier;
+        case 0x10: return &c->timIntfr;
+        case 0x18: case 0x1C: return &c->timChctlr[(off - 0x18) / 4];
+        case 0x20: return &c->timCcer;
+        case 0x24: return &c->timCnt;
+        case 0x28: return &c->timPsc;
+        case 0x2C: return &c->timArr;
+        case 0x34: case 0x38: case 0x3C: case 0x40: return &c->timCcr[(off - 0x34) / 4];
+    }
+    return NULL;
+}
+
+static bool Tim_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    uint32_t* reg = Tim_Register(c, off);
+    
+    *value = reg ? *reg : 0;
+    return reg || off == 0x14 || off == 0x30 || off == 0x44 || off == 0x48;
+}
+
+static bool Tim_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    uint32_t* reg = Tim_Register(c, off);
+    
+    value &= mask & 0xFFFF;
+    if(off == 0x14) {                                   // SWEVGR: UG re-initialises
+        if(value & 1) {
+            c->timCnt = c->timPscCnt = 0;
+            c->timPscActive = c->timPsc;
+            if(!(c->timCtlr1 & (1u << 2))) c->timIntfr |= TIM_UIF;   // Unless URS
+        }
+        return true;
+    }
+    if(!reg) return off == 0x30 || off == 0x44 || off == 0x48;
+    if(off == 0x10) *reg &= value | ~mask;              // rc_w0
+    else *reg = (*reg & ~mask) | value;
+    return true;
+}
+
+// SysTick - 32-bit counter on HCLK or HCLK/8, up or down, compare flag
+static uint64_t Stk_Ticks_To_Match(const Chip_t* c) {
+    uint64_t period = (uint64_t)c->stkCmp + 1;
+    
+    if(c->stkCtlr & STK_MODE) {                         // Down to 0
+        if(c->stkCtlr & STK_STRE) return c->stkCnt % period ? c->stkCnt % period : period;
+        return c->stkCnt ? c->stkCnt : (1ull << 32);
+    }
+    if(c->stkCtlr & STK_STRE) {
+        uint64_t pos = c->stkCnt % period;
+        return (pos < c->stkCmp) ? c->stkCmp - pos : period;
+    }
+    uint32_t d = c->stkCmp - c->stkCnt;
+    return d ? d : (1ull << 32);
+}
+
+static void Stk_Sync(Chip_t* c, uint64_t now) {
+    uint64_t elapsed = now - c->stkLast;
+    
+    c->stkLast = now;
+    if(!(c->stkCtlr & STK_STE)) return;
+    
+    uint32_t div = (c->stkCtlr & STK_STCLK) ? 1 : 8;
+    uint64_t total = c->stkPhase + elapsed, ticks = total / div;
+    c->stkPhase = (uint32_t)(total % div);
+    if(!ticks) return;
+    if(ticks >= Stk_Ticks_To_Match(c)) c->stkSr |= 1;
+    
+    uint64_t period = (uint64_t)c->stkCmp + 1;
+    bool down = c->stkCtlr & STK_MODE;
+    if(c->stkCtlr & STK_STRE) {
+        uint64_t pos = c->stkCnt % period, step = ticks % period;
+        c->stkCnt = (uint32_t)(down ? (pos + period - step) % period : (pos + step) % period);
+    } else c->stkCnt = down ? c->stkCnt - (uint32_t)ticks : c->stkCnt + (uint32_t)ticks;
+}
+
+static uint64_t Stk_Next_Match(const Chip_t* c) {
+    if(!(c->stkCtlr & STK_STE)) return NEVER;
+    uint32_t div = (c->stkCtlr & STK_STCLK) ? 1 : 8;
+    return c->stkLast + Stk_Ticks_To_Match(c) * div - c->stkPhase;
+}
+
+static bool Stk_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    switch(off) {
+        case 0x00: *value = c->stkCtlr; return true;
+        case 0x04: *value = c->stkSr; return true;
+        case 0x08: *value = c->stkCnt; return true;
+        case 0x0C: *value = 0; return true;
+        case 0x10: *value = c->stkCmp; return true;
+        case 0x14: *value = 0; return true;
+    }
+    return false;
+}
+
+static bool Stk_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    switch(off) {
+        case 0x00:
+            c->stkCtlr = (c->stkCtlr & ~mask) | (value & mask);
+            if(c->stkCtlr & STK_INIT) {
+                c->stkCnt = (c->stkCtlr & STK_MODE) ? c->stkCmp : 0;
+                c->stkPhase = 0;
+                c->stkCtlr &= ~STK_INIT;
+            }
+            return true;
+        case 0x04: c->stkSr &= value | ~mask; return true;
+        case 0x08: c->stkCnt = (c->stkCnt & ~mask) | (value & mask); return true;
+        case 0x10: c->stkCmp = (c->stkCmp & ~mask) | (value & mask); return true;
+        case 0x0C: case 0x14: return true;
+    }
+    return false;
+}
+
+// FLASH controller - keys, fast 64-byte pages, 1 KB sectors, wait states
+static void Flash_Busy(Chip_t* c, uint32_t us) {
+    c->flBusyUntil = c->cpu.cycles + Us_To_Cycles(c, us);
+    c->flStatr |= FL_SR_EOP;
+}
+
+static void Flash_Start(Chip_t* c, uint32_t ctlr) {
+    uint32_t addr = c->flAddr & (CHIP_FLASH_SIZE - 1);
+    bool fast = ctlr & (FL_PAGE_ER | FL_PAGE_PG);
+    
+    if(fast && (ctlr & FL_FLOCK)) {
+        c->flStatr |= FL_SR_WRPRTERR;
+        return;
+    }
+    if(ctlr & FL_PAGE_ER) {
+        memset(&c->flash[addr & ~(FLASH_FAST_PAGE - 1)], 0xFF, FLASH_FAST_PAGE);
+        c->flashErases++;
+        Flash_Busy(c, FLASH_ERASE_US);
+    } else if(ctlr & FL_PAGE_PG) {
+        uint8_t* page = &c->flash[addr & ~(FLASH_FAST_PAGE - 1)];
+        for(int i = 0; i < FLASH_FAST_PAGE; i++) page[i] &= c->flBuf[i];
+        c->flashPrograms++;
+        Flash_Busy(c, FLASH_PROGRAM_US);
+    } else if(ctlr & FL_PER) {
+        memset(&c->flash[addr & ~(FLASH_SECTOR - 1)], 0xFF, FLASH_SECTOR);
+        c->flashErases++;
+        Flash_Busy(c, FLASH_ERASE_US);
+    } else if(ctlr & FL_MER) {
+        memset(c->flash, 0xFF, CHIP_FLASH_SIZE);
+        c->flashErases++;
+        Flash_Busy(c, FLASH_ERASE_US);
+    }
+}
+
+// Data writes into the Flash array: buffer latch in fast mode, else a
+// standard halfword program
+static bool Flash_Array_Write(Chip_t* c, uint32_t addr, int size, uint32_t value) {
+    if(c->flCtlr & FL_PAGE_PG) {
+        c->flLatchAddr = addr;
+        c->flLatchData = value;
+        return true;
+    }
+    if(!(c->flCtlr & FL_PG) || size != 2) return false;
+    addr &= CHIP_FLASH_SIZE - 1;
+    c->flash[addr] &= (uint8_t)value;
+    c->flash[addr + 1] &= (uint8_t)(value >> 8);
+    c->flashPrograms++;
+    Flash_Busy(c, FLASH_PROGRAM_US / 16);
+    return true;
+}
+
+static bool Flash_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    switch(off) {
+        case 0x00: *value = c->flActlr; return true;
+        case 0x0C:
+            *value = c->flStatr | (c->cpu.cycles < c->flBusyUntil ? FL_SR_BSY : 0);
+            return true;
+        case 0x10: *value = c->flCtlr; return true;
+        case 0x14: *value = c->flAddr; return true;
+        case 0x1C: *value = c->flObr; return true;
+        case 0x20: *value = c->flWpr; return true;
+        case 0x04: case 0x08: case 0x24: *value = 0; return true;
+    }
+    return false;
+}
+
+static bool Flash_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    value &= mask;
+    switch(off) {
+        case 0x00:
+            c->flActlr = (c->flActlr & ~mask) | value;
+            c->cpu.timing.fetchWait = (uint8_t)(c->flActlr & 3);
+            return true;
+        case 0x04:                                      // KEYR
+            if(value == FLASH_KEY1) c->flKeyStep = 1;
+            else {
+                if(c->flKeyStep == 1 && value == FLASH_KEY2) c->flCtlr &= ~FL_LOCK;
+                c->flKeyStep = 0;
+            }
+            return true;
+        case 0x24:                                      // MODEKEYR
+            if(value == FLASH_KEY1) c->flModeKeyStep = 1;
+            else {
+                if(c->flModeKeyStep == 1 && value == FLASH_KEY2) c->flCtlr &= ~FL_FLOCK;
+                c->flModeKeyStep = 0;
+            }
+            return true;
+        case 0x08: return true;                         // Option byte keys
+        case 0x0C: c->flStatr &= ~(value & (FL_SR_EOP | FL_SR_WRPRTERR)); return true;
+        case 0x10: {
+            uint32_t v = (c->flCtlr & ~mask) | value;
+            if(c->flCtlr & FL_LOCK) {                   // Only the lock bits respond
+                c->flCtlr |= v & (FL_LOCK | FL_FLOCK);
+                return true;
+            }
+            if(v & FL_BUF_RST) memset(c->flBuf, 0xFF, sizeof(c->flBuf));
+            if((v & FL_BUF_LOAD) && (v & FL_PAGE_PG)) {
+                uint32_t at = c->flLatchAddr & (FLASH_FAST_PAGE - 4);
+                for(int i = 0; i < 4; i++) c->flBuf[at + i] = (uint8_t)(c->flLatchData >> (8*i));
+            }
+            if(v & FL_STRT) Flash_Start(c, v);
+            c->flCtlr = v & ~(FL_BUF_RST | FL_BUF_LOAD | FL_STRT);
+            return true;
+        }
+        case 0x14: c->flAddr = (c->flAddr & ~mask) | value; return true;
+        case 0x1C: case 0x20: return true;
+    }
+    return false;
+}
+
+// RCC
+static uint32_t* Rcc_Register(Chip_t* c, uint32_t off) {
+    switch(off) {
+        case 0x00: return &c->rccCtlr;
+        case 0x04: return &c->rccCfgr0;
+        case 0x08: return &c->rccIntr;
+        case 0x0C: return &c->rccApb2Rst;
+        case 0x10: return &c->rccApb1Rst;
+        case 0x14: return &c->rccAhbEn;
+        case 0x18: return &c->rccApb2En;
+        case 0x1C: return &c->rccApb1En;
+        case 0x24: return &c->rccRstsckr;
+    }
+    return NULL;
+}
+
+static bool Rcc_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    uint32_t* reg = Rcc_Register(c, off);
+    
+    if(!reg) return false;
+    *reg = (*reg & ~mask) | (value & mask);
+    switch(off) {
+        case 0x00:                                      // Ready flags follow the enables
+            c->rccCtlr &= ~((1u << 1) | (1u << 17) | (1u << 25));
+            c->rccCtlr |= (c->rccCtlr & ((1u << 0) | (1u << 16) | (1u << 24))) << 1;
+            break;
+        case 0x04:
+            c->rccCfgr0 = (c->rccCfgr0 & ~(3u << 2)) | ((c->rccCfgr0 & 3) << 2);
+            Rcc_Update_Clock(c);
+            break;
+        case 0x0C:                                      // Held in reset while set
+            if(c->rccApb2Rst & (1u << 2)) Gpio_Reset(c, 0);
+            if(c->rccApb2Rst & (1u << 4)) Gpio_Reset(c, 1);
+            if(c->rccApb2Rst & (1u << 5)) Gpio_Reset(c, 2);
+            if(c->rccApb2Rst & (1u << 9)) Adc_Reset(c);
+            if(c->rccApb2Rst & (1u << 14)) Uart_Reset(c);
+            break;
+        case 0x10:
+            if(c->rccApb1Rst & 1) Tim_Reset(c);
+            break;
+    }
+    return true;
+}
+
+// PFIC
+static bool Pfic_Read(Chip_t* c, uint32_t off, uint32_t* value) {
+    if(off < 0x08) { *value = c->pficEnabled[off / 4]; return true; }
+    if(off >= 0x20 && off < 0x28) {
+        *value = c->pficPending[(off - 0x20) / 4] | c->pficLines[(off - 0x20) / 4];
+        return true;
+    }
+    if(off >= 0x300 && off < 0x308) { *value = c->pficActive[(off - 0x300) / 4]; return true; }
+    if(off >= 0x400 && off < 0x400 + CHIP_IRQS) {
+        memcpy(value, &c->pficPrio[off - 0x400], 4);
+        return true;
+    }
+    switch(off) {
+        case 0x40: *value = c->pficIthresdr; return true;
+        case 0x4C:                                      // GISR: nesting, active, pending
+            *value = (uint32_t)(c->irqDepth == 2 ? 3 : c->irqDepth)
+                   | (c->irqDepth ? 1u << 8 : 0) | (c->irqCandidate >= 0 ? 1u << 9 : 0);
+            return true;
+        case 0xD10: *value = c->pficSctlr; return true;
+    }
+    return false;
+}
+
+static bool Pfic_Write(Chip_t* c, uint32_t off, uint32_t value, uint32_t mask) {
+    value &= mask;
+    if(off >= 0x100 && off < 0x108) c->pficEnabled[(off - 0x100) / 4] |= value;
+    else if(off >= 0x180 && off < 0x188) c->pficEnabled[(off - 0x180) / 4] &= ~value;
+    else if(off >= 0x200 && off < 0x208) c->pficPending[(off - 0x200) / 4] |= value;
+    else if(off >= 0x280 && off < 0x288) c->pficPending[(off - 0x280) / 4] &= ~value;
+    else if(off >= 0x400 && off < 0x400 + CHIP_IRQS) {
+        for(int i = 0; i < 4; i++)
+            if(mask & (0xFFu << (8*i))) c->pficPrio[off - 0x400 + i] = (uint8_t)(value >> (8*i));
+    } else if(off == 0x40) c->pficIthresdr = value & 0xFF;
+    else if(off == 0x48) {
+        if((value >> 16) == 0xBEEF && (value & (1u << 7))) c->resetPending = true;
+    } else if(off == 0xD10) {
+        c->pficSctlr = (c->pficSctlr & ~mask) | value;
+        if(c->pficSctlr & (1u << 31)) c->resetPending = true;
+    } else if(off == 0x44 || (off >= 0x50 && off < 0x70)) return true;   // KEYR, VTF: not modelled
+    else return false;
+    c->irqDirty = true;
+    return true;
+}
+
+// Interrupt lines of the modelled peripherals, level sensitive
+static void Update_Lines(Chip_t* c) {
+    uint32_t lines[2] = {0, 0};
+    const ChipUsart_t* u = &c->usart;
+    
+    if((c->stkSr & 1) && (c->stkCtlr & STK_STIE)) lines[0] |= 1u << IRQ_SYSTICK;
+    if(c->stkCtlr & STK_SWIE) lines[0] |= 1u << IRQ_SW;
+    for(int n = 0; n < 7; n++)
+        if((c->dmaIntfr >> (4*n)) & (c->dma[n].cfgr & 0xE)) lines[0] |= 1u << (IRQ_DMA1_CH1 + n);
+    if(((c->adcStatr & ADC_EOC) && (c->adcCtlr1 & ADC_EOCIE)) || ((c->adcStatr & ADC_AWD) && (c->adcCtlr1 & ADC_AWDIE)))
+        lines[0] |= 1u << IRQ_ADC;
+    if(((u->statr & US_TXE) && (u->ctlr1 & US_TXEIE)) || ((u->statr & US_TC) && (u->ctlr1 & US_TCIE))
+       || ((u->statr & (US_RXNE | US_ORE)) && (u->ctlr1 & US_RXNEIE))
+       || ((u->statr & US_IDLE) && (u->ctlr1 & US_IDLEIE)) || ((u->statr & US_PE) && (u->ctlr1 & US_PEIE)))
+        lines[1] |= 1u << (IRQ_USART1 - 32);
+    if(c->timIntfr & c->timDier & 0x1F) lines[1] |= 1u << (IRQ_TIM2 - 32);
+    if(lines[0] != c->pficLines[0] || lines[1] != c->pficLines[1]) c->irqDirty = true;
+    c->pficLines[0] = lines[0];
+    c->pficLines[1] = lines[1];
+}
+
+// Highest priority enabled, pending and not yet active interrupt
+static void Update_Candidate(Chip_t* c) {
+    int best = -1;
+    
+    c->irqDirty = false;
+    for(int w = 0; w < 2; w++) {
+        uint32_t req = (c->pficPending[w] | c->pficLines[w]) & c->pficEnabled[w] & ~c->pficActive[w];
+        while(req) {
+            int irq = 32*w + __builtin_ctz(req);
+            req &= req - 1;
+            if(c->pficIthresdr && c->pficPrio[irq] >= c->pficIthresdr) continue;
+            if(best < 0 || c->pficPrio[irq] < c->pficPrio[best]) best = irq;
+        }
+    }
+    c->irqCandidate = best;
+}
+
+// Outside handlers mstatus.MIE gates; inside, a pending interrupt with the
+// preemption bit clear may nest once over an active one with it set
+static bool Irq_Allowed(const Chip_t* c) {
+    if(c->irqDepth == 0) return c->cpu.mstatus & MSTATUS_MIE;
+    if(c->irqDepth >= 2 || !(c->intsyscr & INTSYSCR_INESTEN)) return false;
+    return !(c->pficPrio[c->irqCandidate] & 0x80) && (c->pficPrio[c->irqStack[0]] & 0x80);
+}
+
+static const uint8_t hpeRegs[10] = {1, 5, 6, 7, 10, 11, 12, 13, 14, 15};
+
+static void Take_Interrupt(Chip_t* c, int irq) {
+    Rv32_t* cpu = &c->cpu;
+    ChipHpeFrame_t* f = &c->hpe[c->irqDepth];
+    uint32_t base, vector = 0;
+    
+    f->saved = c->intsyscr & INTSYSCR_HWSTKEN;
+    for(int i = 0; i < 10; i++) f->regs[i] = cpu->x[hpeRegs[i]];
+    f->mepc = cpu->mepc;
+    f->mstatus = cpu->mstatus;
+    f->mcause = cpu->mcause;
+    c->irqEntry[c->irqDepth] = cpu->cycles;
+    c->irqStack[c->irqDepth++] = (uint8_t)irq;
+    c->pficActive[irq / 32] |= 1u << (irq % 32);
+    c->pficPending[irq / 32] &= ~(1u << (irq % 32));
+    c->irqDirty = true;
+    c->interrupts++;
+    
+    Rv32_Trap(cpu, 0x80000000u | irq, 0);
+    base = cpu->mtvec & ~3u;
+    if((cpu->mtvec & 3) == 3) {                         // Table of handler addresses
+        Rv32_Read(cpu, base + 4*irq, 4, &vector);
+        cpu->pc = vector & ~1u;
+        cpu->cycles += cpu->timing.load;
+    } else if(cpu->mtvec & 1) cpu->pc = base + 4*irq;   // Table of jumps
+    c->irqHandler[irq] = cpu->pc;
+}
+
+static void Mret_Hook(void* ctx) {
+    Chip_t* c = ctx;
+    Rv32_t* cpu = &c->cpu;
+    
+    if(!c->irqDepth) return;
+    int irq = c->irqStack[--c->irqDepth];
+    ChipHpeFrame_t* f = &c->hpe[c->irqDepth];
+    uint64_t spent = cpu->cycles - c->irqEntry[c->irqDepth];
+    c->irqCount[irq]++;
+    if(spent > c->irqMaxCycles[irq]) c->irqMaxCycles[irq] = spent;
+    c->pficActive[irq / 32] &= ~(1u << (irq % 32));
+    if(f->saved)
+        for(int i = 0; i < 10; i++) cpu->x[hpeRegs[i]] = f->regs[i];
+    if(c->irqDepth) {                                   // Back into the outer handler
+        cpu->mepc = f->mepc;
+        cpu->mstatus = f->mstatus;
+        cpu->mcause = f->mcause;
+    }
+    c->irqDirty = true;
+}
+
+// QingKe CSRs: INTSYSCR, GINTENR (an alias of mstatus MIE/MPIE), CORECFGR
+static bool Csr_Hook(void* ctx, uint16_t csr, uint32_t* value, bool write) {
+    Chip_t* c = ctx;
+    
+    switch(csr) {
+        case 0x804:
+            if(write) c->intsyscr = *value & 3;
+            else *value = c->intsyscr;
+            return true;
+        case 0x800:
+            if(write) c->cpu.mstatus = (c->cpu.mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | (*value & (MSTATUS_MIE | MSTATUS_MPIE));
+            else *value = c->cpu.mstatus & (MSTATUS_MIE | MSTATUS_MPIE);
+            return true;
+        case 0xBC0:
+            if(write) c->corecfgr = *value;
+            else *value = c->corecfgr;
+            return true;
+    }
+    return false;
+}
+
+// BUS
+static void Note_Unmodelled(Chip_t* c, uint32_t addr) {
+    for(int i = 0; i < c->unmodelledCount; i++)
+        if(c->unmodelled[i] == addr) return;
+    if(c->unmodelledCount < CHIP_UNMODELLED_MAX) c->unmodelled[c->unmodelledCount++] = addr;
+}
+
+static uint32_t* Store_Slot(Chip_t* c, uint32_t addr) {
+    for(int i = 0; i < c->storeCount; i++)
+        if(c->storeAddr[i] == addr) return &c->storeValue[i];
+    if(c->storeCount == CHIP_STORE_SIZE) return NULL;
+    c->storeAddr[c->storeCount] = addr;
+    c->storeValue[c->storeCount] = 0;
+    return &c->storeValue[c->storeCount++];
+}
+
+static bool Reg_Read(Chip_t* c, uint32_t addr, uint32_t* value) {
+    int p;
+    
+    for(p = 0; p < CHIP_PORTS; p++)
+        if(addr - portBase[p] < 0x400) return Gpio_Read(c, p, addr - portBase[p], value);
+    if(addr - TIM2_BASE < 0x400) return Tim_Read(c, addr - TIM2_BASE, value);
+    if(addr - ADC1_BASE < 0x400) return Adc_Read(c, addr - ADC1_BASE, value);
+    if(addr - USART1_BASE < 0x400) return Uart_Read(c, addr - USART1_BASE, value);
+    if(addr - DMA1_BASE < 0x400) return Dma_Read(c, addr - DMA1_BASE, value);
+    if(addr - FLASHC_BASE < 0x400) return Flash_Read(c, addr - FLASHC_BASE, value);
+    if(addr - PFIC_BASE < 0x1000) return Pfic_Read(c, addr - PFIC_BASE, value);
+    if(addr - STK_BASE < 0x100) return Stk_Read(c, addr - STK_BASE, value);
+    if(addr - RCC_BASE < 0x400) {
+        uint32_t* reg = Rcc_Register(c, addr - RCC_BASE);
+        if(reg) *value = *reg;
+        return reg != NULL;
+    }
+    if(addr == AFIO_BASE + 4) { *value = c->afioPcfr1; return true; }
+    if(addr == AFIO_BASE + 8) { *value = c->afioExticr; return true; }
+    return false;
+}
+
+static bool Reg_Write(Chip_t* c, uint32_t addr, uint32_t value, uint32_t mask) {
+    int p;
+    
+    for(p = 0; p < CHIP_PORTS; p++)
+        if(addr - portBase[p] < 0x400) return Gpio_Write(c, p, addr - portBase[p], value, mask);
+    if(addr - TIM2_BASE < 0x400) return Tim_Write(c, addr - TIM2_BASE, value, mask);
+    if(addr - ADC1_BASE < 0x400) return Adc_Write(c, addr - ADC1_BASE, value, mask);
+    if(addr - USART1_BASE < 0x400) return Uart_Write(c, addr - USART1_BASE, value, mask);
+    if(addr - DMA1_BASE < 0x400) return Dma_Write(c, addr - DMA1_BASE, value, mask);
+    if(addr - FLASHC_BASE < 0x400) return Flash_Write(c, addr - FLASHC_BASE, value, mask);
+    if(addr - PFIC_BASE < 0x1000) return Pfic_Write(c, addr - PFIC_BASE, value, mask);
+    if(addr - STK_BASE < 0x100) return Stk_Write(c, addr - STK_BASE, value, mask);
+    if(addr - RCC_BASE < 0x400) return Rcc_Write(c, addr - RCC_BASE, value, mask);
+    if(addr == AFIO_BASE + 4) { c->afioPcfr1 = (c->afioPcfr1 & ~mask) | (value & mask); return true; }
+    if(addr == AFIO_BASE + 8) { c->afioExticr = (c->afioExticr & ~mask) | (value & mask); return true; }
+    return false;
+}
+
+static bool Peripheral_Space(uint32_t addr) {
+    return addr - 0x40000000 < 0x30000 || addr - 0xE0000000 < 0x100000;
+}
+
+// Sub-word accesses read or merge the containing 32-bit register; unknown
+// registers in peripheral space read back what was written
+static bool Periph_Read(Chip_t* c, uint32_t addr, int size, uint32_t* value) {
+    uint32_t reg, shift = 8 * (addr & 3);
+    
+    if(addr - ESIG_BASE < 0x1000) {                     // Erased, but the Flash size
+        *value = (addr == 0x1FFFF7E0 && size == 2) ? CHIP_FLASH_SIZE / 1024 : 0xFFFFFFFF >> (32 - 8*size);
+        return true;
+    }
+    if(!Reg_Read(c, addr & ~3u, &reg)) {
+        if(!Peripheral_Space(addr)) return false;
+        uint32_t* slot = Store_Slot(c, addr & ~3u);
+        Note_Unmodelled(c, addr & ~3u);
+        reg = slot ? *slot : 0;
+    }
+    *value = (reg >> shift) & (0xFFFFFFFF >> (32 - 8*size));
+    return true;
+}
+
+static bool Periph_Write(Chip_t* c, uint32_t addr, int size, uint32_t value) {
+    uint32_t shift = 8 * (addr & 3), mask = (0xFFFFFFFF >> (32 - 8*size)) << shift;
+    
+    if(addr < CHIP_FLASH_SIZE || addr - FLASH_ALIAS < CHIP_FLASH_SIZE)
+        return Flash_Array_Write(c, addr, size, value);
+    if(Reg_Write(c, addr & ~3u, value << shift, mask)) return true;
+    if(!Peripheral_Space(addr)) return false;
+    uint32_t* slot = Store_Slot(c, addr & ~3u);
+    Note_Unmodelled(c, addr & ~3u);
+    if(slot) *slot = (*slot & ~mask) | ((value << shift) & mask);
+    return true;
+}
+
+static void Schedule(Chip_t* c) {
+    const ChipUsart_t* u = &c->usart;
+    uint64_t next = NEVER, t;
+    
+    if((t = Tim_Next_Update(c)) < next) next = t;
+    if((t = Stk_Next_Match(c)) < next) next = t;
+    if(c->adcBusy && c->adcDone < next) next = c->adcDone;
+    if(u->shifting && u->shiftDone < next) next = u->shiftDone;
+    if(u->rxHead != u->rxTail && u->rxNext < next) next = u->rxNext;
+    if(u->idleAt && u->idleAt < next) next = u->idleAt;
+    if(c->flBusyUntil > c->cpu.cycles && c->flBusyUntil < next) next = c->flBusyUntil;
+    c->nextEvent = next;
+}
+
+static void Sync_Peripherals(Chip_t* c) {
+    uint64_t now = c->cpu.cycles;
+    
+    Tim_Sync(c, now);
+    Stk_Sync(c, now);
+    while(c->adcBusy && c->adcDone <= now) Adc_Complete(c);
+    Uart_Sync(c, now);
+    Update_Lines(c);
+    Schedule(c);
+}
+
+static bool Io_Read(void* ctx, uint32_t addr, int size, uint32_t* value) {
+    Chip_t* c = ctx;
+    
+    Sync_Peripherals(c);
+    if(!Periph_Read(c, addr, size, value)) return false;
+    Update_Lines(c);
+    return true;
+}
+
+static bool Io_Write(void* ctx, uint32_t addr, int size, uint32_t value) {
+    Chip_t* c = ctx;
+    
+    Sync_Peripherals(c);
+    if(!Periph_Write(c, addr, size, value)) return false;
+    Update_Lines(c);
+    Schedule(c);
+    return true;
+}
+
+// RESET AND RUN
+void Chip_Reset(Chip_t* c) {
+    Rv32_t* cpu = &c->cpu;
+    uint64_t now = c->hclkHz ? Chip_Time_Ps(c) : 0;
+    
+    if(c->hclkHz) Rcc_Account(c, now);
+    Rv32_Reset(cpu, FLASH_BASE);
+    cpu->timing = rv32QingKeV2A;
+    cpu->timing.fetchWait = 0;
+    cpu->trapStops = true;
+    cpu->ctx = c;
+    cpu->ioRead = Io_Read;
+    cpu->ioWrite = Io_Write;
+    cpu->csrAccess = Csr_Hook;
+    cpu->mretHook = Mret_Hook;
+    
+    c->basePs = now;
+    c->baseCycle = 0;
+    c->hclkHz = 8000000;                                // HSI/3 until SystemInit
+    c->runUntilCycle = Cycle_At(c, c->runUntilPs);
+    c->status = CHIP_RUNNING;
+    c->sleeping = c->resetPending = false;
+    
+    c->rccCtlr = 0x00000083;                            // HSION, HSIRDY, HSITRIM = 16
+    c->rccCfgr0 = 0x00000020;                           // HPRE = /3
+    c->rccIntr = c->rccApb2Rst = c->rccApb1Rst = c->rccApb2En = c->rccApb1En = 0;
+    c->rccAhbEn = 0x14;
+    c->rccRstsckr = 0x0C000000;
+    Rcc_Update_Clock(c);
+    
+    c->flActlr = c->flStatr = c->flAddr = c->flObr = 0;
+    c->flWpr = 0xFFFFFFFF;
+    c->flCtlr = FL_LOCK | FL_FLOCK;
+    c->flKeyStep = c->flModeKeyStep = 0;
+    c->flBusyUntil = 0;
+    memset(c->flBuf, 0xFF, sizeof(c->flBuf));
+    
+    for(int p = 0; p < CHIP_PORTS; p++) Gpio_Reset(c, p);
+    c->afioPcfr1 = c->afioExticr = 0;
+    Adc_Reset(c);
+    memset(c->dma, 0, sizeof(c->dma));
+    c->dmaIntfr = 0;
+    Uart_Reset(c);
+    c->usart.rxHead = c->usart.rxTail = 0;
+    Tim_Reset(c);
+    c->stkCtlr = c->stkSr = c->stkCnt = c->stkCmp = c->stkPhase = 0;
+    c->stkLast = 0;
+    
+    memset(c->pficEnabled, 0, sizeof(c->pficEnabled));
+    memset(c->pficPending, 0, sizeof(c->pficPending));
+    memset(c->pficActive, 0, sizeof(c->pficActive));
+    memset(c->pficLines, 0, sizeof(c->pficLines));
+    memset(c->pficPrio, 0, sizeof(c->pficPrio));
+    c->pficIthresdr = c->pficSctlr = 0;
+    c->pficEnabled[0] = 0x1C;                           // NMI, HardFault, Ecall are always on
+    c->intsyscr = c->corecfgr = 0;
+    c->irqDepth = 0;
+    c->irqCandidate = -1;
+    c->irqDirty = true;
+    
+    c->loopPc = 0xFFFFFFFF;
+    Schedule(c);
+}
+
+bool Chip_Init(Chip_t* c, const Elf_t* elf) {
+    memset(c, 0, sizeof(*c));
+    memset(c->flash, 0xFF, sizeof(c->flash));
+    c->vdd = 5.0;
+    c->analogVolts[8] = 1.2;                            // Internal reference
+    
+    for(int i = 0; i < elf->segmentCount; i++) {
+        const ElfSegment_t* s = &elf->segments[i];
+        uint32_t at = s->paddr - ((s->paddr >= FLASH_ALIAS) ? FLASH_ALIAS : FLASH_BASE);
+        if(!s->fileSize) continue;
+        if(s->paddr - RAM_BASE < CHIP_RAM_SIZE) continue;   // Copied there by the startup code
+        if(at >= CHIP_FLASH_SIZE || at + s->fileSize > CHIP_FLASH_SIZE) {
+            fprintf(stderr, "segment 0x%08X (%u bytes) outside Flash\n", s->paddr, s->fileSize);
+            return false;
+        }
+        memcpy(&c->flash[at], s->data, s->fileSize);
+    }
+    const ElfSymbol_t* hf = Elf_Symbol(elf, "HardFault_Handler");
+    c->hardFaultAddr = hf ? hf->addr : 0xFFFFFFFF;
+    c->stackLow = 0xFFFFFFFF;
+    
+    Rv32_Map(&c->cpu, FLASH_BASE, CHIP_FLASH_SIZE, c->flash, false);
+    Rv32_Map(&c->cpu, FLASH_ALIAS, CHIP_FLASH_SIZE, c->flash, false);
+    Rv32_Map(&c->cpu, RAM_BASE, CHIP_RAM_SIZE, c->ram, true);
+    Chip_Reset(c);
+    c->resets = 0;
+    return true;
+}
+
+// A backward jump that lands on the same pc with the same registers, and
+// no store or interrupt since the last visit, repeats until the next event:
+// register reads only change there (counters change the registers), so
+// polling loops are skipped as well as RAM-only ones
+static void Idle_Loop_Check(Chip_t* c) {
+    Rv32_t* cpu = &c->cpu;
+    
+    if(cpu->pc == c->loopPc && cpu->stores == c->loopStores && c->interrupts == c->loopInterrupts && memcmp(cpu->x, c->loopRegs, sizeof(cpu->x)) == 0) {
+        uint64_t target = c->nextEvent < c->runUntilCycle ? c->nextEvent : c->runUntilCycle;
+        uint64_t period = cpu->cycles - c->loopCycles;
+        if(target > cpu->cycles && period) {
+            uint64_t skip = target - cpu->cycles;
+            cpu->instret += skip / period * (cpu->instret - c->loopInstret);
+            cpu->cycles = target;
+            c->skippedCycles += skip;
+        }
+    }
+    c->loopPc = cpu->pc;
+    c->loopCycles = cpu->cycles;
+    c->loopInstret = cpu->instret;
+    c->loopStores = cpu->stores;
+    c->loopInterrupts = c->interrupts;
+    memcpy(c->loopRegs, cpu->x, sizeof(cpu->x));
+}
+
+ChipStatus_t Chip_Run(Chip_t* c, uint64_t untilPs) {
+    Rv32_t* cpu = &c->cpu;
+    
+    c->runUntilPs = untilPs;
+    c->runUntilCycle = Cycle_At(c, untilPs);
+    Sync_Peripherals(c);
+    while(c->status == CHIP_RUNNING && cpu->cycles < c->runUntilCycle) {
+        if(cpu->cycles >= c->nextEvent) Sync_Peripherals(c);
+        if(c->irqDirty) Update_Candidate(c);
+        if(c->irqCandidate >= 0) {
+            c->sleeping = false;                        // Any pending interrupt wakes wfi
+            if(Irq_Allowed(c)) Take_Interrupt(c, c->irqCandidate);
+        }
+        if(c->sleeping) {
+            uint64_t target = c->nextEvent < c->runUntilCycle ? c->nextEvent : c->runUntilCycle;
+            c->skippedCycles += target - cpu->cycles;
+            cpu->cycles = target;
+            continue;
+        }
+        if(cpu->pc == c->hardFaultAddr) {
+            c->status = CHIP_STOPPED_HARDFAULT;
+            break;
+        }
+        
+        uint32_t pc = cpu->pc;
+        uint64_t cycles = cpu->cycles;
+        if(c->traceHook) c->traceHook(c->ctx, pc);
+        Rv32Stop_t stop = Rv32_Step(cpu);
+        if(c->profile && pc < CHIP_FLASH_SIZE) c->profile[pc >> 1] += cpu->cycles - cycles;
+        if(stop == RV32_WFI) c->sleeping = true;
+        else if(stop != RV32_RUN) {
+            c->status = CHIP_STOPPED_FAULT;
+            c->faultCause = cpu->mcause;
+        } else if(cpu->pc < pc) Idle_Loop_Check(c);
+        if(cpu->x[2] < c->stackLow && cpu->x[2] - RAM_BASE < CHIP_RAM_SIZE) c->stackLow = cpu->x[2];
+        if(c->resetPending) {
+            c->resets++;
+            Chip_Reset(c);
+        }
+    }
+    Sync_Peripherals(c);
+    return c->status;
+}
+
+// EXTERNAL WORLD
+void Chip_Set_Analog(Chip_t* c, int channel, double volts) {
+    if(channel >= 0 && channel < CHIP_ADC_CHANNELS) c->analogVolts[channel] = volts;
+}
+
+void Chip_Set_Input(Chip_t* c, int port, int pin, bool level) {
+    if(port < 0 || port >= CHIP_PORTS || pin < 0 || pin > 7) return;
+    c->gpioExtDriven[port] |= 1 << pin;
+    if(level) c->gpioExtLevel[port] |= 1 << pin;
+    else c->gpioExtLevel[port] &= ~(1 << pin);
+}
+
+void Chip_Release_Input(Chip_t* c, int port, int pin) {
+    if(port < 0 || port >= CHIP_PORTS || pin < 0 || pin > 7) return;
+    c->gpioExtDriven[port] &= ~(1 << pin);
+}
+
+bool Chip_Uart_Receive(Chip_t* c, const uint8_t* data, int len) {
+    ChipUsart_t* u = &c->usart;
+    
+    Sync_Peripherals(c);
+    for(int i = 0; i < len; i++) {
+        uint16_t next = (u->rxTail + 1) % sizeof(u->rxQueue);
+        if(next == u->rxHead) return false;
+        if(u->rxHead == u->rxTail) u->rxNext = c->cpu.cycles + Uart_Frame_Cycles(c);
+        u->rxQueue[u->rxTail] = data[i];
+        u->rxTail = next;
+    }
+    u->idleAt = 0;
+    Schedule(c);
+    return true;
+}
+
+bool Chip_Output_Level(const Chip_t* c, int port, int pin) {
+    if(port < 0 || port >= CHIP_PORTS || pin < 0 || pin > 7) return false;
+    return (c->gpioOutdr[port] >> pin) & 1;
+}
+
+int Chip_Port_Index(char name) {
+    switch(name) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'D': case 'd': return 2;
+    }
+    return -1;
+}
+
+char Chip_Port_Name(int port) {
+    return "ACD"[port];
+}
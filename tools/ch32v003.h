@@ -0,0 +1,183 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CH32V003 CHIP MODEL (HOST)
+ * ============================================================================
+ * The RV32EC core (rv32ec.c) plus register-level models of the peripherals
+ * the firmware touches, enough to boot the shipped ELF from the reset
+ * vector: RCC, FLASH (keys, 64-byte fast page erase/program, latency),
+ * GPIOA/C/D and AFIO, ADC1 (regular sequence, EOC, analog watchdog, DMA,
+ * continuous mode), DMA1, USART1 (TX/RX, DMA, IDLE, TC), TIM2 (up-counting
+ * time base), SysTick and the PFIC with the QingKe vector table, hardware
+ * prologue/epilogue (HPE) and two-level nesting.
+ *
+ * Time is kept in HCLK cycles; every peripheral on this part runs from
+ * HCLK, so a clock change through RCC only changes how many picoseconds
+ * one cycle is. Peripherals are brought up to date lazily: before each
+ * register access and at the next scheduled event (timer update, end of
+ * conversion, UART bit time).
+ *
+ * Not modelled: TIM1, I2C, SPI, EXTI, watchdogs, option-byte programming,
+ * injected ADC channels and external ADC triggers. Their registers read
+ * back what was written and are listed in the unmodelled-access report.
+ * ============================================================================
+ */
+
+#ifndef __CH32V003_H
+#define __CH32V003_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rv32ec.h"
+#include "elf32.h"
+
+#define CHIP_FLASH_SIZE     16384
+#define CHIP_RAM_SIZE       2048
+#define CHIP_ADC_CHANNELS   10          // A0-A7 pins, 8 = Vref, 9 = Vcal
+#define CHIP_PORTS          3           // GPIOA, GPIOC, GPIOD
+#define CHIP_IRQS           64
+#define CHIP_UNMODELLED_MAX 32
+#define CHIP_STORE_SIZE     256         // Registers of unmodelled peripherals
+#define CHIP_CLOCKS         8           // Distinct HCLK rates with residency kept
+
+typedef enum {
+    CHIP_RUNNING,
+    CHIP_STOPPED_FAULT,                 // Exception: see cpu.stopPc and faultCause
+    CHIP_STOPPED_HARDFAULT              // pc reached HardFault_Handler
+} ChipStatus_t;
+
+typedef struct {
+    uint32_t statr, brr, ctlr1, ctlr2, ctlr3, gpr;
+    uint16_t tdr, rdr, shift;
+    bool tdrFull, shifting, statrRead;
+    uint64_t shiftDone;
+    uint8_t rxQueue[512];
+    uint16_t rxHead, rxTail;
+    uint64_t rxNext, idleAt;
+} ChipUsart_t;
+
+typedef struct {
+    uint32_t cfgr, cntr, reload, paddr, maddr, pcur, mcur;
+} ChipDmaChannel_t;
+
+typedef struct {
+    uint32_t regs[10];                  // x1, x5-x7, x10-x15
+    uint32_t mepc, mstatus, mcause;
+    bool saved;
+} ChipHpeFrame_t;
+
+typedef struct {
+    Rv32_t cpu;
+    uint8_t flash[CHIP_FLASH_SIZE], ram[CHIP_RAM_SIZE];
+    uint64_t basePs, baseCycle;         // Time at the last clock change
+    uint64_t nextEvent;                 // Cycle of the next peripheral event
+    uint64_t runUntilPs, runUntilCycle;
+    uint32_t hclkHz;
+    uint32_t clockHz[CHIP_CLOCKS];      // Residency per HCLK, closed segments only
+    uint64_t clockPs[CHIP_CLOCKS];      // (Chip_Clock_Ps() adds the running one)
+    int clockCount;
+    ChipStatus_t status;
+    bool sleeping, resetPending;
+    uint32_t faultCause;
+    uint32_t hardFaultAddr;             // 0 = no HardFault_Handler symbol
+    uint32_t resets;                    // Software resets through PFIC->CFGR
+    
+    // RCC
+    uint32_t rccCtlr, rccCfgr0, rccIntr, rccApb2Rst, rccApb1Rst;
+    uint32_t rccAhbEn, rccApb2En, rccApb1En, rccRstsckr;
+    
+    // FLASH controller
+    uint32_t flActlr, flStatr, flCtlr, flAddr, flObr, flWpr;
+    int flKeyStep, flModeKeyStep;
+    uint8_t flBuf[64];
+    uint32_t flLatchAddr, flLatchData;
+    uint64_t flBusyUntil;
+    uint32_t flashErases, flashPrograms;
+    
+    // GPIO: pin levels as driven from outside (scripts), per port
+    uint32_t gpioCfglr[CHIP_PORTS], gpioOutdr[CHIP_PORTS];
+    uint8_t gpioExtDriven[CHIP_PORTS], gpioExtLevel[CHIP_PORTS];
+    uint8_t gpioLogged[CHIP_PORTS], gpioLoggedMask[CHIP_PORTS];    // Last reported outputs
+    uint32_t afioPcfr1, afioExticr;
+    
+    // ADC1
+    uint32_t adcStatr, adcCtlr1, adcCtlr2, adcSamptr1, adcSamptr2, adcIofr[4];
+    uint32_t adcWdhtr, adcWdltr, adcRsqr[3], adcIsqr, adcIdatar[4], adcRdatar, adcDlyr;
+    bool adcBusy;
+    int adcSeqIndex;
+    uint64_t adcDone;
+    double analogVolts[CHIP_ADC_CHANNELS], vdd;
+    uint64_t adcConversions;
+    
+    // DMA1
+    ChipDmaChannel_t dma[7];
+    uint32_t dmaIntfr;
+    
+    ChipUsart_t usart;
+    
+    // TIM2 (up-counting time base and flags only)
+    uint32_t timCtlr1, timCtlr2, timSmcfgr, timDier, timIntfr, timChctlr[2], timCcer;
+    uint32_t timCnt, timPsc, timPscActive, timArr, timCcr[4], timPscCnt;
+    uint64_t timLast;
+    
+    // SysTick
+    uint32_t stkCtlr, stkSr, stkCnt, stkCmp, stkPhase;
+    uint64_t stkLast;
+    
+    // PFIC and QingKe interrupt system
+    uint32_t pficEnabled[2], pficPending[2], pficActive[2], pficIthresdr, pficSctlr;
+    uint32_t pficLines[2];              // Peripheral requests, level sensitive
+    int irqCandidate;                   // Best pending interrupt or -1
+    bool irqDirty;
+    uint8_t pficPrio[CHIP_IRQS];
+    uint32_t intsyscr, corecfgr;
+    int irqDepth;
+    uint8_t irqStack[2];
+    ChipHpeFrame_t hpe[2];
+    uint64_t interrupts;
+    
+    // Handler timing: cycles from entry to mret, nested handlers included
+    uint64_t irqEntry[2];
+    uint64_t irqCount[CHIP_IRQS], irqMaxCycles[CHIP_IRQS];
+    uint32_t irqHandler[CHIP_IRQS];     // Vector taken for each irq
+    uint32_t stackLow;                  // Lowest sp seen inside RAM
+    
+    // Registers of unmodelled peripherals, and the addresses that hit them
+    uint32_t storeAddr[CHIP_STORE_SIZE], storeValue[CHIP_STORE_SIZE];
+    int storeCount;
+    uint32_t unmodelled[CHIP_UNMODELLED_MAX];
+    int unmodelledCount;
+    
+    // Idle-loop skipping: a backward branch seen twice with the same
+    // registers and no store or interrupt in between spins until the next
+    // event
+    uint32_t loopPc, loopRegs[16];
+    uint64_t loopCycles, loopInstret, loopStores, loopInterrupts;
+    uint64_t skippedCycles;
+    
+    // Hooks and optional per-halfword cycle profile of Flash
+    void* ctx;
+    void (*gpioHook)(void* ctx, int port, int pin, bool level, uint64_t timePs);
+    void (*uartHook)(void* ctx, uint8_t byte, uint64_t timePs);
+    void (*traceHook)(void* ctx, uint32_t pc);         // Before each instruction
+    uint64_t* profile;                  // CHIP_FLASH_SIZE/2 entries or NULL
+} Chip_t;
+
+bool Chip_Init(Chip_t* chip, const Elf_t* elf);
+void Chip_Reset(Chip_t* chip);
+ChipStatus_t Chip_Run(Chip_t* chip, uint64_t untilPs);
+uint64_t Chip_Time_Ps(const Chip_t* chip);
+uint64_t Chip_Clock_Ps(const Chip_t* chip, int i);     // Time at clockHz[i]
+
+// External world
+void Chip_Set_Analog(Chip_t* chip, int channel, double volts);
+void Chip_Set_Input(Chip_t* chip, int port, int pin, bool level);
+void Chip_Release_Input(Chip_t* chip, int port, int pin);
+bool Chip_Uart_Receive(Chip_t* chip, const uint8_t* data, int len);
+bool Chip_Output_Level(const Chip_t* chip, int port, int pin);
+
+// Port names: 'A', 'C', 'D' <-> 0..2
+int Chip_Port_Index(char name);
+char Chip_Port_Name(int port);
+
+#endif /* __CH32V003_H */
@@ -0,0 +1,587 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CH32V003 SIMULATOR (HOST)
+ * ============================================================================
+ * Runs the shipped firmware ELF from the reset vector on the chip model
+ * (ch32v003.c): startup code, SystemInit, the HAL and the control loop
+ * exactly as flashed. The ADC pins follow a script, GPIO outputs are logged
+ * with their time, and the log can be compared against a golden one, so a
+ * scenario becomes a regression test of the real binary. Idle loops and wfi
+ * are skipped to the next peripheral event; a minute of mains usually
+ * simulates in a few seconds.
+ *
+ * Script: one event per line, '#' starts a comment, times in ms:
+ *   <t_ms> A<n> <volts> [ramp_ms]   ADC channel n (A0 = PA2 is the sense
+ *                                   input); "512c" gives counts instead
+ *   <t_ms> P<port><pin> 0|1|z       drive an input pin, z releases it
+ *   <t_ms> RX "text"                bytes into USART1 RX, \xHH escapes
+ *
+ * Build:
+ *   gcc -O2 -Wall -o ch32v_sim ch32v_sim.c ch32v003.c rv32ec.c elf32.c -lm
+ *
+ * Usage:
+ *   ./ch32v_sim [options] firmware.elf
+ *     -T SEC    simulated time (default 10)
+ *     -s FILE   input script
+ *     -A N=V    ADC channel N at V volts from the start; repeatable
+ *     -V VOLTS  VDD, the ADC reference (default 5.0)
+ *     -o FILE   GPIO log, "<ms> P<port><pin> <level>" per output change
+ *               (default stdout unless -g is given)
+ *     -g FILE   compare the GPIO log with a golden one; exit status 1 on
+ *               the first difference, which is printed
+ *     -u FILE   USART1 TX bytes
+ *     -F FILE   Flash contents outside the ELF (settings, parameters) are
+ *               loaded from and saved back to FILE, as across power cycles
+ *     -p [N]    cycle profile: the N (default 15) hottest functions
+ *     -f FUNC   cycles per call of FUNC, callees and interrupts included:
+ *               Stabilizer_Run gives the cost of one control iteration
+ *     -x N      instruction trace of the first N instructions on stderr
+ *     -B FILE   budget file: "wcet <handler> <cycles>" lines bound the worst
+ *               entry-to-mret time of each interrupt handler, "stack
+ *               <bytes>" the deepest sp seen below the top of RAM; exit
+ *               status 1 when one is exceeded
+ *     -q        no summary on stderr
+ *
+ * Exit status 1 also when the firmware takes an exception or reaches
+ * HardFault_Handler; the pc and cause are printed.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "ch32v003.h"
+
+#define MAX_EVENTS          4096
+#define RAMP_STEP_PS        100000000ull    // 100 us between ramp updates
+#define PS_PER_MS           1000000000ull
+#define RAM_TOP             (0x20000000 + CHIP_RAM_SIZE)
+
+typedef enum { EV_ANALOG, EV_PIN, EV_RX } EventKind_t;
+
+typedef struct {
+    uint64_t timePs, rampPs;
+    EventKind_t kind;
+    int channel, port, pin;             // Channel for EV_ANALOG, port/pin for EV_PIN
+    double value;                       // Volts, or counts when isCounts
+    bool isCounts, release;
+    char text[128];
+    int textLen;
+} Event_t;
+
+typedef struct {
+    bool active;
+    uint64_t startPs, endPs;
+    double from, to;
+} Ramp_t;
+
+static Elf_t elf;
+static Chip_t chip;
+static Event_t events[MAX_EVENTS];
+static int eventCount;
+static Ramp_t ramps[CHIP_ADC_CHANNELS];
+static FILE* gpioLog;
+static FILE* uartOut;
+static uint64_t traceLeft;
+
+// Calls of one function (-f), entry to the return address with the same sp
+typedef struct {
+    uint32_t addr, returnPc, sp;
+    bool inside;
+    uint64_t startCycles, startSkipped;
+    uint64_t calls, sum, min, max;
+    uint64_t activeSum, activeMin, activeMax;  // Without skipped polling and idle
+} CallTiming_t;
+
+static CallTiming_t timing;
+
+// SCRIPT
+static int Parse_Text(const char* s, char* out, int max) {
+    int n = 0;
+    
+    if(*s++ != '"') return -1;
+    while(*s && *s != '"' && n < max) {
+        if(s[0] == '\\' && s[1] == 'x' && isxdigit((unsigned char)s[2]) && isxdigit((unsigned char)s[3])) {
+            char hex[3] = {s[2], s[3], 0};
+            out[n++] = (char)strtol(hex, NULL, 16);
+            s += 4;
+        } else if(s[0] == '\\' && s[1] == 'n') out[n++] = '\n', s += 2;
+        else if(s[0] == '\\' && s[1] == 'r') out[n++] = '\r', s += 2;
+        else if(s[0] == '\\' && s[1]) out[n++] = s[1], s += 2;
+        else out[n++] = *s++;
+    }
+    return (*s == '"') ? n : -1;
+}
+
+static int Compare_Events(const void* a, const void* b) {
+    const Event_t* x = a;
+    const Event_t* y = b;
+    
+    if(x->timePs != y->timePs) return x->timePs < y->timePs ? -1 : 1;
+    return x < y ? -1 : (x > y);
+}
+
+static bool Load_Script(const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[256];
+    int lineNo = 0;
+    
+    if(!f) {
+        perror(path);
+        return false;
+    }
+    while(fgets(line, sizeof(line), f)) {
+        char name[16], value[160];
+        double t, ramp = 0;
+        lineNo++;
+        char* hash = strchr(line, '#');
+        if(hash && !strchr(line, '"')) *hash = 0;
+        int n = sscanf(line, "%lf %15s %159[^\n]", &t, name, value);
+        if(n <= 0) continue;
+        if(n != 3 || eventCount == MAX_EVENTS) {
+            fprintf(stderr, "%s:%d: expected \"<t_ms> <name> <value> [ramp_ms]\"\n", path, lineNo);
+            fclose(f);
+            return false;
+        }
+        
+        Event_t* e = &events[eventCount];
+        memset(e, 0, sizeof(*e));
+        e->timePs = (uint64_t)(t * PS_PER_MS);
+        bool ok = false;
+        if(toupper((unsigned char)name[0]) == 'A' && isdigit((unsigned char)name[1])) {
+            char token[32], *end;
+            e->kind = EV_ANALOG;
+            e->channel = atoi(name + 1);
+            sscanf(value, "%31s %lf", token, &ramp);
+            e->value = strtod(token, &end);
+            e->isCounts = (*end == 'c');
+            ok = end != token && (*end == 0 || strcmp(end, "c") == 0) && e->channel < CHIP_ADC_CHANNELS && ramp >= 0;
+            e->rampPs = (uint64_t)(ramp * PS_PER_MS);
+        } else if(toupper((unsigned char)name[0]) == 'P' && strlen(name) == 3) {
+            e->kind = EV_PIN;
+            e->port = Chip_Port_Index(name[1]);
+            e->pin = name[2] - '0';
+            e->release = (value[0] == 'z' || value[0] == 'Z');
+            e->value = atof(value);
+            ok = e->port >= 0 && e->pin >= 0 && e->pin <= 7;
+        } else if(strcmp(name, "RX") == 0) {
+            e->kind = EV_RX;
+            e->textLen = Parse_Text(value, e->text, sizeof(e->text));
+            ok = e->textLen >= 0;
+        }
+        if(!ok) {
+            fprintf(stderr, "%s:%d: bad event \"%s %s\"\n", path, lineNo, name, value);
+            fclose(f);
+            return false;
+        }
+        eventCount++;
+    }
+    fclose(f);
+    qsort(events, eventCount, sizeof(Event_t), Compare_Events);
+    return true;
+}
+
+static void Apply_Event(const Event_t* e, uint64_t now) {
+    switch(e->kind) {
+        case EV_ANALOG: {
+            double volts = e->isCounts ? e->value * chip.vdd / 1023.0 : e->value;
+            Ramp_t* r = &ramps[e->channel];
+            if(e->rampPs) *r = (Ramp_t){true, now, now + e->rampPs, chip.analogVolts[e->channel], volts};
+            else {
+                r->active = false;
+                Chip_Set_Analog(&chip, e->channel, volts);
+            }
+            break;
+        }
+        case EV_PIN:
+            if(e->release) Chip_Release_Input(&chip, e->port, e->pin);
+            else Chip_Set_Input(&chip, e->port, e->pin, e->value != 0);
+            break;
+        case EV_RX:
+            if(!Chip_Uart_Receive(&chip, (const uint8_t*)e->text, e->textLen))
+                fprintf(stderr, "warning: USART1 RX queue full at %.3f ms\n", (double)now / PS_PER_MS);
+            break;
+    }
+}
+
+// Ramps move in RAMP_STEP_PS steps; returns whether one is still running
+static bool Update_Ramps(uint64_t now) {
+    bool running = false;
+    
+    for(int ch = 0; ch < CHIP_ADC_CHANNELS; ch++) {
+        Ramp_t* r = &ramps[ch];
+        if(!r->active) continue;
+        if(now >= r->endPs) {
+            r->active = false;
+            Chip_Set_Analog(&chip, ch, r->to);
+            continue;
+        }
+        double k = (double)(now - r->startPs) / (double)(r->endPs - r->startPs);
+        Chip_Set_Analog(&chip, ch, r->from + k * (r->to - r->from));
+        running = true;
+    }
+    return running;
+}
+
+// HOOKS
+static void Gpio_Changed(void* ctx, int port, int pin, bool level, uint64_t timePs) {
+    (void)ctx;
+    if(gpioLog) fprintf(gpioLog, "%.3f P%c%d %d\n", (double)timePs / PS_PER_MS, Chip_Port_Name(port), pin, level);
+}
+
+static void Uart_Sent(void* ctx, uint8_t byte, uint64_t timePs) {
+    (void)ctx;
+    (void)timePs;
+    if(uartOut) fputc(byte, uartOut);
+}
+
+static void Trace(void* ctx, uint32_t pc) {
+    const ElfSymbol_t* f = Elf_Function_At(&elf, pc);
+    
+    (void)ctx;
+    if(f) fprintf(stderr, "%12llu %08X %s+0x%X\n", (unsigned long long)chip.cpu.cycles, pc, f->name, pc - f->addr);
+    else fprintf(stderr, "%12llu %08X\n", (unsigned long long)chip.cpu.cycles, pc);
+    traceLeft--;
+}
+
+static void Time_Call(uint32_t pc) {
+    CallTiming_t* t = &timing;
+    
+    if(t->inside) {
+        if(pc != t->returnPc || chip.cpu.x[2] != t->sp) return;
+        uint64_t cycles = chip.cpu.cycles - t->startCycles;
+        uint64_t active = cycles - (chip.skippedCycles - t->startSkipped);
+        if(!t->calls || cycles < t->min) t->min = cycles;
+        if(!t->calls || active < t->activeMin) t->activeMin = active;
+        if(cycles > t->max) t->max = cycles;
+        if(active > t->activeMax) t->activeMax = active;
+        t->sum += cycles;
+        t->activeSum += active;
+        t->calls++;
+        t->inside = false;
+    } else if(pc == t->addr) {
+        t->inside = true;
+        t->returnPc = chip.cpu.x[1];
+        t->sp = chip.cpu.x[2];
+        t->startCycles = chip.cpu.cycles;
+        t->startSkipped = chip.skippedCycles;
+    }
+}
+
+static void Step_Hook(void* ctx, uint32_t pc) {
+    if(traceLeft) Trace(ctx, pc);
+    if(timing.addr) Time_Call(pc);
+    else if(!traceLeft) chip.traceHook = NULL;
+}
+
+// FLASH IMAGE - bytes no ELF segment covers come from the file
+static bool Flash_Load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    uint8_t image[CHIP_FLASH_SIZE];
+    bool covered[CHIP_FLASH_SIZE] = {false};
+    
+    if(!f) return true;                 // First run: Flash as programmed
+    size_t n = fread(image, 1, sizeof(image), f);
+    fclose(f);
+    if(n != sizeof(image)) {
+        fprintf(stderr, "%s: not a %d byte Flash image\n", path, CHIP_FLASH_SIZE);
+        return false;
+    }
+    for(int i = 0; i < elf.segmentCount; i++) {
+        const ElfSegment_t* s = &elf.segments[i];
+        uint32_t at = s->paddr & (CHIP_FLASH_SIZE - 1);
+        if(s->paddr >= 0x20000000) continue;
+        for(uint32_t k = 0; k < s->fileSize && at + k < CHIP_FLASH_SIZE; k++) covered[at + k] = true;
+    }
+    for(int i = 0; i < CHIP_FLASH_SIZE; i++)
+        if(!covered[i]) chip.flash[i] = image[i];
+    return true;
+}
+
+static bool Flash_Save(const char* path) {
+    FILE* f = fopen(path, "wb");
+    
+    if(!f || fwrite(chip.flash, 1, CHIP_FLASH_SIZE, f) != CHIP_FLASH_SIZE) {
+        perror(path);
+        if(f) fclose(f);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+// REPORTS
+typedef struct {
+    const ElfSymbol_t* fn;
+    uint64_t cycles;
+} ProfileEntry_t;
+
+static int Compare_Profile(const void* a, const void* b) {
+    const ProfileEntry_t* x = a;
+    const ProfileEntry_t* y = b;
+    return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+}
+
+static void Print_Profile(const uint64_t* profile, int top) {
+    ProfileEntry_t* e = calloc(elf.symbolCount + 1, sizeof(ProfileEntry_t));
+    uint64_t total = chip.cpu.cycles ? chip.cpu.cycles : 1;
+    int n = 0;
+    
+    for(uint32_t a = 0; a < CHIP_FLASH_SIZE; a += 2) {
+        if(!profile[a >> 1]) continue;
+        const ElfSymbol_t* f = Elf_Function_At(&elf, a);
+        int i;
+        for(i = 0; i < n && e[i].fn != f; i++);
+        if(i == n) e[n++] = (ProfileEntry_t){f, 0};
+        e[i].cycles += profile[a >> 1];
+    }
+    qsort(e, n, sizeof(ProfileEntry_t), Compare_Profile);
+    fprintf(stderr, "%-32s %14s %7s\n", "function", "cycles", "share");
+    for(int i = 0; i < n && i < top; i++)
+        fprintf(stderr, "%-32s %14llu %6.2f%%\n", e[i].fn ? e[i].fn->name : "?",
+                (unsigned long long)e[i].cycles, 100.0 * e[i].cycles / total);
+    fprintf(stderr, "%-32s %14llu %6.2f%%\n", "(idle, skipped)",
+            (unsigned long long)chip.skippedCycles, 100.0 * chip.skippedCycles / total);
+    free(e);
+}
+
+static void Print_Stop(void) {
+    uint32_t pc = chip.status == CHIP_STOPPED_HARDFAULT ? chip.cpu.mepc : chip.cpu.stopPc;
+    const ElfSymbol_t* f = Elf_Function_At(&elf, pc);
+    
+    if(chip.status == CHIP_STOPPED_HARDFAULT)
+        fprintf(stderr, "stopped: HardFault_Handler reached, mcause %u, mepc 0x%08X (%s+0x%X)\n",
+                chip.cpu.mcause, pc, f ? f->name : "?", f ? pc - f->addr : pc);
+    else
+        fprintf(stderr, "stopped: exception cause %u at 0x%08X (%s+0x%X), mtval 0x%08X\n",
+                chip.faultCause, pc, f ? f->name : "?", f ? pc - f->addr : pc, chip.cpu.mtval);
+}
+
+static int Compare(const char* logPath, const char* goldenPath) {
+    FILE* a = fopen(logPath, "r");
+    FILE* b = fopen(goldenPath, "r");
+    char la[128], lb[128];
+    int line = 0;
+    
+    if(!a || !b) {
+        perror(a ? goldenPath : logPath);
+        if(a) fclose(a);
+        if(b) fclose(b);
+        return 2;
+    }
+    for(;;) {
+        char* ra = fgets(la, sizeof(la), a);
+        char* rb = fgets(lb, sizeof(lb), b);
+        line++;
+        if(!ra && !rb) break;
+        if(!ra || !rb || strcmp(la, lb) != 0) {
+            printf("GPIO log differs at line %d\n  run:    %s  golden: %s", line,
+                   ra ? la : "(end)\n", rb ? lb : "(end)\n");
+            fclose(a);
+            fclose(b);
+            return 1;
+        }
+    }
+    fclose(a);
+    fclose(b);
+    printf("GPIO log matches %s (%d lines)\n", goldenPath, line - 1);
+    return 0;
+}
+
+// Handler times and the measured stack against a budget file; the worst
+// case is what this run's script reached, see stack_report for the static
+// stack bound
+static bool Check_Budgets(const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[256], name[64];
+    bool ok = true;
+    unsigned long long budget;
+    
+    if(!f) {
+        perror(path);
+        return false;
+    }
+    while(fgets(line, sizeof(line), f)) {
+        if(sscanf(line, " stack %llu", &budget) == 1) {
+            uint32_t used = chip.stackLow == 0xFFFFFFFF ? 0 : RAM_TOP - chip.stackLow;
+            printf("%-28s %9llu %9u%s\n", "stack (measured)", budget, used, used > budget ? "  OVER BUDGET" : "");
+            ok = ok && used <= budget;
+        }
+        if(sscanf(line, " wcet %63s %llu", name, &budget) != 2) continue;
+        const ElfSymbol_t* s = Elf_Symbol(&elf, name);
+        bool found = false;
+        for(int irq = 0; s && irq < CHIP_IRQS; irq++) {
+            if(!chip.irqCount[irq] || Elf_Function_At(&elf, chip.irqHandler[irq]) != s) continue;
+            bool over = chip.irqMaxCycles[irq] > budget;
+            printf("%-28s %9llu %9llu%s\n", name, budget, (unsigned long long)chip.irqMaxCycles[irq],
+                   over ? "  OVER BUDGET" : "");
+            ok = ok && !over;
+            found = true;
+        }
+        if(!found) printf("%-28s %9llu %9s\n", name, budget, "-");
+    }
+    fclose(f);
+    return ok;
+}
+
+static void Usage(const char* name) {
+    fprintf(stderr, "usage: %s [-T sec] [-s script] [-A ch=volts] [-V vdd] [-o gpio.log] [-g golden.log]\n"
+            "       [-u uart.bin] [-F flash.bin] [-p [n]] [-f func] [-x n] [-B budgets.txt] [-q] firmware.elf\n", name);
+}
+
+int main(int argc, char** argv) {
+    const char* input = NULL;
+    const char* scriptPath = NULL;
+    const char* outPath = NULL;
+    const char* goldenPath = NULL;
+    const char* uartPath = NULL;
+    const char* flashPath = NULL;
+    const char* budgetPath = NULL;
+    const char* timedName = NULL;
+    const char* analog[CHIP_ADC_CHANNELS];
+    int analogCount = 0, profileTop = 0;
+    double seconds = 10.0, vdd = 5.0;
+    bool quiet = false;
+    char tmpPath[] = "/tmp/ch32v_sim_XXXXXX";
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-T") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) scriptPath = argv[++i];
+        else if(strcmp(argv[i], "-A") == 0 && i + 1 < argc && analogCount < CHIP_ADC_CHANNELS) analog[analogCount++] = argv[++i];
+        else if(strcmp(argv[i], "-V") == 0 && i + 1 < argc) vdd = atof(argv[++i]);
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc) goldenPath = argv[++i];
+        else if(strcmp(argv[i], "-u") == 0 && i + 1 < argc) uartPath = argv[++i];
+        else if(strcmp(argv[i], "-F") == 0 && i + 1 < argc) flashPath = argv[++i];
+        else if(strcmp(argv[i], "-p") == 0) profileTop = (i + 1 < argc && isdigit((unsigned char)argv[i+1][0])) ? atoi(argv[++i]) : 15;
+        else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc) timedName = argv[++i];
+        else if(strcmp(argv[i], "-x") == 0 && i + 1 < argc) traceLeft = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-B") == 0 && i + 1 < argc) budgetPath = argv[++i];
+        else if(strcmp(argv[i], "-q") == 0) quiet = true;
+        else if(!input && argv[i][0] != '-') input = argv[i];
+        else input = NULL, i = argc;
+    }
+    if(!input || seconds <= 0 || vdd <= 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+    if(!Elf_Load(input, &elf) || !Chip_Init(&chip, &elf)) return 2;
+    if(flashPath && !Flash_Load(flashPath)) return 2;
+    if(scriptPath && !Load_Script(scriptPath)) return 2;
+    chip.vdd = vdd;
+    for(int i = 0; i < analogCount; i++) {
+        int ch;
+        double v;
+        if(sscanf(analog[i], "%d=%lf", &ch, &v) != 2 || ch < 0 || ch >= CHIP_ADC_CHANNELS) {
+            Usage(argv[0]);
+            return 2;
+        }
+        Chip_Set_Analog(&chip, ch, v);
+    }
+    
+    gpioLog = stdout;
+    if(goldenPath && !outPath) {
+        int fd = mkstemp(tmpPath);
+        gpioLog = fd >= 0 ? fdopen(fd, "w") : NULL;
+        outPath = tmpPath;
+    } else if(outPath) {
+        gpioLog = fopen(outPath, "w");
+    }
+    if(!gpioLog) { perror(outPath); return 2; }
+    if(uartPath && !(uartOut = fopen(uartPath, "wb"))) { perror(uartPath); return 2; }
+    
+    uint64_t* profile = profileTop ? calloc(CHIP_FLASH_SIZE / 2, sizeof(uint64_t)) : NULL;
+    chip.gpioHook = Gpio_Changed;
+    chip.uartHook = Uart_Sent;
+    chip.profile = profile;
+    if(timedName) {
+        const ElfSymbol_t* f = Elf_Symbol(&elf, timedName);
+        if(!f) { fprintf(stderr, "%s: no symbol %s\n", input, timedName); return 2; }
+        timing.addr = f->addr & ~1u;
+    }
+    if(traceLeft || timing.addr) chip.traceHook = Step_Hook;
+    Chip_Reset(&chip);                  // Report the pins with the hooks in place
+    
+    // Run to each script event, in ramp steps while a ramp is moving
+    struct timespec w0, w1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    uint64_t endPs = (uint64_t)(seconds * 1e12), now = 0;
+    int next = 0;
+    while(now < endPs && chip.status == CHIP_RUNNING) {
+        while(next < eventCount && events[next].timePs <= now) Apply_Event(&events[next++], now);
+        bool ramping = Update_Ramps(now);
+        uint64_t until = endPs;
+        if(next < eventCount && events[next].timePs < until) until = events[next].timePs;
+        if(ramping && now + RAMP_STEP_PS < until) until = now + RAMP_STEP_PS;
+        Chip_Run(&chip, until);
+        now = until;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    double wall = (w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9;
+    double simulated = (double)Chip_Time_Ps(&chip) / 1e12;
+    
+    if(gpioLog != stdout) fclose(gpioLog);
+    if(uartOut) fclose(uartOut);
+    if(flashPath && !Flash_Save(flashPath)) return 2;
+    
+    if(!quiet) {
+        fprintf(stderr, "%s: %.3f s simulated in %.2f s (%.1fx real time), %.1f M instructions, "
+                "HCLK %.0f MHz, %.1f %% idle skipped\n", input, simulated, wall,
+                wall > 0 ? simulated / wall : 0.0, chip.cpu.instret / 1e6, chip.hclkHz / 1e6,
+                chip.cpu.cycles ? 100.0 * chip.skippedCycles / chip.cpu.cycles : 0.0);
+        fprintf(stderr, "  %llu interrupts, %llu ADC conversions, %u Flash erases, %u programs, %u resets\n",
+                (unsigned long long)chip.interrupts, (unsigned long long)chip.adcConversions,
+                chip.flashErases, chip.flashPrograms, chip.resets);
+        if(chip.clockCount > 1 && simulated > 0) {
+            // Mean HCLK: dynamic current scales with it, at a given supply
+            double mean = 0;
+            fprintf(stderr, "  HCLK residency:");
+            for(int i = 0; i < chip.clockCount; i++) {
+                double share = Chip_Clock_Ps(&chip, i) / 1e12 / simulated;
+                mean += share * chip.clockHz[i];
+                fprintf(stderr, " %.0f MHz %.1f %%,", chip.clockHz[i] / 1e6, 100.0 * share);
+            }
+            fprintf(stderr, " mean %.1f MHz\n", mean / 1e6);
+        }
+        for(int irq = 0; irq < CHIP_IRQS; irq++) {
+            if(!chip.irqCount[irq]) continue;
+            const ElfSymbol_t* h = Elf_Function_At(&elf, chip.irqHandler[irq]);
+            fprintf(stderr, "  irq %2d %-24s %10llu calls, worst %llu cycles (%.1f us)\n", irq, h ? h->name : "?",
+                    (unsigned long long)chip.irqCount[irq], (unsigned long long)chip.irqMaxCycles[irq],
+                    chip.irqMaxCycles[irq] * 1e6 / chip.hclkHz);
+        }
+        if(chip.stackLow != 0xFFFFFFFF)
+            fprintf(stderr, "  lowest sp 0x%08X\n", chip.stackLow);
+        for(int i = 0; i < chip.unmodelledCount; i++)
+            fprintf(stderr, "  unmodelled register 0x%08X\n", chip.unmodelled[i]);
+        if(timing.calls) {
+            const CallTiming_t* t = &timing;
+            fprintf(stderr, "  %s: %llu calls, cycles min/mean/max %llu/%llu/%llu, "
+                    "without skipped polling %llu/%llu/%llu\n", timedName, (unsigned long long)t->calls,
+                    (unsigned long long)t->min, (unsigned long long)(t->sum / t->calls), (unsigned long long)t->max,
+                    (unsigned long long)t->activeMin, (unsigned long long)(t->activeSum / t->calls),
+                    (unsigned long long)t->activeMax);
+        } else if(timedName) {
+            fprintf(stderr, "  %s: never returned\n", timedName);
+        }
+        if(profile) Print_Profile(profile, profileTop);
+    }
+    int status = 0;
+    if(chip.status != CHIP_RUNNING) {
+        Print_Stop();
+        status = 1;
+    }
+    if(budgetPath && !Check_Budgets(budgetPath)) status = 1;
+    if(goldenPath) {
+        int cmp = Compare(outPath, goldenPath);
+        if(outPath == tmpPath) remove(tmpPath);
+        if(cmp) status = cmp;
+    }
+    free(profile);
+    Elf_Free(&elf);
+    return status;
+}
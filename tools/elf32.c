@@ -0,0 +1,131 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - ELF32 LOADER (HOST)
+ * ============================================================================
+ * See elf32.h. Only what the simulators need: no relocations, no dynamic
+ * sections, no big-endian files.
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf32.h"
+
+#define EM_RISCV        243
+#define PT_LOAD         1
+#define SHT_SYMTAB      2
+#define STT_NOTYPE      0
+#define STT_OBJECT      1
+#define STT_FUNC        2
+
+static uint32_t Get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static uint32_t Get32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+static int Compare_Symbols(const void* a, const void* b) {
+    const ElfSymbol_t* x = a;
+    const ElfSymbol_t* y = b;
+    if(x->addr != y->addr) return x->addr < y->addr ? -1 : 1;
+    return (int)y->size - (int)x->size;
+}
+
+static bool Fail(Elf_t* elf, const char* path, const char* why) {
+    fprintf(stderr, "%s: %s\n", path, why);
+    Elf_Free(elf);
+    return false;
+}
+
+bool Elf_Load(const char* path, Elf_t* elf) {
+    FILE* f = fopen(path, "rb");
+    long len;
+    
+    memset(elf, 0, sizeof(*elf));
+    if(!f) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    elf->image = malloc(len > 0 ? len : 1);
+    if(len < 52 || fread(elf->image, 1, len, f) != (size_t)len) {
+        fclose(f);
+        return Fail(elf, path, "not an ELF file");
+    }
+    fclose(f);
+    
+    const uint8_t* img = elf->image;
+    if(memcmp(img, "\177ELF", 4) || img[4] != 1 || img[5] != 1 || Get16(img + 18) != EM_RISCV)
+        return Fail(elf, path, "not a 32-bit little-endian RISC-V ELF");
+    elf->entry = Get32(img + 24);
+    
+    // Program headers: PT_LOAD only
+    uint32_t phoff = Get32(img + 28), phentsize = Get16(img + 42), phnum = Get16(img + 44);
+    if(phoff + phnum * phentsize > (uint32_t)len) return Fail(elf, path, "truncated program headers");
+    elf->segments = calloc(phnum ? phnum : 1, sizeof(ElfSegment_t));
+    for(uint32_t i = 0; i < phnum; i++) {
+        const uint8_t* ph = img + phoff + i * phentsize;
+        uint32_t offset = Get32(ph + 4), fileSize = Get32(ph + 16);
+        if(Get32(ph) != PT_LOAD) continue;
+        if(offset + fileSize > (uint32_t)len) return Fail(elf, path, "truncated segment");
+        elf->segments[elf->segmentCount++] = (ElfSegment_t){
+            Get32(ph + 12), Get32(ph + 8), fileSize, Get32(ph + 20), img + offset
+        };
+    }
+    
+    // Symbol table: functions, objects and linker symbols (__global_pointer$)
+    uint32_t shoff = Get32(img + 32), shentsize = Get16(img + 46), shnum = Get16(img + 48);
+    if(shoff + shnum * shentsize > (uint32_t)len) return Fail(elf, path, "truncated section headers");
+    for(uint32_t i = 0; i < shnum; i++) {
+        const uint8_t* sh = img + shoff + i * shentsize;
+        if(Get32(sh + 4) != SHT_SYMTAB) continue;
+        uint32_t symOff = Get32(sh + 16), symSize = Get32(sh + 20), link = Get32(sh + 24);
+        if(link >= shnum) break;
+        const uint8_t* strSh = img + shoff + link * shentsize;
+        uint32_t strOff = Get32(strSh + 16), strSize = Get32(strSh + 20);
+        if(symOff + symSize > (uint32_t)len || strOff + strSize > (uint32_t)len) break;
+        
+        elf->symbols = calloc(symSize / 16 + 1, sizeof(ElfSymbol_t));
+        for(uint32_t s = 0; s < symSize / 16; s++) {
+            const uint8_t* sym = img + symOff + 16 * s;
+            uint32_t name = Get32(sym), type = sym[12] & 15;
+            if(type > STT_FUNC || name == 0 || name >= strSize || img[strOff + name] == '$') continue;
+            elf->symbols[elf->symbolCount++] = (ElfSymbol_t){
+                (char*)img + strOff + name, Get32(sym + 4), Get32(sym + 8), type == STT_FUNC
+            };
+        }
+        break;
+    }
+    qsort(elf->symbols, elf->symbolCount, sizeof(ElfSymbol_t), Compare_Symbols);
+    return true;
+}
+
+void Elf_Free(Elf_t* elf) {
+    free(elf->image);
+    free(elf->segments);
+    free(elf->symbols);
+    memset(elf, 0, sizeof(*elf));
+}
+
+const ElfSymbol_t* Elf_Symbol(const Elf_t* elf, const char* name) {
+    for(int i = 0; i < elf->symbolCount; i++)
+        if(strcmp(elf->symbols[i].name, name) == 0) return &elf->symbols[i];
+    return NULL;
+}
+
+const ElfSymbol_t* Elf_Function_At(const Elf_t* elf, uint32_t addr) {
+    int lo = 0, hi = elf->symbolCount;
+    
+    // First symbol above addr, then walk back over objects and neighbours
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(elf->symbols[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    for(int i = lo - 1; i >= 0; i--) {
+        const ElfSymbol_t* s = &elf->symbols[i];
+        if(s->isFunc && addr - s->addr < (s->size ? s->size : 1)) return s;
+    }
+    return NULL;
+}
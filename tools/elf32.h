@@ -0,0 +1,42 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - ELF32 LOADER (HOST)
+ * ============================================================================
+ * Reads a linked little-endian RISC-V ELF: PT_LOAD segments (placed at their
+ * physical address, so .data is loaded where the startup code copies it
+ * from) and the named function, object and linker symbols with sizes.
+ * ============================================================================
+ */
+
+#ifndef __ELF32_H
+#define __ELF32_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    char* name;
+    uint32_t addr, size;
+    bool isFunc;
+} ElfSymbol_t;
+
+typedef struct {
+    uint32_t paddr, vaddr, fileSize, memSize;
+    const uint8_t* data;
+} ElfSegment_t;
+
+typedef struct {
+    uint8_t* image;
+    uint32_t entry;
+    ElfSegment_t* segments;
+    int segmentCount;
+    ElfSymbol_t* symbols;       // Sorted by address
+    int symbolCount;
+} Elf_t;
+
+bool Elf_Load(const char* path, Elf_t* elf);
+void Elf_Free(Elf_t* elf);
+const ElfSymbol_t* Elf_Symbol(const Elf_t* elf, const char* name);
+const ElfSymbol_t* Elf_Function_At(const Elf_t* elf, uint32_t addr);
+
+#endif /* __ELF32_H */
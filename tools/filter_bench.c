@@ -0,0 +1,289 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - FILTER CHAIN BENCHMARK (HOST)
+ * ============================================================================
+ * Runs filter.c chains, one averaged ADC count per control pass, on
+ * synthetic inputs and reports per chain:
+ *   t50/t90   passes to 50 % and 90 % of a 100-count step, in ms
+ *   over      overshoot past the step, in counts
+ *   settle    last time the output is more than 1 count off the step, ms;
+ *             '-' when it still is at the end of the window
+ *   noise     output RMS / input RMS for Gaussian noise on a steady count
+ *   spike     largest output deviation after one pass SPIKE_COUNTS high
+ * The first two rows are the shipped protection and regulation chains
+ * (ADC_PROTECTION_CHAIN, ADC_REGULATION_CHAIN). Cycles per sample on the
+ * target come from rv32bench: its Bench_Filter_* kernels time each stage
+ * kind and ADC_ReadCount_Filtered the shipped pair.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -o filter_bench filter_bench.c ../filter.c -lm
+ *
+ * Usage:
+ *   ./filter_bench [options]
+ *     -s SPEC   benchmark this chain; repeatable, replaces the built-in set.
+ *               Stages comma separated, run left to right:
+ *                 median:N  ema:SHIFT  ema10:TENTHS  slew:COUNTS
+ *                 lp:HZ[:Q] (Butterworth Q by default)  biquad:B0:B1:B2:A1:A2
+ *     -n RMS    input noise in counts (default 2)
+ *     -d HZ[:Q] print a low-pass biquad as a FILTER_STAGE_BIQUAD entry
+ *     -c FILE   write the results as CSV
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stabilizer.h"
+#include "filter.h"
+
+#define MAX_STAGES          8
+#define MAX_CHAINS          32
+#define PASS_RATE_HZ        (1000.0 / LOOP_PERIOD_MS)
+#define BASE_COUNTS         500
+#define STEP_COUNTS         100
+#define STEP_PASSES         300         // 3 s after the step
+#define SPIKE_COUNTS        150
+#define NOISE_PASSES        20000
+#define NOISE_WARMUP        200
+
+typedef struct {
+    char spec[96];
+    FilterStage_t stages[MAX_STAGES];
+    FilterState_t state[MAX_STAGES];
+    int count;
+} Bench_t;
+
+typedef struct {
+    int t50Ms, t90Ms, settleMs;
+    double overshoot, noiseRatio, spike;
+} Result_t;
+
+static const char* builtin[] = {
+    "median:3", "median:5", "median:3,ema:1", "ema:0", "ema:2", "ema:3",
+    "ema10:5", "lp:5", "lp:2", "slew:2", "median:3,lp:5"
+};
+
+static uint32_t noiseSeed;
+
+// Gaussian, Box-Muller on a fixed-seed LCG
+static double Noise(void) {
+    double u1, u2;
+    noiseSeed = noiseSeed * 1664525u + 1013904223u;
+    u1 = ((noiseSeed >> 8) + 1.0) / 16777217.0;
+    noiseSeed = noiseSeed * 1664525u + 1013904223u;
+    u2 = (noiseSeed >> 8) / 16777216.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// RBJ low-pass at the pass rate, Q2.14; b1 absorbs the rounding so that
+// b0 + b1 + b2 = 1 + a1 + a2 exactly and a steady count passes unchanged
+static bool Design_Lowpass(double hz, double q, FilterStage_t* st) {
+    double w, alpha, a0;
+    int32_t one = 1 << FILTER_BIQUAD_SHIFT;
+    
+    if(hz <= 0 || hz >= PASS_RATE_HZ / 2 || q <= 0) return false;
+    w = 2.0 * M_PI * hz / PASS_RATE_HZ;
+    alpha = sin(w) / (2.0 * q);
+    a0 = 1.0 + alpha;
+    memset(st, 0, sizeof(*st));
+    st->kind = FILTER_BIQUAD;
+    st->coef[3] = (int32_t)lround(-2.0 * cos(w) / a0 * one);
+    st->coef[4] = (int32_t)lround((1.0 - alpha) / a0 * one);
+    st->coef[0] = st->coef[2] = (int32_t)lround((1.0 - cos(w)) / 2.0 / a0 * one);
+    st->coef[1] = one + st->coef[3] + st->coef[4] - 2 * st->coef[0];
+    return true;
+}
+
+static bool Parse_Stage(char* s, FilterStage_t* st) {
+    char* args = strchr(s, ':');
+    double v[5] = {0, M_SQRT1_2, 0, 0, 0};
+    int n = 0;
+    
+    if(args) *args++ = 0;
+    while(args && *args && n < 5) {
+        v[n++] = atof(args);
+        args = strchr(args, ':');
+        if(args) args++;
+    }
+    memset(st, 0, sizeof(*st));
+    st->arg = (uint8_t)v[0];
+    if(strcmp(s, "median") == 0) {
+        st->kind = FILTER_MEDIAN;
+        return n == 1 && v[0] >= 1 && v[0] <= FILTER_MEDIAN_MAX && ((int)v[0] & 1);
+    }
+    if(strcmp(s, "ema") == 0) {
+        st->kind = FILTER_EMA;
+        return n == 1 && v[0] >= 0 && v[0] <= 12;
+    }
+    if(strcmp(s, "ema10") == 0) {
+        st->kind = FILTER_EMA10;
+        return n == 1 && v[0] >= 1 && v[0] <= 10;
+    }
+    if(strcmp(s, "slew") == 0) {
+        st->kind = FILTER_SLEW;
+        return n == 1 && v[0] >= 1 && v[0] <= 255;
+    }
+    if(strcmp(s, "lp") == 0) return n >= 1 && Design_Lowpass(v[0], v[1], st);
+    if(strcmp(s, "biquad") == 0) {
+        st->kind = FILTER_BIQUAD;
+        for(int i = 0; i < 5; i++) st->coef[i] = (int32_t)v[i];
+        return n == 5;
+    }
+    return false;
+}
+
+static bool Parse_Chain(const char* spec, Bench_t* b) {
+    char buf[sizeof(b->spec)];
+    
+    snprintf(b->spec, sizeof(b->spec), "%s", spec);
+    snprintf(buf, sizeof(buf), "%s", spec);
+    b->count = 0;
+    for(char* s = strtok(buf, ","); s; s = strtok(NULL, ",")) {
+        if(b->count >= MAX_STAGES || !Parse_Stage(s, &b->stages[b->count])) {
+            fprintf(stderr, "bad stage '%s' in '%s'\n", s, spec);
+            return false;
+        }
+        b->count++;
+    }
+    return b->count > 0;
+}
+
+static void Describe(const FilterStage_t* st, int count, char* out, size_t size) {
+    size_t len = 0;
+    
+    out[0] = 0;
+    for(int i = 0; i < count && len < size; i++) {
+        const char* sep = i ? "," : "";
+        switch(st[i].kind) {
+            case FILTER_MEDIAN: len += snprintf(out + len, size - len, "%smedian:%u", sep, st[i].arg); break;
+            case FILTER_EMA:    len += snprintf(out + len, size - len, "%sema:%u", sep, st[i].arg); break;
+            case FILTER_EMA10:  len += snprintf(out + len, size - len, "%sema10:%u", sep, st[i].arg); break;
+            case FILTER_SLEW:   len += snprintf(out + len, size - len, "%sslew:%u", sep, st[i].arg); break;
+            default:            len += snprintf(out + len, size - len, "%sbiquad", sep); break;
+        }
+    }
+}
+
+// MEASUREMENTS - every run starts from a reset chain seeded at BASE_COUNTS
+static FilterChain_t Chain(Bench_t* b) {
+    FilterChain_t c = { b->stages, b->state, (uint8_t)b->count, false };
+    Filter_Run(&c, BASE_COUNTS);
+    return c;
+}
+
+static void Measure(Bench_t* b, double noiseRms, Result_t* r) {
+    FilterChain_t c = Chain(b);
+    double sum = 0, sumSq = 0, inSq = 0;
+    int target = BASE_COUNTS + STEP_COUNTS;
+    
+    r->t50Ms = r->t90Ms = -1;
+    r->settleMs = 0;
+    r->overshoot = 0;
+    for(int i = 0; i < 20; i++) Filter_Run(&c, BASE_COUNTS);
+    for(int i = 1; i <= STEP_PASSES; i++) {
+        int y = Filter_Run(&c, target);
+        if(r->t50Ms < 0 && y >= BASE_COUNTS + STEP_COUNTS / 2) r->t50Ms = i * LOOP_PERIOD_MS;
+        if(r->t90Ms < 0 && y >= BASE_COUNTS + STEP_COUNTS * 9 / 10) r->t90Ms = i * LOOP_PERIOD_MS;
+        if(y - target > r->overshoot) r->overshoot = y - target;
+        if(abs(y - target) > 1) r->settleMs = i * LOOP_PERIOD_MS;
+    }
+    
+    c = Chain(b);
+    r->spike = 0;
+    for(int i = 0; i < 20; i++) Filter_Run(&c, BASE_COUNTS);
+    for(int i = 0; i < STEP_PASSES; i++) {
+        int y = Filter_Run(&c, i == 0 ? BASE_COUNTS + SPIKE_COUNTS : BASE_COUNTS);
+        if(abs(y - BASE_COUNTS) > r->spike) r->spike = abs(y - BASE_COUNTS);
+    }
+    
+    c = Chain(b);
+    noiseSeed = 1;
+    for(int i = 0; i < NOISE_WARMUP + NOISE_PASSES; i++) {
+        double n = noiseRms * Noise();
+        int x = (int)lround(BASE_COUNTS + n);
+        int y = Filter_Run(&c, (uint16_t)x);
+        if(i < NOISE_WARMUP) continue;
+        inSq += (x - BASE_COUNTS) * (double)(x - BASE_COUNTS);
+        sum += y;
+        sumSq += (double)y * y;
+    }
+    {
+        double mean = sum / NOISE_PASSES;
+        double outVar = sumSq / NOISE_PASSES - mean * mean;
+        r->noiseRatio = inSq > 0 ? sqrt(outVar > 0 ? outVar : 0) / sqrt(inSq / NOISE_PASSES) : 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    static const FilterStage_t protection[] = { ADC_PROTECTION_CHAIN };
+    static const FilterStage_t regulation[] = { ADC_REGULATION_CHAIN };
+    static Bench_t benches[MAX_CHAINS];
+    const char* specs[MAX_CHAINS];
+    int specCount = 0, count = 0;
+    double noiseRms = 2.0;
+    const char* csvPath = NULL;
+    FILE* csv = NULL;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc && specCount < MAX_CHAINS - 2) specs[specCount++] = argv[++i];
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) noiseRms = atof(argv[++i]);
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) csvPath = argv[++i];
+        else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            char* arg = argv[++i];
+            char* qs = strchr(arg, ':');
+            double q = qs ? atof(qs + 1) : M_SQRT1_2;
+            FilterStage_t st;
+            if(!Design_Lowpass(atof(arg), q, &st)) {
+                fprintf(stderr, "low-pass %s: needs 0 < Hz < %.0f and Q > 0\n", arg, PASS_RATE_HZ / 2);
+                return 2;
+            }
+            printf("FILTER_STAGE_BIQUAD(%d, %d, %d, %d, %d)\n",
+                   st.coef[0], st.coef[1], st.coef[2], st.coef[3], st.coef[4]);
+            return 0;
+        }
+        else {
+            fprintf(stderr, "usage: %s [-s stage,...] [-n rms] [-c results.csv] | -d hz[:q]\n", argv[0]);
+            return 2;
+        }
+    }
+    
+    // Shipped chains first, then the candidates
+    memcpy(benches[0].stages, protection, sizeof(protection));
+    benches[0].count = sizeof(protection) / sizeof(protection[0]);
+    memcpy(benches[1].stages, regulation, sizeof(regulation));
+    benches[1].count = sizeof(regulation) / sizeof(regulation[0]);
+    for(int i = 0; i < 2; i++) Describe(benches[i].stages, benches[i].count, benches[i].spec, sizeof(benches[i].spec));
+    count = 2;
+    if(specCount == 0) {
+        for(unsigned i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) specs[specCount++] = builtin[i];
+    }
+    for(int i = 0; i < specCount; i++) {
+        if(!Parse_Chain(specs[i], &benches[count])) return 2;
+        count++;
+    }
+    
+    if(csvPath) {
+        if(!(csv = fopen(csvPath, "w"))) { perror(csvPath); return 2; }
+        fprintf(csv, "chain,t50_ms,t90_ms,overshoot,settle_ms,noise_ratio,spike\n");
+    }
+    printf("%-24s %6s %6s %5s %7s %6s %6s\n", "chain", "t50", "t90", "over", "settle", "noise", "spike");
+    for(int i = 0; i < count; i++) {
+        Result_t r;
+        const char* role = i == 0 ? " (protection)" : i == 1 ? " (regulation)" : "";
+        char name[128], settle[16];
+        Measure(&benches[i], noiseRms, &r);
+        snprintf(name, sizeof(name), "%.96s%s", benches[i].spec, role);
+        if(r.settleMs >= STEP_PASSES * LOOP_PERIOD_MS) snprintf(settle, sizeof(settle), "-");
+        else snprintf(settle, sizeof(settle), "%d", r.settleMs);
+        printf("%-24s %6d %6d %5.0f %7s %6.2f %6.0f\n", name, r.t50Ms, r.t90Ms, r.overshoot,
+               settle, r.noiseRatio, r.spike);
+        if(csv) fprintf(csv, "\"%s\",%d,%d,%.0f,%d,%.3f,%.0f\n", benches[i].spec, r.t50Ms, r.t90Ms,
+                        r.overshoot, r.settleMs, r.noiseRatio, r.spike);
+    }
+    printf("%d-count step from %d, noise %.1f counts RMS, %d-count one-pass spike; ms at %d ms per pass\n",
+           STEP_COUNTS, BASE_COUNTS, noiseRms, SPIKE_COUNTS, LOOP_PERIOD_MS);
+    if(csv) fclose(csv);
+    return 0;
+}
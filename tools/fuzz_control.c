@@ -0,0 +1,427 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - FUZZ HARNESS FOR THE CONTROL CORE (HOST)
+ * ============================================================================
+ * libFuzzer target for the unmodified control core (stabilizer.c, params.c)
+ * on the mock HAL. An input is a boot configuration followed by control
+ * passes, each with a voltage, the LOWCUT_EN and M-START pins, a repeat
+ * count and a jump of the tick:
+ *
+ *   byte 0      mode: 0 full pass (Stabilizer_Run: filter chain, R1-R4, R5)
+ *                     1 state machines driven directly with currentADC(Fast)
+ *                     2 filter chain alone (ADC_ReadCount_Averaged/Filtered)
+ *   bytes 1-2   calibration adcCapturedA (1..1023)
+ *   byte 3      reconnect delay in seconds (3..180)
+ *   bytes 4-5   the second run starts this many x 10 ms before the tick wraps
+ *   byte 6      debounce_ms = 8 x value (up to 2000)
+ *   byte 7      detect times 20 + 100 x (low nibble) ms, resume times
+ *               20 + 100 x (high nibble) ms, for both cuts
+ *   then per record (4 bytes):
+ *     u16       bits 0-9 ADC count, bit 10 LOWCUT_EN, bit 11 M-START
+ *     u8        passes with these inputs (1..256), passPeriodMs apart
+ *     u8        j: the tick first jumps j*j*j ms (up to 4.6 hours)
+ *   mode 2 instead reads 16 ADC samples (u16) per call plus a selector byte
+ *
+ * Invariants, checked after every pass and on every relay change:
+ *   - R5 never closes while the protection path (currentADCFast) is above
+ *     the HICUT trip count, and stays open in every cut, resume and
+ *     reconnect-delay state
+ *   - currentStep and pendingStep stay in 0..7, and R1-R4 show that step
+ *   - relay rate: tap changes at least debounceMs apart and each one counted
+ *     in relayOperations; R5 stays closed for at least the shorter detect
+ *     time and open for at least the shorter resume time
+ *   - adaptive rate: a pass period other than LOOP_PERIOD_MS is
+ *     PASS_SLOW_MS, and only in NORMAL with R5 closed and no tap change
+ *     pending
+ *   - tick wraparound: the input runs once from tick 0 and once across the
+ *     2^32 ms wrap; relay outputs, step and states must match pass by pass
+ *   - filter chain: the averaged count lies between the 5th and 12th of its
+ *     16 sorted samples; the filtered count between the previous filtered
+ *     value and the new average, and so does the protection path
+ * A violation prints what failed and aborts, so libFuzzer keeps the input.
+ *
+ * Build (libFuzzer):
+ *   clang -g -O1 -fsanitize=fuzzer,address,undefined -DFUZZ_LIBFUZZER -I.. \
+ *       -DSERIAL_PROTOCOL=0 -o fuzz_control fuzz_control.c hal_mock.c \
+ *       ../stabilizer.c ../params.c ../filter.c ../crc16.c
+ *   ./fuzz_control -max_len=4096 corpus/
+ *
+ * Build (any compiler, no libFuzzer: replays inputs or runs random ones):
+ *   gcc -O2 -Wall -I.. -DSERIAL_PROTOCOL=0 -o fuzz_control fuzz_control.c \
+ *       hal_mock.c ../stabilizer.c ../params.c ../filter.c ../crc16.c
+ *   ./fuzz_control crash-1234...        replay saved inputs
+ *   ./fuzz_control -r 10000 [-S seed]   random inputs; a failing one is
+ *                                       saved as fuzz_control.crash
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "hal_mock.h"
+
+#define HEADER_BYTES        8
+#define RECORD_BYTES        4
+#define MAX_PASSES          50000       // Per input, keeps one run under a second
+#define FILTER_CALL_BYTES   (1 + 2*ADC_SAMPLES_COUNT)
+
+// Control state not in stabilizer.h, reset between inputs
+extern volatile uint32_t relayChangeTimer, r5Timer, delayCountStart, settingBlinkTimer;
+extern volatile uint32_t buttonPressStart, mstartPressStart, ledBlinkTimer;
+extern volatile bool settingLedState, buttonWasPressed, mstartWasPressed, ledBlinkState;
+
+typedef struct {
+    uint8_t step, r5State, state, relays;
+} Pass_t;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size, pos;
+} Input_t;
+
+static Pass_t passLog[2][MAX_PASSES];
+static int passCount[2];
+static Input_t in;
+static uint16_t passAdc;
+static int passIndex;
+static bool passLowcut, passMstart;
+
+// Relay history of the current run, in 64-bit ms (no wrap)
+static uint64_t lastStepMs, lastR5OpenMs, lastR5CloseMs;
+static bool stepSeen, r5OpenSeen, r5CloseSeen;
+static uint32_t stepChanges;
+
+static const uint8_t* failInput;
+static size_t failSize;
+
+static void Fail(const char* what) {
+    fprintf(stderr, "fuzz_control: %s (pass %d, step %u, r5State %d, state %d, adc %u, tick %u)\n",
+            what, passIndex, currentStep, (int)r5State, (int)currentState, currentADC, HAL_GetTick());
+#ifndef FUZZ_LIBFUZZER
+    FILE* f = fopen("fuzz_control.crash", "wb");
+    if(f) {
+        fwrite(failInput, 1, failSize, f);
+        fclose(f);
+        fprintf(stderr, "fuzz_control: input saved as fuzz_control.crash\n");
+    }
+#endif
+    abort();
+}
+
+static uint8_t Take_U8(Input_t* i) {
+    return i->pos < i->size ? i->data[i->pos++] : 0;
+}
+
+static uint16_t Take_U16(Input_t* i) {
+    uint16_t lo = Take_U8(i);
+    return lo | (uint16_t)(Take_U8(i) << 8);
+}
+
+// HAL HOOKS
+static uint16_t Pass_Adc(uint64_t timeUs) {
+    (void)timeUs;
+    return passAdc;
+}
+
+static bool Pass_Input(HalInput_t pin, uint64_t timeUs) {
+    (void)timeUs;
+    if(pin == HAL_IN_LOWCUT_EN) return passLowcut;
+    if(pin == HAL_IN_M_START) return passMstart;
+    return false;
+}
+
+// Shortest detect or resume time over the protection channels
+static uint16_t Min_Prot_Ms(const ControlTable_t* t, bool resume) {
+    uint16_t m = 0xFFFF;
+    for(int ch = 0; ch < R5_CH_COUNT; ch++) {
+        uint16_t v = resume ? t->prot[ch].resumeMs : t->prot[ch].detectMs;
+        if(v < m) m = v;
+    }
+    return m;
+}
+
+static void Relay_Changed(HalOutput_t out, bool on, uint64_t timeUs) {
+    const ControlTable_t* t = controlTable;
+    uint64_t ms = timeUs / 1000;
+    
+    if(out == HAL_OUT_R5) {
+        if(on) {
+            if(currentADCFast > t->prot[R5_CH_HICUT].tripAdc) Fail("R5 closed above the HICUT threshold");
+            if(r5OpenSeen && ms - lastR5OpenMs < Min_Prot_Ms(t, true))
+                Fail("R5 closed again before a resume time passed");
+            lastR5CloseMs = ms;
+            r5CloseSeen = true;
+        } else {
+            if(r5CloseSeen && ms - lastR5CloseMs < Min_Prot_Ms(t, false))
+                Fail("R5 opened again before a detect time passed");
+            lastR5OpenMs = ms;
+            r5OpenSeen = true;
+        }
+    } else if(out <= HAL_OUT_R4 && (!stepSeen || ms != lastStepMs)) {
+        // One tap change moves up to four contacts in the same tick
+        if(stepSeen && ms - lastStepMs < t->debounceMs) Fail("tap change inside the debounce time");
+        lastStepMs = ms;
+        stepSeen = true;
+        stepChanges++;
+    }
+}
+
+// CONTROL RUNS
+static void Reset_Core(void) {
+    currentState = STATE_NORMAL;
+    settingState = SETTING_IDLE;
+    r5State = R5_NORMAL;
+    adcCapturedA = currentADC = currentADCFast = 0;
+    currentOPV = currentIPV = 0;
+    currentStep = pendingStep = 0;
+    r5Status = stepChangePending = false;
+    relayOperations = hicutTrips = locutTrips = 0;
+    relayChangeTimer = r5Timer = delayCountStart = settingBlinkTimer = 0;
+    buttonPressStart = mstartPressStart = ledBlinkTimer = 0;
+    settingLedState = buttonWasPressed = mstartWasPressed = ledBlinkState = false;
+    delayTimeMs = DEFAULT_DELAY_TIME_SEC*1000;
+}
+
+static void Check_Pass(void) {
+    const RelayStep_t* s = &relaySteps[currentStep < 8 ? currentStep : 0];
+    bool cut = r5State != R5_NORMAL && r5State != R5_HICUT_DETECTING && r5State != R5_LOCUT_DETECTING;
+    
+    if(currentStep > 7 || pendingStep > 7) Fail("step outside 0..7");
+    if(Mock_Relays() != s->relays)
+        Fail("R1-R4 do not match currentStep");
+    if(mockOutputs[HAL_OUT_R5] != r5Status) Fail("R5 output differs from r5Status");
+    if(cut && r5Status) Fail("R5 closed in a cut or reconnect state");
+    if((uint16_t)stepChanges != relayOperations) Fail("relayOperations misses a tap change");
+    if(passPeriodMs != LOOP_PERIOD_MS && (passPeriodMs != PASS_SLOW_MS || currentState != STATE_NORMAL ||
+                                          r5State != R5_NORMAL || stepChangePending))
+        Fail("slow pass outside a steady NORMAL state");
+}
+
+// One boot plus every pass of the input, starting at baseMs on the tick
+static void Run_Control(int mode, uint32_t baseMs, Pass_t* log, int* count) {
+    Input_t i = {in.data, in.size, 1};
+    uint16_t cal = Take_U16(&i) % 1023 + 1;
+    uint8_t delayS = Take_U8(&i) % (MAX_DELAY_TIME_SEC - MIN_DELAY_TIME_SEC + 1) + MIN_DELAY_TIME_SEC;
+    uint16_t debounce = (Take_U16(&i), Take_U8(&i) * 8);   // After the wrap offset
+    uint8_t times = Take_U8(&i);
+    int n = 0;
+    
+    i.pos = HEADER_BYTES;
+    Mock_Reset();
+    Reset_Core();
+    mockTimeUs = (uint64_t)baseMs * 1000;
+    passIndex = -1;                     // Boot
+    
+    // Calibrated unit booting into its reconnect delay
+    adcCapturedA = cal;
+    delayTimeMs = delayS * 1000u;
+    Save_Settings();
+    passAdc = i.size >= HEADER_BYTES + 2 ? (i.data[i.pos] | i.data[i.pos+1] << 8) & 0x3FF : 0;
+    mockAdcSource = Pass_Adc;
+    mockInputSource = Pass_Input;
+    Stabilizer_Init();
+    Params_Set(PARAM_DEBOUNCE_MS, debounce > 2000 ? 2000 : debounce);
+    Params_Set(PARAM_HICUT_DETECT_MS, 20 + 100 * (times & 15));
+    Params_Set(PARAM_LOCUT_DETECT_MS, 20 + 100 * (times & 15));
+    Params_Set(PARAM_HICUT_RESUME_MS, 20 + 100 * (times >> 4));
+    Params_Set(PARAM_LOCUT_RESUME_MS, 20 + 100 * (times >> 4));
+    stepSeen = r5OpenSeen = r5CloseSeen = false;
+    stepChanges = 0;
+    mockOutputHook = Relay_Changed;
+    
+    while(i.pos + RECORD_BYTES <= i.size && n < MAX_PASSES) {
+        uint16_t word = Take_U16(&i);
+        int repeat = Take_U8(&i) + 1;
+        uint32_t j = Take_U8(&i);
+        passAdc = word & 0x3FF;
+        passLowcut = (word >> 10) & 1;
+        passMstart = (word >> 11) & 1;
+        Mock_Advance_Us((uint64_t)j*j*j * 1000);
+        
+        for(int r = 0; r < repeat && n < MAX_PASSES; r++, n++) {
+            bool booting = currentState == STATE_BOOT;
+            passIndex = n;
+            if(mode == 0 || booting) {
+                Stabilizer_Run();           // Mode 1 too until the first decision
+            } else {
+                // The control part of Stabilizer_Run with the measurement
+                // replaced by the input count
+                currentADC = currentADCFast = passAdc;
+                currentOPV = Calculate_OPV(passAdc);
+                currentIPV = Calculate_IPV(currentOPV, currentStep < 8 ? currentStep : 0);
+                if(currentState == STATE_NORMAL) StateMachine2_Control_R1_R4();
+                if(currentState != STATE_SETTING) StateMachine2_Control_R5();
+            }
+            if(booting && currentState != STATE_BOOT) {
+                stepSeen = false;           // Initial tap position, not a tap change
+                stepChanges = 0;
+            }
+            Check_Pass();
+            log[n] = (Pass_t){currentStep, (uint8_t)r5State, (uint8_t)currentState,
+                              (uint8_t)(mockOutputs[HAL_OUT_R1] | mockOutputs[HAL_OUT_R2] << 1 |
+                                        mockOutputs[HAL_OUT_R3] << 2 | mockOutputs[HAL_OUT_R4] << 3 |
+                                        mockOutputs[HAL_OUT_R5] << 4)};
+            HAL_Delay_Ms(passPeriodMs);
+        }
+    }
+    *count = n;
+}
+
+static void Fuzz_Control(int mode) {
+    uint32_t before = ((uint32_t)in.data[4] | (uint32_t)in.data[5] << 8) * 10 + 1;
+    
+    Run_Control(mode, 0, passLog[0], &passCount[0]);
+    Run_Control(mode, 0u - before, passLog[1], &passCount[1]);
+    for(int p = 0; p < passCount[0]; p++)
+        if(memcmp(&passLog[0][p], &passLog[1][p], sizeof(Pass_t)) != 0) {
+            passIndex = p;
+            fprintf(stderr, "fuzz_control: from tick 0: step %u r5State %u state %u relays 0x%02X\n",
+                    passLog[0][p].step, passLog[0][p].r5State, passLog[0][p].state, passLog[0][p].relays);
+            Fail("result changes when the tick wraps");
+        }
+}
+
+// FILTER CHAIN
+static uint16_t filterSamples[ADC_SAMPLES_COUNT];
+static int filterTaken;
+
+static uint16_t Input_Adc(uint64_t timeUs) {
+    (void)timeUs;
+    uint16_t v = Take_U16(&in) & 0x3FF;
+    if(filterTaken < ADC_SAMPLES_COUNT) filterSamples[filterTaken++] = v;
+    return v;
+}
+
+static int Compare_U16(const void* a, const void* b) {
+    return *(const uint16_t*)a - *(const uint16_t*)b;
+}
+
+static void Fuzz_Filter(void) {
+    uint16_t previous = 0, previousFast = 0;
+    bool seeded = false;
+    
+    Mock_Reset();
+    Reset_Core();
+    Stabilizer_Init();                  // No calibration: only restarts the filter
+    mockAdcSource = Input_Adc;
+    in.pos = 1;
+    for(int call = 0; in.pos + FILTER_CALL_BYTES <= in.size; call++) {
+        bool filtered = Take_U8(&in) & 1;
+        passIndex = call;
+        filterTaken = 0;
+        uint16_t out = filtered ? ADC_ReadCount_Filtered() : ADC_ReadCount_Averaged();
+        if(filterTaken != ADC_SAMPLES_COUNT) Fail("filter chain read the wrong number of samples");
+        qsort(filterSamples, ADC_SAMPLES_COUNT, sizeof(uint16_t), Compare_U16);
+        
+        uint16_t lo = filterSamples[ADC_DISCARD_SAMPLES];
+        uint16_t hi = filterSamples[ADC_SAMPLES_COUNT-1-ADC_DISCARD_SAMPLES];
+        if(!filtered) {
+            if(out < lo || out > hi) Fail("average outside the kept samples");
+            continue;
+        }
+        // The average itself is not visible here: bound it by the kept samples
+        if(seeded) {
+            if(lo > previous) lo = previous;
+            if(hi < previous) hi = previous;
+        }
+        if(out < lo || out > hi) Fail("filtered value outside previous value and new average");
+        lo = filterSamples[ADC_DISCARD_SAMPLES];
+        hi = filterSamples[ADC_SAMPLES_COUNT-1-ADC_DISCARD_SAMPLES];
+        if(seeded) {
+            if(lo > previousFast) lo = previousFast;
+            if(hi < previousFast) hi = previousFast;
+        }
+        if(currentADCFast < lo || currentADCFast > hi) Fail("protection path outside previous value and new average");
+        previous = out;
+        previousFast = currentADCFast;
+        seeded = true;
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if(size < HEADER_BYTES) return 0;
+    in = (Input_t){data, size, 0};
+    failInput = data;
+    failSize = size;
+    if(data[0] % 3 == 2) Fuzz_Filter();
+    else Fuzz_Control(data[0] % 3);
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+// STANDALONE DRIVER - replays files, or runs random inputs shaped like the
+// fuzzer's: mostly voltages near the protection and tap thresholds
+static uint32_t rngState;
+
+static uint32_t Random(void) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static int Run_File(const char* path) {
+    FILE* f = fopen(path, "rb");
+    static uint8_t buf[1 << 20];
+    size_t n;
+    
+    if(!f) {
+        perror(path);
+        return 2;
+    }
+    n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(buf, n);
+    printf("%s: ok (%zu bytes)\n", path, n);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    static uint8_t buf[4096];
+    long runs = 0;
+    uint32_t seed = 1;
+    int files = 0;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) runs = atol(argv[++i]);
+        else if(strcmp(argv[i], "-S") == 0 && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if(argv[i][0] != '-') {
+            if(Run_File(argv[i])) return 2;
+            files++;
+        } else {
+            files = -1;
+            break;
+        }
+    }
+    if(files < 0 || (!files && runs <= 0)) {
+        fprintf(stderr, "usage: %s [-r runs] [-S seed] [input...]\n", argv[0]);
+        return 2;
+    }
+    
+    rngState = seed ? seed : 1;
+    for(long r = 0; r < runs; r++) {
+        size_t size = HEADER_BYTES + RECORD_BYTES * (1 + Random() % 256);
+        uint16_t cal = 500 + Random() % 400;
+        for(size_t k = 0; k < size; k++) buf[k] = (uint8_t)Random();
+        buf[1] = (uint8_t)cal;
+        buf[2] = (uint8_t)(cal >> 8);
+        for(size_t k = HEADER_BYTES; buf[0] % 3 != 2 && k + RECORD_BYTES <= size; k += RECORD_BYTES) {
+            // Volts around 150-300 V at this calibration, rarely a long
+            // repeat or a big jump
+            uint16_t adc = (uint16_t)(cal * (150 + Random() % 150) / CALIBRATION_VOLTAGE);
+            uint16_t word = (adc > 1023 ? 1023 : adc) | (buf[k+1] & 0x0C) << 8;
+            buf[k] = (uint8_t)word;
+            buf[k+1] = (uint8_t)(word >> 8);
+            if(Random() % 8) buf[k+2] &= 0x3F;
+            if(Random() % 8) buf[k+3] = 0;
+        }
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+    if(runs > 0) printf("%ld random inputs (seed %u): all invariants held\n", runs, seed);
+    return 0;
+}
+#endif
@@ -0,0 +1,146 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MOCK HAL (HOST)
+ * ============================================================================
+ * See hal_mock.h. Flash checks mirror hal_ch32v00x.c (64-byte aligned
+ * pages, erased state 0xFF) so parameter and settings code paths behave as
+ * on the MCU.
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stabilizer.h"
+#include "hal_mock.h"
+
+uint64_t mockTimeUs=0;
+uint16_t mockAdc=0;
+uint16_t (*mockAdcSource)(uint64_t timeUs)=NULL;
+bool mockInputs[HAL_IN_COUNT];
+bool (*mockInputSource)(HalInput_t in, uint64_t timeUs)=NULL;
+bool mockOutputs[HAL_OUT_COUNT];
+void (*mockOutputHook)(HalOutput_t out, bool on, uint64_t timeUs)=NULL;
+uint32_t mockFlashWrites=0, mockFlashErases=0;
+uint64_t mockAdcReads=0;
+
+static uint32_t mockFlashWords[MOCK_FLASH_SIZE/4];
+uint8_t* const mockFlash = (uint8_t*)mockFlashWords;
+
+static const char* const outputNames[HAL_OUT_COUNT] = {
+    "R1", "R2", "R3", "R4", "R5", "MAIN_LED", "FAULT_LED", "SETTING_LED"
+};
+static const char* const inputNames[HAL_IN_COUNT] = {
+    "LOWCUT_EN", "M_START", "BUTTON"
+};
+
+const char* Mock_Output_Name(HalOutput_t out) { return out < HAL_OUT_COUNT ? outputNames[out] : "?"; }
+const char* Mock_Input_Name(HalInput_t in) { return in < HAL_IN_COUNT ? inputNames[in] : "?"; }
+
+uint8_t Mock_Relays(void) {
+    uint8_t relays = 0;
+    for(int i = 0; i < 4; i++) if(mockOutputs[HAL_OUT_R1 + i]) relays |= 1 << i;
+    return relays;
+}
+
+void Mock_Reset(void) {
+    mockTimeUs = 0;
+    mockAdc = 0;
+    mockAdcSource = NULL;
+    mockInputSource = NULL;
+    mockOutputHook = NULL;
+    memset(mockInputs, 0, sizeof(mockInputs));
+    memset(mockOutputs, 0, sizeof(mockOutputs));
+    memset(mockFlashWords, 0xFF, sizeof(mockFlashWords));
+    mockFlashWrites = mockFlashErases = 0;
+    mockAdcReads = 0;
+}
+
+void Mock_Advance_Us(uint64_t us) {
+    mockTimeUs += us;
+}
+
+void HAL_Init(void) {
+}
+
+// CLOCK - mock time does not depend on it
+void HAL_Clock_Set(HalClock_t clock) {
+    (void)clock;
+}
+
+// ADC
+uint16_t HAL_ADC_Read(void) {
+    Mock_Advance_Us(MOCK_ADC_CONVERSION_US);
+    mockAdcReads++;
+    uint16_t v = mockAdcSource ? mockAdcSource(mockTimeUs) : mockAdc;
+    return v > 1023 ? 1023 : v;
+}
+
+// GPIO
+void HAL_Output_Write(HalOutput_t out, bool on) {
+    if(out >= HAL_OUT_COUNT) return;
+    if(mockOutputs[out] != on && mockOutputHook) mockOutputHook(out, on, mockTimeUs);
+    mockOutputs[out] = on;
+}
+
+// One output at a time in R1..R4 order, so the hook sees every change
+void HAL_Relays_Write(uint8_t relays) {
+    for(int i = 0; i < 4; i++) HAL_Output_Write((HalOutput_t)(HAL_OUT_R1 + i), (relays >> i) & 1);
+}
+
+bool HAL_Input_Active(HalInput_t in) {
+    if(in >= HAL_IN_COUNT) return false;
+    return mockInputSource ? mockInputSource(in, mockTimeUs) : mockInputs[in];
+}
+
+// TIME
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(mockTimeUs / 1000);
+}
+
+uint32_t HAL_GetMicros(void) {
+    return (uint32_t)mockTimeUs;
+}
+
+void HAL_Delay_Ms(uint32_t ms) {
+    Mock_Advance_Us((uint64_t)ms * 1000);
+}
+
+void HAL_Delay_Us(uint32_t us) {
+    Mock_Advance_Us(us);
+}
+
+// Wakes on the tick, like the target
+void HAL_Sleep_Until(uint32_t start, uint32_t ms) {
+    while(HAL_GetTick() - start < ms) Mock_Advance_Us(1000 - mockTimeUs % 1000);
+}
+
+// FLASH
+static uint32_t Mock_Flash_Offset(uint32_t addr, uint32_t len) {
+    if(addr < MOCK_FLASH_BASE || addr + len > MOCK_FLASH_BASE + MOCK_FLASH_SIZE) {
+        fprintf(stderr, "hal_mock: Flash access 0x%08X outside the mocked region\n", addr);
+        abort();
+    }
+    return addr - MOCK_FLASH_BASE;
+}
+
+const void* HAL_Flash_Read(uint32_t addr) {
+    return mockFlash + Mock_Flash_Offset(addr, 4);
+}
+
+void HAL_Flash_Erase(uint32_t addr) {
+    addr &= ~(uint32_t)(FLASH_PAGE_SIZE-1);
+    memset(mockFlash + Mock_Flash_Offset(addr, FLASH_PAGE_SIZE), 0xFF, FLASH_PAGE_SIZE);
+    mockFlashErases++;
+}
+
+bool HAL_Flash_Write(uint32_t addr, const void* data, uint16_t len) {
+    if(len > FLASH_PAGE_SIZE || (addr & (FLASH_PAGE_SIZE-1))) return false;
+    uint8_t* page = mockFlash + Mock_Flash_Offset(addr, FLASH_PAGE_SIZE);
+    memset(page, 0xFF, FLASH_PAGE_SIZE);
+    memcpy(page, data, len);
+    mockFlashErases++;
+    mockFlashWrites++;
+    return true;
+}
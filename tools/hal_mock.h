@@ -0,0 +1,47 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MOCK HAL (HOST)
+ * ============================================================================
+ * hal.h for native builds. Time is virtual: delays and ADC conversions
+ * advance mockTimeUs instead of waiting, so hours of control run in
+ * milliseconds. Tests drive the inputs and ADC through the variables or
+ * hooks below and observe the outputs and the Flash image.
+ * ============================================================================
+ */
+
+#ifndef __HAL_MOCK_H
+#define __HAL_MOCK_H
+
+#include "hal.h"
+
+#define MOCK_FLASH_BASE         0x08001C00  // Last 1 KB: settings + params pages
+#define MOCK_FLASH_SIZE         1024
+#define MOCK_ADC_CONVERSION_US  85          // 241 + 12.5 cycles at 3 MHz ADCCLK
+
+// VIRTUAL TIME
+extern uint64_t mockTimeUs;
+
+// ADC - mockAdcSource, when set, is sampled at the current virtual time
+extern uint16_t mockAdc;
+extern uint16_t (*mockAdcSource)(uint64_t timeUs);
+
+// GPIO - mockInputSource, when set, overrides mockInputs[]
+extern bool mockInputs[HAL_IN_COUNT];
+extern bool (*mockInputSource)(HalInput_t in, uint64_t timeUs);
+extern bool mockOutputs[HAL_OUT_COUNT];
+extern void (*mockOutputHook)(HalOutput_t out, bool on, uint64_t timeUs);
+
+// FLASH
+extern uint8_t* const mockFlash;
+extern uint32_t mockFlashWrites, mockFlashErases;
+
+// STATISTICS
+extern uint64_t mockAdcReads;
+
+void Mock_Reset(void);                  // t = 0, Flash erased, inputs released
+void Mock_Advance_Us(uint64_t us);
+const char* Mock_Output_Name(HalOutput_t out);
+const char* Mock_Input_Name(HalInput_t in);
+uint8_t Mock_Relays(void);              // R1-R4 outputs as a RELAY_R1..R4 mask
+
+#endif /* __HAL_MOCK_H */
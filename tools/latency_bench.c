@@ -0,0 +1,424 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RESPONSE LATENCY BENCHMARK (HOST)
+ * ============================================================================
+ * Measures how long the unmodified control core (stabilizer.c, params.c)
+ * takes to react on the plant model (plant.c): sense RC, ADC filter chain,
+ * detect timers, debounce and relay operate/release times all included.
+ *
+ * Paths, each timed from the moment the mains crosses the level that
+ * requires a reaction:
+ *   hicut     mains above HICUT x the top tap ratio (the load is over HICUT on
+ *             every tap) -> R5 contact open
+ *   locut     mains below LOCUT x the bottom tap ratio -> R5 contact open
+ *   tap_up    mains above the up threshold of the next step -> tap contacts
+ *             settled on a higher step (last move plus contact bounce)
+ *   tap_down  mains below the down threshold of the current step -> settled
+ *             on a lower step
+ * Every path is driven by three scenario families: an instant step, a ramp
+ * at a random rate, and a swell (hicut, tap_up) or sag (locut, tap_down) of
+ * random depth and length. Each instance boots a calibrated unit, lets it
+ * settle with R5 closed and starts the event at a random offset from the
+ * loop phase, so the results form a distribution. The command latency
+ * (coil write) is reported next to the contact latency. A tap instance whose
+ * unit is not on the intended step when the event starts (the taps hunt) is
+ * skipped and counted, and fails a budget check.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -DSERIAL_PROTOCOL=0 -o latency_bench latency_bench.c plant.c \
+ *       hal_mock.c ../stabilizer.c ../params.c ../filter.c ../crc16.c -lm
+ *
+ * Usage:
+ *   ./latency_bench [options]
+ *     -n N      instances per scenario family (default 100)
+ *     -S SEED   random seed (default 1)
+ *     -P N=V    set parameter N to V in raw units before every run; repeatable
+ *     -c FILE   CSV of every path/scenario row, '-' for stdout
+ *     -B FILE   check "latency <path> <p50|p99|max> <ms>" lines of a budgets
+ *               file against the contact latency of all scenarios of the path
+ *
+ * Exit status 1 when a budget is exceeded, or a budgeted path missed an event
+ * or skipped an instance.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "plant.h"
+
+#define SETTLE_US           6000000     // Boot, reconnect delay (3 s) and filter settle
+#define PHASE_SPREAD_US     20000       // Event start spread over two loop periods
+#define TAIL_US             3000000     // Simulated after the event has ended
+#define MAX_SETS            16
+
+typedef enum { PATH_HICUT, PATH_LOCUT, PATH_TAP_UP, PATH_TAP_DOWN, PATH_COUNT } Path_t;
+typedef enum { FAMILY_STEP, FAMILY_RAMP, FAMILY_EVENT, FAMILY_COUNT } Family_t;
+
+static const char* const pathNames[PATH_COUNT] = { "hicut", "locut", "tap_up", "tap_down" };
+static const char* const familyNames[PATH_COUNT][FAMILY_COUNT] = {
+    {"step", "ramp", "swell"}, {"step", "ramp", "sag"}, {"step", "ramp", "swell"}, {"step", "ramp", "sag"}
+};
+
+// Core timers not in stabilizer.h, cleared between runs
+extern volatile uint32_t relayChangeTimer, r5Timer, delayCountStart, settingBlinkTimer;
+extern volatile uint32_t buttonPressStart, mstartPressStart, ledBlinkTimer;
+extern volatile bool settingLedState, buttonWasPressed, mstartWasPressed, ledBlinkState;
+
+typedef struct {
+    double* command;            // ms after the crossing, per valid instance
+    double* contact;
+    int n, missed, invalid;
+} Series_t;
+
+typedef struct {
+    double p50, p99, max;
+} Summary_t;
+
+static Series_t series[PATH_COUNT][FAMILY_COUNT + 1];   // Last column: all families
+static const char* sets[MAX_SETS];
+static int setCount = 0;
+static uint32_t seed = 1;
+
+// Levels from the parameter registry with the -P overrides
+static float hicutV, locutV, stepUpV[8], stepDownV[8];
+static uint16_t hicutDetectMs, locutDetectMs;
+
+// Measurement of the running instance
+static PlantConfig_t cfg;
+static Path_t runPath;
+static bool armed, contacts[5];
+static int startStep, targetStep;
+static int64_t commandUs, contactUs, passTapUs, lastTapMoveUs;
+
+static int Random(int lo, int hi) {
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (int)((seed >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+static void Reset_Core(void) {
+    currentState = STATE_NORMAL;
+    settingState = SETTING_IDLE;
+    r5State = R5_NORMAL;
+    adcCapturedA = currentADC = currentADCFast = 0;
+    currentOPV = currentIPV = 0;
+    currentStep = pendingStep = 0;
+    r5Status = stepChangePending = false;
+    relayOperations = hicutTrips = locutTrips = 0;
+    relayChangeTimer = r5Timer = delayCountStart = settingBlinkTimer = 0;
+    buttonPressStart = mstartPressStart = ledBlinkTimer = 0;
+    settingLedState = buttonWasPressed = mstartWasPressed = ledBlinkState = false;
+}
+
+static bool Apply_Sets(void) {
+    for(int i = 0; i < setCount; i++) {
+        char name[24];
+        unsigned value;
+        int id;
+        if(sscanf(sets[i], "%23[^=]=%u", name, &value) != 2 || (id = Params_Find(name)) < 0 ||
+           Params_Set((ParamId_t)id, (uint16_t)value) != PARAM_OK) {
+            fprintf(stderr, "-P %s rejected\n", sets[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Thresholds do not depend on the calibration: read them once
+static bool Load_Levels(void) {
+    Mock_Reset();
+    Reset_Core();
+    adcCapturedA = Plant_Calibration_Adc();
+    Params_Init();
+    if(!Apply_Sets()) return false;
+    hicutV = Params_Get(PARAM_HICUT) / 10.0f;
+    locutV = Params_Get(PARAM_LOCUT) / 10.0f;
+    hicutDetectMs = Params_Get(PARAM_HICUT_DETECT_MS);
+    locutDetectMs = Params_Get(PARAM_LOCUT_DETECT_MS);
+    for(int s = 1; s < 8; s++) {
+        stepUpV[s] = controlTable->stepUp[s] * 0.1f;
+        stepDownV[s] = controlTable->stepDown[s] * 0.1f;
+    }
+    return true;
+}
+
+// MEASUREMENT HOOKS
+static bool Tap_Settled(int step) {
+    uint8_t closed = 0;
+    
+    for(int i = 0; i < 4; i++) if(contacts[i]) closed |= 1 << i;
+    return closed == relaySteps[step].relays;
+}
+
+static void Output_Hook(HalOutput_t out, bool on, uint64_t timeUs) {
+    if(!armed || commandUs >= 0) return;
+    if(runPath <= PATH_LOCUT) {
+        if(out == HAL_OUT_R5 && !on) commandUs = (int64_t)timeUs;
+    } else if(out <= HAL_OUT_R4 && passTapUs < 0) {
+        passTapUs = (int64_t)timeUs;    // Direction checked after the pass
+    }
+}
+
+static void Contact_Hook(HalOutput_t relay, bool closed, uint64_t timeUs) {
+    contacts[relay] = closed;
+    if(relay <= HAL_OUT_R4) lastTapMoveUs = (int64_t)timeUs;
+    if(commandUs < 0 || contactUs >= 0) return;
+    if(runPath <= PATH_LOCUT) {
+        if(relay == HAL_OUT_R5 && !closed) contactUs = (int64_t)timeUs;
+    } else if(relay <= HAL_OUT_R4 && Tap_Settled(targetStep)) {
+        contactUs = (int64_t)timeUs + cfg.bounceUs;
+    }
+}
+
+// SCENARIOS
+// First time the piecewise-linear profile crosses level in the given direction
+static double Crossing_Us(const PlantPoint_t* p, int n, float level, bool rising) {
+    for(int i = 1; i < n; i++) {
+        float a = p[i-1].volts, b = p[i].volts;
+        bool beyond = rising ? b > level : b < level;
+        if(!beyond) continue;
+        if(p[i].timeS == p[i-1].timeS || a == b) return p[i].timeS * 1e6;
+        return (p[i-1].timeS + (level - a) / (b - a) * (p[i].timeS - p[i-1].timeS)) * 1e6;
+    }
+    return -1;
+}
+
+// Builds the profile; returns the crossing level, sets *step to the step the
+// unit must sit on at the event (-1: any)
+static float Build_Scenario(Path_t path, Family_t family, PlantPoint_t* p, int* n, int* step) {
+    float te = (SETTLE_US + Random(0, PHASE_SPREAD_US)) / 1e6f;
+    bool rising = (path == PATH_HICUT || path == PATH_TAP_UP);
+    float v0, level, v1;
+    
+    *step = -1;
+    switch(path) {
+        case PATH_HICUT:
+            v0 = 230.0f;
+            level = hicutV * RELAY_STEP_RATIO(7);
+            v1 = level + Random(5, 60);
+            break;
+        case PATH_LOCUT:
+            v0 = 230.0f;
+            level = locutV * RELAY_STEP_RATIO(0);
+            v1 = level - Random(5, 50);
+            break;
+        default: {
+            // Mid-way between the thresholds that keep step s
+            int s = Random(1, 6);
+            v0 = (stepDownV[s] + stepUpV[s+1]) / 2.0f;
+            level = (path == PATH_TAP_UP) ? stepUpV[s+1] : stepDownV[s];
+            v1 = rising ? level + Random(5, 25) : level - Random(5, 25);
+            *step = s;
+            break;
+        }
+    }
+    
+    // Events outlast the response: detect time for protection, filter and debounce for taps
+    uint16_t detectMs = (path == PATH_HICUT) ? hicutDetectMs : locutDetectMs;
+    float holdS = (path <= PATH_LOCUT) ? (detectMs + Random(300, 2500)) / 1000.0f : Random(500, 2000) / 1000.0f;
+    float rampS = (family == FAMILY_RAMP) ? fabsf(v1 - v0) / (path <= PATH_LOCUT ? Random(50, 1000) : Random(2, 100)) : 0.0f;
+    
+    *n = 0;
+    p[(*n)++] = (PlantPoint_t){ 0.0f, v0 };
+    p[(*n)++] = (PlantPoint_t){ te, v0 };
+    p[(*n)++] = (PlantPoint_t){ te + rampS, v1 };
+    if(family == FAMILY_EVENT) {
+        p[(*n)++] = (PlantPoint_t){ te + holdS, v1 };
+        p[(*n)++] = (PlantPoint_t){ te + holdS, v0 };
+        p[(*n)++] = (PlantPoint_t){ te + holdS + TAIL_US / 1e6f, v0 };
+    } else {
+        p[(*n)++] = (PlantPoint_t){ te + rampS + holdS + TAIL_US / 1e6f, v1 };
+    }
+    return level;
+}
+
+static void Run_Instance(Path_t path, Family_t family) {
+    PlantPoint_t profile[8];
+    int n, step;
+    float level = Build_Scenario(path, family, profile, &n, &step);
+    double crossUs = Crossing_Us(profile, n, level, path == PATH_HICUT || path == PATH_TAP_UP);
+    uint64_t eventUs = (uint64_t)(profile[1].timeS * 1e6);
+    uint64_t endUs = (uint64_t)(profile[n-1].timeS * 1e6);
+    Series_t* s = &series[path][family];
+    
+    Plant_Default_Config(&cfg);
+    cfg.profile = profile;
+    cfg.profileLen = n;
+    Mock_Reset();
+    Reset_Core();
+    memset(contacts, 0, sizeof(contacts));
+    runPath = path;
+    armed = false;
+    commandUs = contactUs = passTapUs = lastTapMoveUs = -1;
+    mockInputs[HAL_IN_LOWCUT_EN] = true;
+    HAL_Init();
+    mockOutputHook = Output_Hook;
+    plantContactHook = Contact_Hook;
+    Plant_Init(&cfg);
+    adcCapturedA = Plant_Calibration_Adc();
+    delayTimeMs = MIN_DELAY_TIME_SEC * 1000;
+    Save_Settings();
+    Stabilizer_Init();
+    if(!Apply_Sets()) exit(2);
+    
+    while(mockTimeUs < endUs && contactUs < 0) {
+        if(!armed && mockTimeUs >= eventUs) {
+            // Event starts: the unit must be connected and on the expected step
+            if(r5State != R5_NORMAL || !r5Status || (step >= 0 && currentStep != step)) {
+                s->invalid++;
+                return;
+            }
+            armed = true;
+            startStep = currentStep;
+        }
+        passTapUs = -1;
+        Stabilizer_Run();
+        if(armed && runPath >= PATH_TAP_UP && commandUs < 0 && passTapUs >= 0 &&
+           (runPath == PATH_TAP_UP ? currentStep > startStep : currentStep < startStep)) {
+            commandUs = passTapUs;
+            targetStep = currentStep;
+            if(Tap_Settled(targetStep)) contactUs = lastTapMoveUs + cfg.bounceUs;
+        }
+        HAL_Delay_Ms(passPeriodMs);
+        Plant_Update(mockTimeUs);
+    }
+    
+    if(contactUs < 0) {
+        s->missed++;
+        return;
+    }
+    s->command = realloc(s->command, (s->n + 1) * sizeof(double));
+    s->contact = realloc(s->contact, (s->n + 1) * sizeof(double));
+    s->command[s->n] = (commandUs - crossUs) / 1000.0;
+    s->contact[s->n] = (contactUs - crossUs) / 1000.0;
+    s->n++;
+}
+
+// REPORT
+static int Compare_Double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentiles; sorts v
+static Summary_t Summarize(double* v, int n) {
+    Summary_t r = { NAN, NAN, NAN };
+    if(n == 0) return r;
+    qsort(v, (size_t)n, sizeof(double), Compare_Double);
+    r.p50 = v[(int)ceil(0.50 * n) - 1];
+    r.p99 = v[(int)ceil(0.99 * n) - 1];
+    r.max = v[n-1];
+    return r;
+}
+
+static void Merge_All(void) {
+    for(int p = 0; p < PATH_COUNT; p++) {
+        Series_t* all = &series[p][FAMILY_COUNT];
+        for(int f = 0; f < FAMILY_COUNT; f++) {
+            const Series_t* s = &series[p][f];
+            all->command = realloc(all->command, (all->n + s->n + 1) * sizeof(double));
+            all->contact = realloc(all->contact, (all->n + s->n + 1) * sizeof(double));
+            memcpy(all->command + all->n, s->command, s->n * sizeof(double));
+            memcpy(all->contact + all->n, s->contact, s->n * sizeof(double));
+            all->n += s->n;
+            all->missed += s->missed;
+            all->invalid += s->invalid;
+        }
+    }
+}
+
+static bool Check_Budgets(const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[256], name[32], stat[8];
+    bool ok = true;
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    printf("\n%-10s %-4s %9s %9s %6s\n", "path", "stat", "budget", "measured", "used");
+    while(fgets(line, sizeof(line), f)) {
+        double budget;
+        int p;
+        if(sscanf(line, " latency %31s %7s %lf", name, stat, &budget) != 3) continue;
+        for(p = 0; p < PATH_COUNT && strcmp(pathNames[p], name) != 0; p++);
+        if(p == PATH_COUNT) {
+            printf("%-10s %-4s %9.1f %9s\n", name, stat, budget, "-");
+            continue;
+        }
+        Series_t* all = &series[p][FAMILY_COUNT];
+        Summary_t c = Summarize(all->contact, all->n);
+        double v = strcmp(stat, "p50") == 0 ? c.p50 : strcmp(stat, "p99") == 0 ? c.p99 : c.max;
+        bool over = !(v <= budget) || all->missed > 0 || all->invalid > 0;
+        printf("%-10s %-4s %9.1f %9.1f %5.1f%%%s\n", name, stat, budget, v, 100.0 * v / budget,
+               all->missed ? "  MISSED EVENTS" : all->invalid ? "  SKIPPED INSTANCES" : over ? "  OVER BUDGET" : "");
+        if(over) ok = false;
+    }
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* csvPath = NULL;
+    const char* budgets = NULL;
+    int count = 100;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-S") == 0 && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-P") == 0 && i + 1 < argc && setCount < MAX_SETS) sets[setCount++] = argv[++i];
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) csvPath = argv[++i];
+        else if(strcmp(argv[i], "-B") == 0 && i + 1 < argc) budgets = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [-n count] [-S seed] [-P name=value] [-c latency.csv] [-B budgets.txt]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(count < 1) count = 1;
+    
+    Plant_Default_Config(&cfg);
+    Plant_Init(&cfg);                   // Sense gain for the calibration
+    if(!Load_Levels()) return 2;
+    for(int p = 0; p < PATH_COUNT; p++)
+        for(int f = 0; f < FAMILY_COUNT; f++)
+            for(int i = 0; i < count; i++) Run_Instance((Path_t)p, (Family_t)f);
+    Merge_All();
+    
+    FILE* csv = NULL;
+    if(csvPath) {
+        csv = strcmp(csvPath, "-") == 0 ? stdout : fopen(csvPath, "w");
+        if(!csv) { perror(csvPath); return 2; }
+        fprintf(csv, "path,scenario,n,missed,invalid,command_p50_ms,command_p99_ms,command_max_ms,"
+                     "contact_p50_ms,contact_p99_ms,contact_max_ms\n");
+    }
+    if(csv != stdout) {
+        printf("%-9s %-6s %5s %6s %5s   %-23s   %-23s\n", "path", "event", "n", "missed", "skip",
+               "command p50/p99/max ms", "contact p50/p99/max ms");
+    }
+    for(int p = 0; p < PATH_COUNT; p++) {
+        for(int f = 0; f <= FAMILY_COUNT; f++) {
+            Series_t* s = &series[p][f];
+            const char* family = f < FAMILY_COUNT ? familyNames[p][f] : "all";
+            Summary_t cmd = Summarize(s->command, s->n);
+            Summary_t con = Summarize(s->contact, s->n);
+            if(csv) {
+                fprintf(csv, "%s,%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", pathNames[p], family, s->n,
+                        s->missed, s->invalid, cmd.p50, cmd.p99, cmd.max, con.p50, con.p99, con.max);
+            }
+            if(csv != stdout) {
+                printf("%-9s %-6s %5d %6d %5d   %7.1f %7.1f %7.1f   %7.1f %7.1f %7.1f\n", f ? "" : pathNames[p],
+                       family, s->n, s->missed, s->invalid, cmd.p50, cmd.p99, cmd.max, con.p50, con.p99, con.max);
+            }
+        }
+    }
+    if(csv && csv != stdout) fclose(csv);
+    
+    bool ok = true;
+    if(budgets) ok = Check_Budgets(budgets);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - MODBUS RTU SLAVE ON A PSEUDO-TERMINAL (HOST)
+ * ============================================================================
+ * Runs the firmware's protocol engine (modbus.c) behind a Linux pty so a
+ * master - mbpoll, a PLC gateway, or the built-in self test - can talk to
+ * it exactly as it would over RS-485. Frames are delimited by T3.5 silence.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -o modbus_pty modbus_pty.c ../modbus.c ../crc16.c
+ *
+ * Usage:
+ *   ./modbus_pty             print the pty path and serve requests
+ *   ./modbus_pty --selftest  drive scripted requests through the pty,
+ *                            exit status 0 when every response matches
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+#include "modbus.h"
+#include "crc16.h"
+
+#define SLAVE_ID            1
+#define T35_US              1750        // 3.5 characters at 19200 baud
+#define RESPONSE_TIMEOUT_MS 500
+
+// SIMULATED DEVICE - same layout as the firmware map in modbus_slave.c
+static uint16_t simInput[13] = {2301, 2301, 690, 4, 0, 0, 0x0B, 17, 2, 1, 0, 3600, 731};
+static uint16_t simHolding[6] = {2560, 2490, 1810, 1890, 180, 0};
+static uint16_t simStaged[6];               // A write request until Sim_Write_End
+
+static uint16_t Sim_Read(uint16_t* table, uint16_t idx) { return table[idx]; }
+
+#define SIM_IR(n) static uint16_t IR_##n(void) { return Sim_Read(simInput, n); }
+SIM_IR(0) SIM_IR(1) SIM_IR(2) SIM_IR(3) SIM_IR(4) SIM_IR(5) SIM_IR(6)
+SIM_IR(7) SIM_IR(8) SIM_IR(9) SIM_IR(10) SIM_IR(11) SIM_IR(12)
+
+#define SIM_HR(n) static uint16_t HR_##n(void) { return Sim_Read(simHolding, n); }
+SIM_HR(0) SIM_HR(1) SIM_HR(2) SIM_HR(3) SIM_HR(4) SIM_HR(5)
+
+// Same rules as the firmware: ranges per register, then LOCUT < LOCUT
+// resume < HICUT resume < HICUT on the whole request
+static bool Sim_Stage(int n, uint16_t v, uint16_t min, uint16_t max) {
+    if(v < min || v > max) return false;
+    simStaged[n] = v;
+    return true;
+}
+
+static bool HR_Set0(uint16_t v) { return Sim_Stage(0, v, 2000, 3000); }
+static bool HR_Set1(uint16_t v) { return Sim_Stage(1, v, 1800, 3000); }
+static bool HR_Set2(uint16_t v) { return Sim_Stage(2, v, 1000, 2400); }
+static bool HR_Set3(uint16_t v) { return Sim_Stage(3, v, 1000, 2600); }
+static bool HR_Set4(uint16_t v) { return Sim_Stage(4, v, 3, 180); }
+static bool HR_Set5(uint16_t v) { return v == 1; }
+
+static void Sim_Write_Begin(void) {
+    memcpy(simStaged, simHolding, sizeof(simStaged));
+}
+
+static bool Sim_Write_End(bool apply) {
+    const uint16_t* s = simStaged;
+    
+    if(!apply || !(s[2] < s[3] && s[3] < s[1] && s[1] < s[0])) return false;
+    memcpy(simHolding, simStaged, sizeof(simHolding));
+    return true;
+}
+
+static const ModbusRegister_t simInputRegs[] = {
+    {IR_0, 0}, {IR_1, 0}, {IR_2, 0}, {IR_3, 0}, {IR_4, 0}, {IR_5, 0}, {IR_6, 0},
+    {IR_7, 0}, {IR_8, 0}, {IR_9, 0}, {IR_10, 0}, {IR_11, 0}, {IR_12, 0}
+};
+
+static const ModbusRegister_t simHoldingRegs[] = {
+    {HR_0, HR_Set0}, {HR_1, HR_Set1}, {HR_2, HR_Set2},
+    {HR_3, HR_Set3}, {HR_4, HR_Set4}, {HR_5, HR_Set5}
+};
+
+static const ModbusMap_t simMap = {simInputRegs, 13, simHoldingRegs, 6, Sim_Write_Begin, Sim_Write_End};
+
+static void Pty_Raw(int fd) {
+    struct termios t;
+    if(tcgetattr(fd, &t) != 0) return;
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+}
+
+// Reads one frame: first byte waits up to timeoutMs, then ends after T3.5 silence
+static int Read_Frame(int fd, uint8_t* buf, int size, int timeoutMs) {
+    int len = 0;
+    struct timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    
+    while(len < size) {
+        fd_set rd;
+        FD_ZERO(&rd);
+        FD_SET(fd, &rd);
+        int r = select(fd + 1, &rd, NULL, NULL, &tv);
+        if(r <= 0) break;
+        int n = read(fd, buf + len, size - len);
+        if(n <= 0) return -1;
+        len += n;
+        tv.tv_sec = 0;
+        tv.tv_usec = T35_US;
+    }
+    return len;
+}
+
+static void Serve(int fd) {
+    uint8_t req[MODBUS_ADU_MAX + 1], resp[MODBUS_ADU_MAX];
+    
+    for(;;) {
+        int len = Read_Frame(fd, req, sizeof(req), 1000);
+        if(len < 0) return;
+        if(len == 0) continue;
+        uint16_t n = Modbus_Process(&simMap, SLAVE_ID, req, (uint16_t)len, resp);
+        if(n > 0 && write(fd, resp, n) != n) return;
+    }
+}
+
+// SELF TEST
+typedef struct {
+    const char* name;
+    uint8_t req[MODBUS_ADU_MAX];
+    int reqLen;             // Without CRC
+    bool badCrc;
+    uint8_t expect[MODBUS_ADU_MAX];
+    int expectLen;          // Without CRC, 0 = no response expected
+} SelfTest_t;
+
+static const SelfTest_t selfTests[] = {
+    {"read input 0..3", {1, 4, 0, 0, 0, 4}, 6, false,
+     {1, 4, 8, 0x08, 0xFD, 0x08, 0xFD, 0x02, 0xB2, 0x00, 0x04}, 11},
+    {"read input past end", {1, 4, 0, 12, 0, 2}, 6, false, {1, 0x84, 2}, 3},
+    {"read holding 0..4", {1, 3, 0, 0, 0, 5}, 6, false,
+     {1, 3, 10, 0x0A, 0x00, 0x09, 0xBA, 0x07, 0x12, 0x07, 0x62, 0x00, 0xB4}, 13},
+    {"write delay 30 s", {1, 6, 0, 4, 0, 30}, 6, false, {1, 6, 0, 4, 0, 30}, 6},
+    {"read back delay", {1, 3, 0, 4, 0, 1}, 6, false, {1, 3, 2, 0, 30}, 5},
+    {"reject delay 2 s", {1, 6, 0, 4, 0, 2}, 6, false, {1, 0x86, 3}, 3},
+    {"reject HICUT below resume", {1, 6, 0, 0, 0x09, 0x00}, 6, false, {1, 0x86, 3}, 3},
+    {"write HICUT pair", {1, 0x10, 0, 0, 0, 2, 4, 0x0A, 0x28, 0x09, 0xF6}, 11, false,
+     {1, 0x10, 0, 0, 0, 2}, 6},
+    {"read back HICUT pair", {1, 3, 0, 0, 0, 2}, 6, false, {1, 3, 4, 0x0A, 0x28, 0x09, 0xF6}, 7},
+    // 2400/2300/2200/2250: HICUT alone would fall below the old resume
+    {"move all four thresholds", {1, 0x10, 0, 0, 0, 4, 8, 0x09, 0x60, 0x08, 0xFC, 0x08, 0x98, 0x08, 0xCA}, 15,
+     false, {1, 0x10, 0, 0, 0, 4}, 6},
+    {"read back all four", {1, 3, 0, 0, 0, 4}, 6, false,
+     {1, 3, 8, 0x09, 0x60, 0x08, 0xFC, 0x08, 0x98, 0x08, 0xCA}, 11},
+    // HICUT pair fine, delay 2 s out of range: nothing applied
+    {"reject partial write", {1, 0x10, 0, 0, 0, 5, 10, 0x0A, 0x28, 0x09, 0xF6, 0x07, 0x12, 0x07, 0x62,
+     0, 2}, 17, false, {1, 0x90, 3}, 3},
+    {"nothing of it applied", {1, 3, 0, 0, 0, 4}, 6, false,
+     {1, 3, 8, 0x09, 0x60, 0x08, 0xFC, 0x08, 0x98, 0x08, 0xCA}, 11},
+    {"restore thresholds", {1, 0x10, 0, 0, 0, 4, 8, 0x0A, 0x28, 0x09, 0xF6, 0x07, 0x12, 0x07, 0x62}, 15,
+     false, {1, 0x10, 0, 0, 0, 4}, 6},
+    {"write past holding map", {1, 6, 0, 20, 0, 1}, 6, false, {1, 0x86, 2}, 3},
+    {"illegal function", {1, 0x2B, 0x0E, 1, 0, 0}, 6, false, {1, 0xAB, 1}, 3},
+    {"zero quantity", {1, 4, 0, 0, 0, 0}, 6, false, {1, 0x84, 3}, 3},
+    {"other slave id", {7, 4, 0, 0, 0, 1}, 6, false, {0}, 0},
+    {"bad CRC", {1, 4, 0, 0, 0, 1}, 6, true, {0}, 0},
+    {"broadcast write", {0, 6, 0, 4, 0, 60}, 6, false, {0}, 0},
+    {"broadcast applied", {1, 3, 0, 4, 0, 1}, 6, false, {1, 3, 2, 0, 60}, 5},
+};
+
+static int Append_Crc(uint8_t* buf, int len) {
+    uint16_t crc = CRC16_Calculate(buf, (uint16_t)len);
+    buf[len] = (uint8_t)crc;
+    buf[len+1] = (uint8_t)(crc >> 8);
+    return len + 2;
+}
+
+static int Self_Test(const char* ptsName) {
+    int fd = open(ptsName, O_RDWR | O_NOCTTY);
+    int failures = 0;
+    
+    if(fd < 0) { perror(ptsName); return 1; }
+    Pty_Raw(fd);
+    
+    for(size_t i = 0; i < sizeof(selfTests)/sizeof(selfTests[0]); i++) {
+        const SelfTest_t* t = &selfTests[i];
+        uint8_t req[MODBUS_ADU_MAX + 2], expect[MODBUS_ADU_MAX + 2], resp[MODBUS_ADU_MAX + 2];
+        int reqLen, expectLen = 0, got;
+        
+        memcpy(req, t->req, t->reqLen);
+        reqLen = Append_Crc(req, t->reqLen);
+        if(t->badCrc) req[reqLen-1] ^= 0x55;
+        if(t->expectLen > 0) {
+            memcpy(expect, t->expect, t->expectLen);
+            expectLen = Append_Crc(expect, t->expectLen);
+        }
+        
+        if(write(fd, req, reqLen) != reqLen) { perror("write"); close(fd); return 1; }
+        got = Read_Frame(fd, resp, sizeof(resp), t->expectLen > 0 ? RESPONSE_TIMEOUT_MS : 100);
+        
+        bool ok = (got == expectLen) && memcmp(resp, expect, expectLen) == 0;
+        printf("%-28s %s\n", t->name, ok ? "ok" : "FAIL");
+        if(!ok) {
+            printf("  expected:");
+            for(int j = 0; j < expectLen; j++) printf(" %02X", expect[j]);
+            printf("\n  received:");
+            for(int j = 0; j < got; j++) printf(" %02X", resp[j]);
+            printf("\n");
+            failures++;
+        }
+    }
+    
+    close(fd);
+    printf("%d/%zu passed\n", (int)(sizeof(selfTests)/sizeof(selfTests[0])) - failures,
+           sizeof(selfTests)/sizeof(selfTests[0]));
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    bool selfTest = (argc > 1 && strcmp(argv[1], "--selftest") == 0);
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    Pty_Raw(master);
+    
+    const char* pts = ptsname(master);
+    if(!selfTest) {
+        printf("Modbus RTU slave %d on %s\n", SLAVE_ID, pts);
+        fflush(stdout);
+        Serve(master);
+        return 0;
+    }
+    
+    pid_t pid = fork();
+    if(pid == 0) {
+        Serve(master);
+        _exit(0);
+    }
+    int rc = Self_Test(pts);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return rc;
+}
@@ -0,0 +1,267 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - PLANT MODEL (HOST)
+ * ============================================================================
+ * See plant.h. Between two updates the mains voltage is taken at the
+ * midpoint and the tap position is constant, so each interval is one exact
+ * step of the sense RC filter. Relay contacts move operateUs/releaseUs after
+ * the coil command and chatter for bounceUs. While a tap contact chatters
+ * the output is open about half of the time: the sense filter sees half the
+ * voltage and the load counts as dropped out.
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "stabilizer.h"
+#include "plant.h"
+
+#define NO_EVENT    UINT64_MAX
+
+typedef struct {
+    bool coil, contact;
+    uint64_t dueUs;             // Contact moves to coil state, NO_EVENT if none
+    uint64_t settleUs;          // End of chatter after the last move
+} Relay_t;
+
+PlantStats_t plantStats;
+int plantStep=0;
+bool plantChatter=false;
+bool plantLoadOn=false;
+void (*plantContactHook)(HalOutput_t relay, bool closed, uint64_t timeUs)=NULL;
+
+static PlantConfig_t cfg;
+static Relay_t relay[5];        // HAL_OUT_R1..HAL_OUT_R5
+static uint64_t lastUs=0;
+static float senseCounts=0.0f;  // RC filter output in ADC counts
+static float outputVolts=0.0f;
+static bool loadValid=false;    // Load connected to a settled tap
+static uint64_t overRunUs=0, underRunUs=0;
+static int profileCursor=0;
+static uint32_t noiseSeed=1;
+static void (*chainedHook)(HalOutput_t out, bool on, uint64_t timeUs)=NULL;
+
+void Plant_Default_Config(PlantConfig_t* c) {
+    memset(c, 0, sizeof(*c));
+    c->mainsHz = 50.0f;
+    c->senseCountsPerVolt = 1023.0f / 700.0f;   // Full scale at 700 V: step 0 at 330 V mains
+    c->senseTauMs = 20.0f;
+    c->ripplePct = 1.0f;
+    c->noiseCounts = 1;
+    c->operateUs = 8000;
+    c->releaseUs = 4000;
+    c->bounceUs = 1000;
+}
+
+float Plant_Mains_Volts(uint64_t timeUs) {
+    const PlantPoint_t* p = cfg.profile;
+    float s = timeUs / 1e6f;
+    
+    if(!p || cfg.profileLen <= 0) return 230.0f;
+    if(s < p[profileCursor].timeS) profileCursor = 0;
+    while(profileCursor+1 < cfg.profileLen && p[profileCursor+1].timeS <= s) profileCursor++;
+    if(s <= p[profileCursor].timeS || profileCursor+1 >= cfg.profileLen) return p[profileCursor].volts;
+    
+    const PlantPoint_t* a = &p[profileCursor];
+    const PlantPoint_t* b = a + 1;
+    return a->volts + (b->volts - a->volts) * (s - a->timeS) / (b->timeS - a->timeS);
+}
+
+// Contacts R1-R4 -> step, -1 if the combination is not a tap of relaySteps[]
+static int Contact_Step(void) {
+    uint8_t closed = 0;
+    
+    for(int i = 0; i < 4; i++) if(relay[i].contact) closed |= 1 << i;
+    for(int s = 0; s < 8; s++) if(relaySteps[s].relays == closed) return s;
+    return -1;
+}
+
+static void Refresh_State(uint64_t timeUs) {
+    plantStep = Contact_Step();
+    plantChatter = false;
+    for(int i = 0; i < 4; i++) plantChatter |= timeUs < relay[i].settleUs;
+    plantLoadOn = relay[4].contact;
+    loadValid = plantLoadOn && timeUs >= relay[4].settleUs && plantStep >= 0 && !plantChatter;
+}
+
+// Advances filter and statistics over [lastUs, toUs) with the current state
+// Sense chain transfer: output volts -> ADC counts before filter and ripple
+static float Sense_Counts(float volts) {
+    float v = volts > cfg.senseOffsetV ? volts - cfg.senseOffsetV : 0.0f;
+    return v * cfg.senseCountsPerVolt * (1.0f + cfg.senseCurvePct / 1e4f * (volts - CALIBRATION_VOLTAGE));
+}
+
+static void Integrate(uint64_t toUs) {
+    if(toUs <= lastUs) return;
+    uint64_t dt = toUs - lastUs;
+    float mains = Plant_Mains_Volts(lastUs + dt/2);
+    PlantStats_t* st = &plantStats;
+    
+    outputVolts = plantStep >= 0 ? mains / RELAY_STEP_RATIO(plantStep) : 0.0f;
+    float target = Sense_Counts(outputVolts) * (plantChatter ? 0.5f : 1.0f);
+    senseCounts = target + (senseCounts - target) * expf(-(float)dt / (cfg.senseTauMs * 1000.0f));
+    
+    st->simUs += dt;
+    bool over = loadValid && outputVolts > HICUT_THRESHOLD;
+    bool under = loadValid && outputVolts < LOCUT_THRESHOLD;
+    overRunUs = over ? overRunUs + dt : 0;
+    underRunUs = under ? underRunUs + dt : 0;
+    if(overRunUs > st->overMaxRunUs) st->overMaxRunUs = overRunUs;
+    if(underRunUs > st->underMaxRunUs) st->underMaxRunUs = underRunUs;
+    if(plantLoadOn) {
+        if(!loadValid) {
+            st->dropoutUs += dt;
+        } else {
+            int bin = (int)(outputVolts / 10.0f);
+            st->loadOnUs += dt;
+            st->histUs[bin < PLANT_HIST_BINS ? bin : PLANT_HIST_BINS-1] += dt;
+            if(outputVolts >= PLANT_BAND_LOW_V && outputVolts <= PLANT_BAND_HIGH_V) st->inBandUs += dt;
+            if(over) st->overUs += dt;
+            if(under) st->underUs += dt;
+            if(outputVolts < st->loadMinV) st->loadMinV = outputVolts;
+            if(outputVolts > st->loadMaxV) st->loadMaxV = outputVolts;
+        }
+    }
+    lastUs = toUs;
+}
+
+static uint64_t Next_Event(void) {
+    uint64_t next = NO_EVENT;
+    for(int i = 0; i < 5; i++) {
+        if(relay[i].dueUs < next) next = relay[i].dueUs;
+        if(relay[i].settleUs > lastUs && relay[i].settleUs < next) next = relay[i].settleUs;
+    }
+    return next;
+}
+
+void Plant_Update(uint64_t timeUs) {
+    uint64_t next;
+    
+    while((next = Next_Event()) <= timeUs) {
+        Integrate(next);
+        for(int i = 0; i < 5; i++) {
+            Relay_t* r = &relay[i];
+            if(r->dueUs != next) continue;
+            r->contact = r->coil;
+            r->dueUs = NO_EVENT;
+            r->settleUs = next + cfg.bounceUs;
+            plantStats.contactMoves[i]++;
+            if(cfg.bounceUs) plantStats.bounces++;
+            if(i == 4) {
+                if(r->contact) plantStats.r5Closes++;
+                else plantStats.r5Opens++;
+            } else {
+                bool between = false;
+                for(int j = 0; j < 4; j++) between |= relay[j].contact != relay[j].coil;
+                if(between) plantStats.tapTransients++;
+            }
+            if(plantContactHook) plantContactHook((HalOutput_t)i, r->contact, next);
+        }
+        Refresh_State(next);
+    }
+    Integrate(timeUs);
+    Refresh_State(timeUs);
+}
+
+float Plant_Output_Volts(void) {
+    return outputVolts;
+}
+
+float Plant_Load_Volts(void) {
+    return loadValid ? outputVolts : 0.0f;
+}
+
+int Plant_Load_Profile(const char* path, PlantPoint_t* points, int maxPoints) {
+    FILE* f = fopen(path, "r");
+    char line[128];
+    int n = 0;
+    
+    if(!f) { perror(path); return -1; }
+    while(fgets(line, sizeof(line), f)) {
+        char* hash = strchr(line, '#');
+        char time[32];
+        double h, m, s, v;
+        if(hash) *hash = 0;
+        if(sscanf(line, "%31s %lf", time, &v) != 2) continue;
+        switch(sscanf(time, "%lf:%lf:%lf", &h, &m, &s)) {
+            case 1: s = h; break;
+            case 2: s = h*3600 + m*60; break;
+            case 3: s += h*3600 + m*60; break;
+            default: continue;
+        }
+        if(n == maxPoints || (n && s < points[n-1].timeS)) {
+            fprintf(stderr, "%s: too many points or time going backwards\n", path);
+            fclose(f);
+            return -1;
+        }
+        points[n++] = (PlantPoint_t){ (float)s, (float)v };
+    }
+    fclose(f);
+    return n;
+}
+
+uint16_t Plant_Calibration_Adc(void) {
+    return Plant_Sense_Adc(CALIBRATION_VOLTAGE);
+}
+
+uint16_t Plant_Sense_Adc(float volts) {
+    return (uint16_t)(Sense_Counts(volts) + 0.5f);
+}
+
+// ADC: filtered sense voltage, sawtooth ripple at twice mains frequency
+// (peak charge, then RC discharge) and uniform noise
+static uint16_t Plant_Adc(uint64_t timeUs) {
+    Plant_Update(timeUs);
+    
+    uint64_t periodUs = (uint64_t)(1e6f / (2.0f * cfg.mainsHz));
+    float phase = (float)(timeUs % periodUs) / (float)periodUs;
+    float v = senseCounts * (1.0f + cfg.ripplePct / 100.0f * (0.5f - phase));
+    
+    if(cfg.noiseCounts) {
+        noiseSeed = noiseSeed * 1664525u + 1013904223u;
+        v += (float)((int32_t)((noiseSeed >> 16) % (2u*cfg.noiseCounts + 1)) - cfg.noiseCounts);
+    }
+    if(v < 0.0f) return 0;
+    return v > 1023.0f ? 1023 : (uint16_t)(v + 0.5f);
+}
+
+static void Plant_Output(HalOutput_t out, bool on, uint64_t timeUs) {
+    Plant_Update(timeUs);
+    if(out <= HAL_OUT_R5) {
+        Relay_t* r = &relay[out];
+        if(r->coil != on) {
+            r->coil = on;
+            plantStats.coilOps[out]++;
+            // Released before the contact moved: it stays where it was
+            r->dueUs = (r->contact == on) ? NO_EVENT : timeUs + (on ? cfg.operateUs : cfg.releaseUs);
+        }
+    }
+    if(chainedHook) chainedHook(out, on, timeUs);
+}
+
+void Plant_Init(const PlantConfig_t* c) {
+    cfg = *c;
+    lastUs = mockTimeUs;
+    profileCursor = 0;
+    overRunUs = underRunUs = 0;
+    noiseSeed = 1;
+    memset(&plantStats, 0, sizeof(plantStats));
+    plantStats.loadMinV = 1e9f;
+    
+    for(int i = 0; i < 5; i++) {
+        relay[i].coil = relay[i].contact = mockOutputs[i];
+        relay[i].dueUs = NO_EVENT;
+        relay[i].settleUs = 0;
+    }
+    Refresh_State(lastUs);
+    
+    // Sense capacitor already charged: the MCU starts after the supply is up
+    outputVolts = plantStep >= 0 ? Plant_Mains_Volts(lastUs) / RELAY_STEP_RATIO(plantStep) : 0.0f;
+    senseCounts = Sense_Counts(outputVolts);
+    
+    if(mockOutputHook != Plant_Output) chainedHook = mockOutputHook;
+    mockOutputHook = Plant_Output;
+    mockAdcSource = Plant_Adc;
+}
@@ -0,0 +1,81 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - PLANT MODEL (HOST)
+ * ============================================================================
+ * Closed-loop model of what the firmware controls, driven through the mock
+ * HAL: mains RMS profile, the eight transformer taps of relaySteps[], relay
+ * operate/release latency and contact bounce, the R5 load disconnect and the
+ * sense circuit (RC filter, ripple, noise) into ADC counts. The sense input
+ * is the transformer output, ahead of R5, as on the board.
+ *
+ * Plant_Init() installs itself as mockAdcSource and mockOutputHook; any hook
+ * already installed is still called. State advances piecewise between ADC
+ * conversions and relay events, so the cost follows the firmware's sampling
+ * rate rather than the mains frequency.
+ * ============================================================================
+ */
+
+#ifndef __PLANT_H
+#define __PLANT_H
+
+#include "hal_mock.h"
+
+#define PLANT_BAND_LOW_V        207.0f      // 230 V -10%
+#define PLANT_BAND_HIGH_V       253.0f      // 230 V +10%
+#define PLANT_HIST_BINS         32          // 10 V bins of load voltage
+
+// Mains RMS breakpoints, linearly interpolated; two points at the same time
+// make a step
+typedef struct {
+    float timeS, volts;
+} PlantPoint_t;
+
+typedef struct {
+    const PlantPoint_t* profile;
+    int profileLen;
+    float mainsHz;
+    float senseCountsPerVolt;   // ADC counts per volt of transformer output
+    float senseOffsetV;         // Output volts lost in the sense chain (rectifier drop)
+    float senseCurvePct;        // Gain change per 100 V above CALIBRATION_VOLTAGE
+    float senseTauMs;           // Sense RC filter time constant
+    float ripplePct;            // Peak-to-peak ripple at twice mains frequency
+    uint16_t noiseCounts;       // Uniform noise, +/- counts
+    uint16_t operateUs;         // Coil energised -> contact moves
+    uint16_t releaseUs;         // Coil released -> contact moves
+    uint16_t bounceUs;          // Contact chatter after closing
+} PlantConfig_t;
+
+typedef struct {
+    uint64_t simUs;
+    uint64_t loadOnUs;                  // R5 closed and settled, valid tap
+    uint64_t dropoutUs;                 // R5 closed, but a contact is bouncing or no valid tap
+    uint64_t inBandUs;                  // Load within PLANT_BAND_LOW/HIGH_V
+    uint64_t overUs, underUs;           // Load above HICUT / below LOCUT defaults
+    uint64_t overMaxRunUs, underMaxRunUs;   // Longest uninterrupted exposure
+    uint64_t histUs[PLANT_HIST_BINS];
+    float loadMinV, loadMaxV;
+    uint32_t coilOps[5], contactMoves[5], bounces;
+    uint32_t tapTransients;             // Tap combinations passed through between steps
+    uint32_t r5Opens, r5Closes;
+} PlantStats_t;
+
+extern PlantStats_t plantStats;
+extern int plantStep;                   // Step of the tap contacts, -1 if not in relaySteps[]
+extern bool plantChatter;               // A tap contact is bouncing
+extern bool plantLoadOn;                // R5 contact closed (possibly bouncing)
+extern void (*plantContactHook)(HalOutput_t relay, bool closed, uint64_t timeUs);
+
+void Plant_Default_Config(PlantConfig_t* cfg);
+void Plant_Init(const PlantConfig_t* cfg);
+void Plant_Update(uint64_t timeUs);     // Advance the model to timeUs
+float Plant_Mains_Volts(uint64_t timeUs);
+float Plant_Output_Volts(void);         // Transformer output at the last update
+float Plant_Load_Volts(void);           // 0 while R5 is open or a tap is switching
+uint16_t Plant_Calibration_Adc(void);   // Ideal adcCapturedA for this sense gain
+uint16_t Plant_Sense_Adc(float volts);  // Ideal count at an output voltage
+
+// "<time> <volts>" per line, time in seconds or hh:mm[:ss], '#' starts a
+// comment. Returns the number of points, -1 on error (reported on stderr).
+int Plant_Load_Profile(const char* path, PlantPoint_t* points, int maxPoints);
+
+#endif /* __PLANT_H */
@@ -0,0 +1,343 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CLOSED-LOOP PLANT SIMULATOR (HOST)
+ * ============================================================================
+ * Runs the unmodified control core (stabilizer.c, params.c) against the
+ * plant model (plant.c) on the mock HAL's virtual clock. The default profile
+ * is a 24 hour grid day with a lost-neutral swell and a brownout, so both
+ * protection trips and their 180 s reconnect waits are exercised; it
+ * simulates in a few seconds.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -DSERIAL_PROTOCOL=0 -o plant_sim plant_sim.c plant.c \
+ *       trace_io.c hal_mock.c ../stabilizer.c ../params.c ../filter.c ../crc16.c -lm
+ *
+ * Usage:
+ *   ./plant_sim [options]
+ *     -p FILE   mains profile: "<time> <volts>" per line, time in seconds or
+ *               hh:mm[:ss], linear between points, '#' starts a comment
+ *     -T SEC    simulated time (default: end of the profile)
+ *     -d SEC    reconnect delay stored in the settings (default 180)
+ *     -e PCT    calibration error of adcCapturedA (default 0)
+ *     -c V,...  extra sense calibration points at these output volts
+ *     -o V      sense chain offset in output volts (default 0)
+ *     -k PCT    sense gain change per 100 V above 244 V (default 0)
+ *     -L        LOWCUT_EN jumper open (low-cut disabled)
+ *     -P N=V    set parameter N (params.c name) to V in raw units
+ *               (0.1 V, V, ms or s), e.g. -P debounce_ms=100; repeatable
+ *     -s FILE   sample CSV: time, mains, step, OPV, IPV, load, R5 state
+ *     -i SEC    sample interval (default 1)
+ *     -E FILE   event CSV: step changes, R5/system states, relay contacts
+ *     -R FILE   record the ADC trace (trace.h format) for trace_replay
+ *     -D FILE   write the decision log (trace_io.h)
+ *     -B FILE   check "day <taps|coil_ops> <count>" lines of a budgets file
+ *               against tap changes and R1-R4 coil operations per simulated day
+ *
+ * Exit status 1 when the load saw HICUT (or, with low-cut enabled, LOCUT)
+ * for longer than the detect time plus PROTECT_MARGIN_MS in one stretch, or
+ * when a budget is exceeded.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "plant.h"
+#include "trace_io.h"
+
+#define MAX_PROFILE_POINTS  4096
+#define PROTECT_MARGIN_MS   100         // Loop period, filter lag, R5 release
+
+#define H(h, m)     ((h)*3600.0f + (m)*60.0f)
+
+// 24 h grid day. Night high, morning and evening load peaks, a short sag,
+// a 290 V swell the taps can follow, a lost-neutral swell above the top tap
+// (HICUT) and an evening brownout below the bottom tap (LOCUT).
+static const PlantPoint_t dayProfile[] = {
+    {H( 0, 0), 248}, {H( 4, 0), 256}, {H( 5,30), 252}, {H( 7, 0), 228},
+    {H( 9, 0), 215}, {H(10,15), 214}, {H(10,15)+0.1f, 150}, {H(10,15)+0.4f, 150},
+    {H(10,15)+0.5f, 214}, {H(11,20), 220}, {H(11,20)+0.1f, 290}, {H(11,20)+2.0f, 290},
+    {H(11,20)+2.1f, 220}, {H(12, 0), 222}, {H(14, 0), 218}, {H(14,30), 218},
+    {H(14,30)+0.05f, 460}, {H(14,30)+8.0f, 460}, {H(14,30)+8.05f, 218}, {H(16, 0), 205},
+    {H(18, 0), 185}, {H(19, 0), 170}, {H(19,30), 168}, {H(19,30)+0.1f, 75},
+    {H(19,30)+45.0f, 75}, {H(19,30)+46.0f, 168}, {H(21, 0), 190}, {H(22, 0), 215},
+    {H(23, 0), 240}, {H(24, 0), 248}
+};
+
+static PlantPoint_t fileProfile[MAX_PROFILE_POINTS];
+static FILE* eventCsv = NULL;
+static uint16_t (*plantAdc)(uint64_t timeUs) = NULL;
+
+static void Event(const char* name, const char* value) {
+    if(eventCsv) fprintf(eventCsv, "%.3f,%s,%s,%.1f\n", mockTimeUs / 1e6, name, value,
+                         Plant_Mains_Volts(mockTimeUs));
+}
+
+static void Contact_Event(HalOutput_t relay, bool closed, uint64_t timeUs) {
+    if(eventCsv) fprintf(eventCsv, "%.3f,contact_%s,%d,%.1f\n", timeUs / 1e6,
+                         Mock_Output_Name(relay), closed, Plant_Mains_Volts(timeUs));
+}
+
+static uint8_t Input_Pins(void) {
+    uint8_t pins = 0;
+    for(int i = 0; i < HAL_IN_COUNT; i++)
+        if(HAL_Input_Active((HalInput_t)i)) pins |= 1 << i;
+    return pins;
+}
+
+// Plant ADC with every conversion written to the trace, as trace.c does
+static uint16_t Record_Adc(uint64_t timeUs) {
+    uint16_t v = plantAdc(timeUs);
+    if(v > 1023) v = 1023;
+    Trace_Writer_Sample((uint32_t)timeUs, v, Input_Pins());
+    return v;
+}
+
+static void Print_Hms(const char* label, uint64_t us) {
+    uint64_t s = us / 1000000;
+    printf("%s%02u:%02u:%02u", label, (unsigned)(s / 3600), (unsigned)(s / 60 % 60), (unsigned)(s % 60));
+}
+
+static double Pct(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+// Relay wear budgets, scaled to a 24 h day
+static bool Check_Budgets(const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[256], name[32];
+    double perDay = 86400e6 / (double)mockTimeUs;
+    const PlantStats_t* st = &plantStats;
+    bool ok = true;
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    printf("\n%-10s %9s %9s %6s\n", "per day", "budget", "measured", "used");
+    while(fgets(line, sizeof(line), f)) {
+        double budget, v;
+        if(sscanf(line, " day %31s %lf", name, &budget) != 2) continue;
+        if(strcmp(name, "taps") == 0) v = relayOperations * perDay;
+        else if(strcmp(name, "coil_ops") == 0)
+            v = (double)(st->coilOps[0] + st->coilOps[1] + st->coilOps[2] + st->coilOps[3]) * perDay;
+        else {
+            printf("%-10s %9.0f %9s\n", name, budget, "-");
+            continue;
+        }
+        bool over = !(v <= budget);
+        printf("%-10s %9.0f %9.0f %5.1f%%%s\n", name, budget, v, 100.0 * v / budget, over ? "  OVER BUDGET" : "");
+        if(over) ok = false;
+    }
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* profilePath = NULL;
+    const char* samplePath = NULL;
+    const char* eventPath = NULL;
+    const char* recordPath = NULL;
+    const char* decisionPath = NULL;
+    const char* budgets = NULL;
+    FILE* decisionFile = NULL;
+    double durationS = 0, delayS = DEFAULT_DELAY_TIME_SEC, calErrPct = 0, intervalS = 1;
+    bool lowcut = true;
+    PlantConfig_t cfg;
+    FILE* sampleCsv = NULL;
+    const char* sets[16];
+    int setCount = 0;
+    const char* calList = NULL;
+    float senseOffset = 0, senseCurve = 0;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) profilePath = argv[++i];
+        else if(strcmp(argv[i], "-T") == 0 && i + 1 < argc) durationS = atof(argv[++i]);
+        else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc) delayS = atof(argv[++i]);
+        else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc) calErrPct = atof(argv[++i]);
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) calList = argv[++i];
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) senseOffset = atof(argv[++i]);
+        else if(strcmp(argv[i], "-k") == 0 && i + 1 < argc) senseCurve = atof(argv[++i]);
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc) intervalS = atof(argv[++i]);
+        else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc) samplePath = argv[++i];
+        else if(strcmp(argv[i], "-E") == 0 && i + 1 < argc) eventPath = argv[++i];
+        else if(strcmp(argv[i], "-R") == 0 && i + 1 < argc) recordPath = argv[++i];
+        else if(strcmp(argv[i], "-D") == 0 && i + 1 < argc) decisionPath = argv[++i];
+        else if(strcmp(argv[i], "-B") == 0 && i + 1 < argc) budgets = argv[++i];
+        else if(strcmp(argv[i], "-P") == 0 && i + 1 < argc && setCount < 16) sets[setCount++] = argv[++i];
+        else if(strcmp(argv[i], "-L") == 0) lowcut = false;
+        else {
+            fprintf(stderr, "usage: %s [-p profile] [-T sec] [-d sec] [-e pct] [-c V,...] [-o V] [-k pct]\n"
+                            "          [-L] [-P name=value]\n"
+                            "          [-s samples.csv] [-i sec] [-E events.csv] [-R trace.bin] [-D decisions]\n"
+                            "          [-B budgets.txt]\n", argv[0]);
+            return 2;
+        }
+    }
+    
+    Plant_Default_Config(&cfg);
+    cfg.profile = dayProfile;
+    cfg.profileLen = sizeof(dayProfile) / sizeof(dayProfile[0]);
+    cfg.senseOffsetV = senseOffset;
+    cfg.senseCurvePct = senseCurve;
+    if(profilePath) {
+        int n = Plant_Load_Profile(profilePath, fileProfile, MAX_PROFILE_POINTS);
+        if(n <= 0) return 2;
+        cfg.profile = fileProfile;
+        cfg.profileLen = n;
+    }
+    if(durationS <= 0) durationS = cfg.profile[cfg.profileLen-1].timeS;
+    if(samplePath) {
+        if(!(sampleCsv = fopen(samplePath, "w"))) { perror(samplePath); return 2; }
+        fprintf(sampleCsv, "time_s,mains_v,step,opv,ipv,load_v,r5_state\n");
+    }
+    if(eventPath) {
+        if(!(eventCsv = fopen(eventPath, "w"))) { perror(eventPath); return 2; }
+        fprintf(eventCsv, "time_s,event,value,mains_v\n");
+        plantContactHook = Contact_Event;
+    }
+    
+    // Calibrated unit: settings in Flash, parameters at their defaults
+    Mock_Reset();
+    mockInputs[HAL_IN_LOWCUT_EN] = lowcut;
+    HAL_Init();
+    Plant_Init(&cfg);
+    adcCapturedA = (uint16_t)(Plant_Calibration_Adc() * (1.0 + calErrPct / 100.0) + 0.5);
+    delayTimeMs = (uint32_t)(delayS * 1000);
+    for(const char* p = calList; p && *p && calPointCount < CAL_POINTS_MAX - 1; ) {
+        char* end;
+        float v = strtof(p, &end);
+        if(end == p) break;
+        calPoints[calPointCount++] = (CalPoint_t){ Plant_Sense_Adc(v), (uint16_t)(v * 10 + 0.5f) };
+        p = (*end == ',') ? end + 1 : end;
+    }
+    uint8_t calRequested = calPointCount;
+    Save_Settings();
+    if(recordPath) {
+        if(!Trace_Writer_Open(recordPath)) return 2;
+        plantAdc = mockAdcSource;
+        mockAdcSource = Record_Adc;
+    }
+    if(decisionPath) {
+        if(!(decisionFile = fopen(decisionPath, "w"))) { perror(decisionPath); return 2; }
+        Decisions_Begin(decisionFile);
+    }
+    
+    struct timespec w0, w1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    
+    Stabilizer_Init();
+    if(calPointCount != calRequested) {
+        fprintf(stderr, "-c %s rejected (points closer than %u counts or out of order)\n", calList, CAL_MIN_SPAN);
+        return 2;
+    }
+    for(int i = 0; i < setCount; i++) {
+        char name[24];
+        unsigned value;
+        int id;
+        if(sscanf(sets[i], "%23[^=]=%u", name, &value) != 2 || (id = Params_Find(name)) < 0 ||
+           Params_Set((ParamId_t)id, (uint16_t)value) != PARAM_OK) {
+            fprintf(stderr, "-P %s rejected\n", sets[i]);
+            return 2;
+        }
+    }
+    
+    uint64_t endUs = (uint64_t)(durationS * 1e6);
+    uint64_t intervalUs = (uint64_t)(intervalS * 1e6), nextSampleUs = 0;
+    uint64_t delayUs = 0, passes = 0, slowUs = 0;
+    uint32_t configTimer = HAL_GetTick() - TRACE_CONFIG_PERIOD_MS;
+    uint8_t lastStep = currentStep;
+    R5State_t lastR5 = r5State;
+    uint32_t reconnects = (lastR5 == R5_DELAY_ACTIVE);    // Power-on wait, once booted
+    SystemState_t lastState = currentState;
+    char buf[16];
+    
+    while(mockTimeUs < endUs) {
+        uint64_t t = mockTimeUs;
+        Stabilizer_Run();
+        if(decisionFile) Decisions_Poll();
+        if(recordPath) {
+            Trace_Writer_End_Pass();
+            if((HAL_GetTick() - configTimer) >= TRACE_CONFIG_PERIOD_MS) {
+                configTimer = HAL_GetTick();
+                Trace_Writer_Config(Input_Pins());
+            }
+        }
+        if(passPeriodMs > LOOP_PERIOD_MS) slowUs += passPeriodMs * 1000u;
+        HAL_Delay_Ms(passPeriodMs);
+        passes++;
+        if(lastR5 == R5_DELAY_ACTIVE) delayUs += mockTimeUs - t;
+        
+        if(currentStep != lastStep) {
+            snprintf(buf, sizeof(buf), "%u", currentStep);
+            Event("step", buf);
+            lastStep = currentStep;
+        }
+        if(r5State != lastR5) {
+            if(r5State == R5_DELAY_ACTIVE) reconnects++;
+            Event("r5_state", r5StateNames[r5State]);
+            lastR5 = r5State;
+        }
+        if(currentState != lastState) {
+            Event("state", systemStateNames[currentState]);
+            lastState = currentState;
+        }
+        if(sampleCsv && mockTimeUs >= nextSampleUs) {
+            Plant_Update(mockTimeUs);
+            fprintf(sampleCsv, "%.3f,%.1f,%u,%.1f,%.1f,%.1f,%s\n", mockTimeUs / 1e6,
+                    Plant_Mains_Volts(mockTimeUs), currentStep, currentOPV * 0.1f, currentIPV * 0.1f,
+                    Plant_Load_Volts(), r5StateNames[r5State]);
+            nextSampleUs += intervalUs;
+        }
+    }
+    Plant_Update(mockTimeUs);
+    
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    double wall = (w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9;
+    const PlantStats_t* st = &plantStats;
+    
+    Print_Hms("simulated ", mockTimeUs);
+    printf(" in %.2f s (%.0fx real time), %llu loop passes, %llu ADC conversions\n",
+           wall, mockTimeUs / 1e6 / wall, (unsigned long long)passes, (unsigned long long)mockAdcReads);
+    printf("slow pass rate      %6.2f %% of the time (%u ms instead of %u ms between passes)\n",
+           Pct(slowUs, mockTimeUs), PASS_SLOW_MS, LOOP_PERIOD_MS);
+    printf("load connected      %6.2f %%   in %.0f-%.0f V %6.2f %% of that   range %.1f-%.1f V\n",
+           Pct(st->loadOnUs, st->simUs), PLANT_BAND_LOW_V, PLANT_BAND_HIGH_V,
+           Pct(st->inBandUs, st->loadOnUs), st->loadMinV, st->loadMaxV);
+    printf("load > %.0f V        %8.3f s   longest %.3f s\n", HICUT_THRESHOLD, st->overUs / 1e6, st->overMaxRunUs / 1e6);
+    printf("load < %.0f V        %8.3f s   longest %.3f s\n", LOCUT_THRESHOLD, st->underUs / 1e6, st->underMaxRunUs / 1e6);
+    printf("switching dropouts  %8.3f s\n", st->dropoutUs / 1e6);
+    printf("sense error at %.0f/%.0f/%.0f V: %+.1f %+.1f %+.1f V, %u-point calibration\n",
+           LOCUT_THRESHOLD, CALIBRATION_VOLTAGE, HICUT_THRESHOLD,
+           Calculate_OPV(Plant_Sense_Adc(LOCUT_THRESHOLD)) * 0.1f - LOCUT_THRESHOLD,
+           Calculate_OPV(Plant_Sense_Adc(CALIBRATION_VOLTAGE)) * 0.1f - CALIBRATION_VOLTAGE,
+           Calculate_OPV(Plant_Sense_Adc(HICUT_THRESHOLD)) * 0.1f - HICUT_THRESHOLD, 1 + calPointCount);
+    if(currentState != STATE_BOOT)
+        printf("first relay decision %.1f ms after reset\n", bootDecisionUs / 1e3);
+    printf("tap changes %u, HICUT trips %u, LOCUT trips %u, reconnect waits %u (%.1f s)\n",
+           relayOperations, hicutTrips, locutTrips, reconnects, delayUs / 1e6);
+    printf("coil operations R1-R5 %u %u %u %u %u, contact bounces %u, intermediate taps %u\n",
+           st->coilOps[0], st->coilOps[1], st->coilOps[2], st->coilOps[3], st->coilOps[4],
+           st->bounces, st->tapTransients);
+    printf("load voltage (time while connected):\n");
+    for(int b = 0; b < PLANT_HIST_BINS; b++)
+        if(st->histUs[b])
+            printf("  %3d-%3d V %6.2f %%\n", b*10, b*10 + 10, Pct(st->histUs[b], st->loadOnUs));
+    
+    if(sampleCsv) fclose(sampleCsv);
+    if(eventCsv) fclose(eventCsv);
+    if(decisionFile) fclose(decisionFile);
+    Trace_Writer_Close();
+    
+    bool overFail = st->overMaxRunUs > (uint64_t)(controlTable->prot[R5_CH_HICUT].detectMs + PROTECT_MARGIN_MS) * 1000;
+    bool underFail = lowcut && st->underMaxRunUs > (uint64_t)(controlTable->prot[R5_CH_LOCUT].detectMs + PROTECT_MARGIN_MS) * 1000;
+    if(overFail) printf("FAIL: load above HICUT longer than the detect time\n");
+    if(underFail) printf("FAIL: load below LOCUT longer than the detect time\n");
+    bool ok = budgets ? Check_Budgets(budgets) : true;
+    return (overFail || underFail || !ok) ? 1 : 0;
+}
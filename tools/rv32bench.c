@@ -0,0 +1,433 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - CYCLE-COUNT BENCHMARK OF THE HOT PATHS (HOST)
+ * ============================================================================
+ * Loads bench.elf (bench_target.c + the control core, cross-compiled with
+ * the firmware flags) into the RV32EC simulator and calls each kernel
+ * directly, many times, with scripted inputs. Every kernel starts from a
+ * fresh image and Bench_Setup(), so results do not depend on the order.
+ *
+ * The Bench_* kernels time each fixmath.h routine next to the C operator
+ * it replaces (a libgcc call on rv32ec), and every result is checked
+ * against the host's arithmetic. The Bench_Filter_* kernels give the
+ * cycles per sample of each filter.h stage kind (tools/filter_bench has
+ * their step response and noise rejection).
+ *
+ * Per kernel: cycles (min/mean/max), instructions, stack depth, its own
+ * code bytes, the bytes of every function it reached, and the cycles spent
+ * in compiler runtime helpers (__mulsf3, __udivsi3, ...) with their names.
+ * Cycles use the rv32QingKeV2A timing table, see rv32ec.h.
+ *
+ * Build:
+ *   gcc -O2 -Wall -o rv32bench rv32bench.c rv32ec.c elf32.c
+ *
+ * Usage:
+ *   ./rv32bench bench.elf                 table
+ *   ./rv32bench -c bench.elf > base.csv   CSV, one line per kernel
+ *   ./rv32bench -b base.csv [-t 5] bench.elf
+ *                                         compare mean cycles against a
+ *                                         saved CSV, exit status 1 when a
+ *                                         kernel got more than t % slower
+ *   -B budgets.txt                        check the worst observed cycles
+ *                                         against its "wcet <kernel> <cycles>"
+ *                                         lines, exit status 1 when over
+ *   -W n                                  Flash wait states (default 1;
+ *                                         0 at 24 MHz with VDD <= 3.6 V)
+ *
+ * The max column, and so the budget check, is the worst case over the
+ * scripted inputs (noise, both directions of every threshold, the R5
+ * sequence), not a path analysis: a branch the scripts never take is not
+ * in it. Keep the scripts covering the slow paths when the code changes.
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rv32ec.h"
+#include "elf32.h"
+
+#define FLASH_BASE          0x00000000
+#define FLASH_ALIAS         0x08000000
+#define FLASH_SIZE          16384
+#define RAM_BASE            0x20000000
+#define RAM_SIZE            2048
+#define RETURN_ADDR         0xFFFFFFF0  // ra of every call: reaching it ends the call
+#define CALL_LIMIT          1000000     // Instructions per call before giving up
+#define CAL_ADC             700         // Bench_Setup's adcCapturedA
+#define CAL_VOLTS           244.0
+#define MAX_HELPERS         16
+
+typedef struct {
+    const char* name;                   // Symbol called
+    int calls;
+    uint32_t (*prepare)(int i);         // Inputs of call i, returns a0
+    uint32_t (*expect)(uint32_t a0);    // Return value, NULL = not checked
+} Kernel_t;
+
+typedef struct {
+    char name[48];
+    int calls;
+    uint64_t cyclesMin, cyclesMax, cyclesSum, instretSum, rtCyclesSum;
+    uint32_t stackBytes, codeBytes, reachBytes;
+    int helperCount;
+    const char* helpers[MAX_HELPERS];
+} Result_t;
+
+static uint8_t flash[FLASH_SIZE], ram[RAM_SIZE];
+static Rv32_t cpu;
+static Elf_t elf;
+static int16_t* funcAt;                 // Flash halfword -> elf.symbols index
+static bool* reached;
+static uint32_t gp;
+static int waitStates = 1;
+
+// IMAGE
+static void Load_Image(void) {
+    memset(flash, 0xFF, sizeof(flash));
+    memset(ram, 0, sizeof(ram));
+    for(int i = 0; i < elf.segmentCount; i++) {
+        const ElfSegment_t* s = &elf.segments[i];
+        uint32_t addr = s->paddr - FLASH_ALIAS < FLASH_SIZE ? s->paddr - FLASH_ALIAS + FLASH_BASE : s->paddr;
+        uint8_t* dst = NULL;
+        if(addr + s->memSize <= FLASH_SIZE) dst = flash + addr;
+        else if(addr >= RAM_BASE && addr - RAM_BASE + s->memSize <= RAM_SIZE) dst = ram + (addr - RAM_BASE);
+        if(!dst) {
+            fprintf(stderr, "segment 0x%08X (%u bytes) outside Flash/RAM\n", s->paddr, s->memSize);
+            exit(2);
+        }
+        memcpy(dst, s->data, s->fileSize);
+    }
+}
+
+static uint32_t Sym(const char* name) {
+    const ElfSymbol_t* s = Elf_Symbol(&elf, name);
+    if(!s) {
+        fprintf(stderr, "symbol %s not found\n", name);
+        exit(2);
+    }
+    return s->addr;
+}
+
+static void Poke(const char* name, uint32_t offset, int size, uint32_t value) {
+    Rv32_Write(&cpu, Sym(name) + offset, size, value);
+}
+
+static uint32_t Peek(const char* name, int size) {
+    uint32_t v = 0;
+    Rv32_Read(&cpu, Sym(name), size, &v);
+    return v;
+}
+
+static bool Is_Runtime_Helper(const ElfSymbol_t* f) {
+    return f && strncmp(f->name, "__", 2) == 0;
+}
+
+// Runs one call to addr; NULL result = setup call, not measured
+static void Call(uint32_t addr, uint32_t a0, Result_t* r) {
+    uint64_t cycles0 = cpu.cycles, instret0 = cpu.instret, rtCycles = 0;
+    uint32_t sp0 = RAM_BASE + RAM_SIZE, spMin = sp0;
+    
+    cpu.pc = addr;
+    cpu.x[1] = RETURN_ADDR;
+    cpu.x[2] = sp0;
+    cpu.x[3] = gp;
+    cpu.x[10] = a0;
+    while(cpu.pc != RETURN_ADDR) {
+        uint32_t pc = cpu.pc;
+        uint64_t c = cpu.cycles;
+        Rv32Stop_t stop = Rv32_Step(&cpu);
+        const ElfSymbol_t* f = (pc < FLASH_SIZE && funcAt[pc >> 1] >= 0) ? &elf.symbols[funcAt[pc >> 1]] : NULL;
+        
+        if(stop != RV32_RUN || cpu.instret - instret0 > CALL_LIMIT) {
+            fprintf(stderr, "%s: %s at 0x%08X (%s)\n", r ? r->name : "setup",
+                    stop == RV32_RUN ? "runaway" : stop == RV32_ILLEGAL ? "illegal instruction" :
+                    stop == RV32_FAULT ? "bus fault" : "ecall/ebreak",
+                    cpu.stopPc ? cpu.stopPc : pc, f ? f->name : "?");
+            exit(2);
+        }
+        if(!r) continue;
+        if(f) reached[f - elf.symbols] = true;
+        if(Is_Runtime_Helper(f)) rtCycles += cpu.cycles - c;
+        if(cpu.x[2] < spMin) spMin = cpu.x[2];
+    }
+    if(!r) return;
+    
+    uint64_t cycles = cpu.cycles - cycles0;
+    if(r->calls == 0 || cycles < r->cyclesMin) r->cyclesMin = cycles;
+    if(cycles > r->cyclesMax) r->cyclesMax = cycles;
+    r->cyclesSum += cycles;
+    r->instretSum += cpu.instret - instret0;
+    r->rtCyclesSum += rtCycles;
+    if(sp0 - spMin > r->stackBytes) r->stackBytes = sp0 - spMin;
+    r->calls++;
+}
+
+// INPUT SCRIPTS - volts at the sense point, as the board would see them
+static uint32_t Volts_To_Adc(double v) {
+    double adc = v * CAL_ADC / CAL_VOLTS + 0.5;
+    return adc < 0 ? 0 : adc > 1023 ? 1023 : (uint32_t)adc;
+}
+
+// Sense noise: deterministic LCG, +-8 counts with an occasional spike
+static uint32_t noiseState = 1;
+static int Noise(void) {
+    noiseState = noiseState * 1103515245u + 12345u;
+    uint32_t n = (noiseState >> 16) & 0x7FFF;
+    return (n % 97 == 0) ? 120 : (int)(n % 17) - 8;
+}
+
+static uint32_t Prepare_Adc(int i) {
+    if(i == 0) {
+        noiseState = 1;
+        for(int k = 0; k < 256; k++) Poke("benchAdc", 2*k, 2, (uint32_t)(CAL_ADC - 20 + Noise()));
+    }
+    return 0;
+}
+
+static uint32_t Prepare_Opv(int i) {
+    return (uint32_t)(i * 37) % 1024;
+}
+
+// Input volts: triangle 120..300 V over 4 s, a change every 10 ms loop
+static uint32_t Prepare_Tap(int i) {
+    int phase = i % 400;
+    double v = 120.0 + 0.9 * (phase < 200 ? phase : 400 - phase) + (i & 1 ? 0.5 : -0.5);
+    Poke("benchTick", 0, 4, Peek("benchTick", 4) + 10);
+    Poke("currentIPV", 0, 2, (uint32_t)(v * 10.0 + 0.5));
+    return 0;
+}
+
+// Output volts: swell past HICUT, reconnect delay, sag past LOCUT, delay
+static uint32_t Prepare_R5(int i) {
+    static const struct { int calls; double volts; } script[] = {
+        {50, 230}, {100, 262}, {30, 230}, {320, 230}, {100, 170}, {30, 230}, {320, 230}
+    };
+    int k = 0, t = i % 950;
+    while(t >= script[k].calls) t -= script[k++].calls;
+    if(i == 0) Poke("benchInputs", 0, 1, 1);   // HAL_IN_LOWCUT_EN
+    Poke("benchTick", 0, 4, Peek("benchTick", 4) + 10);
+    Poke("currentADCFast", 0, 2, Volts_To_Adc(script[k].volts + ((i & 3) - 1.5)));
+    return 0;
+}
+
+// Filter sums 2 * new + 8 * old, up to 10230
+static uint32_t Prepare_Div10(int i) {
+    return (uint32_t)(i * 10 + i % 7);
+}
+
+static uint32_t Expect_Div10(uint32_t n) {
+    return n / 10;
+}
+
+// Calibration slopes near 700 counts at 244 V with 16 fraction bits, some
+// negative, times every ADC count; packed as slope << 10 | adc
+static uint32_t Prepare_Mul(int i) {
+    int32_t slope = 228000 + (i % 13) * 1500;
+    if(i % 16 == 0) slope = -slope;
+    return ((uint32_t)slope << 10) | (uint32_t)(i * 37 % 1024);
+}
+
+static uint32_t Expect_Mul(uint32_t x) {
+    return (uint32_t)(((int32_t)x >> 10) * (int32_t)(x & 1023));
+}
+
+// Averaged counts of successive passes: steps of 40 counts every second,
+// noise and the occasional spike
+static uint32_t Prepare_Filter(int i) {
+    if(i == 0) noiseState = 1;
+    return (uint32_t)(CAL_ADC - 20 + ((i / 100) & 1) * 40 + Noise());
+}
+
+static const Kernel_t kernels[] = {
+    {"ADC_ReadCount_Averaged",      200,  Prepare_Adc,   NULL},
+    {"ADC_ReadCount_Filtered",      200,  Prepare_Adc,   NULL},
+    {"Calculate_OPV",               1024, Prepare_Opv,   NULL},
+    {"StateMachine2_Control_R1_R4", 1600, Prepare_Tap,   NULL},
+    {"StateMachine2_Control_R5",    1900, Prepare_R5,    NULL},
+    {"Bench_Div10_Fix",             1024, Prepare_Div10, Expect_Div10},
+    {"Bench_Div10_Libgcc",          1024, Prepare_Div10, Expect_Div10},
+    {"Bench_Mul_Fix",               1024, Prepare_Mul,   Expect_Mul},
+    {"Bench_Mul_Libgcc",            1024, Prepare_Mul,   Expect_Mul},
+    {"Bench_Filter_Median",         400,  Prepare_Filter, NULL},
+    {"Bench_Filter_Ema",            400,  Prepare_Filter, NULL},
+    {"Bench_Filter_Ema10",          400,  Prepare_Filter, NULL},
+    {"Bench_Filter_Biquad",         400,  Prepare_Filter, NULL},
+    {"Bench_Filter_Slew",           400,  Prepare_Filter, NULL},
+};
+#define KERNEL_COUNT (int)(sizeof(kernels)/sizeof(kernels[0]))
+
+static void Run_Kernel(const Kernel_t* k, Result_t* r) {
+    const ElfSymbol_t* fn = Elf_Symbol(&elf, k->name);
+    
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", k->name);
+    if(!fn || !fn->isFunc) {
+        fprintf(stderr, "function %s not found\n", k->name);
+        exit(2);
+    }
+    Load_Image();
+    Rv32_Reset(&cpu, 0);
+    Call(Sym("Bench_Setup"), 0, NULL);
+    memset(reached, 0, elf.symbolCount);
+    for(int i = 0; i < k->calls; i++) {
+        uint32_t a0 = k->prepare(i);
+        Call(fn->addr, a0, r);
+        if(k->expect && cpu.x[10] != k->expect(a0)) {
+            fprintf(stderr, "%s(0x%08X) returned 0x%08X, expected 0x%08X\n", k->name, a0, cpu.x[10], k->expect(a0));
+            exit(2);
+        }
+    }
+    
+    r->codeBytes = fn->size;
+    for(int s = 0; s < elf.symbolCount; s++) {
+        if(!reached[s]) continue;
+        r->reachBytes += elf.symbols[s].size;
+        if(Is_Runtime_Helper(&elf.symbols[s]) && r->helperCount < MAX_HELPERS)
+            r->helpers[r->helperCount++] = elf.symbols[s].name;
+    }
+}
+
+// OUTPUT
+static void Print_Table(const Result_t* res, int n) {
+    printf("%-28s %7s %7s %7s %7s %6s %6s %6s %6s  %s\n", "kernel", "min", "mean", "max",
+           "instr", "stack", "code", "reach", "rt%", "runtime helpers");
+    for(int i = 0; i < n; i++) {
+        const Result_t* r = &res[i];
+        double mean = (double)r->cyclesSum / r->calls;
+        printf("%-28s %7llu %7.1f %7llu %7.1f %6u %6u %6u %5.1f%% ", r->name,
+               (unsigned long long)r->cyclesMin, mean, (unsigned long long)r->cyclesMax,
+               (double)r->instretSum / r->calls, r->stackBytes, r->codeBytes, r->reachBytes,
+               r->cyclesSum ? 100.0 * r->rtCyclesSum / r->cyclesSum : 0.0);
+        for(int h = 0; h < r->helperCount; h++) printf(" %s", r->helpers[h]);
+        printf("%s\n", r->helperCount ? "" : " -");
+    }
+    printf("cycles at %d Flash wait state(s); min/mean/max per call, stack/code/reach in bytes\n", waitStates);
+}
+
+static void Print_Csv(const Result_t* res, int n) {
+    printf("kernel,calls,cycles_min,cycles_mean,cycles_max,instret_mean,stack_bytes,"
+           "code_bytes,reach_bytes,rt_cycles_mean,helpers\n");
+    for(int i = 0; i < n; i++) {
+        const Result_t* r = &res[i];
+        printf("%s,%d,%llu,%.1f,%llu,%.1f,%u,%u,%u,%.1f,", r->name, r->calls,
+               (unsigned long long)r->cyclesMin, (double)r->cyclesSum / r->calls,
+               (unsigned long long)r->cyclesMax, (double)r->instretSum / r->calls,
+               r->stackBytes, r->codeBytes, r->reachBytes, (double)r->rtCyclesSum / r->calls);
+        for(int h = 0; h < r->helperCount; h++) printf("%s%s", h ? "+" : "", r->helpers[h]);
+        printf("\n");
+    }
+}
+
+// Mean cycles against a CSV written by -c; true when nothing regressed
+static bool Compare(const Result_t* res, int n, const char* path, double tolerancePct) {
+    FILE* f = fopen(path, "r");
+    char line[512], name[64];
+    bool ok = true;
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    printf("%-28s %9s %9s %8s\n", "kernel", "base", "now", "change");
+    while(fgets(line, sizeof(line), f)) {
+        double baseMean;
+        int calls;
+        unsigned long long cmin;
+        if(sscanf(line, "%63[^,],%d,%llu,%lf", name, &calls, &cmin, &baseMean) != 4) continue;
+        for(int i = 0; i < n; i++) {
+            if(strcmp(res[i].name, name) != 0) continue;
+            double mean = (double)res[i].cyclesSum / res[i].calls;
+            double pct = baseMean > 0 ? 100.0 * (mean - baseMean) / baseMean : 0.0;
+            bool slower = pct > tolerancePct;
+            printf("%-28s %9.1f %9.1f %+7.1f%%%s\n", name, baseMean, mean, pct, slower ? "  SLOWER" : "");
+            if(slower) ok = false;
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+// Worst observed cycles against "wcet <kernel> <cycles>" lines; true when
+// every listed kernel stays inside its budget
+static bool Check_Budgets(const Result_t* res, int n, const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[256], name[64];
+    bool ok = true;
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    printf("%-28s %9s %9s %6s\n", "kernel", "budget", "worst", "used");
+    while(fgets(line, sizeof(line), f)) {
+        unsigned long long budget;
+        bool found = false;
+        if(sscanf(line, " wcet %63s %llu", name, &budget) != 2) continue;
+        for(int i = 0; i < n; i++) {
+            if(strcmp(res[i].name, name) != 0) continue;
+            bool over = res[i].cyclesMax > budget;
+            printf("%-28s %9llu %9llu %5.1f%%%s\n", name, budget, (unsigned long long)res[i].cyclesMax,
+                   budget ? 100.0 * res[i].cyclesMax / budget : 0.0, over ? "  OVER BUDGET" : "");
+            if(over) ok = false;
+            found = true;
+        }
+        if(!found) printf("%-28s %9llu %9s\n", name, budget, "-");
+    }
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    const char* baseline = NULL;
+    const char* budgets = NULL;
+    bool csv = false, ok = true;
+    double tolerancePct = 5.0;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-c") == 0) csv = true;
+        else if(strcmp(argv[i], "-b") == 0 && i+1 < argc) baseline = argv[++i];
+        else if(strcmp(argv[i], "-B") == 0 && i+1 < argc) budgets = argv[++i];
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc) tolerancePct = atof(argv[++i]);
+        else if(strcmp(argv[i], "-W") == 0 && i+1 < argc) waitStates = atoi(argv[++i]);
+        else if(argv[i][0] != '-' && !path) path = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [-c] [-b baseline.csv] [-t pct] [-B budgets.txt] [-W waitstates] bench.elf\n", argv[0]);
+            return 2;
+        }
+    }
+    if(!path) {
+        fprintf(stderr, "usage: %s [-c] [-b baseline.csv] [-t pct] [-B budgets.txt] [-W waitstates] bench.elf\n", argv[0]);
+        return 2;
+    }
+    if(!Elf_Load(path, &elf)) return 2;
+    
+    // Flash halfword -> function, for reach and runtime helper accounting
+    funcAt = malloc(FLASH_SIZE / 2 * sizeof(int16_t));
+    reached = malloc(elf.symbolCount ? elf.symbolCount : 1);
+    for(uint32_t a = 0; a < FLASH_SIZE; a += 2) {
+        const ElfSymbol_t* f = Elf_Function_At(&elf, a);
+        funcAt[a >> 1] = f ? (int16_t)(f - elf.symbols) : -1;
+    }
+    const ElfSymbol_t* g = Elf_Symbol(&elf, "__global_pointer$");
+    gp = g ? g->addr : 0;
+    
+    cpu.timing = rv32QingKeV2A;
+    cpu.timing.fetchWait = (uint8_t)waitStates;
+    cpu.trapStops = true;
+    Rv32_Map(&cpu, FLASH_BASE, FLASH_SIZE, flash, false);
+    Rv32_Map(&cpu, FLASH_ALIAS, FLASH_SIZE, flash, false);
+    Rv32_Map(&cpu, RAM_BASE, RAM_SIZE, ram, true);
+    
+    Result_t results[KERNEL_COUNT];
+    for(int i = 0; i < KERNEL_COUNT; i++) Run_Kernel(&kernels[i], &results[i]);
+    
+    if(baseline) ok = Compare(results, KERNEL_COUNT, baseline, tolerancePct);
+    else if(csv) Print_Csv(results, KERNEL_COUNT);
+    else Print_Table(results, KERNEL_COUNT);
+    if(budgets) ok = Check_Budgets(results, KERNEL_COUNT, budgets) && ok;
+    Elf_Free(&elf);
+    return ok ? 0 : 1;
+}
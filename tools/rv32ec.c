@@ -0,0 +1,434 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RV32EC INSTRUCTION SET SIMULATOR CORE (HOST)
+ * ============================================================================
+ * See rv32ec.h. Compressed instructions are expanded to their 32-bit
+ * equivalents and share one executor, so each operation exists once.
+ * ============================================================================
+ */
+
+#include <string.h>
+
+#include "rv32ec.h"
+
+#define MSTATUS_MIE     (1u << 3)
+#define MSTATUS_MPIE    (1u << 7)
+#define MSTATUS_MPP     (3u << 11)
+
+const Rv32Timing_t rv32QingKeV2A = {
+    .alu = 1, .load = 2, .store = 1, .branch = 1, .branchTaken = 2,
+    .jump = 2, .csr = 1, .trap = 3, .fetchWait = 1
+};
+
+void Rv32_Reset(Rv32_t* cpu, uint32_t pc) {
+    memset(cpu->x, 0, sizeof(cpu->x));
+    cpu->pc = pc;
+    cpu->cycles = cpu->instret = cpu->stores = 0;
+    cpu->mstatus = MSTATUS_MPP;
+    cpu->mtvec = cpu->mepc = cpu->mcause = cpu->mtval = cpu->mscratch = 0;
+    cpu->stopPc = 0;
+}
+
+bool Rv32_Map(Rv32_t* cpu, uint32_t base, uint32_t size, uint8_t* mem, bool writable) {
+    if(cpu->regionCount >= RV32_MAX_REGIONS) return false;
+    cpu->region[cpu->regionCount++] = (Rv32Region_t){base, size, mem, writable};
+    return true;
+}
+
+static Rv32Region_t* Find_Region(Rv32_t* cpu, uint32_t addr, int size) {
+    for(int i = 0; i < cpu->regionCount; i++) {
+        Rv32Region_t* r = &cpu->region[i];
+        if(addr - r->base < r->size && addr - r->base + size <= r->size) return r;
+    }
+    return NULL;
+}
+
+bool Rv32_Read(Rv32_t* cpu, uint32_t addr, int size, uint32_t* value) {
+    Rv32Region_t* r = Find_Region(cpu, addr, size);
+    
+    if(r) {
+        const uint8_t* p = r->mem + (addr - r->base);
+        uint32_t v = 0;
+        for(int i = size-1; i >= 0; i--) v = (v << 8) | p[i];
+        *value = v;
+        return true;
+    }
+    return cpu->ioRead && cpu->ioRead(cpu->ctx, addr, size, value);
+}
+
+bool Rv32_Write(Rv32_t* cpu, uint32_t addr, int size, uint32_t value) {
+    Rv32Region_t* r = Find_Region(cpu, addr, size);
+    
+    cpu->stores++;
+    if(r) {
+        if(!r->writable) return cpu->ioWrite && cpu->ioWrite(cpu->ctx, addr, size, value);
+        uint8_t* p = r->mem + (addr - r->base);
+        for(int i = 0; i < size; i++) p[i] = (uint8_t)(value >> (8*i));
+        return true;
+    }
+    return cpu->ioWrite && cpu->ioWrite(cpu->ctx, addr, size, value);
+}
+
+void Rv32_Trap(Rv32_t* cpu, uint32_t cause, uint32_t tval) {
+    cpu->mepc = cpu->pc;
+    cpu->mcause = cause;
+    cpu->mtval = tval;
+    cpu->mstatus = (cpu->mstatus & ~MSTATUS_MPIE) | ((cpu->mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0);
+    cpu->mstatus = (cpu->mstatus & ~MSTATUS_MIE) | MSTATUS_MPP;
+    cpu->pc = cpu->mtvec & ~3u;
+    cpu->cycles += cpu->timing.trap + cpu->timing.fetchWait;
+}
+
+// Synchronous exception: stop or vector, the faulting pc stays in mepc
+static Rv32Stop_t Exception(Rv32_t* cpu, Rv32Stop_t stop, uint32_t cause, uint32_t tval) {
+    cpu->stopPc = cpu->pc;
+    if(cpu->trapStops) {
+        cpu->mcause = cause;                // For the report; nothing vectors
+        cpu->mtval = tval;
+        return stop;
+    }
+    Rv32_Trap(cpu, cause, tval);
+    return RV32_RUN;
+}
+
+// 32-BIT ENCODERS - targets of the compressed expansion
+static uint32_t Enc_R(uint32_t f7, uint32_t rs2, uint32_t rs1, uint32_t f3, uint32_t rd, uint32_t op) {
+    return (f7 << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static uint32_t Enc_I(int32_t imm, uint32_t rs1, uint32_t f3, uint32_t rd, uint32_t op) {
+    return ((uint32_t)imm << 20) | (rs1 << 15) | (f3 << 12) | (rd << 7) | op;
+}
+
+static uint32_t Enc_S(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3) {
+    uint32_t u = (uint32_t)imm;
+    return ((u >> 5) << 25) | (rs2 << 20) | (rs1 << 15) | (f3 << 12) | ((u & 31) << 7) | 0x23;
+}
+
+static uint32_t Enc_B(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3) {
+    uint32_t u = (uint32_t)imm;
+    return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (f3 << 12) | (((u >> 1) & 0xF) << 8) | (((u >> 11) & 1) << 7) | 0x63;
+}
+
+static uint32_t Enc_J(int32_t imm, uint32_t rd) {
+    uint32_t u = (uint32_t)imm;
+    return (((u >> 20) & 1) << 31) | (((u >> 1) & 0x3FF) << 21) | (((u >> 11) & 1) << 20) |
+           (u & 0xFF000) | (rd << 7) | 0x6F;
+}
+
+static int32_t Sext(uint32_t v, int bits) {
+    return (int32_t)(v << (32-bits)) >> (32-bits);
+}
+
+// RV32C -> RV32I, 0 when the encoding is reserved or not RV32EC
+uint32_t Rv32_Expand(uint16_t c) {
+    uint32_t f3 = c >> 13;
+    uint32_t rd = (c >> 7) & 31, rs2 = (c >> 2) & 31;
+    uint32_t rdp = 8 + ((c >> 7) & 7), rs2p = 8 + ((c >> 2) & 7);
+    int32_t imm6 = Sext(((c >> 7) & 0x20) | ((c >> 2) & 0x1F), 6);
+    
+    switch(c & 3) {
+        case 0:
+            if(f3 == 0) {           // c.addi4spn
+                uint32_t u = ((c >> 7) & 0x30) | ((c >> 1) & 0x3C0) | ((c >> 4) & 4) | ((c >> 2) & 8);
+                return u ? Enc_I((int32_t)u, 2, 0, rs2p, 0x13) : 0;
+            }
+            if(f3 == 2 || f3 == 6) {    // c.lw, c.sw
+                int32_t u = ((c >> 7) & 0x38) | ((c << 1) & 0x40) | ((c >> 4) & 4);
+                return f3 == 2 ? Enc_I(u, rdp, 2, rs2p, 0x03) : Enc_S(u, rs2p, rdp, 2);
+            }
+            return 0;
+        
+        case 1:
+            switch(f3) {
+                case 0: return Enc_I(imm6, rd, 0, rd, 0x13);       // c.addi, c.nop
+                case 1:                                             // c.jal
+                case 5: {                                           // c.j
+                    uint32_t u = ((c >> 1) & 0x800) | ((c >> 7) & 0x10) | ((c >> 1) & 0x300) |
+                                 ((c << 2) & 0x400) | ((c >> 1) & 0x40) | ((c << 1) & 0x80) |
+                                 ((c >> 2) & 0xE) | ((c << 3) & 0x20);
+                    return Enc_J(Sext(u, 12), f3 == 1 ? 1 : 0);
+                }
+                case 2: return Enc_I(imm6, 0, 0, rd, 0x13);        // c.li
+                case 3:
+                    if(rd == 2) {                                   // c.addi16sp
+                        uint32_t u = ((c >> 3) & 0x200) | ((c >> 2) & 0x10) | ((c << 1) & 0x40) |
+                                     ((c << 4) & 0x180) | ((c << 3) & 0x20);
+                        return u ? Enc_I(Sext(u, 10), 2, 0, 2, 0x13) : 0;
+                    }
+                    return imm6 ? (((uint32_t)imm6 << 12) | (rd << 7) | 0x37) : 0;  // c.lui
+                case 4:
+                    switch((c >> 10) & 3) {
+                        case 0:                                     // c.srli
+                        case 1:                                     // c.srai
+                            if(c & 0x1000) return 0;
+                            return Enc_R(((c >> 10) & 1) ? 0x20 : 0, rs2, rdp, 5, rdp, 0x13);
+                        case 2: return Enc_I(imm6, rdp, 7, rdp, 0x13);   // c.andi
+                        default: {
+                            static const uint8_t f3s[4] = {0, 4, 6, 7};  // sub xor or and
+                            uint32_t f = (c >> 5) & 3;
+                            if(c & 0x1000) return 0;
+                            return Enc_R(f == 0 ? 0x20 : 0, rs2p, rdp, f3s[f], rdp, 0x33);
+                        }
+                    }
+                default: {                                          // c.beqz, c.bnez
+                    uint32_t u = ((c >> 4) & 0x100) | ((c >> 7) & 0x18) | ((c << 1) & 0xC0) |
+                                 ((c >> 2) & 6) | ((c << 3) & 0x20);
+                    return Enc_B(Sext(u, 9), 0, rdp, f3 == 6 ? 0 : 1);
+                }
+            }
+        
+        case 2:
+            switch(f3) {
+                case 0:                                             // c.slli
+                    return (c & 0x1000) ? 0 : Enc_R(0, rs2, rd, 1, rd, 0x13);
+                case 2: {                                           // c.lwsp
+                    int32_t u = ((c >> 7) & 0x20) | ((c >> 2) & 0x1C) | ((c << 4) & 0xC0);
+                    return rd ? Enc_I(u, 2, 2, rd, 0x03) : 0;
+                }
+                case 4:
+                    if(!(c & 0x1000)) {
+                        if(rs2) return Enc_R(0, rs2, 0, 0, rd, 0x33);          // c.mv
+                        return rd ? Enc_I(0, rd, 0, 0, 0x67) : 0;             // c.jr
+                    }
+                    if(!rd && !rs2) return 0x00100073;                        // c.ebreak
+                    if(!rs2) return Enc_I(0, rd, 0, 1, 0x67);                 // c.jalr
+                    return Enc_R(0, rs2, rd, 0, rd, 0x33);                    // c.add
+                case 6: {                                           // c.swsp
+                    int32_t u = ((c >> 7) & 0x3C) | ((c >> 1) & 0xC0);
+                    return Enc_S(u, rs2, 2, 2);
+                }
+                default:
+                    return 0;
+            }
+    }
+    return 0;
+}
+
+static bool Csr_Access(Rv32_t* cpu, uint16_t csr, uint32_t* value, bool write) {
+    uint32_t* reg = NULL;
+    
+    switch(csr) {
+        case 0x300: reg = &cpu->mstatus; break;
+        case 0x305: reg = &cpu->mtvec; break;
+        case 0x340: reg = &cpu->mscratch; break;
+        case 0x341: reg = &cpu->mepc; break;
+        case 0x342: reg = &cpu->mcause; break;
+        case 0x343: reg = &cpu->mtval; break;
+        case 0x301:                             // misa: RV32 E C
+            if(!write) *value = 0x40000014;
+            return true;
+        case 0xF11: case 0xF12: case 0xF13: case 0xF14:
+            if(!write) *value = 0;
+            return true;
+        default:
+            return cpu->csrAccess && cpu->csrAccess(cpu->ctx, csr, value, write);
+    }
+    if(write) *reg = (csr == 0x341) ? (*value & ~1u) : *value;
+    else *value = *reg;
+    return true;
+}
+
+Rv32Stop_t Rv32_Step(Rv32_t* cpu) {
+    const Rv32Timing_t* tm = &cpu->timing;
+    uint32_t pc = cpu->pc, lo, hi, ins, len = 4;
+    
+    if(pc & 1) return Exception(cpu, RV32_FAULT, RV32_CAUSE_FETCH_MISALIGNED, pc);
+    if(!Rv32_Read(cpu, pc, 2, &lo)) return Exception(cpu, RV32_FAULT, RV32_CAUSE_FETCH_FAULT, pc);
+    if((lo & 3) != 3) {
+        len = 2;
+        ins = Rv32_Expand((uint16_t)lo);
+        if(!ins) return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, lo);
+    } else {
+        if(!Rv32_Read(cpu, pc + 2, 2, &hi)) return Exception(cpu, RV32_FAULT, RV32_CAUSE_FETCH_FAULT, pc + 2);
+        ins = lo | (hi << 16);
+    }
+    
+    uint32_t op = ins & 0x7F, rd = (ins >> 7) & 31, f3 = (ins >> 12) & 7;
+    uint32_t rs1 = (ins >> 15) & 31, rs2 = (ins >> 20) & 31, f7 = ins >> 25;
+    int32_t immI = (int32_t)ins >> 20;
+    uint32_t* x = cpu->x;
+    uint32_t next = pc + len, result = 0, cost = tm->alu;
+    bool writeRd = true;
+    uint32_t used;
+    
+    // RV32E: x16-x31 do not exist
+    switch(op) {
+        case 0x37: case 0x17: case 0x6F: used = rd; break;
+        case 0x23: case 0x63: used = rs1 | rs2; break;
+        case 0x33: used = rd | rs1 | rs2; break;
+        case 0x73: used = (f3 & 4) ? rd : (rd | rs1); break;   // csrr*i: rs1 is data
+        default: used = rd | rs1; break;
+    }
+    if(used & 16) return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+    
+    uint32_t a = x[rs1 & 15], b = x[rs2 & 15];
+    
+    switch(op) {
+        case 0x37:                                  // lui
+            result = ins & 0xFFFFF000;
+            break;
+        
+        case 0x17:                                  // auipc
+            result = pc + (ins & 0xFFFFF000);
+            break;
+        
+        case 0x6F: {                                // jal
+            int32_t imm = Sext(((ins >> 31) << 20) | (ins & 0xFF000) | (((ins >> 20) & 1) << 11) |
+                               (((ins >> 21) & 0x3FF) << 1), 21);
+            result = next;
+            next = pc + imm;
+            cost = tm->jump + tm->fetchWait;
+            break;
+        }
+        
+        case 0x67:                                  // jalr
+            if(f3) return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+            result = next;
+            next = (a + immI) & ~1u;
+            cost = tm->jump + tm->fetchWait;
+            break;
+        
+        case 0x63: {                                // branches
+            int32_t imm = Sext(((ins >> 31) << 12) | (((ins >> 7) & 1) << 11) |
+                               (((ins >> 25) & 0x3F) << 5) | (((ins >> 8) & 0xF) << 1), 13);
+            bool take;
+            switch(f3) {
+                case 0: take = a == b; break;
+                case 1: take = a != b; break;
+                case 4: take = (int32_t)a < (int32_t)b; break;
+                case 5: take = (int32_t)a >= (int32_t)b; break;
+                case 6: take = a < b; break;
+                case 7: take = a >= b; break;
+                default: return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+            }
+            writeRd = false;
+            cost = tm->branch;
+            if(take) {
+                next = pc + imm;
+                cost = tm->branchTaken + tm->fetchWait;
+            }
+            break;
+        }
+        
+        case 0x03: {                                // loads
+            static const int8_t sizes[8] = {1, 2, 4, -1, 1, 2, -1, -1};
+            uint32_t addr = a + immI, v;
+            int size = sizes[f3];
+            if(size < 0) return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+            if(addr & (size-1)) return Exception(cpu, RV32_FAULT, RV32_CAUSE_LOAD_MISALIGNED, addr);
+            if(!Rv32_Read(cpu, addr, size, &v)) return Exception(cpu, RV32_FAULT, RV32_CAUSE_LOAD_FAULT, addr);
+            if(f3 == 0) v = (uint32_t)Sext(v, 8);
+            if(f3 == 1) v = (uint32_t)Sext(v, 16);
+            result = v;
+            cost = tm->load;
+            break;
+        }
+        
+        case 0x23: {                                // stores
+            int32_t imm = (int32_t)((ins >> 25) << 5 | ((ins >> 7) & 31));
+            uint32_t addr = a + Sext((uint32_t)imm, 12);
+            int size = 1 << f3;
+            if(f3 > 2) return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+            if(addr & (size-1)) return Exception(cpu, RV32_FAULT, RV32_CAUSE_STORE_MISALIGNED, addr);
+            if(!Rv32_Write(cpu, addr, size, b)) return Exception(cpu, RV32_FAULT, RV32_CAUSE_STORE_FAULT, addr);
+            writeRd = false;
+            cost = tm->store;
+            break;
+        }
+        
+        case 0x13: {                                // immediate arithmetic
+            uint32_t sh = (uint32_t)immI & 31;
+            switch(f3) {
+                case 0: result = a + immI; break;
+                case 2: result = (int32_t)a < immI; break;
+                case 3: result = a < (uint32_t)immI; break;
+                case 4: result = a ^ immI; break;
+                case 6: result = a | immI; break;
+                case 7: result = a & immI; break;
+                case 1:
+                    if(f7) return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+                    result = a << sh;
+                    break;
+                default:
+                    if(f7 == 0) result = a >> sh;
+                    else if(f7 == 0x20) result = (uint32_t)((int32_t)a >> sh);
+                    else return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+                    break;
+            }
+            break;
+        }
+        
+        case 0x33:                                  // register arithmetic, no M extension
+            if(f7 != 0 && !(f7 == 0x20 && (f3 == 0 || f3 == 5)))
+                return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+            switch(f3) {
+                case 0: result = f7 ? a - b : a + b; break;
+                case 1: result = a << (b & 31); break;
+                case 2: result = (int32_t)a < (int32_t)b; break;
+                case 3: result = a < b; break;
+                case 4: result = a ^ b; break;
+                case 5: result = f7 ? (uint32_t)((int32_t)a >> (b & 31)) : a >> (b & 31); break;
+                case 6: result = a | b; break;
+                default: result = a & b; break;
+            }
+            break;
+        
+        case 0x0F:                                  // fence, fence.i
+            writeRd = false;
+            break;
+        
+        case 0x73:
+            if(f3 == 0) {
+                writeRd = false;
+                switch(ins) {
+                    case 0x00000073:
+                        return Exception(cpu, RV32_ECALL, RV32_CAUSE_ECALL_M, 0);
+                    case 0x00100073:
+                        return Exception(cpu, RV32_EBREAK, RV32_CAUSE_BREAKPOINT, pc);
+                    case 0x30200073:                // mret
+                        next = cpu->mepc;
+                        cpu->mstatus = (cpu->mstatus & ~MSTATUS_MIE) | ((cpu->mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0);
+                        cpu->mstatus |= MSTATUS_MPIE;
+                        if(cpu->mretHook) cpu->mretHook(cpu->ctx);
+                        cost = tm->trap + tm->fetchWait;
+                        break;
+                    case 0x10500073:                // wfi
+                        cpu->pc = next;
+                        cpu->cycles += tm->alu;
+                        cpu->instret++;
+                        return RV32_WFI;
+                    default:
+                        return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+                }
+            } else {                                // csrrw/s/c and immediate forms
+                uint16_t csr = (uint16_t)(ins >> 20);
+                uint32_t src = (f3 & 4) ? rs1 : a, old = 0, v;
+                if((f3 & 3) == 0)
+                    return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+                if(!((f3 & 3) == 1 && rd == 0) && !Csr_Access(cpu, csr, &old, false))
+                    return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+                switch(f3 & 3) {
+                    case 1: v = src; break;
+                    case 2: v = old | src; break;
+                    default: v = old & ~src; break;
+                }
+                // csrrs/csrrc with a zero source do not write
+                if(((f3 & 3) == 1 || rs1) && !Csr_Access(cpu, csr, &v, true))
+                    return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+                result = old;
+                cost = tm->csr;
+            }
+            break;
+        
+        default:
+            return Exception(cpu, RV32_ILLEGAL, RV32_CAUSE_ILLEGAL, ins);
+    }
+    
+    if(writeRd && rd) x[rd] = result;
+    cpu->pc = next;
+    cpu->cycles += cost;
+    cpu->instret++;
+    return RV32_RUN;
+}
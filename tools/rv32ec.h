@@ -0,0 +1,100 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RV32EC INSTRUCTION SET SIMULATOR CORE (HOST)
+ * ============================================================================
+ * Executes the instruction set of the CH32V003 (QingKe V2A): RV32E base,
+ * C extension, Zicsr, ecall/ebreak/mret/wfi. There is no M extension, so
+ * mul/div encodings are illegal exactly as on the part; WCH's XW
+ * compressed byte/halfword extension is not modelled (build with plain
+ * -march=rv32ec).
+ *
+ * Memory is a list of host buffers (Flash, its 0x08000000 alias, SRAM);
+ * anything else goes to the ioRead/ioWrite hooks. Cycles follow a per
+ * class timing table. The defaults approximate the V2A two-stage pipeline
+ * with one Flash wait state on every non-sequential fetch: good for
+ * comparing two builds, not a substitute for a scope on a real board.
+ * ============================================================================
+ */
+
+#ifndef __RV32EC_H
+#define __RV32EC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RV32_MAX_REGIONS    4
+
+typedef enum {
+    RV32_RUN,               // Instruction retired normally
+    RV32_EBREAK,            // Stops only with trapStops, else they vector
+    RV32_ECALL,
+    RV32_ILLEGAL,
+    RV32_FAULT,             // Misaligned or unmapped access
+    RV32_WFI                // Retired; the caller decides how long to sleep
+} Rv32Stop_t;
+
+// Trap causes (mcause)
+#define RV32_CAUSE_FETCH_MISALIGNED 0
+#define RV32_CAUSE_FETCH_FAULT      1
+#define RV32_CAUSE_ILLEGAL          2
+#define RV32_CAUSE_BREAKPOINT       3
+#define RV32_CAUSE_LOAD_MISALIGNED  4
+#define RV32_CAUSE_LOAD_FAULT       5
+#define RV32_CAUSE_STORE_MISALIGNED 6
+#define RV32_CAUSE_STORE_FAULT      7
+#define RV32_CAUSE_ECALL_M          11
+
+typedef struct {
+    uint8_t alu;            // Register and immediate arithmetic, lui, auipc
+    uint8_t load, store;
+    uint8_t branch;         // Not taken
+    uint8_t branchTaken;    // Taken, before fetchWait
+    uint8_t jump;           // jal, jalr, before fetchWait
+    uint8_t csr;
+    uint8_t trap;           // Entry to mtvec, and mret
+    uint8_t fetchWait;      // Flash wait states on a non-sequential fetch
+} Rv32Timing_t;
+
+typedef struct {
+    uint32_t base, size;
+    uint8_t* mem;
+    bool writable;
+} Rv32Region_t;
+
+typedef struct {
+    uint32_t x[16];
+    uint32_t pc;
+    uint64_t cycles, instret;
+    uint32_t mstatus, mtvec, mepc, mcause, mtval, mscratch;
+    uint64_t stores;        // Data writes so far, for idle-loop detection
+    
+    Rv32Region_t region[RV32_MAX_REGIONS];
+    int regionCount;
+    Rv32Timing_t timing;
+    bool trapStops;         // Exceptions halt the run (cause in mcause/mtval)
+    
+    // Hooks for peripherals and vendor CSRs; false = bus fault / illegal
+    void* ctx;
+    bool (*ioRead)(void* ctx, uint32_t addr, int size, uint32_t* value);
+    bool (*ioWrite)(void* ctx, uint32_t addr, int size, uint32_t value);
+    bool (*csrAccess)(void* ctx, uint16_t csr, uint32_t* value, bool write);
+    void (*mretHook)(void* ctx);    // After mret set the return pc
+    
+    uint32_t stopPc;        // Instruction that stopped the run
+} Rv32_t;
+
+extern const Rv32Timing_t rv32QingKeV2A;
+
+void Rv32_Reset(Rv32_t* cpu, uint32_t pc);
+bool Rv32_Map(Rv32_t* cpu, uint32_t base, uint32_t size, uint8_t* mem, bool writable);
+Rv32Stop_t Rv32_Step(Rv32_t* cpu);
+void Rv32_Trap(Rv32_t* cpu, uint32_t cause, uint32_t tval);
+
+// 32-bit equivalent of a compressed instruction, 0 when it is illegal
+uint32_t Rv32_Expand(uint16_t c);
+
+// Debugger-style access through the memory map and hooks
+bool Rv32_Read(Rv32_t* cpu, uint32_t addr, int size, uint32_t* value);
+bool Rv32_Write(Rv32_t* cpu, uint32_t addr, int size, uint32_t value);
+
+#endif /* __RV32EC_H */
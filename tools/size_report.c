@@ -0,0 +1,372 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - FLASH AND RAM FOOTPRINT REPORT (HOST)
+ * ============================================================================
+ * Where the 16 KB of Flash and 2 KB of RAM go, from the linked firmware:
+ * totals per region, the largest functions with the compiler runtime
+ * (soft-float and libgcc helpers, "__" names) counted apart, the largest
+ * constant and RAM objects and, with the linker map, the bytes each object
+ * file and library contributes.
+ *
+ * The settings and parameter pages sit at fixed addresses inside the Flash
+ * (FLASH_SETTINGS_ADDR, FLASH_PARAMS_ADDR in stabilizer.h). The linker does
+ * not know about them, so a firmware that grows into them links fine and
+ * then erases its own code on the first Save_Settings(): that is an error
+ * here, whatever the budget says.
+ *
+ * Build (from tools/):
+ *   gcc -O2 -Wall -I.. -o size_report size_report.c elf32.c
+ *
+ * Usage:
+ *   ./size_report [options] firmware.elf
+ *     -m FILE   GNU ld map file (-Wl,-Map=...): per object file table
+ *     -n N      rows per table (default 15)
+ *     -c FILE   compare with another build of the firmware: totals and the
+ *               functions whose size changed (e.g. -O2 against -Os/LTO)
+ *     -B FILE   budget file; "flash <bytes>" and "ram <bytes>" lines
+ *
+ * Exit status 1 when code or data overlaps the settings/parameter pages or
+ * a budget is exceeded, 2 on a usage or file error.
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stabilizer.h"
+#include "elf32.h"
+
+#define FLASH_ALIAS         0x08000000
+#define FLASH_SIZE          16384
+#define RAM_BASE            0x20000000
+#define RAM_SIZE            2048
+#define MAX_FILES           128
+
+typedef struct {
+    uint32_t flash, ram, flashEnd;      // flashEnd: first byte after the image
+    uint32_t code, runtime, rodata;     // Function bytes, "__" helpers, Flash objects
+} Totals_t;
+
+typedef struct {
+    char name[96];
+    uint32_t flash, ram;
+} FileUse_t;
+
+static const char* const runtimeNames[] = {"memcpy", "memset", "memmove", "memcmp", "strlen"};
+
+// Offset in Flash for either mapping of it, or FLASH_SIZE when not Flash
+static uint32_t Flash_Offset(uint32_t addr) {
+    if(addr >= FLASH_ALIAS) addr -= FLASH_ALIAS;
+    return addr < FLASH_SIZE ? addr : FLASH_SIZE;
+}
+
+static bool In_Ram(uint32_t addr) {
+    return addr - RAM_BASE < RAM_SIZE;
+}
+
+// Compiler runtime: libgcc (soft-float, division, shifts) and the few
+// libc string routines the compiler calls by itself
+static bool Is_Runtime(const char* name) {
+    if(strncmp(name, "__", 2) == 0) return true;
+    for(size_t i = 0; i < sizeof(runtimeNames)/sizeof(runtimeNames[0]); i++)
+        if(strcmp(name, runtimeNames[i]) == 0) return true;
+    return false;
+}
+
+static void Measure(const Elf_t* elf, Totals_t* t) {
+    memset(t, 0, sizeof(*t));
+    for(int i = 0; i < elf->segmentCount; i++) {
+        const ElfSegment_t* s = &elf->segments[i];
+        uint32_t at = Flash_Offset(s->paddr);
+        if(at < FLASH_SIZE && s->fileSize) {
+            t->flash += s->fileSize;
+            if(at + s->fileSize > t->flashEnd) t->flashEnd = at + s->fileSize;
+        }
+        if(In_Ram(s->vaddr)) t->ram += s->memSize;
+    }
+    for(int i = 0; i < elf->symbolCount; i++) {
+        const ElfSymbol_t* s = &elf->symbols[i];
+        if(Flash_Offset(s->addr) >= FLASH_SIZE) continue;
+        if(s->isFunc && Is_Runtime(s->name)) t->runtime += s->size;
+        else if(s->isFunc) t->code += s->size;
+        else t->rodata += s->size;
+    }
+}
+
+// TABLES
+static int Compare_Size(const void* a, const void* b) {
+    const ElfSymbol_t* x = *(const ElfSymbol_t* const*)a;
+    const ElfSymbol_t* y = *(const ElfSymbol_t* const*)b;
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+// Largest symbols of one kind: 0 application code, 1 runtime, 2 Flash
+// objects, 3 RAM objects
+static void Print_Symbols(const Elf_t* elf, int kind, const char* title, int rows) {
+    const ElfSymbol_t** list = malloc((elf->symbolCount + 1) * sizeof(*list));
+    uint32_t total = 0;
+    int n = 0;
+    
+    for(int i = 0; i < elf->symbolCount; i++) {
+        const ElfSymbol_t* s = &elf->symbols[i];
+        bool flash = Flash_Offset(s->addr) < FLASH_SIZE;
+        int k = s->isFunc ? (Is_Runtime(s->name) ? 1 : 0) : (flash ? 2 : 3);
+        if(!s->size || (!flash && !In_Ram(s->addr)) || k != kind) continue;
+        list[n++] = s;
+        total += s->size;
+    }
+    qsort(list, n, sizeof(*list), Compare_Size);
+    printf("\n%-40s %6s  (%d, %u bytes)\n", title, "bytes", n, total);
+    for(int i = 0; i < n && i < rows; i++)
+        printf("  %-38s %6u  0x%08X\n", list[i]->name, list[i]->size, list[i]->addr);
+    if(n > rows) printf("  %-38s %6s\n", "...", "");
+    free(list);
+}
+
+// Per object file from a GNU ld map: input section lines below "Linker
+// script and memory map", " .section  0xADDR  0xSIZE  file.o", the name
+// alone on its line when it is long. Archive members add up per library.
+static void Add_File(FileUse_t* files, int* count, const char* file, uint32_t flash, uint32_t ram) {
+    char name[96];
+    const char* slash = strrchr(file, '/');
+    const char* paren = strchr(file, '(');
+    int i;
+    
+    snprintf(name, sizeof(name), "%.*s", paren ? (int)(paren - file) : (int)strlen(file), file);
+    if(slash && (!paren || slash < paren)) snprintf(name, sizeof(name), "%.*s",
+        paren ? (int)(paren - slash - 1) : (int)strlen(slash + 1), slash + 1);
+    for(i = 0; i < *count && strcmp(files[i].name, name) != 0; i++);
+    if(i == *count) {
+        if(*count == MAX_FILES) return;
+        snprintf(files[(*count)++].name, sizeof(files[0].name), "%s", name);
+    }
+    files[i].flash += flash;
+    files[i].ram += ram;
+}
+
+static int Compare_Files(const void* a, const void* b) {
+    const FileUse_t* x = a;
+    const FileUse_t* y = b;
+    return (int)(y->flash + y->ram) - (int)(x->flash + x->ram);
+}
+
+static bool Print_Map(const char* path, int rows) {
+    FILE* f = fopen(path, "r");
+    static FileUse_t files[MAX_FILES];
+    char line[512], section[128] = "";
+    bool inMap = false;
+    int count = 0;
+    
+    if(!f) {
+        perror(path);
+        return false;
+    }
+    while(fgets(line, sizeof(line), f)) {
+        char name[128], file[256];
+        unsigned addr, size;
+        if(!inMap) {
+            inMap = strncmp(line, "Linker script and memory map", 28) == 0;
+            continue;
+        }
+        if(line[0] != ' ') {                            // Output section or script line
+            section[0] = 0;
+            continue;
+        }
+        int fields = sscanf(line, " %127s 0x%x 0x%x %255s", name, &addr, &size, file);
+        if(fields == 1 && (name[0] == '.' || strcmp(name, "COMMON") == 0)) {
+            snprintf(section, sizeof(section), "%s", name);     // Long name, rest on the next line
+            continue;
+        }
+        if(fields == 3 && strcmp(name, "*fill*") == 0) {
+            snprintf(file, sizeof(file), "alignment padding");
+        } else if(fields != 4) {
+            if(sscanf(line, " 0x%x 0x%x %255s", &addr, &size, file) != 3 || !section[0]) continue;
+            snprintf(name, sizeof(name), "%s", section);
+        }
+        section[0] = 0;
+        if(!size || (name[0] != '.' && strcmp(name, "COMMON") != 0 && strcmp(name, "*fill*") != 0)) continue;
+        
+        bool data = strncmp(name, ".data", 5) == 0 || strncmp(name, ".sdata", 6) == 0;
+        if(In_Ram(addr)) Add_File(files, &count, file, data ? size : 0, size);
+        else if(Flash_Offset(addr) < FLASH_SIZE) Add_File(files, &count, file, size, 0);
+    }
+    fclose(f);
+    if(!inMap) {
+        fprintf(stderr, "%s: no \"Linker script and memory map\" section\n", path);
+        return false;
+    }
+    qsort(files, count, sizeof(FileUse_t), Compare_Files);
+    printf("\n%-40s %6s %6s\n", "object file / library", "flash", "ram");
+    for(int i = 0; i < count && i < rows; i++)
+        printf("  %-38s %6u %6u\n", files[i].name, files[i].flash, files[i].ram);
+    if(count > rows) printf("  %-38s\n", "...");
+    return true;
+}
+
+// COMPARISON - functions matched by name without the compiler's clone
+// suffixes (.constprop.0, .isra.0, .lto_priv.0)
+static void Base_Name(const char* name, char* out, size_t max) {
+    const char* dot = strchr(name, '.');
+    snprintf(out, max, "%.*s", dot ? (int)(dot - name) : (int)strlen(name), name);
+}
+
+static uint32_t Function_Bytes(const Elf_t* elf, const char* base) {
+    char name[128];
+    uint32_t bytes = 0;
+    
+    for(int i = 0; i < elf->symbolCount; i++) {
+        const ElfSymbol_t* s = &elf->symbols[i];
+        if(!s->isFunc || Flash_Offset(s->addr) >= FLASH_SIZE) continue;
+        Base_Name(s->name, name, sizeof(name));
+        if(strcmp(name, base) == 0) bytes += s->size;
+    }
+    return bytes;
+}
+
+typedef struct {
+    char name[128];
+    int32_t before, after;
+} Delta_t;
+
+static int Compare_Delta(const void* a, const void* b) {
+    const Delta_t* x = a;
+    const Delta_t* y = b;
+    return abs(y->after - y->before) - abs(x->after - x->before);
+}
+
+static void Add_Delta(Delta_t* d, int* n, const Elf_t* a, const Elf_t* b, const char* symbol) {
+    char name[128];
+    
+    Base_Name(symbol, name, sizeof(name));
+    for(int i = 0; i < *n; i++)
+        if(strcmp(d[i].name, name) == 0) return;
+    snprintf(d[*n].name, sizeof(d[0].name), "%s", name);
+    d[*n].before = (int32_t)Function_Bytes(a, name);
+    d[*n].after = (int32_t)Function_Bytes(b, name);
+    if(d[*n].before != d[*n].after) (*n)++;
+}
+
+static void Print_Comparison(const char* basePath, const Elf_t* base, const Elf_t* elf, int rows) {
+    Totals_t a, b;
+    Delta_t* d = calloc(base->symbolCount + elf->symbolCount + 1, sizeof(Delta_t));
+    int n = 0;
+    
+    Measure(base, &a);
+    Measure(elf, &b);
+    printf("\ncompared with %s\n", basePath);
+    printf("  %-22s %7s %7s %7s\n", "", "before", "after", "change");
+    printf("  %-22s %7u %7u %+7d\n", "flash", a.flash, b.flash, (int)(b.flash - a.flash));
+    printf("  %-22s %7u %7u %+7d\n", "  application code", a.code, b.code, (int)(b.code - a.code));
+    printf("  %-22s %7u %7u %+7d\n", "  runtime helpers", a.runtime, b.runtime, (int)(b.runtime - a.runtime));
+    printf("  %-22s %7u %7u %+7d\n", "  constant objects", a.rodata, b.rodata, (int)(b.rodata - a.rodata));
+    printf("  %-22s %7u %7u %+7d\n", "ram (data + bss)", a.ram, b.ram, (int)(b.ram - a.ram));
+    
+    for(int i = 0; i < base->symbolCount; i++)
+        if(base->symbols[i].isFunc && Flash_Offset(base->symbols[i].addr) < FLASH_SIZE)
+            Add_Delta(d, &n, base, elf, base->symbols[i].name);
+    for(int i = 0; i < elf->symbolCount; i++)
+        if(elf->symbols[i].isFunc && Flash_Offset(elf->symbols[i].addr) < FLASH_SIZE)
+            Add_Delta(d, &n, base, elf, elf->symbols[i].name);
+    qsort(d, n, sizeof(Delta_t), Compare_Delta);
+    printf("\n%-40s %7s %7s %7s\n", "function (clones merged)", "before", "after", "change");
+    for(int i = 0; i < n && i < rows; i++)
+        printf("  %-38s %7d %7d %+7d%s\n", d[i].name, d[i].before, d[i].after, d[i].after - d[i].before,
+               !d[i].after ? "  (inlined/removed)" : !d[i].before ? "  (new)" : "");
+    if(n > rows) printf("  ... %d more\n", n - rows);
+    free(d);
+}
+
+static void Read_Budgets(const char* path, uint32_t* flash, uint32_t* ram) {
+    FILE* f = fopen(path, "r");
+    char line[256];
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    while(fgets(line, sizeof(line), f)) {
+        if(sscanf(line, " flash %u", flash) == 1) continue;
+        sscanf(line, " ram %u", ram);
+    }
+    fclose(f);
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    const char* mapPath = NULL;
+    const char* basePath = NULL;
+    const char* budgetPath = NULL;
+    int rows = 15;
+    Elf_t elf;
+    Totals_t t;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) mapPath = argv[++i];
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) rows = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) basePath = argv[++i];
+        else if(strcmp(argv[i], "-B") == 0 && i + 1 < argc) budgetPath = argv[++i];
+        else if(argv[i][0] != '-' && !path) path = argv[i];
+        else path = NULL, i = argc;
+    }
+    if(!path || rows <= 0) {
+        fprintf(stderr, "usage: %s [-m firmware.map] [-n rows] [-c base.elf] [-B budgets.txt] firmware.elf\n", argv[0]);
+        return 2;
+    }
+    if(!Elf_Load(path, &elf)) return 2;
+    Measure(&elf, &t);
+    
+    // Reserved pages: from the lower of the two to the end of the higher
+    uint32_t settings = Flash_Offset(FLASH_SETTINGS_ADDR), params = Flash_Offset(FLASH_PARAMS_ADDR);
+    uint32_t reservedLo = settings < params ? settings : params;
+    uint32_t reservedHi = (settings > params ? settings : params) + FLASH_PAGE_SIZE;
+    bool ok = true;
+    
+    printf("%s\n", path);
+    printf("  flash %6u of %u bytes (%.1f %%), image ends at 0x%04X\n", t.flash, FLASH_SIZE,
+           100.0 * t.flash / FLASH_SIZE, t.flashEnd);
+    uint32_t named = t.code + t.runtime + t.rodata;
+    printf("    application code %6u, runtime helpers %6u, constant objects %6u, other %6u\n",
+           t.code, t.runtime, t.rodata, t.flash > named ? t.flash - named : 0);
+    printf("  ram   %6u of %u bytes (%.1f %%) in .data/.bss, %u left for the stack\n", t.ram, RAM_SIZE,
+           100.0 * t.ram / RAM_SIZE, t.ram < RAM_SIZE ? RAM_SIZE - t.ram : 0);
+    printf("  settings/parameter pages 0x%04X-0x%04X: ", reservedLo, reservedHi - 1);
+    for(int i = 0; i < elf.segmentCount; i++) {
+        const ElfSegment_t* s = &elf.segments[i];
+        uint32_t at = Flash_Offset(s->paddr);
+        if(at >= FLASH_SIZE || !s->fileSize || at >= reservedHi || at + s->fileSize <= reservedLo) continue;
+        if(ok) printf("OVERLAPPED\n");
+        printf("    segment 0x%08X-0x%08X runs into them\n", s->paddr, s->paddr + s->fileSize - 1);
+        ok = false;
+    }
+    if(ok) printf("clear, %u bytes free below them\n", t.flashEnd < reservedLo ? reservedLo - t.flashEnd : 0);
+    
+    Print_Symbols(&elf, 0, "largest functions", rows);
+    Print_Symbols(&elf, 1, "runtime helpers (soft-float, libgcc)", rows);
+    Print_Symbols(&elf, 2, "constant objects in flash", rows);
+    Print_Symbols(&elf, 3, "ram objects", rows);
+    if(mapPath && !Print_Map(mapPath, rows)) return 2;
+    
+    if(basePath) {
+        Elf_t base;
+        if(!Elf_Load(basePath, &base)) return 2;
+        Print_Comparison(basePath, &base, &elf, rows);
+        Elf_Free(&base);
+    }
+    
+    if(budgetPath) {
+        uint32_t flashBudget = 0, ramBudget = 0;
+        Read_Budgets(budgetPath, &flashBudget, &ramBudget);
+        printf("\n");
+        if(flashBudget) {
+            printf("flash budget %u bytes: %s\n", flashBudget, t.flash <= flashBudget ? "OK" : "OVER BUDGET");
+            ok = ok && t.flash <= flashBudget;
+        }
+        if(ramBudget) {
+            printf("ram budget %u bytes: %s\n", ramBudget, t.ram <= ramBudget ? "OK" : "OVER BUDGET");
+            ok = ok && t.ram <= ramBudget;
+        }
+    }
+    Elf_Free(&elf);
+    return ok ? 0 : 1;
+}
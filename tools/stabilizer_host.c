@@ -0,0 +1,324 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - NATIVE BUILD OF THE CONTROL CORE (HOST)
+ * ============================================================================
+ * Links the unmodified control core (stabilizer.c, params.c) against the
+ * mock HAL and walks it through calibration, regulation, M-START and both
+ * protection trips. The sense input is the transformer output scaled like
+ * the board: ADC = mains / tap ratio * adcCapturedA / 244 V, optionally
+ * less a sense offset to exercise multi-point calibration.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -DSERIAL_PROTOCOL=0 -o stabilizer_host stabilizer_host.c \
+ *       hal_mock.c ../stabilizer.c ../params.c ../filter.c ../crc16.c
+ *
+ * Usage:
+ *   ./stabilizer_host        run the checks, exit status 0 when all pass
+ *   ./stabilizer_host -v     also print every output change
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "hal_mock.h"
+
+#define CAL_ADC         700         // ADC count at CALIBRATION_VOLTAGE
+
+typedef struct {
+    HalInput_t in;
+    uint32_t fromMs, toMs;
+} Press_t;
+
+static Press_t presses[8];
+static int pressCount = 0;
+static float mainsVolts = 244.0f;
+static float senseOffsetV = 0.0f;           // Output volts lost in the sense chain
+static uint16_t spikeCounts = 0;            // Added to every sense sample
+static bool verbose = false;
+static int failures = 0;
+
+static bool Script_Input(HalInput_t in, uint64_t timeUs) {
+    uint32_t ms = (uint32_t)(timeUs / 1000);
+    for(int i = 0; i < pressCount; i++)
+        if(presses[i].in == in && ms >= presses[i].fromMs && ms < presses[i].toMs) return true;
+    return mockInputs[in];
+}
+
+static void Press(HalInput_t in, uint32_t atMs, uint32_t forMs) {
+    presses[pressCount++ % 8] = (Press_t){in, atMs, atMs + forMs};
+}
+
+static uint16_t Sense_Count(float opv) {
+    float v = opv > senseOffsetV ? opv - senseOffsetV : 0.0f;
+    return (uint16_t)(v * CAL_ADC / CALIBRATION_VOLTAGE + 0.5f);
+}
+
+// Relay outputs -> step -> sensed output voltage
+static uint16_t Sense_Adc(uint64_t timeUs) {
+    (void)timeUs;
+    for(int s = 0; s < 8; s++)
+        if(relaySteps[s].relays == Mock_Relays()) return Sense_Count(mainsVolts / RELAY_STEP_RATIO(s)) + spikeCounts;
+    return 0;
+}
+
+static uint16_t stepCount = 0;
+static uint16_t Step_Adc(uint64_t timeUs) {
+    (void)timeUs;
+    return stepCount;
+}
+
+static float Opv_Error(float opv) {
+    float e = Calculate_OPV(Sense_Count(opv)) * 0.1f - opv;
+    return e < 0 ? -e : e;
+}
+
+static void Trace_Output(HalOutput_t out, bool on, uint64_t timeUs) {
+    if(verbose) printf("  %9.3f s  %-11s %s\n", timeUs / 1e6, Mock_Output_Name(out), on ? "ON" : "off");
+}
+
+static uint32_t Now(void) { return HAL_GetTick(); }
+
+// One pass of the firmware main loop
+static void Loop_Pass(void) {
+    Stabilizer_Run();
+    HAL_Delay_Ms(passPeriodMs);
+}
+
+static void Run_For(uint32_t ms) {
+    uint32_t start = Now();
+    while((Now() - start) < ms) Loop_Pass();
+}
+
+// Runs the loop until cond holds; t = elapsed ms, or -1 on timeout
+#define RUN_UNTIL(t, cond, maxMs) do { \
+    uint32_t start_ = Now(); \
+    t = -1; \
+    while((Now() - start_) < (maxMs)) { \
+        Loop_Pass(); \
+        if(cond) { t = (int32_t)(Now() - start_); break; } \
+    } \
+} while(0)
+
+static void Check(const char* name, bool ok) {
+    printf("%-36s %s\n", name, ok ? "ok" : "FAIL");
+    if(!ok) failures++;
+}
+
+int main(int argc, char** argv) {
+    verbose = (argc > 1 && strcmp(argv[1], "-v") == 0);
+    
+    Mock_Reset();
+    mockInputSource = Script_Input;
+    mockAdcSource = Sense_Adc;
+    mockOutputHook = Trace_Output;
+    mainsVolts = CALIBRATION_VOLTAGE * RELAY_STEP_RATIO(0);   // OPV = 244 V at step 0
+    
+    // Erased Flash: uncalibrated, hold the button at power-on
+    Press(HAL_IN_BUTTON, 0, 1500);
+    HAL_Init();
+    Stabilizer_Init();
+    int32_t t;
+    RUN_UNTIL(t, currentState != STATE_BOOT, 2000);
+    Check("boot with button enters setting mode", currentState == STATE_SETTING &&
+          settingState == SETTING_ENTRY && !mockOutputs[HAL_OUT_R5]);
+    RUN_UNTIL(t, settingState == SETTING_WAITING_DELAY, 3000);
+    Check("entry blinks without blocking the loop", t >= 1700 && t < 2000);
+    
+    uint32_t t0 = Now();
+    Press(HAL_IN_BUTTON, t0 + 20000, 100);
+    Run_For(21000);
+    Check("delay counted by button press", settingState == SETTING_WAITING_ADC && delayTimeMs == 20000);
+    
+    Press(HAL_IN_BUTTON, Now() + 1000, 100);
+    Run_For(2000);
+    bool calibrated = currentState == STATE_NORMAL && adcCapturedA == CAL_ADC && r5State == R5_DELAY_ACTIVE;
+    adcCapturedA = 0;
+    Load_Settings();
+    Check("calibration captured and stored", calibrated && adcCapturedA == CAL_ADC &&
+          delayTimeMs == 20000 && Params_Get(PARAM_DELAY_S) == 20);
+    
+    // Reconnect delay, then regulation at 230 V
+    mainsVolts = 230.0f;
+    RUN_UNTIL(t, r5State == R5_NORMAL, 30000);
+    Check("R5 closes after the reconnect delay", t > 15000 && mockOutputs[HAL_OUT_R5]);
+    Run_For(2000);
+    Check("230 V regulated on step 4", currentStep == 4 && currentOPV > 2250 && currentOPV < 2350);
+    
+    // Adaptive rate: 3 V below step 5's threshold is within ADAPTIVE_MARGIN_V
+    if(ADAPTIVE_RATE_ENABLE) {
+        Check("steady line at the slow pass rate", passPeriodMs == PASS_SLOW_MS);
+        mainsVolts = relaySteps[5].threshold_up - 3.0f;
+        Run_For(1000);
+        bool nearEdge = passPeriodMs == LOOP_PERIOD_MS && currentStep == 4;
+        mainsVolts = 230.0f;
+        RUN_UNTIL(t, passPeriodMs == PASS_SLOW_MS, 2000);
+        Check("full rate near a tap threshold", nearEdge && t > 0);
+        Params_Set(PARAM_LOCUT_DETECT_MS, ADAPTIVE_LATENCY_MS);
+        Run_For(1000);
+        bool shortDetect = passPeriodMs == LOOP_PERIOD_MS;
+        Params_Set(PARAM_LOCUT_DETECT_MS, LOCUT_DETECT_TIME_MS);
+        RUN_UNTIL(t, passPeriodMs == PASS_SLOW_MS, 2000);
+        Check("full rate with a short detect time", shortDetect && t > 0);
+    }
+    
+    // A 100-count spike for one pass (a slow one with the adaptive rate):
+    // the regulation path moves by its weight of 0.2, no tap change
+    uint16_t spikeBase = currentADC, spikePeak = 0, spikeOps = relayOperations;
+    spikeCounts = 100;
+    Loop_Pass();
+    spikeCounts = 0;
+    for(int i = 0; i < 30; i++) {
+        if(currentADC > spikePeak) spikePeak = currentADC;
+        Loop_Pass();
+    }
+    printf("  one-pass spike of 100 counts: regulation path +%d\n", spikePeak - spikeBase);
+    Check("one-pass spike filtered", spikePeak <= spikeBase + 25 && relayOperations == spikeOps);
+    
+    // HICUT: 460 V is above the top step's reach. From the slow rate it is
+    // seen within one slow pass, then everything runs at the full rate
+    mainsVolts = 460.0f;
+    RUN_UNTIL(t, r5State == R5_HICUT_DETECTING, 1000);
+    int32_t seenMs = t;
+    Check("cut seen within a slow pass", t >= 0 && t <= PASS_SLOW_MS + 5 && passPeriodMs == LOOP_PERIOD_MS);
+    RUN_UNTIL(t, !mockOutputs[HAL_OUT_R5], 5000);
+    t += seenMs;
+    printf("  HICUT trip after %d ms\n", t);
+    Check("HICUT opens R5", t >= 500 && t < 2000 && currentState == STATE_FAULT && hicutTrips == 1 &&
+          mockOutputs[HAL_OUT_FAULT_LED]);
+    
+    mainsVolts = 230.0f;
+    RUN_UNTIL(t, r5State == R5_DELAY_ACTIVE, 5000);
+    Check("HICUT resumes into the reconnect delay", t >= 0 && currentState == STATE_NORMAL &&
+          !mockOutputs[HAL_OUT_FAULT_LED]);
+    
+    // M-START skips the rest of the delay
+    Press(HAL_IN_M_START, Now() + 2000, 100);
+    RUN_UNTIL(t, mockOutputs[HAL_OUT_R5], 10000);
+    Check("M-START closes R5 early", t >= 2000 && t < 3000);
+    
+    // LOCUT only with the enable input pulled low
+    mainsVolts = 70.0f;
+    Run_For(3000);
+    Check("LOCUT ignored while disabled", mockOutputs[HAL_OUT_R5] && locutTrips == 0);
+    mockInputs[HAL_IN_LOWCUT_EN] = true;
+    RUN_UNTIL(t, !mockOutputs[HAL_OUT_R5], 5000);
+    printf("  LOCUT trip after %d ms\n", t);
+    Check("LOCUT opens R5", t >= 500 && t < 2000 && locutTrips == 1);
+    
+    // Runtime threshold change goes through the compiled table
+    mainsVolts = 230.0f;
+    RUN_UNTIL(t, r5State == R5_NORMAL, 60000);
+    Check("HICUT 200 V rejected (order)", Params_Set(PARAM_HICUT, 2000) == PARAM_ERR_ORDER);
+    Check("HICUT 255 V accepted", Params_Set(PARAM_HICUT, 2550) == PARAM_OK &&
+          controlTable->prot[R5_CH_HICUT].tripAdc == (2550 * CAL_ADC) / CALIBRATION_DECIVOLTS);
+    
+    // Staged: all four thresholds move together, which HICUT alone could not
+    const ControlTable_t* live = controlTable;
+    Params_Stage();
+    Params_Set(PARAM_HICUT, 2400);
+    Params_Set(PARAM_HICUT_RESUME, 2300);
+    Params_Set(PARAM_LOCUT, 2200);
+    Params_Set(PARAM_LOCUT_RESUME, 2250);
+    Check("staged thresholds not live", controlTable == live);
+    Check("staged thresholds applied at once", Params_Commit() &&
+          controlTable->prot[R5_CH_HICUT].tripAdc == (2400 * CAL_ADC) / CALIBRATION_DECIVOLTS);
+    Params_Stage();
+    Params_Set(PARAM_HICUT, 2550);
+    Params_Set(PARAM_LOCUT, 2350);                          // Above its resume: refused
+    Check("refused staged set leaves all", !Params_Commit() && Params_Get(PARAM_HICUT) == 2400 &&
+          Params_Get(PARAM_LOCUT) == 2200);
+    Params_Stage();
+    Params_Set(PARAM_HICUT, 2550);
+    Params_Set(PARAM_HICUT_RESUME, 2490);
+    Params_Set(PARAM_LOCUT, 1810);
+    Params_Set(PARAM_LOCUT_RESUME, 1890);
+    Params_Commit();
+    
+    // Power cycle of the calibrated unit at 150 V (in the sense range on
+    // step 0): taps placed once the input settled
+    mainsVolts = 150.0f;
+    Apply_Relay_Step(0);
+    Set_R5_Relay(false);
+    Stabilizer_Init();
+    RUN_UNTIL(t, currentState != STATE_BOOT, 2000);
+    printf("  first relay decision after %d ms\n", t);
+    Check("boot places taps within 50 ms", t >= 0 && t <= 50 && currentStep == 2 &&
+          r5State == R5_DELAY_ACTIVE && !mockOutputs[HAL_OUT_R5]);
+    
+    // Recalibration: the stored calibration stays in Flash and keeps the cut
+    // channels watching until the new one is committed
+    mainsVolts = 140.0f;                                    // 297 V on step 0
+    Apply_Relay_Step(0);
+    Press(HAL_IN_BUTTON, Now(), 1500);
+    Stabilizer_Init();
+    RUN_UNTIL(t, settingState == SETTING_WAITING_DELAY, 5000);
+    Check("HICUT trips in setting mode", hicutTrips == 2 && currentState == STATE_SETTING &&
+          !mockOutputs[HAL_OUT_R5] && mockOutputs[HAL_OUT_FAULT_LED]);
+    
+    mainsVolts = 112.0f;
+    Press(HAL_IN_BUTTON, Now() + 5000, 100);
+    Run_For(5500);
+    Press(HAL_IN_BUTTON, Now() + 500, 100);
+    RUN_UNTIL(t, settingState == SETTING_CAPTURING, 1000);
+    const Settings_t* stored = (const Settings_t*)HAL_Flash_Read(FLASH_SETTINGS_ADDR);
+    Check("old calibration kept while capturing", stored->adc_captured_a == CAL_ADC &&
+          adcCapturedA == CAL_ADC && r5State == R5_NORMAL && !mockOutputs[HAL_OUT_FAULT_LED]);
+    uint16_t capture = Sense_Adc(0);                        // Still on step 0
+    RUN_UNTIL(t, currentState == STATE_NORMAL, 1000);
+    Check("new calibration committed", t >= 200 && stored->adc_captured_a == capture &&
+          adcCapturedA == capture && delayTimeMs == 5000 && r5State == R5_DELAY_ACTIVE);
+    
+    // A 20 V sense offset bends the single-point line; points at 180 and
+    // 270 V straighten it, one 1 V from an existing point is refused
+    senseOffsetV = 20.0f;
+    Calibration_Set_Point(CALIBRATION_DECIVOLTS, Sense_Count(CALIBRATION_VOLTAGE));
+    float before = Opv_Error(LOCUT_THRESHOLD);
+    bool added = Calibration_Set_Point(1800, Sense_Count(180.0f)) &&
+                 Calibration_Set_Point(2700, Sense_Count(270.0f));
+    printf("  OPV error at %.0f V: %.1f V with one point, %.1f V with three\n",
+           LOCUT_THRESHOLD, before, Opv_Error(LOCUT_THRESHOLD));
+    Check("multi-point calibration", added && before > 3.0f && Opv_Error(LOCUT_THRESHOLD) < 0.5f &&
+          Opv_Error(HICUT_THRESHOLD) < 0.5f && Opv_Error(270.0f) < 0.5f && stored->cal_count == 2);
+    Check("close calibration point refused", !Calibration_Set_Point(1810, Sense_Count(181.0f)) &&
+          calPointCount == 2 && stored->cal_count == 2);
+    Load_Settings();
+    Params_Compile();
+    bool reloaded = calPointCount == 2 && Opv_Error(LOCUT_THRESHOLD) < 0.5f;
+    Calibration_Clear_Points();
+    Check("calibration points stored, cleared", reloaded && calPointCount == 0 &&
+          stored->cal_count == 0 && Opv_Error(LOCUT_THRESHOLD) > 3.0f);
+    
+    // A unit from before multi-point calibration and the parameter store:
+    // 16-byte V1 record (SettingsV1_t in stabilizer.c), no parameter page
+    struct { uint16_t adc; uint32_t delayMs, magic, checksum; } v1 =
+        {650, 45000, SETTINGS_MAGIC_V1, 650 + 45000 + SETTINGS_MAGIC_V1};
+    _Static_assert(sizeof(v1) == 16, "V1 settings record is 16 bytes");
+    Calibration_Set_Point(1800, Sense_Count(180.0f));
+    HAL_Flash_Write(FLASH_SETTINGS_ADDR, &v1, sizeof(v1));
+    HAL_Flash_Erase(FLASH_PARAMS_ADDR);
+    Stabilizer_Init();
+    Check("V1 settings record migrated", adcCapturedA == 650 && delayTimeMs == 45000 &&
+          calPointCount == 0 && Params_Get(PARAM_DELAY_S) == 45);
+    
+    // Measurement paths: passes until each covers 90 % of a 100-count step
+    mockAdcSource = Step_Adc;
+    stepCount = 400;
+    for(int i = 0; i < 50; i++) ADC_ReadCount_Filtered();
+    stepCount = 500;
+    int fastMs = -1, slowMs = -1;
+    for(int i = 1; i <= 50 && slowMs < 0; i++) {
+        uint16_t slow = ADC_ReadCount_Filtered();
+        if(fastMs < 0 && currentADCFast >= 490) fastMs = i * LOOP_PERIOD_MS;
+        if(slowMs < 0 && slow >= 490) slowMs = i * LOOP_PERIOD_MS;
+    }
+    printf("  90 %% step response: protection path %d ms, regulation path %d ms\n", fastMs, slowMs);
+    Check("protection path faster", fastMs > 0 && fastMs < slowMs);
+    
+    printf("virtual time %.1f s, %llu ADC conversions, %u Flash writes\n",
+           mockTimeUs / 1e6, (unsigned long long)mockAdcReads, mockFlashWrites);
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,452 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - STATIC STACK DEPTH REPORT (HOST)
+ * ============================================================================
+ * Worst-case stack of the linked firmware: main() with everything it can
+ * call, plus interrupt handlers nested on top of it. Frame sizes come from
+ * the compiler's -fstack-usage files (*.su); functions without one (libgcc
+ * soft-float helpers, startup code) are sized from their sp adjustments.
+ * The call graph is read from the ELF itself with the RV32EC decoder:
+ * jal/call edges, tail calls, and for calls through a pointer every
+ * function whose address is taken (stored in a table or built with
+ * lui/auipc + addi), so the Modbus register callbacks are covered.
+ *
+ * Interrupt handlers are the entries of the vector table. QingKe V2 nests
+ * two levels, so the total is main plus the two deepest distinct handlers,
+ * each with the HPE register frame.
+ *
+ * Build (from tools/; firmware built with -fstack-usage, which leaves a .su
+ * file next to each object):
+ *   gcc -O2 -Wall -o stack_report stack_report.c rv32ec.c elf32.c
+ *
+ * Usage:
+ *   ./stack_report [options] firmware.elf [*.su]
+ *     -B FILE   budget file; its "stack <bytes>" line is the limit
+ *     -b BYTES  stack budget (overrides -B)
+ *     -n N      interrupt nesting levels (default 2)
+ *     -r NAME   root of the main context (default main); repeatable
+ *     -e A:B    extra call edge from A to B; repeatable
+ *     -v        every function, not just the roots and handlers
+ *
+ * Exit status 1 when the worst case exceeds the budget or the free RAM
+ * above .bss, or when recursion or a dynamic frame makes it unbounded.
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rv32ec.h"
+#include "elf32.h"
+
+#define FLASH_ALIAS         0x08000000
+#define FLASH_SIZE          16384
+#define HPE_FRAME_BYTES     40          // x1, x5-x7, x10-x15 per interrupt level
+#define VECTOR_MAX          64
+#define MAX_ROOTS           8
+#define MAX_EXTRA           32
+
+typedef struct {
+    int to;
+    bool tail;                          // Frame already released at the jump
+} Edge_t;
+
+typedef struct {
+    const ElfSymbol_t* sym;
+    int frame;
+    bool fromSu, dynamic, indirect, addressTaken, isr;
+    Edge_t* edges;
+    int edgeCount, edgeCap;
+    int state;                          // 0 new, 1 on the DFS path, 2 done
+    int depth, next;                    // Worst depth and the callee on that path
+} Func_t;
+
+static Elf_t elf;
+static uint8_t flash[FLASH_SIZE];
+static Func_t* funcs;
+static int funcCount;
+static bool recursion;
+
+// IMAGE
+static void Load_Flash(void) {
+    memset(flash, 0xFF, sizeof(flash));
+    for(int i = 0; i < elf.segmentCount; i++) {
+        const ElfSegment_t* s = &elf.segments[i];
+        uint32_t at = s->paddr >= FLASH_ALIAS ? s->paddr - FLASH_ALIAS : s->paddr;
+        if(at < FLASH_SIZE && at + s->fileSize <= FLASH_SIZE) memcpy(flash + at, s->data, s->fileSize);
+    }
+}
+
+static uint32_t Flash_Word(uint32_t addr, int size) {
+    uint32_t v = 0;
+    
+    addr = addr >= FLASH_ALIAS ? addr - FLASH_ALIAS : addr;
+    for(int i = size-1; i >= 0; i--) v = (v << 8) | (addr + i < FLASH_SIZE ? flash[addr + i] : 0);
+    return v;
+}
+
+// Function starting exactly at addr, or -1
+static int Func_At(uint32_t addr) {
+    int lo = 0, hi = funcCount - 1;
+    
+    addr = addr >= FLASH_ALIAS ? addr - FLASH_ALIAS : addr;
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        uint32_t a = funcs[mid].sym->addr >= FLASH_ALIAS ? funcs[mid].sym->addr - FLASH_ALIAS : funcs[mid].sym->addr;
+        if(a == addr) return mid;
+        if(a < addr) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+static int Func_Named(const char* name) {
+    for(int i = 0; i < funcCount; i++)
+        if(strcmp(funcs[i].sym->name, name) == 0) return i;
+    return -1;
+}
+
+static void Add_Edge(Func_t* f, int to, bool tail) {
+    for(int i = 0; i < f->edgeCount; i++)
+        if(f->edges[i].to == to && f->edges[i].tail == tail) return;
+    if(f->edgeCount == f->edgeCap) {
+        f->edgeCap = f->edgeCap ? 2*f->edgeCap : 8;
+        f->edges = realloc(f->edges, f->edgeCap * sizeof(Edge_t));
+    }
+    f->edges[f->edgeCount++] = (Edge_t){to, tail};
+}
+
+// CALL GRAPH - linear decode of each function; register constants from
+// lui/auipc (+ addi) resolve "call" pairs and taken addresses
+static void Scan_Function(int index) {
+    Func_t* f = &funcs[index];
+    uint32_t start = f->sym->addr, end = start + f->sym->size, pc = start;
+    uint32_t value[16];
+    bool known[16] = {false};
+    int sp = 0;
+    
+    while(pc + 2 <= end) {
+        uint32_t lo = Flash_Word(pc, 2), ins, len = 4;
+        if((lo & 3) != 3) {
+            len = 2;
+            ins = Rv32_Expand((uint16_t)lo);
+        } else ins = Flash_Word(pc, 4);
+        if(!ins) {
+            pc += len;
+            continue;
+        }
+        
+        uint32_t op = ins & 0x7F, rd = (ins >> 7) & 15, rs1 = (ins >> 15) & 15, f3 = (ins >> 12) & 7;
+        int32_t immI = (int32_t)ins >> 20;
+        bool writes = true;
+        switch(op) {
+            case 0x37:                                  // lui
+                value[rd] = ins & 0xFFFFF000;
+                known[rd] = true;
+                writes = false;
+                break;
+            case 0x17:                                  // auipc
+                value[rd] = pc + (ins & 0xFFFFF000);
+                known[rd] = true;
+                writes = false;
+                break;
+            case 0x13:
+                if(f3 == 0 && rd == 2 && rs1 == 2) {    // addi sp, sp, imm
+                    if(immI < 0) sp -= immI;
+                    writes = false;
+                } else if(f3 == 0 && known[rs1]) {
+                    value[rd] = value[rs1] + immI;
+                    known[rd] = true;
+                    int t = Func_At(value[rd]);
+                    if(t >= 0) funcs[t].addressTaken = true;
+                    writes = false;
+                }
+                break;
+            case 0x6F: {                                // jal
+                uint32_t imm = ((ins >> 31) << 20) | (((ins >> 12) & 0xFF) << 12)
+                             | (((ins >> 20) & 1) << 11) | (((ins >> 21) & 0x3FF) << 1);
+                uint32_t target = pc + (uint32_t)((int32_t)(imm << 11) >> 11);
+                int t = Func_At(target);
+                if(rd == 1 && t >= 0) Add_Edge(f, t, false);
+                else if(rd == 0 && t >= 0 && t != index) Add_Edge(f, t, true);
+                else if(rd == 1) fprintf(stderr, "warning: %s calls 0x%08X, not a function start\n", f->sym->name, target);
+                memset(known, 0, sizeof(known));
+                writes = false;
+                break;
+            }
+            case 0x67: {                                // jalr
+                int t = known[rs1] ? Func_At(value[rs1] + immI) : -1;
+                if(t >= 0) Add_Edge(f, t, rd == 0);
+                else if(rd == 1) f->indirect = true;    // Call through a pointer
+                // jr other than ret: a switch table inside the function
+                memset(known, 0, sizeof(known));
+                writes = false;
+                break;
+            }
+            case 0x63: case 0x23: case 0x0F:            // Branch, store, fence
+                if(op == 0x63) memset(known, 0, sizeof(known));
+                writes = false;
+                break;
+        }
+        if(writes && rd) known[rd] = false;
+        pc += len;
+    }
+    if(!f->fromSu) f->frame = sp;
+}
+
+// Function addresses stored as data (register maps, vector table)
+static void Scan_Tables(uint32_t vectorBase, int vectorCount) {
+    for(uint32_t a = 0; a + 4 <= FLASH_SIZE; a += 4) {
+        if(a >= vectorBase && a < vectorBase + 4*vectorCount) continue;
+        int t = Func_At(Flash_Word(a, 4));
+        if(t >= 0 && Flash_Word(a, 4) != 0) funcs[t].addressTaken = true;
+    }
+}
+
+// Entries after the reset jump that hold 0 or a function start
+static int Find_Vectors(uint32_t base) {
+    int n = 1;
+    
+    while(n < VECTOR_MAX) {
+        uint32_t v = Flash_Word(base + 4*n, 4);
+        int t = Func_At(v);
+        if(v != 0 && t < 0) break;
+        if(t >= 0) funcs[t].isr = true;
+        n++;
+    }
+    return n;
+}
+
+// STACK USAGE FILES - "file.c:line:col:name<TAB>bytes<TAB>static|dynamic[,bounded]"
+static void Load_Su(const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[512];
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    while(fgets(line, sizeof(line), f)) {
+        char* tab = strchr(line, '\t');
+        if(!tab) continue;
+        *tab = 0;
+        char* name = strrchr(line, ':');
+        name = name ? name + 1 : line;
+        int bytes = atoi(tab + 1);
+        bool dynamic = strstr(tab + 1, "dynamic") && !strstr(tab + 1, "bounded");
+        for(int i = 0; i < funcCount; i++) {
+            Func_t* fn = &funcs[i];
+            if(strcmp(fn->sym->name, name) != 0) continue;
+            // Same static name in two files: keep the larger frame
+            if(!fn->fromSu || bytes > fn->frame) fn->frame = bytes;
+            fn->fromSu = true;
+            fn->dynamic |= dynamic;
+        }
+    }
+    fclose(f);
+}
+
+// DEPTH
+static int Depth(int index) {
+    Func_t* f = &funcs[index];
+    int callMax = 0, tailMax = 0, callNext = -1, tailNext = -1;
+    
+    if(f->state == 2) return f->depth;
+    if(f->state == 1) {
+        fprintf(stderr, "error: recursion through %s\n", f->sym->name);
+        recursion = true;
+        return 0;
+    }
+    f->state = 1;
+    for(int i = 0; i < f->edgeCount; i++) {
+        int d = Depth(f->edges[i].to);
+        if(f->edges[i].tail && d > tailMax) tailMax = d, tailNext = f->edges[i].to;
+        if(!f->edges[i].tail && d > callMax) callMax = d, callNext = f->edges[i].to;
+    }
+    if(f->indirect) {
+        for(int i = 0; i < funcCount; i++) {
+            if(!funcs[i].addressTaken || funcs[i].isr) continue;
+            int d = Depth(i);
+            if(d > callMax) callMax = d, callNext = i;
+        }
+    }
+    f->depth = f->frame + callMax;
+    f->next = callNext;
+    if(tailMax > f->depth) {
+        f->depth = tailMax;
+        f->next = tailNext;
+    }
+    f->state = 2;
+    return f->depth;
+}
+
+static void Print_Path(int index) {
+    int hops = 0;
+    
+    for(int i = index; i >= 0 && hops < 24; i = funcs[i].next, hops++)
+        printf("%s%s", hops ? " > " : "", funcs[i].sym->name);
+    printf("\n");
+}
+
+static void Print_Func(int i) {
+    const Func_t* f = &funcs[i];
+    
+    printf("%-32s %5d%s %6d  ", f->sym->name, f->frame, f->fromSu ? " " : "*", f->depth);
+    Print_Path(i);
+}
+
+static int Budget_From_File(const char* path) {
+    FILE* f = fopen(path, "r");
+    char line[256];
+    int bytes = 0;
+    
+    if(!f) {
+        perror(path);
+        exit(2);
+    }
+    while(fgets(line, sizeof(line), f))
+        if(sscanf(line, " stack %d", &bytes) == 1) break;
+    fclose(f);
+    return bytes;
+}
+
+static int Compare_Depth(const void* a, const void* b) {
+    return funcs[*(const int*)b].depth - funcs[*(const int*)a].depth;
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    const char* budgetPath = NULL;
+    const char* roots[MAX_ROOTS];
+    const char* extra[MAX_EXTRA];
+    const char* suFiles[256];
+    int rootCount = 0, extraCount = 0, suCount = 0, levels = 2, budget = 0;
+    bool verbose = false;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-B") == 0 && i + 1 < argc) budgetPath = argv[++i];
+        else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) budget = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) levels = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc && rootCount < MAX_ROOTS) roots[rootCount++] = argv[++i];
+        else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc && extraCount < MAX_EXTRA) extra[extraCount++] = argv[++i];
+        else if(strcmp(argv[i], "-v") == 0) verbose = true;
+        else if(argv[i][0] != '-' && !path) path = argv[i];
+        else if(argv[i][0] != '-' && suCount < 256) suFiles[suCount++] = argv[i];
+        else path = NULL, i = argc;
+    }
+    if(!path || levels < 0) {
+        fprintf(stderr, "usage: %s [-B budgets.txt] [-b bytes] [-n levels] [-r root] [-e caller:callee] [-v] "
+                "firmware.elf [*.su]\n", argv[0]);
+        return 2;
+    }
+    if(!Elf_Load(path, &elf)) return 2;
+    if(!rootCount) roots[rootCount++] = "main";
+    if(budgetPath && !budget) budget = Budget_From_File(budgetPath);
+    Load_Flash();
+    
+    // Functions in Flash, sorted by address like the symbol table
+    funcs = calloc(elf.symbolCount + 1, sizeof(Func_t));
+    for(int i = 0; i < elf.symbolCount; i++) {
+        const ElfSymbol_t* s = &elf.symbols[i];
+        uint32_t a = s->addr >= FLASH_ALIAS ? s->addr - FLASH_ALIAS : s->addr;
+        if(s->isFunc && s->size && a < FLASH_SIZE && (funcCount == 0 || funcs[funcCount-1].sym->addr != s->addr))
+            funcs[funcCount++].sym = s;
+    }
+    for(int i = 0; i < suCount; i++) Load_Su(suFiles[i]);
+    
+    const ElfSymbol_t* vb = Elf_Symbol(&elf, "_vector_base");
+    uint32_t vectorBase = vb ? vb->addr : 0;
+    int vectorCount = Find_Vectors(vectorBase);
+    for(int i = 0; i < funcCount; i++) Scan_Function(i);
+    Scan_Tables(vectorBase, vectorCount);
+    for(int i = 0; i < extraCount; i++) {
+        char from[64];
+        const char* colon = strchr(extra[i], ':');
+        int a = -1, b = -1;
+        if(colon && colon - extra[i] < (int)sizeof(from)) {
+            snprintf(from, sizeof(from), "%.*s", (int)(colon - extra[i]), extra[i]);
+            a = Func_Named(from);
+            b = Func_Named(colon + 1);
+        }
+        if(a < 0 || b < 0) {
+            fprintf(stderr, "-e %s: function not found\n", extra[i]);
+            return 2;
+        }
+        Add_Edge(&funcs[a], b, false);
+    }
+    
+    // Main context
+    int mainDepth = 0, mainRoot = -1;
+    for(int r = 0; r < rootCount; r++) {
+        int i = Func_Named(roots[r]);
+        if(i < 0) {
+            fprintf(stderr, "root %s not found\n", roots[r]);
+            return 2;
+        }
+        if(Depth(i) >= mainDepth) mainDepth = funcs[i].depth, mainRoot = i;
+    }
+    
+    // Handlers, deepest first
+    int* isr = malloc((funcCount + 1) * sizeof(int));
+    int isrCount = 0;
+    for(int i = 0; i < funcCount; i++)
+        if(funcs[i].isr) {
+            Depth(i);
+            isr[isrCount++] = i;
+        }
+    qsort(isr, isrCount, sizeof(int), Compare_Depth);
+    if(verbose)
+        for(int i = 0; i < funcCount; i++) Depth(i);
+    
+    printf("%-32s %6s %6s  %s\n", "function", "frame", "worst", "deepest path");
+    if(verbose) {
+        int* order = malloc((funcCount + 1) * sizeof(int));
+        for(int i = 0; i < funcCount; i++) order[i] = i;
+        qsort(order, funcCount, sizeof(int), Compare_Depth);
+        for(int i = 0; i < funcCount; i++) Print_Func(order[i]);
+        free(order);
+    } else {
+        Print_Func(mainRoot);
+        for(int i = 0; i < isrCount; i++) Print_Func(isr[i]);
+    }
+    printf("(* frame from sp adjustments: no .su entry)\n\n");
+    
+    bool ok = !recursion;
+    for(int i = 0; i < funcCount; i++) {
+        if(funcs[i].dynamic && funcs[i].state == 2) {
+            fprintf(stderr, "error: %s has a dynamic stack frame\n", funcs[i].sym->name);
+            ok = false;
+        }
+        if(funcs[i].indirect && funcs[i].state == 2)
+            printf("indirect calls in %s: bounded by every address-taken function\n", funcs[i].sym->name);
+    }
+    
+    int total = mainDepth;
+    printf("worst case: %s %d", funcs[mainRoot].sym->name, mainDepth);
+    for(int i = 0; i < isrCount && i < levels; i++) {
+        total += funcs[isr[i]].depth + HPE_FRAME_BYTES;
+        printf(" + %s %d + HPE %d", funcs[isr[i]].sym->name, funcs[isr[i]].depth, HPE_FRAME_BYTES);
+    }
+    printf(" = %d bytes\n", total);
+    
+    // Room between the end of .bss and the top of RAM, when the linker
+    // script names them (MounRiver: _ebss/_end and _eusrstack)
+    const ElfSymbol_t* top = Elf_Symbol(&elf, "_eusrstack");
+    const ElfSymbol_t* bss = Elf_Symbol(&elf, "_ebss");
+    if(!bss) bss = Elf_Symbol(&elf, "_end");
+    if(top && bss && top->addr > bss->addr) {
+        int room = (int)(top->addr - bss->addr);
+        printf("free RAM above .bss: %d bytes - %s\n", room, total <= room ? "fits" : "OVERFLOW");
+        ok = ok && total <= room;
+    }
+    if(budget) {
+        printf("budget: %d bytes - %s\n", budget, total <= budget ? "OK" : "OVER BUDGET");
+        ok = ok && total <= budget;
+    }
+    free(isr);
+    for(int i = 0; i < funcCount; i++) free(funcs[i].edges);
+    free(funcs);
+    Elf_Free(&elf);
+    return ok ? 0 : 1;
+}
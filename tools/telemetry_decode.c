@@ -0,0 +1,455 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - TELEMETRY DECODER (HOST)
+ * ============================================================================
+ * Reads the binary frame stream of telemetry.h from a serial device, a pty,
+ * a capture file or stdin; checks sync, CRC and sequence numbers, and writes
+ * the frames as CSV and/or a columnar binary file. The live summary shows
+ * voltage percentiles, the step histogram and R5 trip events.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -o telemetry_decode telemetry_decode.c ../crc16.c
+ *
+ * Usage:
+ *   ./telemetry_decode [options] <device|file|->
+ *     -c FILE   write CSV ("-" = stdout; default when no other output given)
+ *     -C FILE   write columnar binary (format below)
+ *     -s        live summary on stderr, refreshed once per second
+ *     -b BAUD   line rate when the input is a tty (default 115200)
+ *   ./telemetry_decode --selftest
+ *                       decode a synthetic stream with dropped, corrupted and
+ *                       resynchronised frames, then measure throughput
+ *
+ * Columnar binary: a sequence of blocks, each
+ *   "TLM1", uint32 count, then count values of every column in this order:
+ *   tick u32, seq u16, adc u16, opv u16, ipv u16, relayOps u16,
+ *   flags u8, step u8, pending u8, r5State u8, state u8
+ * All values little-endian, voltages in 0.1 V.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/select.h>
+
+#include "telemetry.h"
+#include "crc16.h"
+
+#define READ_CHUNK          4096
+#define COLUMN_BLOCK        4096        // Frames per columnar block
+#define VOLT_BINS           6001        // 0.0 .. 600.0 V in 0.1 V
+#define EVENT_LOG           8
+
+// Values of R5State_t (stabilizer.h)
+static const char* const r5Names[] = {
+    "NORMAL", "HICUT_DETECTING", "HICUT_ACTIVE", "HICUT_RESUMING",
+    "LOCUT_DETECTING", "LOCUT_ACTIVE", "LOCUT_RESUMING", "DELAY_ACTIVE"
+};
+#define R5_NORMAL           0
+#define R5_HICUT_ACTIVE     2
+#define R5_HICUT_RESUMING   3
+#define R5_LOCUT_ACTIVE     5
+#define R5_LOCUT_RESUMING   6
+
+typedef struct {
+    uint32_t tick;
+    uint16_t seq, adc, opv, ipv, relayOps;
+    uint8_t flags, step, pending, r5State, state;
+} Frame_t;
+
+typedef struct {
+    // Stream reassembly
+    uint8_t buf[READ_CHUNK + TELEMETRY_FRAME_SIZE];
+    size_t len;
+    // Integrity
+    uint64_t frames, crcErrors, junkBytes, gaps, missing, resets;
+    bool haveLast;
+    Frame_t last;
+    // Summary
+    uint32_t opvHist[VOLT_BINS], ipvHist[VOLT_BINS];
+    uint64_t stepHist[8];
+    uint64_t hicutTrips, locutTrips;
+    char events[EVENT_LOG][96];
+    int eventCount;
+} Decoder_t;
+
+typedef struct {
+    FILE* csv;
+    FILE* col;
+    Frame_t block[COLUMN_BLOCK];
+    int blockLen;
+} Output_t;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void On_Signal(int sig) { (void)sig; stopRequested = 1; }
+
+static uint16_t Get16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t Get32(const uint8_t* p) { return Get16(p) | ((uint32_t)Get16(p + 2) << 16); }
+
+static void Put16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void Put32(uint8_t* p, uint32_t v) { Put16(p, (uint16_t)v); Put16(p + 2, (uint16_t)(v >> 16)); }
+
+static void Frame_Unpack(const uint8_t* p, Frame_t* f) {
+    f->flags = p[3];
+    f->seq = Get16(p + 4);
+    f->adc = Get16(p + 6);
+    f->tick = Get32(p + 8);
+    f->opv = Get16(p + 12);
+    f->ipv = Get16(p + 14);
+    f->step = p[16];
+    f->pending = p[17];
+    f->r5State = p[18];
+    f->state = p[19];
+    f->relayOps = Get16(p + 20);
+}
+
+static void Frame_Pack(const Frame_t* f, uint8_t* p) {
+    p[0] = TELEMETRY_SYNC0;
+    p[1] = TELEMETRY_SYNC1;
+    p[2] = TELEMETRY_TYPE_STATUS;
+    p[3] = f->flags;
+    Put16(p + 4, f->seq);
+    Put16(p + 6, f->adc);
+    Put32(p + 8, f->tick);
+    Put16(p + 12, f->opv);
+    Put16(p + 14, f->ipv);
+    p[16] = f->step;
+    p[17] = f->pending;
+    p[18] = f->r5State;
+    p[19] = f->state;
+    Put16(p + 20, f->relayOps);
+    Put16(p + TELEMETRY_CRC_OFFSET, CRC16_Calculate(p, TELEMETRY_CRC_OFFSET));
+}
+
+static const char* R5_Name(uint8_t s) { return s < 8 ? r5Names[s] : "?"; }
+
+static void Event_Log(Decoder_t* d, const Frame_t* f, const char* what) {
+    char* e = d->events[d->eventCount % EVENT_LOG];
+    snprintf(e, sizeof(d->events[0]), "%10.3f s  %-14s IPV %5u.%u V  OPV %5u.%u V  step %u",
+             f->tick / 1000.0, what, f->ipv / 10, f->ipv % 10, f->opv / 10, f->opv % 10, f->step);
+    d->eventCount++;
+}
+
+// OUTPUT
+static void Column_Flush(Output_t* o) {
+    uint8_t hdr[8] = {'T', 'L', 'M', '1'};
+    int n = o->blockLen;
+
+    if(!o->col || n == 0) return;
+    Put32(hdr + 4, (uint32_t)n);
+    fwrite(hdr, 1, sizeof(hdr), o->col);
+
+#define COLUMN(field, size) \
+    for(int i = 0; i < n; i++) { uint8_t b[4]; \
+        if(size == 4) Put32(b, o->block[i].field); \
+        else if(size == 2) Put16(b, (uint16_t)o->block[i].field); \
+        else b[0] = (uint8_t)o->block[i].field; \
+        fwrite(b, 1, size, o->col); }
+    COLUMN(tick, 4) COLUMN(seq, 2) COLUMN(adc, 2) COLUMN(opv, 2) COLUMN(ipv, 2)
+    COLUMN(relayOps, 2) COLUMN(flags, 1) COLUMN(step, 1) COLUMN(pending, 1)
+    COLUMN(r5State, 1) COLUMN(state, 1)
+#undef COLUMN
+
+    o->blockLen = 0;
+}
+
+static void Output_Frame(Output_t* o, const Frame_t* f) {
+    if(o->csv) {
+        fprintf(o->csv, "%u,%u,%u,%u.%u,%u.%u,%u,%u,%u,%u,0x%02X,%u\n",
+                f->tick, f->seq, f->adc, f->opv / 10, f->opv % 10, f->ipv / 10, f->ipv % 10,
+                f->step, f->pending, f->r5State, f->state, f->flags, f->relayOps);
+    }
+    if(o->col) {
+        o->block[o->blockLen++] = *f;
+        if(o->blockLen == COLUMN_BLOCK) Column_Flush(o);
+    }
+}
+
+// DECODING
+static void Decoder_Accept(Decoder_t* d, const Frame_t* f) {
+    if(d->haveLast) {
+        uint16_t expected = (uint16_t)(d->last.seq + 1);
+        if(f->tick < d->last.tick) {
+            d->resets++;                            // Device restarted
+            Event_Log(d, f, "RESET");
+        } else if(f->seq != expected) {
+            d->gaps++;
+            d->missing += (uint16_t)(f->seq - expected);
+        }
+        if(f->r5State != d->last.r5State) {
+            if(f->r5State == R5_HICUT_ACTIVE) { d->hicutTrips++; Event_Log(d, f, "HICUT trip"); }
+            else if(f->r5State == R5_LOCUT_ACTIVE) { d->locutTrips++; Event_Log(d, f, "LOCUT trip"); }
+            else if(f->r5State == R5_NORMAL && (d->last.r5State == R5_HICUT_RESUMING ||
+                    d->last.r5State == R5_LOCUT_RESUMING)) Event_Log(d, f, "R5 restored");
+        }
+    }
+
+    d->opvHist[f->opv < VOLT_BINS ? f->opv : VOLT_BINS - 1]++;
+    d->ipvHist[f->ipv < VOLT_BINS ? f->ipv : VOLT_BINS - 1]++;
+    d->stepHist[f->step & 7]++;
+    d->frames++;
+    d->last = *f;
+    d->haveLast = true;
+}
+
+// Feeds raw bytes; every valid frame goes to the output
+static void Decoder_Feed(Decoder_t* d, Output_t* o, const uint8_t* data, size_t len) {
+    while(len > 0) {
+        size_t n = sizeof(d->buf) - d->len;
+        if(n > len) n = len;
+        memcpy(d->buf + d->len, data, n);
+        d->len += n;
+        data += n;
+        len -= n;
+
+        size_t i = 0;
+        while(d->len - i >= TELEMETRY_FRAME_SIZE) {
+            const uint8_t* p = d->buf + i;
+            if(p[0] != TELEMETRY_SYNC0 || p[1] != TELEMETRY_SYNC1 || p[2] != TELEMETRY_TYPE_STATUS) {
+                i++;
+                d->junkBytes++;
+                continue;
+            }
+            if(CRC16_Calculate(p, TELEMETRY_CRC_OFFSET) != Get16(p + TELEMETRY_CRC_OFFSET)) {
+                d->crcErrors++;
+                i++;                                // Resync inside the bad frame
+                continue;
+            }
+            Frame_t f;
+            Frame_Unpack(p, &f);
+            Decoder_Accept(d, &f);
+            Output_Frame(o, &f);
+            i += TELEMETRY_FRAME_SIZE;
+        }
+        memmove(d->buf, d->buf + i, d->len - i);
+        d->len -= i;
+    }
+}
+
+// SUMMARY
+static double Percentile(const uint32_t* hist, uint64_t total, double p) {
+    uint64_t target = (uint64_t)(p * (total - 1));
+    uint64_t acc = 0;
+    for(int v = 0; v < VOLT_BINS; v++) {
+        acc += hist[v];
+        if(acc > target) return v / 10.0;
+    }
+    return 0;
+}
+
+static void Summary_Print(const Decoder_t* d, FILE* out, double seconds) {
+    fprintf(out, "frames %llu (%.0f/s)  crc errors %llu  junk bytes %llu  gaps %llu (%llu frames)  resets %llu\n",
+            (unsigned long long)d->frames, seconds > 0 ? d->frames / seconds : 0.0,
+            (unsigned long long)d->crcErrors, (unsigned long long)d->junkBytes,
+            (unsigned long long)d->gaps, (unsigned long long)d->missing, (unsigned long long)d->resets);
+    if(d->frames == 0) return;
+
+    fprintf(out, "        p1      p5      p50     p95     p99\n");
+    const uint32_t* h[2] = {d->ipvHist, d->opvHist};
+    for(int k = 0; k < 2; k++) {
+        fprintf(out, "%s", k ? "OPV" : "IPV");
+        static const double ps[] = {0.01, 0.05, 0.50, 0.95, 0.99};
+        for(int j = 0; j < 5; j++) fprintf(out, "  %6.1f", Percentile(h[k], d->frames, ps[j]));
+        fprintf(out, " V\n");
+    }
+
+    fprintf(out, "step histogram:\n");
+    for(int s = 0; s < 8; s++) {
+        int bar = (int)(50 * d->stepHist[s] / d->frames);
+        fprintf(out, "  %u %5.1f%% %.*s\n", s, 100.0 * d->stepHist[s] / d->frames, bar,
+                "##################################################");
+    }
+
+    fprintf(out, "last %s  R5 %s  trips HICUT %llu LOCUT %llu\n",
+            d->last.flags & TELEMETRY_FLAG_R5_CLOSED ? "closed" : "open", R5_Name(d->last.r5State),
+            (unsigned long long)d->hicutTrips, (unsigned long long)d->locutTrips);
+    int first = d->eventCount > EVENT_LOG ? d->eventCount - EVENT_LOG : 0;
+    for(int e = first; e < d->eventCount; e++) fprintf(out, "  %s\n", d->events[e % EVENT_LOG]);
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// INPUT
+static speed_t Baud_Code(long baud) {
+    switch(baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return 0;
+    }
+}
+
+static int Open_Input(const char* path, long baud) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY);
+    struct termios t;
+
+    if(fd < 0) { perror(path); return -1; }
+    if(isatty(fd) && tcgetattr(fd, &t) == 0) {
+        speed_t code = Baud_Code(baud);
+        if(!code) { fprintf(stderr, "unsupported baud rate %ld\n", baud); return -1; }
+        cfmakeraw(&t);
+        cfsetispeed(&t, code);
+        cfsetospeed(&t, code);
+        t.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd, TCSANOW, &t);
+    }
+    return fd;
+}
+
+static int Run(int fd, Output_t* o, bool live) {
+    static Decoder_t d;
+    uint8_t chunk[READ_CHUNK];
+    double start = Now(), nextSummary = start + 1.0;
+
+    while(!stopRequested) {
+        fd_set rd;
+        struct timeval tv = {0, 200000};
+        FD_ZERO(&rd);
+        FD_SET(fd, &rd);
+        int r = select(fd + 1, &rd, NULL, NULL, &tv);
+        if(r < 0) break;
+        if(r > 0) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if(n <= 0) break;                       // EOF, or pty closed (EIO)
+            Decoder_Feed(&d, o, chunk, (size_t)n);
+        }
+        if(live && Now() >= nextSummary) {
+            if(isatty(STDERR_FILENO)) fprintf(stderr, "\033[H\033[J");
+            Summary_Print(&d, stderr, Now() - start);
+            nextSummary += 1.0;
+        }
+    }
+
+    Column_Flush(o);
+    Summary_Print(&d, stderr, Now() - start);
+    return 0;
+}
+
+// SELF TEST
+// Builds a stream with known defects and checks that every counter sees them
+static int Self_Test(void) {
+    static Decoder_t d;
+    static Output_t o;
+    static uint8_t stream[1000 * (TELEMETRY_FRAME_SIZE + 8)];
+    size_t len = 0;
+    int failures = 0;
+    Frame_t f = {0};
+
+    srand(1);
+    for(int i = 0; i < 1000; i++) {
+        f.seq = (uint16_t)(65000 + i);             // Crosses the 16-bit wrap
+        f.tick = 100 * (uint32_t)i;
+        f.ipv = (uint16_t)(2000 + (i % 500));
+        f.opv = 2300;
+        f.step = (uint8_t)(i % 8);
+        f.r5State = (i >= 500 && i < 600) ? R5_HICUT_ACTIVE : (i >= 700 && i < 750) ? R5_LOCUT_ACTIVE : R5_NORMAL;
+        f.flags = f.r5State == R5_NORMAL ? TELEMETRY_FLAG_R5_CLOSED : 0;
+        if(i >= 100 && i < 105) continue;           // 5 frames lost on the wire
+        if(i == 300) {                              // Line noise before a frame
+            static const uint8_t junk[] = {0x00, 0xA5, 0x13, 0xA5, 0x5A, 0x7F, 0xFF};
+            memcpy(stream + len, junk, sizeof(junk));
+            len += sizeof(junk);
+        }
+        Frame_Pack(&f, stream + len);
+        if(i == 200) stream[len + 10] ^= 0x40;     // Bit error
+        len += TELEMETRY_FRAME_SIZE;
+    }
+
+    // Feed in random slices to exercise reassembly
+    for(size_t pos = 0; pos < len; ) {
+        size_t n = 1 + rand() % 61;
+        if(n > len - pos) n = len - pos;
+        Decoder_Feed(&d, &o, stream + pos, n);
+        pos += n;
+    }
+
+#define CHECK(name, cond) do { bool ok = (cond); printf("%-28s %s\n", name, ok ? "ok" : "FAIL"); failures += !ok; } while(0)
+    CHECK("valid frames", d.frames == 994);
+    CHECK("crc errors", d.crcErrors == 1);
+    CHECK("sequence gaps", d.gaps == 2 && d.missing == 6);
+    CHECK("no false resets", d.resets == 0);
+    CHECK("junk skipped", d.junkBytes >= 7);
+    CHECK("trip events", d.hicutTrips == 1 && d.locutTrips == 1);
+    CHECK("step histogram", d.stepHist[0] + d.stepHist[7] > 0 && d.stepHist[3] >= 124);
+    CHECK("IPV median", Percentile(d.ipvHist, d.frames, 0.5) >= 224.0 && Percentile(d.ipvHist, d.frames, 0.5) <= 226.0);
+    CHECK("OPV constant", Percentile(d.opvHist, d.frames, 0.01) == 230.0 && Percentile(d.opvHist, d.frames, 0.99) == 230.0);
+#undef CHECK
+
+    // Throughput: decode 1M frames to CSV on /dev/null (115200 baud is 480 frames/s)
+    memset(&d, 0, sizeof(d));
+    o.csv = fopen("/dev/null", "w");
+    double t0 = Now();
+    for(int rep = 0; rep < 1000; rep++) Decoder_Feed(&d, &o, stream, len);
+    double dt = Now() - t0;
+    fclose(o.csv);
+    printf("throughput: %.0f frames/s (%.0fx line rate at 115200 baud)\n",
+           d.frames / dt, d.frames / dt / (115200.0 / 10 / TELEMETRY_FRAME_SIZE));
+
+    printf("%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    static Output_t out;
+    const char* csvPath = NULL;
+    const char* colPath = NULL;
+    const char* input = NULL;
+    bool live = false;
+    long baud = 115200;
+
+    if(argc > 1 && strcmp(argv[1], "--selftest") == 0) return Self_Test();
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) csvPath = argv[++i];
+        else if(strcmp(argv[i], "-C") == 0 && i + 1 < argc) colPath = argv[++i];
+        else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) baud = strtol(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-s") == 0) live = true;
+        else if(!input && (argv[i][0] != '-' || argv[i][1] == 0)) input = argv[i];
+        else input = NULL, i = argc;
+    }
+    if(!input) {
+        fprintf(stderr, "usage: %s [-c csv] [-C columnar] [-s] [-b baud] <device|file|->\n"
+                        "       %s --selftest\n", argv[0], argv[0]);
+        return 2;
+    }
+    if(!csvPath && !colPath && !live) csvPath = "-";
+
+    if(csvPath) {
+        out.csv = strcmp(csvPath, "-") == 0 ? stdout : fopen(csvPath, "w");
+        if(!out.csv) { perror(csvPath); return 1; }
+        setvbuf(out.csv, NULL, _IOFBF, 1 << 16);
+        fprintf(out.csv, "tick_ms,seq,adc,opv_v,ipv_v,step,pending,r5_state,state,flags,relay_ops\n");
+    }
+    if(colPath) {
+        out.col = fopen(colPath, "wb");
+        if(!out.col) { perror(colPath); return 1; }
+    }
+
+    int fd = Open_Input(input, baud);
+    if(fd < 0) return 1;
+    signal(SIGINT, On_Signal);
+    signal(SIGTERM, On_Signal);
+
+    int rc = Run(fd, &out, live);
+    if(out.csv) fflush(out.csv);
+    if(out.col) fclose(out.col);
+    return rc;
+}
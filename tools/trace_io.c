@@ -0,0 +1,231 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - ADC TRACE FILES AND DECISION LOG (HOST)
+ * ============================================================================
+ * See trace_io.h. The writer closes frames under the same rules as trace.c
+ * (full, gap above TRACE_GAP_MAX_US, end of pass) and never drops one.
+ * ============================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "crc16.h"
+#include "trace_io.h"
+
+const char* const r5StateNames[8] = {
+    "NORMAL", "HICUT_DETECTING", "HICUT_ACTIVE", "HICUT_RESUMING",
+    "LOCUT_DETECTING", "LOCUT_ACTIVE", "LOCUT_RESUMING", "DELAY_ACTIVE"
+};
+const char* const systemStateNames[4] = { "NORMAL", "SETTING", "FAULT", "BOOT" };
+
+#define TRACE_CONFIG_V1_SIZE    72          // Config frame before the calibration points
+
+// LOADER
+static bool Trace_Crc_Ok(const uint8_t* buf, uint32_t size) {
+    return CRC16_Calculate(buf, size - 2) == (buf[size-2] | buf[size-1] << 8);
+}
+
+static bool Trace_Grow(void** buf, uint32_t count, uint32_t* cap, size_t size) {
+    if(count < *cap) return true;
+    *cap = *cap ? *cap * 2 : 4096;
+    void* p = realloc(*buf, *cap * size);
+    if(!p) return false;
+    *buf = p;
+    return true;
+}
+
+bool Trace_File_Load(const char* path, TraceData_t* d) {
+    FILE* f = fopen(path, "rb");
+    uint8_t buf[TRACE_CONFIG_FRAME_SIZE];
+    uint32_t sampleCap = 0, configCap = 0, have = 0;
+    uint64_t lastUs = 0;
+    uint16_t nextSeq = 0;
+    bool first = true;
+    
+    memset(d, 0, sizeof(*d));
+    if(!f) { perror(path); return false; }
+    
+    // The buffer holds the largest frame, so a short frame means end of file
+    for(;;) {
+        have += (uint32_t)fread(buf + have, 1, sizeof(buf) - have, f);
+        if(have < 3) { d->skippedBytes += have; break; }
+        
+        uint32_t size = buf[2] == TRACE_TYPE_SAMPLES ? TRACE_SAMPLES_FRAME_SIZE :
+                        buf[2] == TRACE_TYPE_CONFIG ? TRACE_CONFIG_FRAME_SIZE : 0;
+        bool framed = buf[0] == TRACE_SYNC0 && buf[1] == TRACE_SYNC1 && size;
+        if(framed && buf[2] == TRACE_TYPE_CONFIG && have >= TRACE_CONFIG_V1_SIZE &&
+           Trace_Crc_Ok(buf, TRACE_CONFIG_V1_SIZE) && !(have >= size && Trace_Crc_Ok(buf, size)))
+            size = TRACE_CONFIG_V1_SIZE;
+        if(framed && have < size) { d->skippedBytes += have; break; }
+        if(framed && !Trace_Crc_Ok(buf, size)) {
+            d->crcErrors++;
+            framed = false;
+        }
+        if(!framed) {
+            memmove(buf, buf + 1, --have);
+            d->skippedBytes++;
+            continue;
+        }
+        
+        uint16_t seq = buf[4] | buf[5] << 8;
+        if(!first) d->lostFrames += (uint16_t)(seq - nextSeq);
+        nextSeq = seq + 1;
+        d->frames++;
+        
+        if(buf[2] == TRACE_TYPE_SAMPLES) {
+            TraceSamplesFrame_t s;
+            memcpy(&s, buf, sizeof(s));
+            uint64_t t = first ? s.timeUs : lastUs + (uint32_t)(s.timeUs - (uint32_t)lastUs);
+            for(int i = 0; i < s.count && i < TRACE_SAMPLES_MAX; i++) {
+                if(!Trace_Grow((void**)&d->samples, d->sampleCount, &sampleCap, sizeof(TraceSample_t))) break;
+                t += (uint64_t)(s.samples[i] >> 10) * TRACE_GAP_UNIT_US;
+                d->samples[d->sampleCount++] = (TraceSample_t){ t, s.samples[i] & 0x3FF, s.pins };
+            }
+            lastUs = t;
+            first = false;
+        } else {
+            TraceConfigFrame_t c;
+            memset(&c, 0, sizeof(c));
+            memcpy(&c, buf, size == TRACE_CONFIG_V1_SIZE ? size - 2 : sizeof(c));
+            uint32_t us = c.tick * 1000u;
+            uint64_t t = first ? us : lastUs + (int32_t)(us - (uint32_t)lastUs);
+            if(Trace_Grow((void**)&d->configs, d->configCount, &configCap, sizeof(TraceConfig_t)))
+                d->configs[d->configCount++] = (TraceConfig_t){ t, c };
+            lastUs = t;
+            first = false;
+        }
+        memmove(buf, buf + size, have - size);
+        have -= size;
+    }
+    fclose(f);
+    return true;
+}
+
+void Trace_File_Free(TraceData_t* d) {
+    free(d->samples);
+    free(d->configs);
+    memset(d, 0, sizeof(*d));
+}
+
+// WRITER
+static FILE* writerFile = NULL;
+static TraceSamplesFrame_t writerFrame;
+static uint16_t writerSeq = 0;
+static uint32_t writerLastUs = 0;
+
+bool Trace_Writer_Open(const char* path) {
+    writerFile = fopen(path, "wb");
+    if(!writerFile) { perror(path); return false; }
+    writerFrame.count = 0;
+    writerSeq = 0;
+    return true;
+}
+
+void Trace_Writer_End_Pass(void) {
+    TraceSamplesFrame_t* f = &writerFrame;
+    if(!writerFile || f->count == 0) return;
+    for(int i = f->count; i < TRACE_SAMPLES_MAX; i++) f->samples[i] = 0;
+    f->crc = CRC16_Calculate((const uint8_t*)f, TRACE_SAMPLES_CRC_OFFSET);
+    fwrite(f, TRACE_SAMPLES_FRAME_SIZE, 1, writerFile);
+    f->count = 0;
+}
+
+void Trace_Writer_Sample(uint32_t timeUs, uint16_t adc, uint8_t pins) {
+    TraceSamplesFrame_t* f = &writerFrame;
+    uint32_t gap = timeUs - writerLastUs;
+    
+    if(!writerFile) return;
+    if(f->count > 0 && (f->count == TRACE_SAMPLES_MAX || gap > TRACE_GAP_MAX_US)) Trace_Writer_End_Pass();
+    
+    if(f->count == 0) {
+        f->sync[0] = TRACE_SYNC0;
+        f->sync[1] = TRACE_SYNC1;
+        f->type = TRACE_TYPE_SAMPLES;
+        f->pins = pins;
+        f->seq = writerSeq++;
+        f->reserved = 0;
+        f->timeUs = timeUs;
+        f->samples[0] = adc & 0x3FF;
+        writerLastUs = timeUs;
+    } else {
+        uint32_t units = (gap + TRACE_GAP_UNIT_US/2) / TRACE_GAP_UNIT_US;
+        f->samples[f->count] = (adc & 0x3FF) | (uint16_t)(units << 10);
+        writerLastUs += units * TRACE_GAP_UNIT_US;
+    }
+    f->count++;
+}
+
+void Trace_Writer_Config(uint8_t pins) {
+    TraceConfigFrame_t c;
+    
+    if(!writerFile) return;
+    memset(&c, 0, sizeof(c));
+    c.sync[0] = TRACE_SYNC0;
+    c.sync[1] = TRACE_SYNC1;
+    c.type = TRACE_TYPE_CONFIG;
+    c.pins = pins;
+    c.seq = writerSeq++;
+    c.adcCapturedA = adcCapturedA;
+    c.tick = HAL_GetTick();
+    c.delayTimeMs = delayTimeMs;
+    c.step = currentStep;
+    c.r5State = (uint8_t)r5State;
+    c.state = (uint8_t)currentState;
+    c.paramCount = PARAM_COUNT;
+    for(int i = 0; i < PARAM_COUNT && i < TRACE_PARAMS_MAX; i++) c.params[i] = Params_Get((ParamId_t)i);
+    for(int i = 0; i < calPointCount && i < TRACE_CAL_MAX; i++) {
+        c.cal[i][0] = calPoints[i].adc;
+        c.cal[i][1] = calPoints[i].decivolts;
+    }
+    c.crc = CRC16_Calculate((const uint8_t*)&c, TRACE_CONFIG_CRC_OFFSET);
+    fwrite(&c, TRACE_CONFIG_FRAME_SIZE, 1, writerFile);
+}
+
+void Trace_Writer_Close(void) {
+    if(!writerFile) return;
+    Trace_Writer_End_Pass();
+    fclose(writerFile);
+    writerFile = NULL;
+}
+
+// DECISION LOG
+static FILE* decisionsOut = NULL;
+static void (*decisionsChained)(HalOutput_t out, bool on, uint64_t timeUs) = NULL;
+static uint8_t lastStep;
+static R5State_t lastR5;
+static SystemState_t lastState;
+
+static void Decisions_Output(HalOutput_t out, bool on, uint64_t timeUs) {
+    if(out <= HAL_OUT_R5)
+        fprintf(decisionsOut, "%u out %s %s\n", (uint32_t)(timeUs / 1000), Mock_Output_Name(out), on ? "on" : "off");
+    if(decisionsChained) decisionsChained(out, on, timeUs);
+}
+
+void Decisions_Begin(FILE* out) {
+    decisionsOut = out;
+    lastStep = currentStep;
+    lastR5 = r5State;
+    lastState = currentState;
+    if(mockOutputHook != Decisions_Output) decisionsChained = mockOutputHook;
+    mockOutputHook = Decisions_Output;
+}
+
+void Decisions_Poll(void) {
+    uint32_t now = HAL_GetTick();
+    
+    if(currentStep != lastStep) {
+        fprintf(decisionsOut, "%u step %u\n", now, currentStep);
+        lastStep = currentStep;
+    }
+    if(r5State != lastR5) {
+        fprintf(decisionsOut, "%u r5 %s\n", now, r5StateNames[r5State]);
+        lastR5 = r5State;
+    }
+    if(currentState != lastState) {
+        fprintf(decisionsOut, "%u state %s\n", now, systemStateNames[currentState]);
+        lastState = currentState;
+    }
+}
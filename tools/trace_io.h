@@ -0,0 +1,64 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - ADC TRACE FILES AND DECISION LOG (HOST)
+ * ============================================================================
+ * A trace file is the raw trace.h byte stream, exactly as captured from
+ * USART1 (e.g. cat /dev/ttyUSB0 > incident.bin). The writer produces the
+ * same stream from host simulations; the loader checks sync and CRC,
+ * unwraps timestamps and flattens it into samples and config snapshots.
+ *
+ * The decision log is the control core's observable behaviour, one line per
+ * event, stamped with HAL_GetTick():
+ *   <ms> out R1..R5 on|off      relay commands
+ *   <ms> step N                 currentStep changed
+ *   <ms> r5 <R5State_t>         R5 protection state changed
+ *   <ms> state <SystemState_t>  system state changed
+ * Two runs behaved the same iff their logs are identical.
+ * ============================================================================
+ */
+
+#ifndef __TRACE_IO_H
+#define __TRACE_IO_H
+
+#include <stdio.h>
+
+#include "trace.h"
+#include "hal_mock.h"
+
+typedef struct {
+    uint64_t timeUs;
+    uint16_t adc;
+    uint8_t pins;               // TRACE_PIN_* of the frame
+} TraceSample_t;
+
+typedef struct {
+    uint64_t timeUs;
+    TraceConfigFrame_t frame;
+} TraceConfig_t;
+
+typedef struct {
+    TraceSample_t* samples;
+    uint32_t sampleCount;
+    TraceConfig_t* configs;
+    uint32_t configCount;
+    uint32_t frames, crcErrors, lostFrames, skippedBytes;
+} TraceData_t;
+
+// FILES
+bool Trace_File_Load(const char* path, TraceData_t* data);
+void Trace_File_Free(TraceData_t* data);
+
+bool Trace_Writer_Open(const char* path);
+void Trace_Writer_Sample(uint32_t timeUs, uint16_t adc, uint8_t pins);
+void Trace_Writer_End_Pass(void);       // As Trace_Service(): close the frame
+void Trace_Writer_Config(uint8_t pins); // Snapshot of the core's globals
+void Trace_Writer_Close(void);
+
+// DECISION LOG
+void Decisions_Begin(FILE* out);        // Chains into mockOutputHook
+void Decisions_Poll(void);              // After every Stabilizer_Run()
+
+extern const char* const r5StateNames[8];
+extern const char* const systemStateNames[4];
+
+#endif /* __TRACE_IO_H */
@@ -0,0 +1,218 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - ADC TRACE REPLAY (HOST)
+ * ============================================================================
+ * Feeds a recorded ADC trace (trace.h, from the firmware's SERIAL_TRACE mode
+ * or plant_sim -R) through the unmodified control core on the mock HAL and
+ * writes the decision log (trace_io.h). Compared against a golden log, a
+ * captured incident becomes a regression test.
+ *
+ * Calibration and parameters come from the first config frame. A trace that
+ * starts within TRACE_COLD_START_US of reset replays from power-on through
+ * Stabilizer_Init(); a later one starts warm at the first config frame with
+ * its step and R5/system state (timers restart there).
+ *
+ * Conversions are served in recorded order. The virtual clock follows the
+ * trace: it jumps forward to a sample more than one gap unit ahead, and
+ * samples more than TRACE_LATE_US behind it are skipped, so the replay stays
+ * in step with the recording even if the code reads more or fewer samples.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -DSERIAL_PROTOCOL=0 -o trace_replay trace_replay.c \
+ *       trace_io.c hal_mock.c ../stabilizer.c ../params.c ../filter.c ../crc16.c
+ *
+ * Usage:
+ *   ./trace_replay [-o decisions.txt] [-g golden.txt] [-q] trace.bin
+ *     -o FILE   write the decision log (default stdout unless -g is given)
+ *     -g FILE   compare with a golden log; exit status 1 on the first
+ *               difference, which is printed
+ *     -q        no trace summary on stderr
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "trace_io.h"
+
+#define TRACE_COLD_START_US     2000000
+#define TRACE_LATE_US           1000
+
+// Not in stabilizer.h: the R5 phase timer, restarted for a warm start
+extern volatile uint32_t r5Timer;
+
+static TraceData_t trace;
+static uint32_t cursor = 0;
+static uint32_t skippedSamples = 0;
+static uint8_t currentPins = 0;
+static bool exhausted = false;
+
+static uint16_t Replay_Adc(uint64_t timeUs) {
+    while(cursor < trace.sampleCount && trace.samples[cursor].timeUs + TRACE_LATE_US < timeUs) {
+        cursor++;
+        skippedSamples++;
+    }
+    if(cursor >= trace.sampleCount) {
+        exhausted = true;
+        return trace.sampleCount ? trace.samples[trace.sampleCount-1].adc : 0;
+    }
+    
+    const TraceSample_t* s = &trace.samples[cursor++];
+    if(s->timeUs > timeUs + TRACE_GAP_UNIT_US) mockTimeUs = s->timeUs;
+    currentPins = s->pins;
+    return s->adc;
+}
+
+static bool Replay_Input(HalInput_t in, uint64_t timeUs) {
+    (void)timeUs;
+    return (currentPins >> in) & 1;
+}
+
+// Parameters one by one can pass through an invalid order; retry until
+// every value has been accepted
+static bool Apply_Params(const TraceConfigFrame_t* c) {
+    int n = c->paramCount < PARAM_COUNT ? c->paramCount : PARAM_COUNT;
+    
+    if(c->paramCount != PARAM_COUNT)
+        fprintf(stderr, "trace has %u parameters, this build %d\n", c->paramCount, PARAM_COUNT);
+    for(int pass = 0; pass < 3; pass++)
+        for(int i = 0; i < n; i++) Params_Set((ParamId_t)i, c->params[i]);
+    for(int i = 0; i < n; i++)
+        if(Params_Get((ParamId_t)i) != c->params[i]) return false;
+    return true;
+}
+
+static int Compare(const char* logPath, const char* goldenPath) {
+    FILE* a = fopen(logPath, "r");
+    FILE* b = fopen(goldenPath, "r");
+    char la[128], lb[128];
+    int line = 0;
+    
+    if(!a || !b) {
+        perror(a ? goldenPath : logPath);
+        if(a) fclose(a);
+        if(b) fclose(b);
+        return 2;
+    }
+    for(;;) {
+        char* ra = fgets(la, sizeof(la), a);
+        char* rb = fgets(lb, sizeof(lb), b);
+        line++;
+        if(!ra && !rb) break;
+        if(!ra || !rb || strcmp(la, lb) != 0) {
+            printf("decision log differs at line %d\n  replay: %s  golden: %s", line,
+                   ra ? la : "(end)\n", rb ? lb : "(end)\n");
+            fclose(a);
+            fclose(b);
+            return 1;
+        }
+    }
+    fclose(a);
+    fclose(b);
+    printf("decision log matches %s (%d lines)\n", goldenPath, line - 1);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* input = NULL;
+    const char* outPath = NULL;
+    const char* goldenPath = NULL;
+    bool quiet = false;
+    char tmpPath[] = "/tmp/trace_replay_XXXXXX";
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if(strcmp(argv[i], "-g") == 0 && i + 1 < argc) goldenPath = argv[++i];
+        else if(strcmp(argv[i], "-q") == 0) quiet = true;
+        else if(!input && argv[i][0] != '-') input = argv[i];
+        else input = NULL, i = argc;
+    }
+    if(!input) {
+        fprintf(stderr, "usage: %s [-o decisions.txt] [-g golden.txt] [-q] trace.bin\n", argv[0]);
+        return 2;
+    }
+    if(!Trace_File_Load(input, &trace)) return 2;
+    if(trace.configCount == 0 || trace.sampleCount == 0) {
+        fprintf(stderr, "%s: no config frame or no samples\n", input);
+        return 2;
+    }
+    
+    FILE* out = stdout;
+    if(goldenPath && !outPath) {
+        int fd = mkstemp(tmpPath);
+        if(fd >= 0) out = fdopen(fd, "w");
+        outPath = tmpPath;
+    } else if(outPath) {
+        out = fopen(outPath, "w");
+    }
+    if(!out) { perror(outPath); return 2; }
+    
+    const TraceConfigFrame_t* cfg = &trace.configs[0].frame;
+    bool cold = trace.samples[0].timeUs < TRACE_COLD_START_US;
+    
+    // The unit's calibration and parameters, stored as it had them in Flash
+    Mock_Reset();
+    HAL_Init();
+    adcCapturedA = cfg->adcCapturedA;
+    delayTimeMs = cfg->delayTimeMs;
+    calPointCount = 0;
+    for(int i = 0; i < TRACE_CAL_MAX && cfg->cal[i][1]; i++)
+        calPoints[calPointCount++] = (CalPoint_t){ cfg->cal[i][0], cfg->cal[i][1] };
+    Save_Settings();
+    Params_Init();
+    if(!Apply_Params(cfg)) fprintf(stderr, "warning: parameter set not accepted as recorded\n");
+    Params_Save();
+    
+    mockAdcSource = Replay_Adc;
+    mockInputSource = Replay_Input;
+    currentPins = trace.samples[0].pins;
+    
+    if(cold) {
+        Decisions_Begin(out);
+        Stabilizer_Init();
+    } else {
+        // Warm start at the snapshot
+        uint64_t t0 = trace.configs[0].timeUs;
+        mockTimeUs = t0;
+        while(cursor < trace.sampleCount && trace.samples[cursor].timeUs < t0) cursor++;
+        currentPins = cfg->pins;
+        if(cfg->state == STATE_BOOT) {
+            Stabilizer_Init();              // Still booting: boot from the snapshot
+        } else {
+            Load_Settings();
+            Params_Init();
+            currentStep = cfg->step < 8 ? cfg->step : 0;
+            Apply_Relay_Step(currentStep);
+            r5State = (R5State_t)(cfg->r5State < 8 ? cfg->r5State : R5_NORMAL);
+            currentState = (SystemState_t)(cfg->state < 3 ? cfg->state : STATE_NORMAL);
+            Set_R5_Relay(r5State == R5_NORMAL || r5State == R5_HICUT_DETECTING || r5State == R5_LOCUT_DETECTING);
+            r5Timer = HAL_GetTick();
+        }
+        Decisions_Begin(out);
+    }
+    
+    while(!exhausted) {
+        Stabilizer_Run();
+        Decisions_Poll();
+        HAL_Delay_Ms(passPeriodMs);
+    }
+    
+    if(out != stdout) fclose(out);
+    if(!quiet)
+        fprintf(stderr, "%s: %u frames, %u CRC errors, %u lost, %u bytes skipped; %u samples over %.1f s, "
+                "%s start, %u samples skipped in replay\n", input, trace.frames, trace.crcErrors,
+                trace.lostFrames, trace.skippedBytes, trace.sampleCount,
+                (trace.samples[trace.sampleCount-1].timeUs - trace.samples[0].timeUs) / 1e6,
+                cold ? "cold" : "warm", skippedSamples);
+    
+    int rc = 0;
+    if(goldenPath) {
+        rc = Compare(outPath, goldenPath);
+        if(outPath == tmpPath) remove(tmpPath);
+    }
+    Trace_File_Free(&trace);
+    return rc;
+}
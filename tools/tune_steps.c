@@ -0,0 +1,534 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - STEP TABLE TUNER (HOST)
+ * ============================================================================
+ * Searches the tap thresholds and the tap debounce against a corpus of mains
+ * profiles. Every candidate runs the unmodified control core (stabilizer.c,
+ * params.c) on the plant model (plant.c), with its table loaded through
+ * Params_Set exactly as a unit configured over the serial link.
+ *
+ * A candidate is three numbers: the load voltage the taps aim for, the
+ * hysteresis between each up and down threshold, and the debounce. Step s
+ * switches where taps s-1 and s miss the target by the same amount:
+ *   centre = 2 * target / (1/ratio[s-1] + 1/ratio[s])
+ *   up = centre * (1 + hyst/2), down = centre * (1 - hyst/2)
+ * The shipped table sits close to target 219 V, hysteresis 3.5 %; it is
+ * always evaluated as well and is the reference for the constraints.
+ *
+ * Objectives, summed over the corpus: coil operations of R1-R4 (relay wear)
+ * and the time the connected load spends outside 230 V +/-10%, switching
+ * dropouts included. A candidate is feasible when
+ *   - Params_Set accepts its table (ranges, strict ordering),
+ *   - no profile keeps the load above HICUT or below LOCUT longer than the
+ *     detect time plus PROTECT_MARGIN_MS (the plant_sim check),
+ *   - no profile trips HICUT or LOCUT more often than the shipped table.
+ * The report lists the feasible candidates no other candidate beats on both
+ * objectives (the Pareto front). The choice is the front point with the
+ * fewest operations whose out-of-band time stays within -x percent of the
+ * lowest on the front; it can be written as a drop-in RELAY_STEP_TABLE for
+ * stabilizer.h.
+ *
+ * Build:
+ *   gcc -O2 -Wall -I.. -DSERIAL_PROTOCOL=0 -o tune_steps tune_steps.c plant.c \
+ *       hal_mock.c ../stabilizer.c ../params.c ../filter.c ../crc16.c -lm
+ *
+ * Usage:
+ *   ./tune_steps [options]
+ *     -p FILE   add a mains profile (plant_sim format) to the corpus;
+ *               repeatable, replaces the built-in corpus
+ *     -t A:B:S  target load voltage from A to B in steps of S (default 214:234:4)
+ *     -y A:B:S  hysteresis in percent (default 1.5:7.5:1.5)
+ *     -b LIST   debounce in ms, comma separated (default 10,50,100,250,500)
+ *     -x PCT    out-of-band time the choice may add over the lowest on the
+ *               front (default 50)
+ *     -j N      worker processes (default 1)
+ *     -o FILE   write the chosen RELAY_STEP_TABLE as C
+ *     -c FILE   write every candidate as CSV
+ *
+ * Exit status 1 when no candidate is feasible.
+ * ============================================================================
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "stabilizer.h"
+#include "params.h"
+#include "plant.h"
+
+#define MAX_PROFILES        16
+#define MAX_PROFILE_POINTS  4096
+#define MAX_DEBOUNCE        16
+#define MAX_JOBS            64
+#define PROTECT_MARGIN_MS   100         // Loop period, filter lag, R5 release
+
+// Core timers not in stabilizer.h, cleared between runs
+extern volatile uint32_t relayChangeTimer, r5Timer, delayCountStart, settingBlinkTimer;
+extern volatile uint32_t buttonPressStart, mstartPressStart, ledBlinkTimer;
+extern volatile bool settingLedState, buttonWasPressed, mstartWasPressed, ledBlinkState;
+
+typedef struct {
+    char name[32];
+    PlantPoint_t* points;
+    int count;
+} Profile_t;
+
+typedef struct {
+    float targetV, hystPct;             // Both 0 for the shipped table
+    uint16_t debounceMs;
+    uint16_t up[8], down[8];
+} Candidate_t;
+
+typedef struct {
+    bool valid;                         // Table accepted by Params_Set
+    bool exposed;                       // HICUT/LOCUT exposure beyond the detect time
+    uint32_t coilOps[MAX_PROFILES];
+    uint64_t outOfBandUs[MAX_PROFILES];
+    uint16_t trips[MAX_PROFILES];
+    uint32_t totalOps;
+    uint64_t totalOutUs;
+} Result_t;
+
+static Profile_t corpus[MAX_PROFILES];
+static int corpusCount = 0;
+static uint32_t corpusSeed = 1;
+
+// CORPUS
+static PlantPoint_t* Corpus_Add(const char* name) {
+    Profile_t* p = &corpus[corpusCount++];
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    p->points = malloc(MAX_PROFILE_POINTS * sizeof(PlantPoint_t));
+    p->count = 0;
+    if(!p->points) { perror("malloc"); exit(2); }
+    return p->points;
+}
+
+static void Corpus_Point(float timeS, float volts) {
+    Profile_t* p = &corpus[corpusCount-1];
+    if(p->count < MAX_PROFILE_POINTS) p->points[p->count++] = (PlantPoint_t){ timeS, volts };
+}
+
+static int Corpus_Random(int lo, int hi) {
+    corpusSeed = corpusSeed * 1664525u + 1013904223u;
+    return lo + (int)((corpusSeed >> 16) % (uint32_t)(hi - lo + 1));
+}
+
+// About an hour of mains: a compressed day, random wander around three
+// voltages, short dips on a rising supply (motor starts) and the events
+// protection has to handle. Generated from a fixed seed.
+static void Corpus_Builtin(void) {
+    static const PlantPoint_t drift[] = {
+        {0, 245}, {300, 200}, {600, 165}, {800, 165}, {1000, 220}, {1200, 285}, {1350, 285}, {1500, 240}
+    };
+    static const PlantPoint_t events[] = {
+        {0, 230}, {30, 230}, {30.05f, 150}, {30.35f, 150}, {30.4f, 230},   // Sag the taps ride out
+        {90, 230}, {90.1f, 290}, {92, 290}, {92.1f, 230},                   // Swell within the taps
+        {150, 230}, {150.05f, 470}, {153, 470}, {153.05f, 230},             // Lost neutral: HICUT
+        {220, 230}, {220.1f, 75}, {230, 75}, {231, 230}, {300, 230}         // Brownout: LOCUT
+    };
+    float t = 0;
+    
+    Corpus_Add("drift");
+    for(unsigned i = 0; i < sizeof(drift) / sizeof(drift[0]); i++) Corpus_Point(drift[i].timeS, drift[i].volts);
+    
+    // Random walk, up to 2 V every 2 s, within 8 V of the centre
+    Corpus_Add("wander");
+    for(int c = 0; c < 3; c++) {
+        float centre = 200.0f + 40.0f * c, v = centre;
+        for(int k = 0; k < 150; k++, t += 2.0f) {
+            Corpus_Point(t, v);
+            v += (float)Corpus_Random(-2, 2);
+            if(v > centre + 8.0f) v = centre + 8.0f;
+            if(v < centre - 8.0f) v = centre - 8.0f;
+        }
+    }
+    
+    // Dips of 10-25 V for 60-500 ms every 3-8 s, supply rising 195 -> 235 V
+    Corpus_Add("flicker");
+    for(t = 0; t < 600.0f; t += (float)Corpus_Random(3, 8)) {
+        float base = 195.0f + 40.0f * t / 600.0f;
+        float depth = (float)Corpus_Random(10, 25), len = Corpus_Random(60, 500) / 1000.0f;
+        Corpus_Point(t, base);
+        Corpus_Point(t + 0.02f, base - depth);
+        Corpus_Point(t + 0.02f + len, base - depth);
+        Corpus_Point(t + 0.04f + len, base);
+    }
+    Corpus_Point(600.0f, 235.0f);
+    
+    Corpus_Add("events");
+    for(unsigned i = 0; i < sizeof(events) / sizeof(events[0]); i++) Corpus_Point(events[i].timeS, events[i].volts);
+}
+
+static float Profile_Seconds(const Profile_t* p) {
+    return p->count ? p->points[p->count-1].timeS : 0.0f;
+}
+
+// CANDIDATES
+static void Candidate_Shipped(Candidate_t* c) {
+    memset(c, 0, sizeof(*c));
+    c->debounceMs = DEBOUNCE_TIME_MS;
+    for(int s = 0; s < 8; s++) {
+        c->up[s] = relaySteps[s].threshold_up;
+        c->down[s] = relaySteps[s].threshold_down;
+    }
+}
+
+static void Candidate_Build(Candidate_t* c, float targetV, float hystPct, uint16_t debounceMs) {
+    memset(c, 0, sizeof(*c));
+    c->targetV = targetV;
+    c->hystPct = hystPct;
+    c->debounceMs = debounceMs;
+    for(int s = 1; s < 8; s++) {
+        float centre = 2.0f * targetV / (1.0f / RELAY_STEP_RATIO(s-1) + 1.0f / RELAY_STEP_RATIO(s));
+        c->up[s] = (uint16_t)lroundf(centre * (1.0f + hystPct / 200.0f));
+        c->down[s] = (uint16_t)lroundf(centre * (1.0f - hystPct / 200.0f));
+        if(c->up[s] <= c->down[s]) c->up[s] = c->down[s] + 1;
+    }
+}
+
+// Thresholds one at a time, retrying until the ordering lets each through
+static bool Candidate_Apply(const Candidate_t* c) {
+    bool done[PARAM_COUNT] = { false };
+    int left = 14;
+    
+    for(int pass = 0; pass < 16 && left; pass++) {
+        for(int s = 1; s < 8; s++) {
+            for(int d = 0; d < 2; d++) {
+                ParamId_t id = (ParamId_t)(PARAM_STEP1_UP + 2*(s-1) + d);
+                if(done[id]) continue;
+                if(Params_Set(id, d ? c->down[s] : c->up[s]) == PARAM_OK) {
+                    done[id] = true;
+                    left--;
+                }
+            }
+        }
+    }
+    return left == 0 && Params_Set(PARAM_DEBOUNCE_MS, c->debounceMs) == PARAM_OK;
+}
+
+// EVALUATION
+static void Reset_Core(void) {
+    currentState = STATE_NORMAL;
+    settingState = SETTING_IDLE;
+    r5State = R5_NORMAL;
+    adcCapturedA = currentADC = currentADCFast = 0;
+    currentOPV = currentIPV = 0;
+    currentStep = pendingStep = 0;
+    r5Status = stepChangePending = false;
+    relayOperations = hicutTrips = locutTrips = 0;
+    relayChangeTimer = r5Timer = delayCountStart = settingBlinkTimer = 0;
+    buttonPressStart = mstartPressStart = ledBlinkTimer = 0;
+    settingLedState = buttonWasPressed = mstartWasPressed = ledBlinkState = false;
+}
+
+// Calibrated unit, low-cut enabled, shortest reconnect delay, candidate
+// stored in the parameter page before power-up
+static void Evaluate(const Candidate_t* c, Result_t* r) {
+    memset(r, 0, sizeof(*r));
+    r->valid = true;
+    
+    for(int p = 0; p < corpusCount; p++) {
+        const Profile_t* prof = &corpus[p];
+        PlantConfig_t cfg;
+        
+        Plant_Default_Config(&cfg);
+        cfg.profile = prof->points;
+        cfg.profileLen = prof->count;
+        Mock_Reset();
+        Reset_Core();
+        mockInputs[HAL_IN_LOWCUT_EN] = true;
+        HAL_Init();
+        Plant_Init(&cfg);
+        adcCapturedA = Plant_Calibration_Adc();
+        delayTimeMs = MIN_DELAY_TIME_SEC * 1000;
+        Save_Settings();
+        Params_Init();
+        if(!Candidate_Apply(c) || !Params_Save()) {
+            r->valid = false;
+            return;
+        }
+        
+        Stabilizer_Init();
+        uint64_t endUs = (uint64_t)(Profile_Seconds(prof) * 1e6);
+        while(mockTimeUs < endUs) {
+            Stabilizer_Run();
+            HAL_Delay_Ms(passPeriodMs);
+        }
+        Plant_Update(mockTimeUs);
+        
+        const PlantStats_t* st = &plantStats;
+        r->coilOps[p] = st->coilOps[0] + st->coilOps[1] + st->coilOps[2] + st->coilOps[3];
+        r->outOfBandUs[p] = st->loadOnUs - st->inBandUs + st->dropoutUs;
+        r->trips[p] = hicutTrips + locutTrips;
+        r->exposed |= st->overMaxRunUs > (uint64_t)(controlTable->prot[R5_CH_HICUT].detectMs + PROTECT_MARGIN_MS) * 1000;
+        r->exposed |= st->underMaxRunUs > (uint64_t)(controlTable->prot[R5_CH_LOCUT].detectMs + PROTECT_MARGIN_MS) * 1000;
+        r->totalOps += r->coilOps[p];
+        r->totalOutUs += r->outOfBandUs[p];
+    }
+}
+
+static bool Read_Full(int fd, void* buf, size_t len) {
+    uint8_t* b = buf;
+    while(len) {
+        ssize_t n = read(fd, b, len);
+        if(n <= 0) return false;
+        b += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Candidates w, w+jobs, ... go to worker w; each worker sends its results
+// back in that order through its own pipe
+static bool Evaluate_All(const Candidate_t* c, Result_t* r, int n, int jobs) {
+    int fd[MAX_JOBS];
+    pid_t pid[MAX_JOBS];
+    bool ok = true;
+    
+    if(jobs <= 1) {
+        for(int i = 0; i < n; i++) Evaluate(&c[i], &r[i]);
+        return true;
+    }
+    for(int w = 0; w < jobs; w++) {
+        int p[2];
+        if(pipe(p) != 0 || (pid[w] = fork()) < 0) { perror("fork"); exit(2); }
+        if(pid[w] == 0) {
+            close(p[0]);
+            for(int i = w; i < n; i += jobs) {
+                Evaluate(&c[i], &r[i]);
+                if(write(p[1], &r[i], sizeof(r[i])) != (ssize_t)sizeof(r[i])) _exit(1);
+            }
+            _exit(0);
+        }
+        close(p[1]);
+        fd[w] = p[0];
+    }
+    for(int w = 0; w < jobs; w++) {
+        for(int i = w; i < n && ok; i += jobs) ok = Read_Full(fd[w], &r[i], sizeof(r[i]));
+        close(fd[w]);
+        waitpid(pid[w], NULL, 0);
+    }
+    return ok;
+}
+
+// REPORT
+static bool Feasible(const Result_t* r, const Result_t* shipped) {
+    if(!r->valid || r->exposed) return false;
+    for(int p = 0; p < corpusCount; p++)
+        if(r->trips[p] > shipped->trips[p]) return false;
+    return true;
+}
+
+static bool Dominates(const Result_t* a, const Result_t* b) {
+    return a->totalOps <= b->totalOps && a->totalOutUs <= b->totalOutUs &&
+           (a->totalOps < b->totalOps || a->totalOutUs < b->totalOutUs);
+}
+
+static void Print_Candidate(const char* mark, const Candidate_t* c, const Result_t* r) {
+    if(c->targetV > 0) printf("%s %6.1f %6.1f", mark, c->targetV, c->hystPct);
+    else printf("%s shipped      ", mark);
+    printf(" %8u %9u %12.3f\n", c->debounceMs, r->totalOps, r->totalOutUs / 1e6);
+}
+
+// Contacts and exact tap ratios of the source table in stabilizer.h
+#define SOURCE_ROW(s, r1, r2, r3, r4, up, down, ratio) {{r1, r2, r3, r4}, ratio},
+static const struct { uint8_t r[4]; float ratio; } sourceSteps[8] = { RELAY_STEP_TABLE(SOURCE_ROW) };
+
+static void Print_Table(FILE* f, const Candidate_t* c) {
+    fprintf(f, "#define RELAY_STEP_TABLE(X) \\\n");
+    for(int s = 0; s < 8; s++) {
+        const uint8_t* r = sourceSteps[s].r;
+        fprintf(f, "    X(%d, %u,%u,%u,%u, %3u, %3u, %.6ff)%s\n", s, r[0], r[1], r[2], r[3],
+                c->up[s], c->down[s], sourceSteps[s].ratio, s == 7 ? "" : " \\");
+    }
+}
+
+static bool Write_Table(const char* path, const Candidate_t* c, const Result_t* r, const Result_t* shipped) {
+    FILE* f = fopen(path, "w");
+    float minutes = 0;
+    
+    if(!f) { perror(path); return false; }
+    for(int p = 0; p < corpusCount; p++) minutes += Profile_Seconds(&corpus[p]) / 60.0f;
+    fprintf(f, "// RELAY STEP TABLE - tune_steps, %d profiles, %.0f min of mains\n", corpusCount, minutes);
+    if(c->targetV > 0)
+        fprintf(f, "// Target %.1f V, hysteresis %.1f %%, ", c->targetV, c->hystPct);
+    else
+        fprintf(f, "// Shipped thresholds, ");
+    fprintf(f, "debounce %u ms (DEBOUNCE_TIME_MS or debounce_ms)\n", c->debounceMs);
+    fprintf(f, "// R1-R4 coil operations %u (shipped %u), out of band %.3f s (shipped %.3f s)\n",
+            r->totalOps, shipped->totalOps, r->totalOutUs / 1e6, shipped->totalOutUs / 1e6);
+    Print_Table(f, c);
+    fclose(f);
+    return true;
+}
+
+static bool Write_Csv(const char* path, const Candidate_t* c, const Result_t* r, const bool* pareto,
+                      const Result_t* shipped, int n) {
+    FILE* f = fopen(path, "w");
+    
+    if(!f) { perror(path); return false; }
+    fprintf(f, "target_v,hyst_pct,debounce_ms,coil_ops,out_of_band_s,trips,valid,exposed,feasible,pareto");
+    for(int s = 1; s < 8; s++) fprintf(f, ",step%d_up,step%d_down", s, s);
+    fprintf(f, "\n");
+    for(int i = 0; i < n; i++) {
+        unsigned trips = 0;
+        for(int p = 0; p < corpusCount; p++) trips += r[i].trips[p];
+        if(c[i].targetV > 0) fprintf(f, "%.1f,%.2f,", c[i].targetV, c[i].hystPct);
+        else fprintf(f, ",,");
+        fprintf(f, "%u,%u,%.3f,%u,%d,%d,%d,%d", c[i].debounceMs, r[i].totalOps, r[i].totalOutUs / 1e6,
+                trips, r[i].valid, r[i].exposed, Feasible(&r[i], shipped), pareto[i]);
+        for(int s = 1; s < 8; s++) fprintf(f, ",%u,%u", c[i].up[s], c[i].down[s]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    return true;
+}
+
+static bool Parse_Range(const char* arg, float* lo, float* hi, float* step) {
+    return sscanf(arg, "%f:%f:%f", lo, hi, step) == 3 && *step > 0 && *lo <= *hi;
+}
+
+int main(int argc, char** argv) {
+    const char* tablePath = NULL;
+    const char* csvPath = NULL;
+    const char* profiles[MAX_PROFILES];
+    int profileCount = 0, jobs = 1, debounceCount = 0;
+    float tLo = 214, tHi = 234, tStep = 4, yLo = 1.5f, yHi = 7.5f, yStep = 1.5f, slackPct = 50;
+    uint16_t debounce[MAX_DEBOUNCE];
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-p") == 0 && i + 1 < argc && profileCount < MAX_PROFILES) profiles[profileCount++] = argv[++i];
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc && Parse_Range(argv[i+1], &tLo, &tHi, &tStep)) i++;
+        else if(strcmp(argv[i], "-y") == 0 && i + 1 < argc && Parse_Range(argv[i+1], &yLo, &yHi, &yStep)) i++;
+        else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            char list[128];
+            snprintf(list, sizeof(list), "%s", argv[++i]);
+            debounceCount = 0;
+            for(char* tok = strtok(list, ","); tok && debounceCount < MAX_DEBOUNCE; tok = strtok(NULL, ","))
+                debounce[debounceCount++] = (uint16_t)atoi(tok);
+        }
+        else if(strcmp(argv[i], "-x") == 0 && i + 1 < argc) slackPct = (float)atof(argv[++i]);
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) tablePath = argv[++i];
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) csvPath = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [-p profile]... [-t lo:hi:step] [-y lo:hi:step] [-b ms,ms,...]\n"
+                            "          [-x pct] [-j jobs] [-o table.c] [-c candidates.csv]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(jobs < 1 || jobs > MAX_JOBS) jobs = jobs < 1 ? 1 : MAX_JOBS;
+    if(debounceCount == 0) {
+        static const uint16_t def[] = { 10, 50, 100, 250, 500 };
+        for(unsigned i = 0; i < sizeof(def) / sizeof(def[0]); i++) debounce[debounceCount++] = def[i];
+    }
+    
+    if(profileCount == 0) Corpus_Builtin();
+    for(int i = 0; i < profileCount; i++) {
+        const char* base = strrchr(profiles[i], '/');
+        PlantPoint_t* pts = Corpus_Add(base ? base + 1 : profiles[i]);
+        int n = Plant_Load_Profile(profiles[i], pts, MAX_PROFILE_POINTS);
+        if(n <= 1) {
+            if(n == 0 || n == 1) fprintf(stderr, "%s: needs at least two points\n", profiles[i]);
+            return 2;
+        }
+        corpus[corpusCount-1].count = n;
+    }
+    
+    // Shipped table first, then the grid
+    int tCount = (int)floorf((tHi - tLo) / tStep + 1e-3f) + 1;
+    int yCount = (int)floorf((yHi - yLo) / yStep + 1e-3f) + 1;
+    int n = 1 + tCount * yCount * debounceCount;
+    Candidate_t* cand = calloc((size_t)n, sizeof(Candidate_t));
+    Result_t* res = calloc((size_t)n, sizeof(Result_t));
+    bool* pareto = calloc((size_t)n, sizeof(bool));
+    if(!cand || !res || !pareto) { perror("calloc"); return 2; }
+    
+    Candidate_Shipped(&cand[0]);
+    n = 1;
+    for(int a = 0; a < tCount; a++)
+        for(int b = 0; b < yCount; b++)
+            for(int d = 0; d < debounceCount; d++)
+                Candidate_Build(&cand[n++], tLo + a * tStep, yLo + b * yStep, debounce[d]);
+    
+    struct timespec w0, w1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    if(!Evaluate_All(cand, res, n, jobs)) {
+        fprintf(stderr, "worker failed\n");
+        return 2;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    double wall = (w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9;
+    
+    // Pareto front over the feasible candidates
+    const Result_t* shipped = &res[0];
+    int feasible = 0, invalid = 0, exposed = 0, front = 0;
+    for(int i = 0; i < n; i++) {
+        if(!res[i].valid) { invalid++; continue; }
+        if(res[i].exposed) exposed++;
+        if(!Feasible(&res[i], shipped)) continue;
+        feasible++;
+        pareto[i] = true;
+        for(int j = 0; j < n && pareto[i]; j++)
+            if(j != i && Feasible(&res[j], shipped) && Dominates(&res[j], &res[i])) pareto[i] = false;
+        front += pareto[i];
+    }
+    
+    // Fewest operations within the out-of-band allowance
+    uint64_t bestOutUs = UINT64_MAX;
+    for(int i = 0; i < n; i++)
+        if(pareto[i] && res[i].totalOutUs < bestOutUs) bestOutUs = res[i].totalOutUs;
+    uint64_t allowUs = (uint64_t)(bestOutUs * (1.0 + slackPct / 100.0));
+    int chosen = -1;
+    for(int i = 0; i < n; i++) {
+        if(!pareto[i] || res[i].totalOutUs > allowUs) continue;
+        if(chosen < 0 || res[i].totalOps < res[chosen].totalOps ||
+           (res[i].totalOps == res[chosen].totalOps && res[i].totalOutUs < res[chosen].totalOutUs))
+            chosen = i;
+    }
+    
+    float minutes = 0;
+    for(int p = 0; p < corpusCount; p++) minutes += Profile_Seconds(&corpus[p]) / 60.0f;
+    printf("corpus %d profiles, %.1f min:", corpusCount, minutes);
+    for(int p = 0; p < corpusCount; p++) printf(" %s %.1f min", corpus[p].name, Profile_Seconds(&corpus[p]) / 60.0f);
+    printf("\n%d candidates in %.1f s: %d feasible, %d invalid tables, %d over the exposure limit, %d on the Pareto front\n",
+           n, wall, feasible, invalid, exposed, front);
+    printf("\n  target   hyst debounce  coil ops  out of band\n"
+             "       V      %%       ms     R1-R4            s\n");
+    Print_Candidate(Feasible(shipped, shipped) ? " " : "x", &cand[0], shipped);
+    printf("Pareto front (* chosen):\n");
+    int* order = calloc((size_t)front + 1, sizeof(int));
+    int shown = 0;
+    for(int i = 0; i < n; i++) {
+        if(!pareto[i]) continue;
+        int k = shown++;
+        for(; k > 0 && res[order[k-1]].totalOps > res[i].totalOps; k--) order[k] = order[k-1];
+        order[k] = i;
+    }
+    for(int k = 0; k < shown; k++) Print_Candidate(order[k] == chosen ? "*" : " ", &cand[order[k]], &res[order[k]]);
+    free(order);
+    
+    if(chosen < 0) {
+        printf("\nno feasible candidate\n");
+    } else {
+        const Candidate_t* c = &cand[chosen];
+        printf("\n%-10s %9s %12s %9s %12s\n", "profile", "coil ops", "out of band", "shipped", "out of band");
+        for(int p = 0; p < corpusCount; p++)
+            printf("%-10.10s %9u %12.3f %9u %12.3f\n", corpus[p].name, res[chosen].coilOps[p],
+                   res[chosen].outOfBandUs[p] / 1e6, shipped->coilOps[p], shipped->outOfBandUs[p] / 1e6);
+        printf("\nRELAY_STEP_TABLE:\n");
+        Print_Table(stdout, c);
+        printf("plant_sim -P debounce_ms=%u", c->debounceMs);
+        for(int s = 1; s < 8; s++) printf(" -P step%d_up=%u -P step%d_down=%u", s, c->up[s], s, c->down[s]);
+        printf("\n");
+        if(tablePath && !Write_Table(tablePath, c, &res[chosen], shipped)) return 2;
+    }
+    if(csvPath && !Write_Csv(csvPath, cand, res, pareto, shipped, n)) return 2;
+    return feasible ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RAW ADC TRACE
+ * ============================================================================
+ * Two sample frame buffers (one filling, one queued or owned by DMA) and one
+ * config frame. Trace_Record_Sample() runs inside HAL_ADC_Read() and also
+ * hands queued frames to DMA, so a config frame does not hold up samples
+ * for a whole loop period.
+ * ============================================================================
+ */
+
+#include "stabilizer.h"
+#include "hal.h"
+#include "serial.h"
+#include "crc16.h"
+#include "params.h"
+#include "trace.h"
+
+#define TRACE_DMA_NONE      0xFF
+#define TRACE_DMA_CONFIG    2
+
+typedef char TraceParamsCheck_t[(PARAM_COUNT <= TRACE_PARAMS_MAX) ? 1 : -1];
+typedef char TraceCalCheck_t[(CAL_POINTS_MAX-1 <= TRACE_CAL_MAX) ? 1 : -1];
+
+volatile uint16_t traceOverruns=0;
+
+static TraceSamplesFrame_t traceFrames[2];
+static TraceConfigFrame_t traceConfig;
+static uint8_t traceFill=0;             // Buffer being filled
+static bool traceQueued=false;          // The other buffer holds an unsent frame
+static bool traceConfigQueued=false;
+static uint8_t traceDmaBuf=TRACE_DMA_NONE;
+static uint16_t traceSeq=0;
+static uint32_t traceLastUs=0;
+static uint32_t traceConfigTimer=0;
+
+static uint8_t Trace_Pins(void) {
+    uint8_t pins = 0;
+    for(int i = 0; i < HAL_IN_COUNT; i++)
+        if(HAL_Input_Active((HalInput_t)i)) pins |= 1 << i;
+    return pins;
+}
+
+static bool Trace_Buffer_Busy(uint8_t buf) {
+    return traceDmaBuf == buf && Serial_TxBusy();
+}
+
+// Samples first: they are the time-critical part of the trace
+static void Trace_Kick(void) {
+    if(Serial_TxBusy()) return;
+    traceDmaBuf = TRACE_DMA_NONE;
+    
+    if(traceQueued) {
+        uint8_t buf = traceFill ^ 1;
+        if(Serial_Write((const uint8_t*)&traceFrames[buf], TRACE_SAMPLES_FRAME_SIZE)) {
+            traceDmaBuf = buf;
+            traceQueued = false;
+        }
+    } else if(traceConfigQueued) {
+        if(Serial_Write((const uint8_t*)&traceConfig, TRACE_CONFIG_FRAME_SIZE)) {
+            traceDmaBuf = TRACE_DMA_CONFIG;
+            traceConfigQueued = false;
+        }
+    }
+}
+
+static void Trace_Close_Frame(void) {
+    TraceSamplesFrame_t* f = &traceFrames[traceFill];
+    
+    if(f->count == 0) return;
+    f->crc = CRC16_Calculate((const uint8_t*)f, TRACE_SAMPLES_CRC_OFFSET);
+    
+    if(traceQueued || Trace_Buffer_Busy(traceFill ^ 1)) {
+        traceOverruns++;            // Dropped: seq gap in the stream
+    } else {
+        traceFill ^= 1;
+        traceQueued = true;
+    }
+    traceFrames[traceFill].count = 0;
+    Trace_Kick();
+}
+
+void Trace_Record_Sample(uint16_t adc) {
+    uint32_t now = HAL_GetMicros();
+    TraceSamplesFrame_t* f = &traceFrames[traceFill];
+    uint32_t gap = now - traceLastUs;
+    
+    if(f->count > 0 && (f->count == TRACE_SAMPLES_MAX || gap > TRACE_GAP_MAX_US)) {
+        Trace_Close_Frame();
+        f = &traceFrames[traceFill];
+    }
+    
+    if(f->count == 0) {
+        f->sync[0] = TRACE_SYNC0;
+        f->sync[1] = TRACE_SYNC1;
+        f->type = TRACE_TYPE_SAMPLES;
+        f->pins = Trace_Pins();
+        f->seq = traceSeq++;
+        f->reserved = 0;
+        f->timeUs = now;
+        f->samples[0] = adc & 0x3FF;
+        traceLastUs = now;
+    } else {
+        // Rounded gaps add up to the decoded time: the error does not drift
+        uint32_t units = (gap + TRACE_GAP_UNIT_US/2) / TRACE_GAP_UNIT_US;
+        f->samples[f->count] = (adc & 0x3FF) | (uint16_t)(units << 10);
+        traceLastUs += units * TRACE_GAP_UNIT_US;
+    }
+    f->count++;
+    Trace_Kick();
+}
+
+static void Trace_Build_Config(void) {
+    TraceConfigFrame_t* c = &traceConfig;
+    
+    c->sync[0] = TRACE_SYNC0;
+    c->sync[1] = TRACE_SYNC1;
+    c->type = TRACE_TYPE_CONFIG;
+    c->pins = Trace_Pins();
+    c->seq = traceSeq++;
+    c->adcCapturedA = adcCapturedA;
+    c->tick = HAL_GetTick();
+    c->delayTimeMs = delayTimeMs;
+    c->step = currentStep;
+    c->r5State = (uint8_t)r5State;
+    c->state = (uint8_t)currentState;
+    c->paramCount = PARAM_COUNT;
+    for(int i = 0; i < TRACE_PARAMS_MAX; i++)
+        c->params[i] = (i < PARAM_COUNT) ? Params_Get((ParamId_t)i) : 0;
+    for(int i = 0; i < TRACE_CAL_MAX; i++) {
+        c->cal[i][0] = (i < calPointCount) ? calPoints[i].adc : 0;
+        c->cal[i][1] = (i < calPointCount) ? calPoints[i].decivolts : 0;
+    }
+    c->crc = CRC16_Calculate((const uint8_t*)c, TRACE_CONFIG_CRC_OFFSET);
+}
+
+void Trace_Init(void) {
+    Serial_Init(TRACE_BAUDRATE, USART_Parity_No, false);
+    // First snapshot on the first service, after the settings are loaded
+    traceConfigTimer = HAL_GetTick() - TRACE_CONFIG_PERIOD_MS;
+}
+
+void Trace_Service(void) {
+    uint32_t now = HAL_GetTick();
+    
+    // End of a control pass: its samples make one frame
+    Trace_Close_Frame();
+    
+    if((now - traceConfigTimer) >= TRACE_CONFIG_PERIOD_MS && !traceConfigQueued &&
+       !Trace_Buffer_Busy(TRACE_DMA_CONFIG)) {
+        traceConfigTimer = now;
+        Trace_Build_Config();
+        traceConfigQueued = true;
+    }
+    Trace_Kick();
+}
@@ -0,0 +1,103 @@
+/*
+ * ============================================================================
+ * VOLTAGE STABILIZER - RAW ADC TRACE
+ * ============================================================================
+ * Streams every ADC conversion with its timestamp and the input pins on
+ * USART1, plus a periodic snapshot of calibration, parameters and state, so
+ * a field incident can be replayed through the control core on a PC
+ * (tools/trace_replay.c). Plain <stdint.h> layout, shared with host tools.
+ *
+ * Samples frame (little-endian, 48 bytes):
+ *   0  sync     0xA5 0x5A
+ *   2  type     TRACE_TYPE_SAMPLES
+ *   3  pins     TRACE_PIN_* at the first sample
+ *   4  seq      frame counter shared by both frame types, wraps at 65535
+ *   6  count    valid samples (1-TRACE_SAMPLES_MAX)
+ *   7  reserved 0
+ *   8  timeUs   HAL_GetMicros() at the first sample
+ *  12  samples  bits 0-9 ADC count, bits 10-15 time since the previous
+ *               sample in TRACE_GAP_UNIT_US units (0 for the first)
+ *  46  crc      CRC-16/MODBUS over bytes 0-45
+ *
+ * Config frame (little-endian, 88 bytes), every TRACE_CONFIG_PERIOD_MS:
+ *   0  sync, 2 type TRACE_TYPE_CONFIG, 3 pins, 4 seq (as above)
+ *   6  adcCapturedA
+ *   8  tick     HAL_GetTick()
+ *  12  delayTimeMs
+ *  16  step, 17 r5State, 18 state, 19 paramCount
+ *  20  params   Params_Get() values in ParamId_t order, raw units
+ *  70  cal      extra calibration points, adc and decivolts per point,
+ *               decivolts 0 when unused
+ *  86  crc      CRC-16/MODBUS over bytes 0-85
+ *
+ * A frame is closed when it is full, when the next sample is more than
+ * TRACE_GAP_MAX_US later, and by Trace_Service() after every control pass.
+ * A closed frame that finds both buffers busy is dropped; the seq gap shows
+ * it to the decoder.
+ * ============================================================================
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_SYNC0             0xA5        // Same sync as telemetry.h
+#define TRACE_SYNC1             0x5A
+#define TRACE_TYPE_SAMPLES      0x02
+#define TRACE_TYPE_CONFIG       0x03
+
+#define TRACE_PIN_LOWCUT_EN     0x01        // Bit n = HalInput_t n active
+#define TRACE_PIN_M_START       0x02
+#define TRACE_PIN_BUTTON        0x04
+
+#define TRACE_SAMPLES_MAX       17
+#define TRACE_GAP_UNIT_US       16
+#define TRACE_GAP_MAX_US        (63 * TRACE_GAP_UNIT_US)
+#define TRACE_PARAMS_MAX        25
+#define TRACE_CAL_MAX           4           // CAL_POINTS_MAX-1 (checked in trace.c)
+
+typedef struct {
+    uint8_t  sync[2];
+    uint8_t  type;
+    uint8_t  pins;
+    uint16_t seq;
+    uint8_t  count;
+    uint8_t  reserved;
+    uint32_t timeUs;
+    uint16_t samples[TRACE_SAMPLES_MAX];
+    uint16_t crc;
+} TraceSamplesFrame_t;
+
+typedef struct {
+    uint8_t  sync[2];
+    uint8_t  type;
+    uint8_t  pins;
+    uint16_t seq;
+    uint16_t adcCapturedA;
+    uint32_t tick;
+    uint32_t delayTimeMs;
+    uint8_t  step;
+    uint8_t  r5State;
+    uint8_t  state;
+    uint8_t  paramCount;
+    uint16_t params[TRACE_PARAMS_MAX];
+    uint16_t cal[TRACE_CAL_MAX][2];
+    uint16_t crc;
+} TraceConfigFrame_t;
+
+#define TRACE_SAMPLES_FRAME_SIZE    48
+#define TRACE_SAMPLES_CRC_OFFSET    46
+#define TRACE_CONFIG_FRAME_SIZE     88
+#define TRACE_CONFIG_CRC_OFFSET     86
+
+typedef char TraceSamplesSizeCheck_t[(sizeof(TraceSamplesFrame_t) == TRACE_SAMPLES_FRAME_SIZE) ? 1 : -1];
+typedef char TraceConfigSizeCheck_t[(sizeof(TraceConfigFrame_t) == TRACE_CONFIG_FRAME_SIZE) ? 1 : -1];
+
+void Trace_Init(void);
+void Trace_Service(void);
+void Trace_Record_Sample(uint16_t adc);
+
+extern volatile uint16_t traceOverruns;
+
+#endif /* __TRACE_H */